@@ -9,10 +9,10 @@ void setup() {
 }
 
 void loop() {
-    /* If you haven't personalized your device yet, you will recieve
-     * this on your serial terminal:
+    /* If you haven't personalized your device yet, it returns
        ffff0000ffff0000ffff0000ffff0000ffff0000ffff0000ffff0000ffff0000
-       Success
+       which fails the health tests, so you will recieve Failure on your
+       serial terminal.
 
        Otherwise, you'll get actual random bytes.
     */
@@ -0,0 +1,279 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/** \file
+ *  \brief Benchmark of Sha204AsyncDevice against a Thread per Device
+ *
+ *         Runs Random commands on many emulated devices sharing one
+ *         adapter and prints the operations per second of
+ *         - coroutines on one Sha204EventLoop,
+ *         - one thread per device with blocking calls and
+ *         - blocking calls on one thread, one device after the other.
+ *
+ *         The devices execute a command for #BENCH_EXECUTION_US and the
+ *         bus runs at 400 kHz, so a thread that waits for a device
+ *         blocks the way it would on real hardware.
+ *
+ *         usage: async_benchmark [devices [operations per device]]
+ */
+
+#include <stdio.h>                      // printf()
+#include <stdlib.h>                     // atoi()
+#include <sys/resource.h>               // getrusage()
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "sha204_lib_return_codes.h"
+#include "sha204_comm_marshaling.h"
+#include "sha204_physical.h"
+#include "i2c_emulator.h"
+#include "../../src/api/Sha204Async.h"
+
+#define BENCH_DEVICES           (32)     //!< default number of devices
+#define BENCH_OPERATIONS        (20)     //!< default number of commands per device
+#define BENCH_EXECUTION_US      (11000)  //!< typical execution time of Random
+#define BENCH_BIT_NS            (2500)   //!< bit time of a 400 kHz bus
+#define BENCH_FIRST_ADDRESS     (0x10)   //!< 8-bit address of the first device
+
+//! emulated devices
+static struct sha204e_device devices[SHA204E_I2C_DEVICES];
+
+//! failed commands of the current run
+static std::atomic<uint32_t> failures;
+
+
+/** \brief This function returns the 8-bit address of a device.
+ * \param[in] index index of the device
+ * \return address
+ */
+static uint8_t bench_address(uint32_t index)
+{
+	return (uint8_t) (BENCH_FIRST_ADDRESS + 2 * index);
+}
+
+
+/** \brief This function checks the response of the n-th Random command of a device.
+ * \param[in] ret_code status of the command
+ * \param[in] rx response
+ * \param[in] n number of Random commands the device ran before
+ */
+static void bench_check(uint8_t ret_code, const uint8_t *rx, uint32_t n)
+{
+	// first byte of the emulator's random pattern
+	if (ret_code != SHA204_SUCCESS || rx[SHA204_BUFFER_POS_DATA] != (uint8_t) (n * 33 + 0x5A))
+		failures++;
+}
+
+
+/** \brief This function puts fresh devices on the adapter.
+ * \param[in] count number of devices
+ */
+static void bench_reset(uint32_t count)
+{
+	uint32_t i;
+
+	sha204e_i2c_reset(1, BENCH_BIT_NS);
+	for (i = 0; i < count; i++) {
+		sha204e_init(&devices[i]);
+		devices[i].busy_polls = 0;
+		devices[i].execution_us = BENCH_EXECUTION_US;
+		sha204e_i2c_attach(&devices[i], bench_address(i));
+	}
+	failures = 0;
+}
+
+
+/** \brief This function runs the commands of one device as a coroutine.
+ * \param[in,out] device device
+ * \param[in] operations number of commands
+ * \return task returning the status of the last command
+ */
+static Sha204Task<uint8_t> bench_coroutine(Sha204AsyncDevice& device, uint32_t operations)
+{
+	uint8_t ret_code = SHA204_SUCCESS;
+	uint32_t n;
+
+	for (n = 0; n < operations; n++) {
+		ret_code = co_await device.random(RANDOM_NO_SEED_UPDATE);
+		bench_check(ret_code, device.response(), n);
+	}
+
+	co_return ret_code;
+}
+
+
+/** \brief This function runs all devices as coroutines on one event loop.
+ * \param[in] count number of devices
+ * \param[in] operations number of commands per device
+ */
+static void bench_event_loop(uint32_t count, uint32_t operations)
+{
+	Sha204EventLoop loop;
+	std::vector<Sha204AsyncDevice> async_devices;
+	std::vector<Sha204Task<uint8_t> > tasks;
+	uint32_t i;
+
+	if (sha204p_linux_i2c_open(SHA204E_I2C_PATH) != SHA204_SUCCESS) {
+		failures += count * operations;
+		return;
+	}
+
+	async_devices.reserve(count);
+	for (i = 0; i < count; i++) {
+		async_devices.emplace_back(loop, bench_address(i));
+		if (async_devices[i].wakeup() != SHA204_SUCCESS)
+			failures++;
+	}
+
+	tasks.reserve(count);
+	for (i = 0; i < count; i++) {
+		tasks.push_back(bench_coroutine(async_devices[i], operations));
+		tasks[i].start();
+	}
+	loop.run();
+
+	for (i = 0; i < count; i++) {
+		if (!tasks[i].done())
+			failures++;
+		(void) async_devices[i].sleep();
+	}
+
+	sha204p_linux_i2c_close();
+}
+
+
+/** \brief This function runs the commands of one device on its own thread.
+ * \param[in] index index of the device
+ * \param[in] operations number of commands
+ */
+static void bench_thread(uint32_t index, uint32_t operations)
+{
+	uint8_t tx[SHA204_CMD_SIZE_MAX];
+	uint8_t rx[SHA204_RSP_SIZE_MAX];
+	uint32_t n;
+
+	// Every thread has its own file descriptor and address.
+	if (sha204p_linux_i2c_open(SHA204E_I2C_PATH) != SHA204_SUCCESS) {
+		failures += operations;
+		return;
+	}
+	sha204p_set_device_id(bench_address(index));
+
+	if (sha204c_wakeup(rx) != SHA204_SUCCESS)
+		failures++;
+	for (n = 0; n < operations; n++)
+		bench_check(sha204m_random(tx, rx, RANDOM_NO_SEED_UPDATE), rx, n);
+	(void) sha204p_sleep();
+
+	sha204p_linux_i2c_close();
+}
+
+
+/** \brief This function runs every device on its own thread.
+ * \param[in] count number of devices
+ * \param[in] operations number of commands per device
+ */
+static void bench_threads(uint32_t count, uint32_t operations)
+{
+	std::vector<std::thread> threads;
+	uint32_t i;
+
+	for (i = 0; i < count; i++)
+		threads.emplace_back(bench_thread, i, operations);
+	for (i = 0; i < count; i++)
+		threads[i].join();
+}
+
+
+/** \brief This function runs the devices one after the other with blocking calls.
+ * \param[in] count number of devices
+ * \param[in] operations number of commands per device
+ */
+static void bench_sequential(uint32_t count, uint32_t operations)
+{
+	uint32_t i;
+
+	for (i = 0; i < count; i++)
+		bench_thread(i, operations);
+}
+
+
+/** \brief This function returns the processor time the process has used.
+ * \return user and system time in us
+ */
+static uint64_t bench_cpu_us(void)
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+
+	return (uint64_t) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000
+		+ usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+
+/** \brief This function runs one variant and prints its results.
+ * \param[in] name name of the variant
+ * \param[in] run variant
+ * \param[in] threads number of threads the variant uses
+ * \param[in] count number of devices
+ * \param[in] operations number of commands per device
+ * \return number of failed commands
+ */
+static uint32_t bench_run(const char *name, void (*run)(uint32_t, uint32_t), uint32_t threads,
+			uint32_t count, uint32_t operations)
+{
+	uint64_t start_us, cpu_us;
+	double seconds;
+
+	bench_reset(count);
+	start_us = Sha204EventLoop::now();
+	cpu_us = bench_cpu_us();
+	run(count, operations);
+	cpu_us = bench_cpu_us() - cpu_us;
+	seconds = (Sha204EventLoop::now() - start_us) / 1e6;
+
+	printf("%-22s %7u %9.0f %9.3f %9.3f %8u\n", name, threads,
+				count * operations / seconds, seconds, cpu_us / 1e6, failures.load());
+
+	return failures;
+}
+
+
+int main(int argc, char *argv[])
+{
+	uint32_t count = argc > 1 ? (uint32_t) atoi(argv[1]) : BENCH_DEVICES;
+	uint32_t operations = argc > 2 ? (uint32_t) atoi(argv[2]) : BENCH_OPERATIONS;
+	uint32_t failed = 0;
+
+	if (!count || count > SHA204E_I2C_DEVICES || !operations) {
+		printf("usage: %s [devices (1 to %u) [operations per device]]\n", argv[0], SHA204E_I2C_DEVICES);
+		return 2;
+	}
+
+	printf("%u devices, %u Random commands each, %u us execution, 400 kHz bus\n\n",
+				count, operations, BENCH_EXECUTION_US);
+	printf("%-22s %7s %9s %9s %9s %8s\n", "variant", "threads", "ops/s", "wall s", "cpu s", "failed");
+
+	failed += bench_run("coroutines", bench_event_loop, 1, count, operations);
+	failed += bench_run("thread per device", bench_threads, count, count, operations);
+	failed += bench_run("blocking, sequential", bench_sequential, 1, count, operations);
+
+	return failed ? 1 : 0;
+}
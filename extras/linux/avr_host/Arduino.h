@@ -0,0 +1,48 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/** \file
+ *  \brief Arduino Functions for Host Builds of the AVR Modules
+ *
+ *         twi_emulator.cpp implements them on the virtual clock of the
+ *         TWI model.
+ */
+#ifndef SHA204E_ARDUINO_H
+#   define SHA204E_ARDUINO_H
+
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#define LOW             (0)
+#define HIGH            (1)
+#define INPUT           (0)
+#define OUTPUT          (1)
+#define SDA             (18)     //!< pin of the TWI data line
+#define SCL             (19)     //!< pin of the TWI clock line
+
+unsigned long micros(void);
+void yield(void);
+void noInterrupts(void);
+void interrupts(void);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+
+#endif
@@ -0,0 +1,37 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/** \file
+ *  \brief Interrupt Vectors for Host Builds of the AVR Modules
+ *
+ *         The model in twi_emulator.cpp calls the TWI interrupt routine
+ *         while interrupts are enabled.
+ */
+#ifndef SHA204E_AVR_INTERRUPT_H
+#   define SHA204E_AVR_INTERRUPT_H
+
+//! name of the TWI interrupt routine
+#define TWI_vect        sha204e_twi_vect
+
+//! defines an interrupt routine
+#define ISR(vector)     extern "C" void vector(void)
+
+ISR(TWI_vect);
+
+#endif
@@ -0,0 +1,61 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/** \file
+ *  \brief TWI Registers for Host Builds of the AVR Modules
+ *
+ *         Holds what i2c_phys.c, i2c_isr_phys.c and sha204_i2c.c use.
+ *         The modules are compiled as C++ against this header. TWCR is an
+ *         object there, so the model in twi_emulator.cpp sees every access.
+ */
+#ifndef SHA204E_AVR_IO_H
+#   define SHA204E_AVR_IO_H
+
+#include <stdint.h>
+
+#ifndef __cplusplus
+#   error Compile the AVR modules as C++ for the TWI model.
+#endif
+
+#define _BV(bit)        (1 << (bit))
+
+#define TWINT           (7)      //!< TWCR: interrupt flag
+#define TWEA            (6)      //!< TWCR: enable acknowledge
+#define TWSTA           (5)      //!< TWCR: Start condition
+#define TWSTO           (4)      //!< TWCR: Stop condition
+#define TWWC            (3)      //!< TWCR: write collision flag
+#define TWEN            (2)      //!< TWCR: enable
+#define TWIE            (0)      //!< TWCR: interrupt enable
+
+#define TWPS0           (0)      //!< TWSR: prescaler bit 0
+#define TWPS1           (1)      //!< TWSR: prescaler bit 1
+
+//! TWI control register, every read and write goes to the model
+class sha204e_twcr {
+public:
+	operator uint8_t() const;
+	sha204e_twcr& operator=(uint8_t value);
+};
+
+extern sha204e_twcr TWCR;       //!< TWI control register
+extern volatile uint8_t TWDR;   //!< TWI data register
+extern volatile uint8_t TWSR;   //!< TWI status register
+extern volatile uint8_t TWBR;   //!< TWI bit rate register
+
+#endif
@@ -0,0 +1,33 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/** \file
+ *  \brief Program Memory for Host Builds of the AVR Modules
+ *
+ *         Program memory is ordinary memory on the host.
+ */
+#ifndef SHA204E_AVR_PGMSPACE_H
+#   define SHA204E_AVR_PGMSPACE_H
+
+#include <stdint.h>
+
+#define PROGMEM
+#define pgm_read_byte(address)  (*(const uint8_t *) (address))
+
+#endif
@@ -0,0 +1,44 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/** \file
+ *  \brief TWI Status Codes for Host Builds of the AVR Modules
+ */
+#ifndef SHA204E_UTIL_TWI_H
+#   define SHA204E_UTIL_TWI_H
+
+#include <avr/io.h>
+
+#define TW_STATUS       (TWSR & 0xF8)   //!< status bits of TWSR
+
+#define TW_START        (0x08)   //!< Start condition sent
+#define TW_REP_START    (0x10)   //!< repeated Start condition sent
+#define TW_MT_SLA_ACK   (0x18)   //!< address for writing acknowledged
+#define TW_MT_SLA_NACK  (0x20)   //!< address for writing not acknowledged
+#define TW_MT_DATA_ACK  (0x28)   //!< data byte sent and acknowledged
+#define TW_MT_DATA_NACK (0x30)   //!< data byte sent, not acknowledged
+#define TW_MT_ARB_LOST  (0x38)   //!< arbitration lost
+#define TW_MR_SLA_ACK   (0x40)   //!< address for reading acknowledged
+#define TW_MR_SLA_NACK  (0x48)   //!< address for reading not acknowledged
+#define TW_MR_DATA_ACK  (0x50)   //!< data byte received and acknowledged
+#define TW_MR_DATA_NACK (0x58)   //!< data byte received, not acknowledged
+#define TW_NO_INFO      (0xF8)   //!< no operation is running
+#define TW_BUS_ERROR    (0x00)   //!< illegal Start or Stop condition
+
+#endif
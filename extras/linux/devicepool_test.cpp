@@ -0,0 +1,226 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/** \file
+ *  \brief Test of DevicePool against Emulated Devices
+ *
+ *         Every bus of the pool opens the emulated adapter in its own
+ *         worker thread. The devices of a bus sit at addresses of their
+ *         own, so the buses stay apart the way they would on separate
+ *         adapters.
+ */
+
+#include <stdio.h>                      // printf()
+#include <stdexcept>
+#include <vector>
+#include "sha204_lib_return_codes.h"
+#include "sha204_comm_marshaling.h"
+#include "sha204_physical.h"
+#include "i2c_emulator.h"
+#include "../../src/api/DevicePool.h"
+
+#define TEST_STOLEN_JOBS        (20)     //!< stealable jobs queued for one device
+#define TEST_EXECUTION_US       (2000)   //!< time a command keeps a device busy while jobs are stolen
+
+//! emulated devices: two on bus 0, one on bus 1
+static struct sha204e_device devices[3];
+
+//! 8-bit addresses of the devices
+static const uint8_t addresses[3] = { 0x10, 0x12, 0x20 };
+
+//! number of failed checks
+static int failures;
+
+
+/** \brief This function records the result of a check.
+ * \param[in] ok result of the check
+ * \param[in] what description
+ */
+static void check(int ok, const char *what)
+{
+	printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+	if (!ok)
+		failures++;
+}
+
+
+/** \brief This function opens the emulated adapter in a worker thread.
+ * \return status of the operation
+ */
+static uint8_t test_open(void)
+{
+	return sha204p_linux_i2c_open(SHA204E_I2C_PATH);
+}
+
+
+/** \brief This function runs a Random command in a session.
+ * \param[in,out] session device and command buffers
+ * \return status of the command
+ */
+static uint8_t test_random(Sha204Session& session)
+{
+	return sha204m_random(session.tx, session.rx, RANDOM_NO_SEED_UPDATE);
+}
+
+
+/** \brief This function puts fresh devices on the adapter and two buses into a pool.
+ * \param[in,out] pool pool without buses
+ * \param[in] execution_us time a command keeps a device busy
+ */
+static void test_setup(DevicePool& pool, uint32_t execution_us)
+{
+	uint8_t i;
+
+	sha204e_i2c_reset(1, 0);
+	pool.addBus(test_open);
+	pool.addBus(test_open);
+	for (i = 0; i < 3; i++) {
+		sha204e_init(&devices[i]);
+		devices[i].busy_polls = 0;
+		devices[i].execution_us = execution_us;
+		sha204e_i2c_attach(&devices[i], addresses[i]);
+		pool.addDevice(i < 2 ? 0 : 1, addresses[i]);
+	}
+}
+
+
+/** \brief This function checks that results come back from the device a job was queued for. */
+static void test_results(void)
+{
+	DevicePool pool;
+	std::vector<std::future<Sha204PoolResult> > futures;
+	Sha204PoolResult result;
+	Sha204BusStats bus0, bus1;
+	uint8_t ids_ok = 1;
+	uint8_t ok = 1;
+	uint16_t i;
+
+	printf("-- results\n");
+	test_setup(pool, 0);
+
+	// Two jobs per device, queued before the workers start, make one session per device.
+	for (i = 0; i < 6; i++)
+		futures.push_back(pool.submit(i % 3, [&ids_ok](Sha204Session& session) {
+				if (session.id != addresses[session.device] || session.bus != (session.device < 2 ? 0 : 1))
+					ids_ok = 0;
+				return test_random(session);
+			}));
+	pool.start();
+
+	for (i = 0; i < 6; i++) {
+		result = futures[i].get();
+		// first byte of the emulator's random pattern for the first and second Random of a device
+		if (result.status != SHA204_SUCCESS || result.device != i % 3
+					|| result.response[SHA204_BUFFER_POS_DATA] != (uint8_t) ((i / 3) * 33 + 0x5A))
+			ok = 0;
+	}
+	check(ok, "futures resolve with the device and response of their job");
+	check(ids_ok, "jobs run with the bus and address of their device");
+
+	result = pool.submit(3, test_random).get();
+	check(result.status == SHA204_BAD_PARAM, "a job for an unknown device fails");
+
+	pool.stop();
+	bus0 = pool.stats(0);
+	bus1 = pool.stats(1);
+	check(bus0.jobs == 4 && bus1.jobs == 2 && !bus0.stolen && !bus1.stolen,
+				"stats() counts the jobs of every bus");
+	check(bus0.sessions == 2 && bus1.sessions == 1 && bus0.busy_us > 0,
+				"stats() counts one session per device with queued jobs");
+}
+
+
+/** \brief This function checks that stealable jobs move to an idle bus. */
+static void test_stealing(void)
+{
+	DevicePool pool;
+	std::vector<std::future<Sha204PoolResult> > futures;
+	Sha204PoolResult result;
+	Sha204BusStats bus0, bus1;
+	uint32_t on_bus1 = 0;
+	uint8_t ok = 1;
+	uint16_t i;
+
+	printf("-- stealing\n");
+	test_setup(pool, TEST_EXECUTION_US);
+
+	for (i = 0; i < TEST_STOLEN_JOBS; i++)
+		futures.push_back(pool.submit(0, test_random, true));
+	pool.start();
+
+	for (i = 0; i < TEST_STOLEN_JOBS; i++) {
+		result = futures[i].get();
+		if (result.status != SHA204_SUCCESS || result.device == 1)
+			ok = 0;
+		if (result.device == 2)
+			on_bus1++;
+	}
+	pool.stop();
+	bus0 = pool.stats(0);
+	bus1 = pool.stats(1);
+	printf("      %u of %u jobs ran on bus 1\n", on_bus1, TEST_STOLEN_JOBS);
+	check(ok, "stealable jobs succeed");
+	check(on_bus1 > 0 && bus1.stolen == on_bus1 && bus1.jobs == on_bus1,
+				"the idle bus takes stealable jobs of the busy one");
+	check(bus0.jobs + bus1.jobs == TEST_STOLEN_JOBS && devices[2].randoms == on_bus1,
+				"every job runs once");
+}
+
+
+/** \brief This function checks that a job that throws fails only its own future. */
+static void test_exception(void)
+{
+	DevicePool pool;
+	std::future<Sha204PoolResult> thrown, next;
+	uint8_t caught = 0;
+
+	printf("-- exception\n");
+	test_setup(pool, 0);
+
+	thrown = pool.submit(0, [](Sha204Session& session) -> uint8_t {
+			(void) session;
+			throw std::runtime_error("job failed");
+		});
+	next = pool.submit(0, test_random);
+	pool.start();
+
+	try {
+		(void) thrown.get();
+	}
+	catch (const std::runtime_error&) {
+		caught = 1;
+	}
+	check(caught, "the future of a throwing job rethrows its exception");
+	check(next.get().status == SHA204_SUCCESS, "the worker goes on with the next job");
+
+	pool.stop();
+	check(pool.stats(0).jobs == 2, "stats() counts the throwing job");
+}
+
+
+int main(void)
+{
+	test_results();
+	test_stealing();
+	test_exception();
+
+	printf("%s\n", failures ? "FAILED" : "OK");
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,398 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/** \file
+ *  \brief Emulated i2c-dev Adapter with ATSHA204 Devices on it
+ */
+
+#include <errno.h>                      // errno values
+#include <fcntl.h>                      // open()
+#include <pthread.h>                    // pthread_mutex_lock()
+#include <stdarg.h>                     // va_list
+#include <string.h>                     // strcmp()
+#include <time.h>                       // clock_nanosleep()
+#include <sys/ioctl.h>                  // ioctl()
+#include <linux/i2c.h>                  // I2C message definitions
+#include <linux/i2c-dev.h>              // i2c-dev ioctl definitions
+#include "i2c_emulator.h"
+
+int __real_open(const char *path, int flags, ...);
+int __real_ioctl(int fd, unsigned long request, ...);
+int __real_close(int fd);
+
+//! devices on the adapter and their 7-bit addresses
+static struct {
+	struct sha204e_device *device;
+	uint8_t address;
+} emulated_devices[SHA204E_I2C_DEVICES];
+
+//! number of entries in emulated_devices
+static uint8_t emulated_count;
+
+//! adapter supports plain I<SUP>2</SUP>C transfers, otherwise SMBus only
+static uint8_t emulated_plain_i2c = 1;
+
+//! time of one bit on the wire in ns, 0 if transfers take no time
+static uint32_t emulated_bit_ns;
+
+//! 1 for file descriptors handed out for the adapter
+static uint8_t emulated_fds[SHA204E_I2C_FDS];
+
+//! address set with I2C_SLAVE or I2C_SLAVE_FORCE, per file descriptor
+static uint16_t slave_addresses[SHA204E_I2C_FDS];
+
+//! ioctl counters
+static struct sha204e_i2c_counters counters;
+
+//! held while the bus is in use
+static pthread_mutex_t bus_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/** \brief This function removes all devices and sets up the adapter.
+ * \param[in] plain_i2c 1 to support I2C_RDWR, 0 for an SMBus-only adapter like i2c-stub
+ * \param[in] bit_ns time of one bit on the wire in ns, e.g. 2500 for 400 kHz, 0 for none
+ */
+void sha204e_i2c_reset(uint8_t plain_i2c, uint32_t bit_ns)
+{
+	pthread_mutex_lock(&bus_mutex);
+	emulated_count = 0;
+	emulated_plain_i2c = plain_i2c;
+	emulated_bit_ns = bit_ns;
+	pthread_mutex_unlock(&bus_mutex);
+}
+
+
+/** \brief This function puts a device on the emulated adapter.
+ * \param[in] device device
+ * \param[in] address 8-bit I<SUP>2</SUP>C address as the library uses it, e.g. 0xC8
+ * \return 0, -1 if the adapter is full
+ */
+int sha204e_i2c_attach(struct sha204e_device *device, uint8_t address)
+{
+	int ret = -1;
+
+	pthread_mutex_lock(&bus_mutex);
+	if (emulated_count < SHA204E_I2C_DEVICES) {
+		emulated_devices[emulated_count].device = device;
+		emulated_devices[emulated_count].address = address >> 1;
+		emulated_count++;
+		ret = 0;
+	}
+	pthread_mutex_unlock(&bus_mutex);
+
+	return ret;
+}
+
+
+/** \brief This function finds the device at an address.
+ * \param[in] address 7-bit address
+ * \return device, NULL if there is none
+ */
+static struct sha204e_device *sha204e_i2c_device(uint16_t address)
+{
+	uint8_t i;
+
+	for (i = 0; i < emulated_count; i++) {
+		if (emulated_devices[i].address == address)
+			return emulated_devices[i].device;
+	}
+
+	return NULL;
+}
+
+
+/** \brief This function occupies the bus for the time a message takes.
+ * \param[in] length number of bytes after the address byte
+ */
+static void sha204e_i2c_wire(uint16_t length)
+{
+	struct timespec delay;
+	// eight bits and the acknowledge for every byte
+	uint64_t delay_ns = (uint64_t) (length + 1) * 9 * emulated_bit_ns;
+
+	if (!delay_ns)
+		return;
+
+	delay.tv_sec = (time_t) (delay_ns / 1000000000);
+	delay.tv_nsec = (long) (delay_ns % 1000000000);
+	while (clock_nanosleep(CLOCK_MONOTONIC, 0, &delay, &delay) == EINTR)
+		;
+}
+
+
+/** \brief This function reads the ioctl counters.
+ * \param[out] copy copy of the counters
+ * \param[in] reset non-zero to clear the counters after copying them
+ */
+void sha204e_i2c_get_counters(struct sha204e_i2c_counters *copy, uint8_t reset)
+{
+	pthread_mutex_lock(&bus_mutex);
+	if (copy)
+		*copy = counters;
+	if (reset)
+		memset(&counters, 0, sizeof(counters));
+	pthread_mutex_unlock(&bus_mutex);
+}
+
+
+/** \brief This function runs one message on the bus.
+ *
+ * A write of no bytes to the general call address is the Wake-up
+ * token for all devices. Nobody acknowledges it. The bus mutex has to be
+ * held.
+ * \param[in] address 7-bit address
+ * \param[in] read 1 to read, 0 to write
+ * \param[in,out] buffer bytes to write or read
+ * \param[in] length number of bytes
+ * \return 0 if acknowledged, -1 otherwise
+ */
+static int sha204e_i2c_message(uint16_t address, uint8_t read, uint8_t *buffer, uint16_t length)
+{
+	struct sha204e_device *device;
+	uint16_t i;
+
+	sha204e_i2c_wire(length);
+
+	if (address == 0 && !read) {
+		for (i = 0; i < emulated_count; i++)
+			sha204e_wake(emulated_devices[i].device);
+		return -1;
+	}
+
+	device = sha204e_i2c_device(address);
+	if (!device || !device->awake || sha204e_is_busy(device))
+		return -1;
+
+	if (read) {
+		for (i = 0; i < length; i++)
+			buffer[i] = sha204e_transmit(device);
+		return 0;
+	}
+
+	if (length == 0)
+		return 0;
+
+	switch (buffer[0]) {
+	case 0x00:
+		sha204e_reset_io(device);
+		break;
+	case 0x01:
+	case 0x02:
+		sha204e_sleep(device);
+		break;
+	case 0x03:
+		sha204e_receive(device, &buffer[1], (uint8_t) (length - 1));
+		break;
+	}
+
+	return 0;
+}
+
+
+/** \brief This function serves I2C_RDWR.
+ *
+ * The bus mutex has to be held.
+ * \param[in,out] data messages
+ * \return number of messages, -1 with errno set on failure
+ */
+static int sha204e_i2c_rdwr(struct i2c_rdwr_ioctl_data *data)
+{
+	uint32_t i;
+
+	counters.rdwr++;
+
+	if (!emulated_plain_i2c) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	for (i = 0; i < data->nmsgs; i++) {
+		if (sha204e_i2c_message(data->msgs[i].addr, (data->msgs[i].flags & I2C_M_RD) ? 1 : 0,
+					data->msgs[i].buf, data->msgs[i].len) < 0) {
+			counters.nacks++;
+			errno = ENXIO;
+			return -1;
+		}
+	}
+
+	return (int) data->nmsgs;
+}
+
+
+/** \brief This function serves I2C_SMBUS.
+ *
+ * The bus mutex has to be held.
+ * \param[in] slave_address 7-bit address set for the file descriptor
+ * \param[in,out] args transfer
+ * \return 0, -1 with errno set on failure
+ */
+static int sha204e_i2c_smbus(uint16_t slave_address, struct i2c_smbus_ioctl_data *args)
+{
+	uint8_t buffer[1 + I2C_SMBUS_BLOCK_MAX];
+	uint8_t read = (args->read_write == I2C_SMBUS_READ);
+	int ret;
+
+	counters.smbus++;
+
+	switch (args->size) {
+	case I2C_SMBUS_QUICK:
+		ret = sha204e_i2c_message(slave_address, read, NULL, 0);
+		break;
+
+	case I2C_SMBUS_BYTE:
+		if (read)
+			ret = sha204e_i2c_message(slave_address, 1, &args->data->byte, 1);
+		else {
+			buffer[0] = args->command;
+			ret = sha204e_i2c_message(slave_address, 0, buffer, 1);
+		}
+		break;
+
+	case I2C_SMBUS_I2C_BLOCK_DATA:
+		if (read || args->data->block[0] > I2C_SMBUS_BLOCK_MAX) {
+			errno = EINVAL;
+			return -1;
+		}
+		buffer[0] = args->command;
+		memcpy(&buffer[1], &args->data->block[1], args->data->block[0]);
+		ret = sha204e_i2c_message(slave_address, 0, buffer, (uint16_t) (args->data->block[0] + 1));
+		break;
+
+	default:
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	if (ret < 0) {
+		counters.nacks++;
+		errno = ENXIO;
+	}
+
+	return ret;
+}
+
+
+/** \brief This function opens the emulated adapter or passes the call on.
+ * \param[in] path path of the file
+ * \param[in] flags open flags
+ * \return file descriptor, -1 on failure
+ */
+int __wrap_open(const char *path, int flags, ...)
+{
+	va_list args;
+	int mode = 0;
+	int fd;
+
+	if (flags & O_CREAT) {
+		va_start(args, flags);
+		mode = va_arg(args, int);
+		va_end(args);
+	}
+
+	if (strcmp(path, SHA204E_I2C_PATH))
+		return __real_open(path, flags, mode);
+
+	// A real descriptor, so that close() and fd numbering behave.
+	fd = __real_open("/dev/null", O_RDWR | (flags & O_CLOEXEC));
+	if (fd >= SHA204E_I2C_FDS) {
+		__real_close(fd);
+		errno = EMFILE;
+		return -1;
+	}
+	if (fd >= 0) {
+		pthread_mutex_lock(&bus_mutex);
+		emulated_fds[fd] = 1;
+		slave_addresses[fd] = 0;
+		pthread_mutex_unlock(&bus_mutex);
+	}
+
+	return fd;
+}
+
+
+/** \brief This function serves an ioctl of the emulated adapter or passes the call on.
+ * \param[in] fd file descriptor
+ * \param[in] request ioctl request
+ * \return result of the ioctl
+ */
+int __wrap_ioctl(int fd, unsigned long request, ...)
+{
+	va_list args;
+	void *arg;
+	int ret;
+
+	va_start(args, request);
+	arg = va_arg(args, void *);
+	va_end(args);
+
+	if (fd < 0 || fd >= SHA204E_I2C_FDS || !emulated_fds[fd])
+		return __real_ioctl(fd, request, arg);
+
+	pthread_mutex_lock(&bus_mutex);
+
+	switch (request) {
+	case I2C_RDWR:
+		ret = sha204e_i2c_rdwr((struct i2c_rdwr_ioctl_data *) arg);
+		break;
+
+	case I2C_SMBUS:
+		ret = sha204e_i2c_smbus(slave_addresses[fd], (struct i2c_smbus_ioctl_data *) arg);
+		break;
+
+	case I2C_FUNCS:
+		counters.other++;
+		*(unsigned long *) arg = emulated_plain_i2c
+			? I2C_FUNC_I2C | I2C_FUNC_SMBUS_EMUL
+			: I2C_FUNC_SMBUS_QUICK | I2C_FUNC_SMBUS_BYTE | I2C_FUNC_SMBUS_I2C_BLOCK;
+		ret = 0;
+		break;
+
+	case I2C_SLAVE:
+	case I2C_SLAVE_FORCE:
+		counters.other++;
+		slave_addresses[fd] = (uint16_t) (unsigned long) arg;
+		ret = 0;
+		break;
+
+	default:
+		counters.other++;
+		errno = ENOTTY;
+		ret = -1;
+	}
+
+	pthread_mutex_unlock(&bus_mutex);
+
+	return ret;
+}
+
+
+/** \brief This function closes a file and forgets the emulated adapter if it was that.
+ * \param[in] fd file descriptor
+ * \return result of close()
+ */
+int __wrap_close(int fd)
+{
+	if (fd >= 0 && fd < SHA204E_I2C_FDS && emulated_fds[fd]) {
+		pthread_mutex_lock(&bus_mutex);
+		emulated_fds[fd] = 0;
+		pthread_mutex_unlock(&bus_mutex);
+	}
+
+	return __real_close(fd);
+}
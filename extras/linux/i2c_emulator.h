@@ -0,0 +1,61 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/** \file
+ *  \brief Emulated i2c-dev Adapter with ATSHA204 Devices on it
+ *
+ *         Programs linked with -Wl,--wrap=open,--wrap=ioctl,--wrap=close get
+ *         an adapter when they open #SHA204E_I2C_PATH. Its ioctls go to the
+ *         sha204e_device objects on it instead of the kernel, like the
+ *         i2c-stub driver but with devices that answer commands. All other
+ *         files are passed through.
+ *
+ *         Every thread may open the adapter. Transfers are serialized like
+ *         on a real bus and can be given the time they take on the wire.
+ */
+#ifndef I2C_EMULATOR_H
+#   define I2C_EMULATOR_H
+
+#include "sha204_emulator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHA204E_I2C_PATH        "/dev/i2c-emulated"  //!< path that opens the emulated adapter
+#define SHA204E_I2C_DEVICES     (112)                //!< devices the adapter holds, one per 7-bit address
+#define SHA204E_I2C_FDS         (1024)               //!< file descriptors below this can be the adapter
+
+//! ioctls the emulated adapter has served
+struct sha204e_i2c_counters {
+	uint32_t rdwr;          //!< I2C_RDWR transfers
+	uint32_t smbus;         //!< I2C_SMBUS transfers
+	uint32_t other;         //!< all other ioctls
+	uint32_t nacks;         //!< transfers that were not acknowledged
+};
+
+void sha204e_i2c_reset(uint8_t plain_i2c, uint32_t bit_ns);
+int  sha204e_i2c_attach(struct sha204e_device *device, uint8_t address);
+void sha204e_i2c_get_counters(struct sha204e_i2c_counters *counters, uint8_t reset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,136 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/** \file
+ *  \brief Test of sha204_linux_i2c.c against the emulated adapter
+ *
+ *         Runs the same commands on an adapter with plain I<SUP>2</SUP>C
+ *         transfers and on an SMBus-only one, checks what reaches the
+ *         emulated device and prints the system calls per command.
+ */
+
+#include <stdio.h>                      // printf()
+#include <string.h>                     // memcmp(), memset()
+#include "sha204_lib_return_codes.h"
+#include "sha204_comm_marshaling.h"
+#include "i2c_emulator.h"
+
+//! number of failed checks
+static int failures;
+
+
+/** \brief This function records the result of a check.
+ * \param[in] ok result of the check
+ * \param[in] what description
+ */
+static void check(int ok, const char *what)
+{
+	printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+	if (!ok)
+		failures++;
+}
+
+
+/** \brief This function runs the test on one kind of adapter.
+ * \param[in] plain_i2c 1 for an adapter with I2C_RDWR, 0 for an SMBus-only one
+ */
+static void test_adapter(uint8_t plain_i2c)
+{
+	static struct sha204e_device device;
+	struct sha204_linux_i2c_stats stats;
+	struct sha204e_i2c_counters counters;
+	struct sha204_response_view view;
+	uint8_t tx[SHA204_CMD_SIZE_MAX];
+	uint8_t rx[SHA204_RSP_SIZE_MAX];
+	uint8_t value[32];
+	uint8_t block[32];
+	uint16_t crc;
+	uint8_t ret_code;
+	uint8_t i;
+
+	printf("-- %s adapter\n", plain_i2c ? "I2C" : "SMBus-only");
+
+	sha204e_init(&device);
+	sha204e_i2c_reset(plain_i2c, 0);
+	sha204e_i2c_attach(&device, SHA204_I2C_DEFAULT_ADDRESS);
+
+	check(sha204p_linux_i2c_open(SHA204E_I2C_PATH) == SHA204_SUCCESS, "open adapter");
+	sha204p_init();
+
+	check(sha204c_wakeup(rx) == SHA204_SUCCESS && device.awake, "Wake-up");
+
+	sha204p_linux_i2c_get_stats(NULL, 1);
+	sha204e_i2c_get_counters(NULL, 1);
+	ret_code = sha204m_random(tx, rx, 0);
+	check(ret_code == SHA204_SUCCESS && !memcmp(&rx[SHA204_BUFFER_POS_DATA], device.random, 32), "Random");
+	sha204p_linux_i2c_get_stats(&stats, 1);
+	sha204e_i2c_get_counters(&counters, 1);
+	printf("      %u commands, %u polls, %u system calls, %u transfers\n",
+				stats.commands, stats.polls, stats.syscalls, counters.rdwr + counters.smbus);
+	if (plain_i2c)
+		// one write, then one read per poll
+		check(counters.rdwr == 1 + stats.polls && !counters.smbus, "Random sends its packet in one transfer");
+	else
+		// one block write, the refused poll, then one byte per response byte
+		check(counters.smbus == 1 + stats.polls - 1 + RANDOM_RSP_SIZE, "Random reads byte by byte");
+
+	check(sha204m_read(tx, rx, SHA204_ZONE_CONFIG, 0) == SHA204_SUCCESS
+				&& !memcmp(&rx[SHA204_BUFFER_POS_DATA], device.config, 4), "Read of 4 configuration bytes");
+
+	memset(block, 0, sizeof(block));
+	view.size = sizeof(block);
+	view.data = block;
+	ret_code = sha204m_execute_view(SHA204_READ, SHA204_ZONE_CONFIG | SHA204_ZONE_COUNT_FLAG, 0,
+				0, NULL, 0, NULL, 0, NULL, &view);
+	check(ret_code == SHA204_SUCCESS && !memcmp(block, device.config, sizeof(block)),
+				"Read of 32 configuration bytes into a view");
+
+	for (i = 0; i < 4; i++)
+		value[i] = 0xA0 + i;
+	check(sha204m_write(tx, rx, SHA204_ZONE_CONFIG, 16, value, NULL) == SHA204_SUCCESS
+				&& !memcmp(&device.config[16], value, 4), "Write of 4 configuration bytes");
+
+	crc = sha204e_crc(0, device.config, SHA204E_CONFIG_SIZE);
+	check(sha204m_lock(tx, rx, SHA204_ZONE_CONFIG, crc) == SHA204_SUCCESS
+				&& rx[SHA204_BUFFER_POS_STATUS] == SHA204_SUCCESS, "Lock of the configuration zone");
+
+	for (i = 0; i < sizeof(value); i++)
+		value[i] = i;
+	ret_code = sha204m_write(tx, rx, SHA204_ZONE_DATA | SHA204_ZONE_COUNT_FLAG, 0, value, NULL);
+	if (plain_i2c)
+		check(ret_code == SHA204_SUCCESS && !memcmp(device.data, value, sizeof(value)), "Write of 32 data bytes");
+	else
+		check(ret_code == SHA204_INVALID_SIZE && device.data[0] == 0xFF,
+					"Write of 32 data bytes is refused, its packet exceeds an SMBus block");
+
+	check(sha204p_sleep() == SHA204_SUCCESS && !device.awake, "Sleep");
+
+	sha204p_linux_i2c_close();
+}
+
+
+int main(void)
+{
+	test_adapter(1);
+	test_adapter(0);
+
+	printf("%s\n", failures ? "FAILED" : "OK");
+
+	return failures ? 1 : 0;
+}
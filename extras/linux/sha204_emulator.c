@@ -0,0 +1,376 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/** \file
+ *  \brief Model of an ATSHA204 for Testing the Linux Transports
+ */
+
+#include <string.h>                     // memcpy(), memset()
+#include <time.h>                       // clock_gettime()
+#include "sha204_emulator.h"
+
+#define SHA204E_LOCK_VALUE      (86)          //!< byte address of LockValue
+#define SHA204E_LOCK_CONFIG     (87)          //!< byte address of LockConfig
+#define SHA204E_UNLOCKED        ((uint8_t) 0x55)  //!< value of an unlocked lock byte
+#define SHA204E_WRITABLE_START  (16)          //!< first configuration byte Write changes
+#define SHA204E_WRITABLE_END    (84)          //!< configuration byte following the last one Write changes
+
+//! factory contents of the first 16 configuration bytes
+static const uint8_t sha204e_factory_config[16] = {
+	0x01, 0x23, 0x5A, 0x9C, 0x00, 0x09, 0x04, 0x00,
+	0x11, 0x22, 0x33, 0x44, 0xEE, 0x00, 0xC8, 0x00
+};
+
+
+/** \brief This function calculates the CRC the device uses.
+ * \param[in] crc CRC of the preceding bytes, 0 to start
+ * \param[in] data bytes
+ * \param[in] length number of bytes
+ * \return CRC
+ */
+uint16_t sha204e_crc(uint16_t crc, const uint8_t *data, uint16_t length)
+{
+	uint16_t i;
+	uint8_t mask;
+
+	for (i = 0; i < length; i++) {
+		for (mask = 1; mask; mask <<= 1) {
+			uint8_t bit = (data[i] & mask) ? 1 : 0;
+
+			if (bit != (crc >> 15))
+				crc = (uint16_t) (crc << 1) ^ 0x8005;
+			else
+				crc <<= 1;
+		}
+	}
+
+	return crc;
+}
+
+
+/** \brief This function returns the time of the monotonic clock.
+ * \return time in us
+ */
+static uint64_t sha204e_now_us(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+
+/** \brief This function puts a device into its factory state, asleep.
+ * \param[out] device device
+ */
+void sha204e_init(struct sha204e_device *device)
+{
+	memset(device, 0, sizeof(*device));
+	memcpy(device->config, sha204e_factory_config, sizeof(sha204e_factory_config));
+	device->config[SHA204E_LOCK_VALUE] = SHA204E_UNLOCKED;
+	device->config[SHA204E_LOCK_CONFIG] = SHA204E_UNLOCKED;
+	memset(device->otp, 0xFF, sizeof(device->otp));
+	memset(device->data, 0xFF, sizeof(device->data));
+	device->busy_polls = 1;
+}
+
+
+/** \brief This function puts a response packet into the output buffer.
+ * \param[in,out] device device
+ * \param[in] data response data
+ * \param[in] length number of bytes in data
+ */
+static void sha204e_respond(struct sha204e_device *device, const uint8_t *data, uint8_t length)
+{
+	uint16_t crc;
+
+	device->output[0] = length + 3;
+	memcpy(&device->output[1], data, length);
+	crc = sha204e_crc(0, device->output, length + 1);
+	device->output[length + 1] = (uint8_t) (crc & 0xFF);
+	device->output[length + 2] = (uint8_t) (crc >> 8);
+	device->output_count = length + 3;
+	device->output_pos = 0;
+}
+
+
+/** \brief This function puts a status response into the output buffer.
+ * \param[in,out] device device
+ * \param[in] status status byte
+ */
+static void sha204e_respond_status(struct sha204e_device *device, uint8_t status)
+{
+	sha204e_respond(device, &status, 1);
+}
+
+
+/** \brief This function wakes a device up.
+ *
+ * A Wake-up token to a device that is awake is ignored.
+ * \param[in,out] device device
+ */
+void sha204e_wake(struct sha204e_device *device)
+{
+	static const uint8_t wake_status = 0x11;
+
+	if (device->awake)
+		return;
+
+	device->awake = 1;
+	device->busy = 0;
+	device->busy_until_us = 0;
+	device->wakes++;
+	sha204e_respond(device, &wake_status, 1);
+}
+
+
+/** \brief This function puts a device to sleep.
+ * \param[in,out] device device
+ */
+void sha204e_sleep(struct sha204e_device *device)
+{
+	device->awake = 0;
+	device->output_count = 0;
+	device->output_pos = 0;
+}
+
+
+/** \brief This function resets the I/O buffer of a device.
+ * \param[in,out] device device
+ */
+void sha204e_reset_io(struct sha204e_device *device)
+{
+	device->output_pos = 0;
+}
+
+
+/** \brief This function counts an attempt to address a busy device.
+ * \param[in,out] device device
+ * \return 1 if the device is busy and refuses the attempt
+ */
+uint8_t sha204e_is_busy(struct sha204e_device *device)
+{
+	if (device->busy) {
+		device->busy--;
+		return 1;
+	}
+
+	return device->busy_until_us && sha204e_now_us() < device->busy_until_us;
+}
+
+
+/** \brief This function finds the zone a Read or Write addresses.
+ * \param[in] device device
+ * \param[in] param1 zone and length flag
+ * \param[in] param2 word address
+ * \param[out] offset byte offset into the zone
+ * \param[out] size number of bytes accessed
+ * \return zone memory, NULL if the address is out of range
+ */
+static uint8_t *sha204e_zone(struct sha204e_device *device, uint8_t param1, uint16_t param2,
+			uint16_t *offset, uint8_t *size)
+{
+	uint8_t *zone;
+	uint16_t zone_size;
+
+	switch (param1 & 0x03) {
+	case 0:
+		zone = device->config;
+		zone_size = SHA204E_CONFIG_SIZE;
+		break;
+	case 1:
+		zone = device->otp;
+		zone_size = SHA204E_OTP_SIZE;
+		break;
+	case 2:
+		zone = device->data;
+		zone_size = SHA204E_DATA_SIZE;
+		break;
+	default:
+		return NULL;
+	}
+
+	*size = (param1 & 0x80) ? 32 : 4;
+	*offset = (uint16_t) (param2 & 0xFF) * 4;
+	*offset -= *offset % *size;
+	if (*offset + *size > zone_size)
+		return NULL;
+
+	return zone;
+}
+
+
+/** \brief This function executes a command packet.
+ * \param[in,out] device device
+ * \param[in] packet command packet with a valid count and CRC
+ */
+static void sha204e_execute(struct sha204e_device *device, const uint8_t *packet)
+{
+	uint8_t op_code = packet[1];
+	uint8_t param1 = packet[2];
+	uint16_t param2 = packet[3] | ((uint16_t) packet[4] << 8);
+	const uint8_t *data = &packet[5];
+	uint8_t length = packet[0] - 7;
+	uint8_t data_locked = device->config[SHA204E_LOCK_VALUE] != SHA204E_UNLOCKED;
+	uint8_t config_locked = device->config[SHA204E_LOCK_CONFIG] != SHA204E_UNLOCKED;
+	uint8_t response[32];
+	uint8_t *zone;
+	uint16_t offset, crc, i;
+	uint8_t size;
+
+	switch (op_code) {
+	case 0x30:      // DevRev
+		memset(response, 0, 4);
+		response[3] = 0x09;
+		sha204e_respond(device, response, 4);
+		return;
+
+	case 0x1B:      // Random
+		for (i = 0; i < sizeof(device->random); i++)
+			device->random[i] = (uint8_t) (device->randoms * 33 + i * 7 + 0x5A);
+		device->randoms++;
+		sha204e_respond(device, device->random, sizeof(device->random));
+		return;
+
+	case 0x16:      // Nonce
+		if ((param1 & 0x03) == 0x03 && length == 32) {
+			sha204e_respond_status(device, SHA204E_STATUS_SUCCESS);
+			return;
+		}
+		if ((param1 & 0x03) <= 0x01 && length == 20) {
+			for (i = 0; i < sizeof(response); i++)
+				response[i] = (uint8_t) (data[i % 20] + i);
+			sha204e_respond(device, response, sizeof(response));
+			return;
+		}
+		break;
+
+	case 0x02:      // Read
+		zone = sha204e_zone(device, param1, param2, &offset, &size);
+		if (!zone || length)
+			break;
+		if (zone != device->config && !data_locked) {
+			sha204e_respond_status(device, SHA204E_STATUS_EXECUTE);
+			return;
+		}
+		sha204e_respond(device, &zone[offset], size);
+		return;
+
+	case 0x12:      // Write without MAC
+		zone = sha204e_zone(device, param1, param2, &offset, &size);
+		if (!zone || length != size)
+			break;
+		if (zone == device->config) {
+			if (config_locked) {
+				sha204e_respond_status(device, SHA204E_STATUS_EXECUTE);
+				return;
+			}
+			// Bytes outside the writable range keep their value.
+			for (i = 0; i < size; i++) {
+				if (offset + i >= SHA204E_WRITABLE_START && offset + i < SHA204E_WRITABLE_END)
+					zone[offset + i] = data[i];
+			}
+		}
+		else {
+			if (!config_locked || data_locked) {
+				sha204e_respond_status(device, SHA204E_STATUS_EXECUTE);
+				return;
+			}
+			memcpy(&zone[offset], data, size);
+		}
+		sha204e_respond_status(device, SHA204E_STATUS_SUCCESS);
+		return;
+
+	case 0x17:      // Lock
+		if (length || (param1 & 0x7E))
+			break;
+		if (!(param1 & 0x01)) {
+			if (config_locked) {
+				sha204e_respond_status(device, SHA204E_STATUS_EXECUTE);
+				return;
+			}
+			crc = sha204e_crc(0, device->config, SHA204E_CONFIG_SIZE);
+		}
+		else {
+			if (!config_locked || data_locked) {
+				sha204e_respond_status(device, SHA204E_STATUS_EXECUTE);
+				return;
+			}
+			crc = sha204e_crc(sha204e_crc(0, device->data, SHA204E_DATA_SIZE), device->otp, SHA204E_OTP_SIZE);
+		}
+		if (!(param1 & 0x80) && crc != param2) {
+			sha204e_respond_status(device, SHA204E_STATUS_EXECUTE);
+			return;
+		}
+		device->config[(param1 & 0x01) ? SHA204E_LOCK_VALUE : SHA204E_LOCK_CONFIG] = 0x00;
+		sha204e_respond_status(device, SHA204E_STATUS_SUCCESS);
+		return;
+	}
+
+	sha204e_respond_status(device, SHA204E_STATUS_PARSE);
+}
+
+
+/** \brief This function receives a command packet and executes it.
+ *
+ * The packet has to arrive in one piece. A packet with a bad count or
+ * CRC gets a CRC error response. After a command the device is busy
+ * for #sha204e_device.busy_polls attempts to address it and for
+ * #sha204e_device.execution_us.
+ * \param[in,out] device device
+ * \param[in] bytes packet, starting with its count byte
+ * \param[in] count number of bytes received
+ */
+void sha204e_receive(struct sha204e_device *device, const uint8_t *bytes, uint8_t count)
+{
+	uint16_t crc;
+
+	device->commands++;
+	device->busy = device->busy_polls;
+	device->busy_until_us = device->execution_us ? sha204e_now_us() + device->execution_us : 0;
+
+	if (count < 7 || count > SHA204E_PACKET_MAX || bytes[0] != count) {
+		sha204e_respond_status(device, SHA204E_STATUS_CRC);
+		return;
+	}
+
+	crc = sha204e_crc(0, bytes, count - 2);
+	if (bytes[count - 2] != (uint8_t) (crc & 0xFF) || bytes[count - 1] != (uint8_t) (crc >> 8)) {
+		sha204e_respond_status(device, SHA204E_STATUS_CRC);
+		return;
+	}
+
+	sha204e_execute(device, bytes);
+}
+
+
+/** \brief This function sends the next byte of the response.
+ *
+ * Past the end of the response the device sends 0xFF.
+ * \param[in,out] device device
+ * \return byte
+ */
+uint8_t sha204e_transmit(struct sha204e_device *device)
+{
+	if (device->output_pos >= device->output_count)
+		return 0xFF;
+
+	return device->output[device->output_pos++];
+}
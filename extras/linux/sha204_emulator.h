@@ -0,0 +1,82 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/** \file
+ *  \brief Model of an ATSHA204 for Testing the Linux Transports
+ *
+ *         The model knows the packet format, the sleep and wake states and
+ *         the commands the tests use: DevRev, Lock, Nonce, Random, Read and
+ *         Write without MAC. After a command the device stays busy for
+ *         #sha204e_device.busy_polls attempts to address it, and for
+ *         #sha204e_device.execution_us if that is set. Bus emulators feed it
+ *         the bytes of the wire protocol.
+ */
+#ifndef SHA204_EMULATOR_H
+#   define SHA204_EMULATOR_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHA204E_CONFIG_SIZE     (88)          //!< size of the configuration zone
+#define SHA204E_OTP_SIZE        (64)          //!< size of the OTP zone
+#define SHA204E_DATA_SIZE       (512)         //!< size of the data zone
+#define SHA204E_PACKET_MAX      (84)          //!< largest command packet
+#define SHA204E_RESPONSE_MAX    (35)          //!< largest response packet
+
+#define SHA204E_STATUS_SUCCESS  ((uint8_t) 0x00)  //!< command succeeded
+#define SHA204E_STATUS_PARSE    ((uint8_t) 0x03)  //!< unknown command or bad parameters
+#define SHA204E_STATUS_EXECUTE  ((uint8_t) 0x0F)  //!< command not allowed in this state
+#define SHA204E_STATUS_CRC      ((uint8_t) 0xFF)  //!< packet with a bad count or CRC
+
+//! state of an emulated device
+struct sha204e_device {
+	uint8_t config[SHA204E_CONFIG_SIZE];     //!< configuration zone
+	uint8_t otp[SHA204E_OTP_SIZE];           //!< OTP zone
+	uint8_t data[SHA204E_DATA_SIZE];         //!< data zone
+	uint8_t awake;                           //!< 1 between Wake-up and Sleep or Idle
+	uint8_t busy_polls;                      //!< attempts to address the device it refuses after a command
+	uint8_t busy;                            //!< attempts it still refuses
+	uint32_t execution_us;                   //!< time a command keeps the device busy, 0 for none
+	uint64_t busy_until_us;                  //!< end of the current command on the monotonic clock
+	uint8_t output[SHA204E_RESPONSE_MAX];    //!< response packet
+	uint8_t output_count;                    //!< bytes in output
+	uint8_t output_pos;                      //!< next byte of output to send
+	uint8_t random[32];                      //!< output of the last Random
+	uint32_t randoms;                        //!< number of Random commands so far
+	uint32_t commands;                       //!< number of packets executed
+	uint32_t wakes;                          //!< number of Wake-up tokens while asleep
+};
+
+void    sha204e_init(struct sha204e_device *device);
+void    sha204e_wake(struct sha204e_device *device);
+void    sha204e_sleep(struct sha204e_device *device);
+void    sha204e_reset_io(struct sha204e_device *device);
+uint8_t sha204e_is_busy(struct sha204e_device *device);
+void    sha204e_receive(struct sha204e_device *device, const uint8_t *bytes, uint8_t count);
+uint8_t sha204e_transmit(struct sha204e_device *device);
+uint16_t sha204e_crc(uint16_t crc, const uint8_t *data, uint16_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
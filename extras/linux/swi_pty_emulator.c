@@ -0,0 +1,239 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/** \file
+ *  \brief ATSHA204 on the Single-Wire Interface behind a Pseudo-Terminal
+ */
+
+#include <errno.h>                      // errno values
+#include <poll.h>                       // poll()
+#include <pthread.h>                    // pthread_create()
+#include <pty.h>                        // openpty()
+#include <string.h>                     // strncpy()
+#include <termios.h>                    // cfmakeraw()
+#include <unistd.h>                     // read(), write(), close()
+#include "swi_pty_emulator.h"
+
+#define SWI_FLAG_CMD            ((uint8_t) 0x77)  //!< flag preceding a command
+#define SWI_FLAG_TX             ((uint8_t) 0x88)  //!< flag requesting a response
+#define SWI_FLAG_IDLE           ((uint8_t) 0xBB)  //!< flag requesting Idle mode
+#define SWI_FLAG_SLEEP          ((uint8_t) 0xCC)  //!< flag requesting Sleep mode
+
+#define SWI_CHAR_ONE            ((uint8_t) 0x7F)  //!< character of a one bit
+#define SWI_CHAR_ZERO           ((uint8_t) 0x7D)  //!< character of a zero bit
+
+//! state of the emulator thread
+static struct {
+	struct sha204e_device *device;           //!< device on the wire
+	int master_fd;                           //!< master side of the pseudo-terminal
+	int slave_fd;                            //!< slave side, kept open so the master never sees a hang-up
+	pthread_t thread;                        //!< emulator thread
+	pthread_mutex_t mutex;                   //!< held while the device changes
+	volatile int stopping;                   //!< set to end the thread
+	uint8_t byte;                            //!< byte being decoded
+	uint8_t bit_mask;                        //!< next bit of byte
+	uint8_t packet[SHA204E_PACKET_MAX];      //!< command packet being received
+	uint8_t packet_count;                    //!< bytes in packet
+	uint8_t in_command;                      //!< 1 between a Command flag and the end of its packet
+} emulator = {NULL, -1, -1, 0, PTHREAD_MUTEX_INITIALIZER, 0, 0, 1, {0}, 0, 0};
+
+
+/** \brief This function expands a byte into one character per bit.
+ * \param[in] value byte
+ * \param[out] chars eight characters
+ */
+static void sha204e_swi_expand(uint8_t value, uint8_t *chars)
+{
+	uint8_t bit_mask, n = 0;
+
+	for (bit_mask = 1; bit_mask; bit_mask <<= 1)
+		chars[n++] = (value & bit_mask) ? SWI_CHAR_ONE : SWI_CHAR_ZERO;
+}
+
+
+/** \brief This function handles a byte the host sent.
+ * \param[in] value byte
+ * \param[out] reply characters to send, the response to a Transmit flag is appended
+ * \param[in,out] reply_count number of characters in reply
+ */
+static void sha204e_swi_byte(uint8_t value, uint8_t *reply, uint16_t *reply_count)
+{
+	struct sha204e_device *device = emulator.device;
+	uint8_t i;
+
+	if (emulator.in_command) {
+		emulator.packet[emulator.packet_count++] = value;
+		if (emulator.packet_count == emulator.packet[0] || emulator.packet_count == sizeof(emulator.packet)
+					|| emulator.packet[0] < 7 || emulator.packet[0] > SHA204E_PACKET_MAX) {
+			sha204e_receive(device, emulator.packet, emulator.packet_count);
+			emulator.in_command = 0;
+		}
+		return;
+	}
+
+	// No break reaches the emulator, see the file comment.
+	if (!device->awake)
+		sha204e_wake(device);
+
+	switch (value) {
+	case SWI_FLAG_CMD:
+		emulator.in_command = 1;
+		emulator.packet_count = 0;
+		break;
+
+	case SWI_FLAG_TX:
+		// A busy device does not answer.
+		if (sha204e_is_busy(device))
+			break;
+		sha204e_reset_io(device);
+		for (i = 0; i < device->output_count; i++) {
+			sha204e_swi_expand(sha204e_transmit(device), &reply[*reply_count]);
+			*reply_count += 8;
+		}
+		break;
+
+	case SWI_FLAG_IDLE:
+	case SWI_FLAG_SLEEP:
+		sha204e_sleep(device);
+		break;
+	}
+}
+
+
+/** \brief This function runs the emulator until sha204e_swi_pty_stop() is called.
+ * \param[in] arg not used
+ * \return NULL
+ */
+static void *sha204e_swi_run(void *arg)
+{
+	uint8_t chars[256];
+	// the echo, and a response for each byte in chars that is a Transmit flag
+	uint8_t reply[sizeof(chars) + sizeof(chars) / 8 * SHA204E_RESPONSE_MAX * 8];
+	struct pollfd readable;
+	uint16_t reply_count;
+	ssize_t n, i, sent;
+
+	(void) arg;
+
+	readable.fd = emulator.master_fd;
+	readable.events = POLLIN;
+
+	while (!emulator.stopping) {
+		if (poll(&readable, 1, 20) <= 0)
+			continue;
+
+		pthread_mutex_lock(&emulator.mutex);
+
+		n = read(emulator.master_fd, chars, sizeof(chars));
+		reply_count = 0;
+		for (i = 0; i < n; i++) {
+			// Tied TX and RX lines echo every character.
+			reply[reply_count++] = chars[i];
+
+			if ((chars[i] & 0x7E) == 0x7E)
+				emulator.byte |= emulator.bit_mask;
+			emulator.bit_mask <<= 1;
+			if (!emulator.bit_mask) {
+				sha204e_swi_byte(emulator.byte, reply, &reply_count);
+				emulator.byte = 0;
+				emulator.bit_mask = 1;
+			}
+		}
+
+		for (sent = 0; sent < reply_count; ) {
+			n = write(emulator.master_fd, reply + sent, reply_count - sent);
+			if (n < 0 && errno != EINTR)
+				break;
+			if (n > 0)
+				sent += n;
+		}
+
+		pthread_mutex_unlock(&emulator.mutex);
+	}
+
+	return NULL;
+}
+
+
+/** \brief This function creates a pseudo-terminal and starts the emulator on it.
+ * \param[in] device device on the wire
+ * \param[out] path path of the slave side, for swi_linux_uart_open()
+ * \param[in] size size of path
+ * \return 0, -1 on failure
+ */
+int sha204e_swi_pty_start(struct sha204e_device *device, char *path, size_t size)
+{
+	char name[64];
+	struct termios tio;
+
+	if (openpty(&emulator.master_fd, &emulator.slave_fd, name, NULL, NULL) < 0)
+		return -1;
+
+	// Raw until the transport configures the port, so nothing is echoed
+	// by the line discipline.
+	if (tcgetattr(emulator.slave_fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		(void) tcsetattr(emulator.slave_fd, TCSANOW, &tio);
+	}
+
+	strncpy(path, name, size - 1);
+	path[size - 1] = 0;
+
+	emulator.device = device;
+	emulator.stopping = 0;
+	emulator.byte = 0;
+	emulator.bit_mask = 1;
+	emulator.in_command = 0;
+
+	if (pthread_create(&emulator.thread, NULL, sha204e_swi_run, NULL)) {
+		close(emulator.master_fd);
+		close(emulator.slave_fd);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/** \brief This function stops the emulator and closes the pseudo-terminal. */
+void sha204e_swi_pty_stop(void)
+{
+	emulator.stopping = 1;
+	pthread_join(emulator.thread, NULL);
+	close(emulator.master_fd);
+	close(emulator.slave_fd);
+	emulator.master_fd = emulator.slave_fd = -1;
+}
+
+
+/** \brief This function keeps the emulator from changing the device.
+ *
+ * Hold it while looking at the device.
+ */
+void sha204e_swi_pty_lock(void)
+{
+	pthread_mutex_lock(&emulator.mutex);
+}
+
+
+/** \brief This function lets the emulator change the device again. */
+void sha204e_swi_pty_unlock(void)
+{
+	pthread_mutex_unlock(&emulator.mutex);
+}
@@ -0,0 +1,41 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/** \file
+ *  \brief ATSHA204 on the Single-Wire Interface behind a Pseudo-Terminal
+ *
+ *         A thread on the master side of a pseudo-terminal speaks SWI as
+ *         uart_linux_phys.c encodes it, one character per bit. It echoes
+ *         every character, as the tied TX and RX lines of a real adapter
+ *         do, and answers the Transmit flag with the response of a
+ *         sha204e_device. A pseudo-terminal does not pass a break on, so a
+ *         device that is asleep wakes up at the next flag it receives.
+ */
+#ifndef SWI_PTY_EMULATOR_H
+#   define SWI_PTY_EMULATOR_H
+
+#include <stddef.h>
+#include "sha204_emulator.h"
+
+int  sha204e_swi_pty_start(struct sha204e_device *device, char *path, size_t size);
+void sha204e_swi_pty_stop(void);
+void sha204e_swi_pty_lock(void);
+void sha204e_swi_pty_unlock(void);
+
+#endif
@@ -0,0 +1,135 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/** \file
+ *  \brief Test of uart_linux_phys.c against the pseudo-terminal emulator
+ *
+ *         Runs commands through the SWI transport, checks what reaches the
+ *         emulated device and prints the system calls per command.
+ */
+
+#include <stdio.h>                      // printf()
+#include <string.h>                     // memcmp(), memset()
+#include "sha204_lib_return_codes.h"
+#include "sha204_comm_marshaling.h"
+#include "swi_phys.h"
+#include "swi_pty_emulator.h"
+
+//! It takes 39 us to send one character, see uart_linux_phys.c.
+#define US_PER_CHAR             (39)
+
+//! number of failed checks
+static int failures;
+
+
+/** \brief This function records the result of a check.
+ * \param[in] ok result of the check
+ * \param[in] what description
+ */
+static void check(int ok, const char *what)
+{
+	printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+	if (!ok)
+		failures++;
+}
+
+
+int main(void)
+{
+	static struct sha204e_device device;
+	struct swi_linux_uart_stats stats;
+	struct sha204_response_view view;
+	char path[64];
+	uint8_t tx[SHA204_CMD_SIZE_MAX];
+	uint8_t rx[SHA204_RSP_SIZE_MAX];
+	uint8_t value[4] = {0xA0, 0xA1, 0xA2, 0xA3};
+	uint8_t block[32];
+	uint32_t wait_max_us;
+	uint8_t ret_code;
+	int ok;
+
+	sha204e_init(&device);
+	if (sha204e_swi_pty_start(&device, path, sizeof(path)) < 0) {
+		printf("FAIL: no pseudo-terminal\n");
+		return 1;
+	}
+	printf("-- emulator on %s\n", path);
+
+	check(swi_linux_uart_open(path) == SWI_FUNCTION_RETCODE_SUCCESS, "open port");
+	sha204p_init();
+
+	check(sha204c_wakeup(rx) == SHA204_SUCCESS, "Wake-up");
+
+	// The first poll after a command finds the device busy.
+	ret_code = sha204m_random(tx, rx, 0);
+	sha204e_swi_pty_lock();
+	ok = !memcmp(&rx[SHA204_BUFFER_POS_DATA], device.random, 32);
+	sha204e_swi_pty_unlock();
+	check(ret_code == SHA204_SUCCESS && ok, "Random of a busy device");
+
+	device.busy_polls = 0;
+	swi_linux_uart_get_stats(NULL, 1);
+	ret_code = sha204m_random(tx, rx, 0);
+	swi_linux_uart_get_stats(&stats, 1);
+	sha204e_swi_pty_lock();
+	ok = !memcmp(&rx[SHA204_BUFFER_POS_DATA], device.random, 32);
+	sha204e_swi_pty_unlock();
+	check(ret_code == SHA204_SUCCESS && ok, "Random");
+	printf("      %u packets, %u reads, %u system calls, %u us waiting\n",
+				stats.packets, stats.reads, stats.syscalls, stats.wait_us);
+	// the command and the Transmit flag, then the count byte and the rest
+	check(stats.packets == 2 && stats.reads == 2, "Random costs two writes and two reads");
+
+	// A status response into a view with room for 32 bytes: the wait
+	// follows the count byte, not the size of the view.
+	memset(block, 0, sizeof(block));
+	view.size = sizeof(block);
+	view.data = block;
+	swi_linux_uart_get_stats(NULL, 1);
+	ret_code = sha204m_execute_view(SHA204_WRITE, SHA204_ZONE_CONFIG, 16 >> 2,
+				sizeof(value), value, 0, NULL, 0, NULL, &view);
+	swi_linux_uart_get_stats(&stats, 1);
+	// echo of the command packet and the Transmit flag, then the response
+	wait_max_us = (uint32_t) ((1 + WRITE_COUNT_SHORT) + 1 + WRITE_RSP_SIZE) * 8 * US_PER_CHAR;
+	sha204e_swi_pty_lock();
+	ok = !memcmp(&device.config[16], value, sizeof(value));
+	sha204e_swi_pty_unlock();
+	check(ret_code == SHA204_SUCCESS && view.status == SHA204_SUCCESS && ok, "Write with a status response into a view");
+	printf("      %u us waiting, at most %u expected\n", stats.wait_us, wait_max_us);
+	check(stats.wait_us <= wait_max_us, "Wait is sized from the announced count");
+
+	ret_code = sha204m_execute_view(SHA204_READ, SHA204_ZONE_CONFIG | SHA204_ZONE_COUNT_FLAG, 0,
+				0, NULL, 0, NULL, 0, NULL, &view);
+	sha204e_swi_pty_lock();
+	ok = !memcmp(block, device.config, sizeof(block));
+	sha204e_swi_pty_unlock();
+	check(ret_code == SHA204_SUCCESS && ok, "Read of 32 configuration bytes into a view");
+
+	// A device that did not go to sleep would answer with the response
+	// of the Read instead of the Wake-up status.
+	check(sha204p_sleep() == SHA204_SUCCESS && sha204c_wakeup(rx) == SHA204_SUCCESS, "Sleep and Wake-up");
+
+	(void) sha204p_sleep();
+	swi_linux_uart_close();
+	sha204e_swi_pty_stop();
+
+	printf("%s\n", failures ? "FAILED" : "OK");
+
+	return failures ? 1 : 0;
+}
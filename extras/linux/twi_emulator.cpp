@@ -0,0 +1,514 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/** \file
+ *  \brief Model of the AVR TWI Peripheral with ATSHA204 Devices on its Bus
+ */
+
+#include <string.h>                     // memset()
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/twi.h>
+#include "Arduino.h"
+#include "timer_utilities.h"
+#include "twi_emulator.h"
+
+//! operations the peripheral runs on the bus
+enum sha204e_twi_operation {
+	TWI_IDLE,               //!< nothing is running
+	TWI_START,              //!< Start condition
+	TWI_BYTE                //!< address or data byte
+};
+
+sha204e_twcr TWCR;
+volatile uint8_t TWDR;
+volatile uint8_t TWSR = TW_NO_INFO;
+volatile uint8_t TWBR;
+
+//! devices on the bus
+static struct {
+	struct sha204e_device *device;
+	uint8_t address;                    //!< 8-bit address
+	uint32_t execution_us;              //!< time a command keeps the device busy
+	uint64_t busy_until_ns;             //!< end of the current command
+} twi_devices[SHA204E_TWI_DEVICES];
+
+//! number of entries in twi_devices
+static uint8_t twi_count;
+
+static uint64_t now_ns;                 //!< virtual time
+static uint8_t control;                 //!< TWEA, TWEN and TWIE as last written
+static uint8_t flag;                    //!< TWINT
+static uint8_t operation;               //!< running operation, see #sha204e_twi_operation
+static uint64_t done_ns;                //!< end of the running operation
+static uint8_t result;                  //!< status the running operation ends with
+static uint8_t received;                //!< byte the running read puts into TWDR
+static uint8_t owner;                   //!< 1 between Start and Stop
+static uint8_t expect_address;          //!< The next byte is an address.
+static uint8_t reading;                 //!< The addressed device is being read.
+static int addressed = -1;              //!< device that acknowledged its address, -1 for none
+static uint8_t packet[SHA204E_PACKET_MAX + 1];  //!< bytes written to the addressed device
+static uint8_t packet_count;            //!< number of bytes in packet
+static uint8_t interrupts_enabled = 1;  //!< interrupts are globally enabled
+static uint8_t in_interrupt;            //!< The interrupt routine is running.
+static uint8_t sda_low;                 //!< SDA is driven low as a GPIO
+static uint64_t sda_low_ns;             //!< time SDA went low
+static uint8_t refused_pending;         //!< A read was refused and no read followed yet.
+static uint64_t refused_ns;             //!< end of the refused read
+static uint8_t corrupt_count;           //!< responses left to corrupt
+static struct sha204e_twi_counters counters;
+
+
+/** \brief This function returns the length of one SCL period.
+ * \return time in ns at a prescaler of 1 and a 16 MHz CPU
+ */
+static uint64_t twi_scl_ns(void)
+{
+	return (16 + 2 * (uint64_t) TWBR) * 1000 / 16;
+}
+
+
+/** \brief This function starts an operation on the bus.
+ * \param[in] kind operation
+ * \param[in] periods number of SCL periods it takes
+ * \param[in] status status it ends with
+ */
+static void twi_begin(uint8_t kind, uint8_t periods, uint8_t status)
+{
+	operation = kind;
+	done_ns = now_ns + periods * twi_scl_ns();
+	result = status;
+}
+
+
+/** \brief This function finds the device at an address.
+ * \param[in] address 8-bit address, read / write bit cleared
+ * \return index into twi_devices, -1 if there is none
+ */
+static int twi_device(uint8_t address)
+{
+	int i;
+
+	for (i = 0; i < twi_count; i++) {
+		if (twi_devices[i].address == address)
+			return i;
+	}
+
+	return -1;
+}
+
+
+/** \brief This function hands what was written to the addressed device to it. */
+static void twi_end_message(void)
+{
+	struct sha204e_device *device;
+
+	if (addressed < 0 || reading || !packet_count)
+		return;
+
+	device = twi_devices[addressed].device;
+	switch (packet[0]) {
+	case 0x00:
+		sha204e_reset_io(device);
+		break;
+	case 0x01:
+	case 0x02:
+		sha204e_sleep(device);
+		break;
+	case 0x03:
+		sha204e_receive(device, &packet[1], packet_count - 1);
+		twi_devices[addressed].busy_until_ns = now_ns + twi_devices[addressed].execution_us * 1000ULL;
+		break;
+	}
+	packet_count = 0;
+}
+
+
+/** \brief This function runs the address byte in TWDR. */
+static void twi_address(void)
+{
+	uint8_t sla = TWDR;
+	int index = twi_device(sla & 0xFE);
+	struct sha204e_device *device = index < 0 ? NULL : twi_devices[index].device;
+	uint8_t ack = device && device->awake && now_ns >= twi_devices[index].busy_until_ns
+				&& !sha204e_is_busy(device);
+	uint32_t gap_us;
+
+	expect_address = 0;
+	reading = sla & 1;
+	addressed = ack ? index : -1;
+	packet_count = 0;
+
+	if (reading && refused_pending) {
+		gap_us = (uint32_t) ((now_ns - refused_ns) / 1000);
+		if (gap_us < counters.min_poll_gap_us)
+			counters.min_poll_gap_us = gap_us;
+	}
+	refused_pending = 0;
+	if (reading && device && !ack)
+		counters.refused++;
+
+	if (reading)
+		twi_begin(TWI_BYTE, 9, ack ? TW_MR_SLA_ACK : TW_MR_SLA_NACK);
+	else
+		twi_begin(TWI_BYTE, 9, ack ? TW_MT_SLA_ACK : TW_MT_SLA_NACK);
+}
+
+
+/** \brief This function sends or receives the next data byte.
+ * \param[in] acknowledge The master acknowledges the byte it reads.
+ */
+static void twi_data(uint8_t acknowledge)
+{
+	struct sha204e_device *device;
+
+	if (!reading) {
+		if (addressed >= 0 && packet_count < sizeof(packet))
+			packet[packet_count++] = TWDR;
+		twi_begin(TWI_BYTE, 9, addressed >= 0 ? TW_MT_DATA_ACK : TW_MT_DATA_NACK);
+		return;
+	}
+
+	received = 0xFF;
+	if (addressed >= 0) {
+		device = twi_devices[addressed].device;
+		received = sha204e_transmit(device);
+		if (corrupt_count && device->output_pos == device->output_count) {
+			// Flip a bit of the last CRC byte.
+			received ^= 0x01;
+			corrupt_count--;
+			counters.corrupted++;
+		}
+	}
+	twi_begin(TWI_BYTE, 9, acknowledge ? TW_MR_DATA_ACK : TW_MR_DATA_NACK);
+}
+
+
+/** \brief This function releases the bus with a Stop condition. */
+static void twi_stop(void)
+{
+	twi_end_message();
+	owner = 0;
+	addressed = -1;
+	expect_address = 0;
+	operation = TWI_IDLE;
+	TWSR = TW_NO_INFO | (TWSR & (_BV(TWPS0) | _BV(TWPS1)));
+}
+
+
+/** \brief This function ends the running operation if its time has come. */
+static void twi_update(void)
+{
+	if (operation == TWI_IDLE || now_ns < done_ns)
+		return;
+
+	operation = TWI_IDLE;
+	TWSR = result | (TWSR & (_BV(TWPS0) | _BV(TWPS1)));
+	if (result == TW_MR_DATA_ACK || result == TW_MR_DATA_NACK)
+		TWDR = received;
+	if (result == TW_MR_SLA_NACK) {
+		refused_pending = 1;
+		refused_ns = now_ns;
+	}
+	flag = 1;
+}
+
+
+/** \brief This function ends the running operation if its time has come
+ *         and runs the interrupt routine if it is due.
+ */
+static void twi_service(void)
+{
+	twi_update();
+	if (flag && (control & _BV(TWIE)) && interrupts_enabled && !in_interrupt) {
+		in_interrupt = 1;
+		counters.interrupts++;
+		TWI_vect();
+		in_interrupt = 0;
+	}
+}
+
+
+/** \brief This function lets virtual time pass.
+ * \param[in] ns time to pass
+ */
+static void twi_advance(uint64_t ns)
+{
+	uint64_t end_ns = now_ns + ns;
+
+	for (;;) {
+		twi_service();
+		if (operation != TWI_IDLE && done_ns > now_ns && done_ns < end_ns)
+			now_ns = done_ns;
+		else
+			break;
+	}
+	now_ns = end_ns;
+	twi_service();
+}
+
+
+/** \brief This function reads TWCR. It takes #SHA204E_TWI_ACCESS_NS.
+ * \return TWINT, TWEA, TWEN and TWIE. TWSTO reads 0 since Stop conditions take no time.
+ */
+sha204e_twcr::operator uint8_t() const
+{
+	now_ns += SHA204E_TWI_ACCESS_NS;
+	twi_update();
+
+	return control | (flag ? _BV(TWINT) : 0);
+}
+
+
+/** \brief This function writes TWCR.
+ *
+ * Writing TWINT as one clears the flag and starts what the other bits ask for.
+ * \param[in] value new value
+ * \return register
+ */
+sha204e_twcr& sha204e_twcr::operator=(uint8_t value)
+{
+	control = value & (_BV(TWEA) | _BV(TWEN) | _BV(TWIE));
+
+	if (!(value & _BV(TWEN))) {
+		// Disabling the peripheral releases the bus.
+		twi_stop();
+		flag = 0;
+		return *this;
+	}
+	if (!(value & _BV(TWINT)))
+		return *this;
+
+	flag = 0;
+	if (value & _BV(TWSTO)) {
+		twi_stop();
+		if (!(value & _BV(TWSTA)))
+			return *this;
+	}
+	if (value & _BV(TWSTA)) {
+		twi_end_message();
+		twi_begin(TWI_START, 1, owner ? TW_REP_START : TW_START);
+		owner = 1;
+		expect_address = 1;
+		addressed = -1;
+		return *this;
+	}
+	if (!owner)
+		return *this;
+
+	if (expect_address)
+		twi_address();
+	else
+		twi_data(value & _BV(TWEA));
+
+	return *this;
+}
+
+
+/** \brief This function removes all devices, resets the peripheral and the virtual clock. */
+void sha204e_twi_reset(void)
+{
+	twi_count = 0;
+	now_ns = 0;
+	control = flag = 0;
+	owner = 0;
+	operation = TWI_IDLE;
+	addressed = -1;
+	expect_address = reading = packet_count = 0;
+	interrupts_enabled = 1;
+	in_interrupt = 0;
+	sda_low = 0;
+	refused_pending = 0;
+	corrupt_count = 0;
+	TWSR = TW_NO_INFO;
+	TWBR = 0;
+	sha204e_twi_get_counters(NULL, 1);
+}
+
+
+/** \brief This function puts a device on the bus.
+ * \param[in] device device
+ * \param[in] address 8-bit address, read / write bit cleared
+ * \param[in] execution_us time every command keeps the device busy
+ * \return 0 on success, -1 if the bus is full or the address taken
+ */
+int sha204e_twi_attach(struct sha204e_device *device, uint8_t address, uint32_t execution_us)
+{
+	if (twi_count >= SHA204E_TWI_DEVICES || twi_device(address) >= 0)
+		return -1;
+
+	twi_devices[twi_count].device = device;
+	twi_devices[twi_count].address = address;
+	twi_devices[twi_count].execution_us = execution_us;
+	twi_devices[twi_count++].busy_until_ns = 0;
+
+	return 0;
+}
+
+
+/** \brief This function changes the time the next commands keep a device busy.
+ * \param[in] address 8-bit address of the device
+ * \param[in] execution_us time every command keeps the device busy
+ * \return 0 on success, -1 if there is no device at the address
+ */
+int sha204e_twi_set_execution(uint8_t address, uint32_t execution_us)
+{
+	int index = twi_device(address);
+
+	if (index < 0)
+		return -1;
+
+	twi_devices[index].execution_us = execution_us;
+
+	return 0;
+}
+
+
+/** \brief This function corrupts the next responses on the wire.
+ *
+ * The devices keep their responses, so they can be read again intact.
+ * \param[in] count number of responses to corrupt
+ */
+void sha204e_twi_corrupt(uint8_t count)
+{
+	corrupt_count = count;
+}
+
+
+/** \brief This function lets time pass as if the CPU was doing other work.
+ * \param[in] us time in us
+ */
+void sha204e_twi_run(uint32_t us)
+{
+	twi_advance(us * 1000ULL);
+}
+
+
+/** \brief This function returns the virtual time.
+ * \return time in us since sha204e_twi_reset()
+ */
+uint32_t sha204e_twi_now_us(void)
+{
+	return (uint32_t) (now_ns / 1000);
+}
+
+
+/** \brief This function reads the counters.
+ * \param[out] copy copy of the counters, can be NULL
+ * \param[in] reset non-zero to clear the counters after copying them
+ */
+void sha204e_twi_get_counters(struct sha204e_twi_counters *copy, uint8_t reset)
+{
+	if (copy)
+		*copy = counters;
+	if (reset) {
+		memset(&counters, 0, sizeof(counters));
+		counters.min_poll_gap_us = UINT32_MAX;
+	}
+}
+
+
+/** \brief This function returns the virtual time. It takes #SHA204E_TWI_ACCESS_NS.
+ * \return time in us
+ */
+unsigned long micros(void)
+{
+	twi_advance(SHA204E_TWI_ACCESS_NS);
+
+	return (unsigned long) (now_ns / 1000);
+}
+
+
+//! This function lets other tasks run, which takes #SHA204E_TWI_ACCESS_NS.
+void yield(void)
+{
+	twi_advance(SHA204E_TWI_ACCESS_NS);
+}
+
+
+//! This function disables interrupts.
+void noInterrupts(void)
+{
+	interrupts_enabled = 0;
+}
+
+
+//! This function enables interrupts and runs a pending interrupt routine.
+void interrupts(void)
+{
+	interrupts_enabled = 1;
+	twi_service();
+}
+
+
+/** \brief This function sets the direction of a pin. SDA is driven by digitalWrite() anyway.
+ * \param[in] pin pin
+ * \param[in] mode #INPUT or #OUTPUT
+ */
+void pinMode(uint8_t pin, uint8_t mode)
+{
+	(void) pin;
+	(void) mode;
+}
+
+
+/** \brief This function drives a pin.
+ *
+ * SDA pulled low for #SHA204E_TWI_WAKE_US while the peripheral is
+ * disabled wakes all devices up.
+ * \param[in] pin pin
+ * \param[in] value #LOW or #HIGH
+ */
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+	uint8_t i;
+
+	if (pin != SDA || (control & _BV(TWEN)))
+		return;
+
+	if (value == LOW) {
+		sda_low = 1;
+		sda_low_ns = now_ns;
+		return;
+	}
+	if (sda_low && now_ns - sda_low_ns >= SHA204E_TWI_WAKE_US * 1000ULL) {
+		for (i = 0; i < twi_count; i++)
+			sha204e_wake(twi_devices[i].device);
+		counters.wakes++;
+	}
+	sda_low = 0;
+}
+
+
+/** \brief This function waits on the virtual clock.
+ * \param[in] delay number of 10 us
+ */
+void delay_10us(uint8_t delay)
+{
+	twi_advance(delay * 10000ULL);
+}
+
+
+/** \brief This function waits on the virtual clock.
+ * \param[in] delay number of ms
+ */
+void delay_ms(uint8_t delay)
+{
+	twi_advance(delay * 1000000ULL);
+}
@@ -0,0 +1,60 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/** \file
+ *  \brief Model of the AVR TWI Peripheral with ATSHA204 Devices on its Bus
+ *
+ *         i2c_phys.c, i2c_isr_phys.c and sha204_i2c.c are compiled as C++
+ *         for the host against the headers in avr_host/. The model serves
+ *         their register accesses the way the peripheral would: a Start
+ *         condition takes one SCL period, an address or data byte nine,
+ *         then TWINT gets set and, with TWIE set, the TWI interrupt routine
+ *         runs at the next chance while interrupts are enabled.
+ *
+ *         Time is virtual. It advances with micros(), yield(), the delay
+ *         functions and every read of TWCR, so busy-wait loops terminate,
+ *         and with sha204e_twi_run() for the other work of the CPU.
+ */
+#ifndef TWI_EMULATOR_H
+#   define TWI_EMULATOR_H
+
+#include "sha204_emulator.h"
+
+#define SHA204E_TWI_DEVICES     (8)       //!< devices the bus holds
+#define SHA204E_TWI_ACCESS_NS   (500)     //!< time a register read or a call of micros() takes
+#define SHA204E_TWI_WAKE_US     (60)      //!< low time of SDA that wakes the devices up
+
+//! what happened on the bus
+struct sha204e_twi_counters {
+	uint32_t interrupts;        //!< calls of the TWI interrupt routine
+	uint32_t refused;           //!< reads a busy or sleeping device did not acknowledge
+	uint32_t min_poll_gap_us;   //!< shortest time from a refused read to the next read, UINT32_MAX if none
+	uint32_t wakes;             //!< Wake-up pulses on SDA
+	uint32_t corrupted;         //!< responses corrupted by sha204e_twi_corrupt()
+};
+
+void     sha204e_twi_reset(void);
+int      sha204e_twi_attach(struct sha204e_device *device, uint8_t address, uint32_t execution_us);
+int      sha204e_twi_set_execution(uint8_t address, uint32_t execution_us);
+void     sha204e_twi_corrupt(uint8_t count);
+void     sha204e_twi_run(uint32_t us);
+uint32_t sha204e_twi_now_us(void);
+void     sha204e_twi_get_counters(struct sha204e_twi_counters *copy, uint8_t reset);
+
+#endif
@@ -0,0 +1,156 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/** \file
+ *  \brief Test of the Interrupt-Driven I2C Path against the TWI Model
+ *
+ *         Runs sha204_i2c.c with I2C_USE_INTERRUPTS, compiled for the host
+ *         against twi_emulator.cpp, and checks that a command started with
+ *         sha204m_start_view_P() - what AtSha204::start() runs - leaves the
+ *         CPU to other work, polls the device no faster than
+ *         #SHA204_RESPONSE_TIMEOUT and recovers from a corrupted response
+ *         and a sleeping device without blocking.
+ */
+
+#include <stdio.h>                      // printf()
+#include <string.h>                     // memcmp(), memset()
+#include "sha204_lib_return_codes.h"
+#include "sha204_comm_marshaling.h"
+#include "twi_emulator.h"
+
+#define TEST_WORK_US            (10)     //!< other work of the CPU between two polls
+#define TEST_EXECUTION_US       (RANDOM_DELAY * 1000 + 3000)  //!< time Random keeps the device busy
+#define TEST_READ_US            (1000)   //!< time Read keeps the device busy
+
+//! number of failed checks
+static int failures;
+
+
+/** \brief This function records the result of a check.
+ * \param[in] ok result of the check
+ * \param[in] what description
+ */
+static void check(int ok, const char *what)
+{
+	printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+	if (!ok)
+		failures++;
+}
+
+
+/** \brief This function runs a command without blocking.
+ * \param[in] op_code command op-code
+ * \param[in] param1 first parameter
+ * \param[out] data response data, 32 bytes
+ * \param[out] work_us time the CPU spent on other work
+ * \param[out] elapsed_us time the command took
+ * \return status of the command
+ */
+static uint8_t test_command(uint8_t op_code, uint8_t param1, uint8_t *data, uint32_t *work_us, uint32_t *elapsed_us)
+{
+	struct sha204c_exchange exchange;
+	struct sha204_command_view command;
+	struct sha204_response_view view;
+	uint32_t start_us = sha204e_twi_now_us();
+	uint8_t ret_code;
+
+	view.size = 32;
+	view.data = data;
+	*work_us = 0;
+	ret_code = sha204m_start_view_P(&exchange, &command, op_code, param1, 0,
+				0, NULL, 0, NULL, 0, NULL, 0, &view);
+	while (ret_code == SHA204_PENDING) {
+		sha204e_twi_run(TEST_WORK_US);
+		*work_us += TEST_WORK_US;
+		ret_code = sha204c_poll(&exchange);
+	}
+	*elapsed_us = sha204e_twi_now_us() - start_us;
+
+	return ret_code;
+}
+
+
+int main(void)
+{
+	static struct sha204e_device device;
+	struct sha204e_twi_counters counters;
+	struct sha204_response_view view;
+	uint8_t response[SHA204_RSP_SIZE_MAX];
+	uint8_t data[32];
+	uint32_t work_us, elapsed_us, commands;
+	uint8_t ret_code;
+
+	sha204e_twi_reset();
+	sha204e_init(&device);
+	device.busy_polls = 0;
+	sha204e_twi_attach(&device, SHA204_I2C_DEFAULT_ADDRESS, TEST_EXECUTION_US);
+	sha204p_init();
+
+	check(sha204c_wakeup(response) == SHA204_SUCCESS && device.awake, "Wake-up");
+
+	sha204e_twi_get_counters(NULL, 1);
+	ret_code = test_command(SHA204_RANDOM, RANDOM_NO_SEED_UPDATE, data, &work_us, &elapsed_us);
+	sha204e_twi_get_counters(&counters, 1);
+	printf("      %u us, %u us other work, %u interrupts, %u refused polls, %u us between polls\n",
+				elapsed_us, work_us, counters.interrupts, counters.refused, counters.min_poll_gap_us);
+	check(ret_code == SHA204_SUCCESS && data[0] == 0x5A && !memcmp(data, device.random, sizeof(data)),
+				"Random without blocking");
+	check(counters.interrupts > 0, "the transfers run from the TWI interrupt");
+	check(counters.refused > 0 && counters.min_poll_gap_us >= SHA204_RESPONSE_TIMEOUT,
+				"a busy device is polled no faster than SHA204_RESPONSE_TIMEOUT");
+	check(counters.refused <= (TEST_EXECUTION_US - RANDOM_DELAY * 1000) / SHA204_RESPONSE_TIMEOUT + 1,
+				"polls stop once the device answers");
+	check(work_us * 10 >= elapsed_us * 9, "the CPU does other work for 90 % of the command");
+
+	commands = device.commands;
+	sha204e_twi_corrupt(1);
+	ret_code = test_command(SHA204_RANDOM, RANDOM_NO_SEED_UPDATE, data, &work_us, &elapsed_us);
+	sha204e_twi_get_counters(&counters, 1);
+	check(ret_code == SHA204_SUCCESS && counters.corrupted == 1 && device.commands == commands + 1
+				&& !memcmp(data, device.random, sizeof(data)),
+				"a corrupted response is read again, not the command sent again");
+
+	sha204e_sleep(&device);
+	commands = device.commands;
+	ret_code = test_command(SHA204_RANDOM, RANDOM_NO_SEED_UPDATE, data, &work_us, &elapsed_us);
+	sha204e_twi_get_counters(&counters, 1);
+	check(ret_code == SHA204_SUCCESS && counters.wakes == 1 && device.commands == commands + 1
+				&& !memcmp(data, device.random, sizeof(data)),
+				"a sleeping device is woken up and the command sent again");
+
+	memset(data, 0, sizeof(data));
+	sha204e_twi_set_execution(SHA204_I2C_DEFAULT_ADDRESS, TEST_READ_US);
+	ret_code = test_command(SHA204_READ, SHA204_ZONE_CONFIG, data, &work_us, &elapsed_us);
+	check(ret_code == SHA204_SUCCESS && !memcmp(data, device.config, 4),
+				"a response shorter than the view lands in its buffer and CRC");
+
+	sha204e_twi_set_execution(SHA204_I2C_DEFAULT_ADDRESS, TEST_EXECUTION_US);
+	view.size = 32;
+	view.data = data;
+	ret_code = sha204m_execute_view(SHA204_RANDOM, RANDOM_NO_SEED_UPDATE, 0,
+				0, NULL, 0, NULL, 0, NULL, &view);
+	check(ret_code == SHA204_SUCCESS && !memcmp(data, device.random, sizeof(data)),
+				"blocking Random over the interrupt-driven transfers");
+
+	check(sha204p_sleep() == SHA204_SUCCESS && !device.awake, "Sleep");
+
+	printf("%s\n", failures ? "FAILED" : "OK");
+
+	return failures ? 1 : 0;
+}
@@ -18,6 +18,7 @@
  *
  */
 #include "AtSha204.h"
+#include "Sha204Packet.h"
 #include "../atsha204-atmel/sha204_physical.h"
 #include "../atsha204-atmel/sha204_comm_marshaling.h"
 #include "../atsha204-atmel/sha204_lib_return_codes.h"
@@ -26,6 +27,9 @@
 #include <string.h>
 #include <arduino.h>
 #include "../common-atmel/swi_phys.h"
+#ifdef SHA204_CONFIG_CACHE
+#include <avr/eeprom.h>
+#endif
 
 
 
@@ -40,9 +44,12 @@
 #define USE_FLAG_SLOT6		(64)
 #define USE_FLAG_SLOT7		(66)
 #define UPDATE_COUNT_SLOT7  (67)
+#define SERIAL_NUMBER_END   (13)
+#define SLOT_CONFIG_START   (20)
 
-#define USER_DATA_START_ADDR (0x120)
-#define MATING_LIMIT_START_ADDR (0x1E0)  
+#define USER_DATA_RECORD    (1)
+#define MATING_LIMIT_RECORD (2)
+#define MATING_LIMIT_SIZE   (32)
 
 
 typedef struct
@@ -53,7 +60,7 @@ typedef struct
 } slot_pair;
 
 
-const slot_pair smartid_slot_config[] = {
+const slot_pair smartid_slot_config[] PROGMEM = {
 
 	{20, {0x8F, 0x31, 0x8F, 0x32} },  // slots 0 and 1
 	{24, {0x8F, 0x8F, 0x9F, 0x8F} },  // slots 2 and 3
@@ -67,6 +74,9 @@ const slot_pair smartid_slot_config[] = {
 
 AtSha204::AtSha204(uint8_t pin)
 {
+#ifdef SHA204_MULTI_TRANSPORT
+  sha204p_select_transport(&sha204p_swi_transport);
+#endif
   
   sha204p_set_device_id(pin);	// tag development - pass in Arduino pin
   sha204p_init();
@@ -87,9 +97,36 @@ AtSha204::AtSha204(uint8_t pin)
   device_port_OUT_inst = device_port_OUT;
   device_port_IN_inst = device_port_IN;
   device_pin_inst = device_pin;
+  device_address_inst = SHA204_I2C_DEFAULT_ADDRESS;
+  selector_inst = SHA204_SELECTOR_DEFAULT;
+#ifdef SHA204_MULTI_TRANSPORT
+  transport_inst = &sha204p_swi_transport;
+#endif
 
 }
 
+#ifdef SHA204_MULTI_TRANSPORT
+/** \brief This constructor is for firmware that mixes I2C and SWI devices.
+	\param[in] transport sha204p_i2c_transport or sha204p_swi_transport
+	\param[in] id Arduino pin for SWI, I2C address for I2C
+*/
+AtSha204::AtSha204(const struct sha204_transport* transport, uint8_t id)
+{
+  transport_inst = transport;
+  sha204p_select_transport(transport);
+
+  sha204p_set_device_id(id);
+  sha204p_init();
+
+  device_port_DDR_inst = device_port_DDR;
+  device_port_OUT_inst = device_port_OUT;
+  device_port_IN_inst = device_port_IN;
+  device_pin_inst = device_pin;
+  device_address_inst = transport->addressed ? id : SHA204_I2C_DEFAULT_ADDRESS;
+  selector_inst = SHA204_SELECTOR_DEFAULT;
+}
+#endif
+
 AtSha204::~AtSha204() { }
 
 void AtSha204::idle()
@@ -99,29 +136,183 @@ void AtSha204::idle()
     sha204p_idle();
 }
 
+/** \brief This function wakes up the device whose ports are selected.
+ *
+		   When several SWI devices share the signal wire, the Wake-up
+		   token wakes up all of them. Their Wake-up responses would
+		   collide, so none is read. A Pause command with the Selector
+		   of this instance puts all others into Idle mode, and only
+		   this device answers it.
+	\return status of the operation
+*/
+uint8_t AtSha204::wakeup()
+{
+	uint8_t ret_code;
+	uint8_t rx_buffer[PAUSE_RSP_SIZE];
+
+#ifdef SHA204_SWI_MULTIDROP
+#ifdef SHA204_MULTI_TRANSPORT
+	if (!transport_inst->addressed)
+#endif
+	{
+		// sha204p_wakeup() waits tWHI after the Wake-up token.
+		ret_code = sha204p_wakeup();
+		if (ret_code == SHA204_SUCCESS)
+			ret_code = execute(SHA204_PAUSE, selector_inst, 0, 0, NULL);
+		return ret_code;
+	}
+#endif
+
+	ret_code = sha204c_wakeup(rx_buffer);
+
+	return ret_code;
+}
+
+/** \brief This function sets the Selector of this instance.
+ *
+		   It has an effect only with SHA204_SWI_MULTIDROP. The value has to
+		   match the Selector byte at configuration zone address 85.
+	\param[in] selector Selector byte of the device
+*/
+void AtSha204::setSelector(uint8_t selector)
+{
+	selector_inst = selector;
+}
+
+/** \brief This function returns the Selector of this instance.
+	\return Selector byte of the device
+*/
+uint8_t AtSha204::getSelector(void)
+{
+	return selector_inst;
+}
+
+/** \brief This function reads 32 random bytes into rsp.
+ *
+ *  The bytes run through the health tests, see check_random().
+	\return status of the operation, #SHA204_HEALTH_FAIL if a health test failed
+*/
 uint8_t AtSha204::getRandom()
 {
   volatile uint8_t ret_code;
 
-  uint8_t *random = &this->temp[SHA204_BUFFER_POS_DATA];
+  if (this->health.failed)
+  {
+	  this->rsp.clear();
+	  return SHA204_HEALTH_FAIL;
+  }
 
   setSwiPorts();
 
-  sha204p_wakeup();
+  wakeup();
 
-  ret_code = sha204m_random(this->command, this->temp, RANDOM_NO_SEED_UPDATE);
+  // The random number goes straight into rsp.
+  ret_code = execute_packet(Sha204RandomPacket::bytes, 32, this->rsp.getWritePointer(32));
+  if (ret_code == SHA204_SUCCESS)
+	  ret_code = check_random(this->rsp.getPointer(), 32);
   if (ret_code != SHA204_SUCCESS)
   {
+	  this->rsp.clear();
 	  sha204p_sleep();
 	  return ret_code;
   }
 
-  this->rsp.copyBufferFrom(random, 32);
-
 
   return ret_code;
 }
 
+/** \brief This function reads 32 random bytes in a wake session of their own.
+ *
+ *  The bytes run through the health tests, see check_random(). They
+ *  are erased if a test fails.
+	\param[out] random where the 32 bytes go
+	\return status of the operation, #SHA204_HEALTH_FAIL if a health test failed
+*/
+uint8_t AtSha204::getRandom(uint8_t* random)
+{
+	uint8_t ret_code;
+
+	if (this->health.failed)
+		return SHA204_HEALTH_FAIL;
+
+	setSwiPorts();
+
+	ret_code = wakeup();
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+
+	ret_code = execute_packet(Sha204RandomPacket::bytes, 32, random);
+
+	sha204p_sleep();
+
+	if (ret_code == SHA204_SUCCESS)
+		ret_code = check_random(random, 32);
+	if (ret_code == SHA204_HEALTH_FAIL)
+		memset(random, 0, 32);
+
+	return ret_code;
+}
+
+/** \brief This function runs the health tests on random bytes.
+ *
+ *  The repetition count and adaptive proportion tests of NIST SP 800-90B
+ *  4.4 take a constant time per byte, and their state carries over from
+ *  one Random to the next. A response of 0xFFFF0000FFFF0000..., which an
+ *  unlocked device returns, fails at once. Once a test failed, getRandom()
+ *  fails without using the device until resetHealthTests() is called.
+	\param[in] random random bytes
+	\param[in] length number of bytes
+	\return #SHA204_SUCCESS or #SHA204_HEALTH_FAIL
+*/
+uint8_t AtSha204::check_random(const uint8_t* random, uint8_t length)
+{
+	struct sha204_health* h = &this->health;
+	uint8_t unlocked = (length == 32);
+	uint8_t i;
+
+	for (i = 0; i < length; i++)
+	{
+		if (random[i] != ((i & 2) ? 0x00 : 0xFF))
+			unlocked = 0;
+
+		// repetition count test
+		if (h->rct_count && random[i] == h->rct_value)
+		{
+			if (++h->rct_count >= SHA204_HEALTH_RCT_CUTOFF)
+				h->failed = 1;
+		}
+		else
+		{
+			h->rct_value = random[i];
+			h->rct_count = 1;
+		}
+
+		// adaptive proportion test
+		if (!h->apt_index)
+		{
+			h->apt_value = random[i];
+			h->apt_count = 1;
+		}
+		else if (random[i] == h->apt_value && ++h->apt_count >= SHA204_HEALTH_APT_CUTOFF)
+			h->failed = 1;
+		if (++h->apt_index >= SHA204_HEALTH_APT_WINDOW)
+			h->apt_index = 0;
+	}
+
+	if (unlocked)
+		h->failed = 1;
+
+	return h->failed ? SHA204_HEALTH_FAIL : SHA204_SUCCESS;
+}
+
+/** \brief This function clears the state of the health tests, e.g. after
+ *  the configuration zone was locked.
+ */
+void AtSha204::resetHealthTests(void)
+{
+	memset(&this->health, 0, sizeof(this->health));
+}
+
 
 void AtSha204::enableDebug(Stream* stream)
 {
@@ -130,143 +321,985 @@ void AtSha204::enableDebug(Stream* stream)
 
 
 
-uint8_t AtSha204::read_zone(uint8_t zone, uint16_t address, uint8_t* zone_data)
+/** \brief This function runs a command without assembling it in a buffer.
+ *
+		   The data blocks are sent from where they are. The response data
+		   go straight into \a data.
+	\param[in] op_code command op-code
+	\param[in] param1 first parameter
+	\param[in] param2 second parameter
+	\param[in] size number of response data bytes, 1 for the status byte of a status response
+	\param[out] data where the response data go, can be NULL if they are not needed
+	\param[in] datalen1 number of bytes in first data block
+	\param[in] data1 pointer to first data block
+	\param[in] datalen2 number of bytes in second data block
+	\param[in] data2 pointer to second data block
+	\param[in] datalen3 number of bytes in third data block
+	\param[in] data3 pointer to third data block
+	\param[in] progmem data blocks in program memory, see #SHA204_DATA_PROGMEM
+	\return status of the operation
+*/
+uint8_t AtSha204::execute(uint8_t op_code, uint8_t param1, uint16_t param2, uint8_t size, uint8_t* data,
+			uint8_t datalen1, uint8_t* data1, uint8_t datalen2, uint8_t* data2, uint8_t datalen3, uint8_t* data3,
+			uint8_t progmem)
 {
+	struct sha204_response_view view;
+	uint8_t status;
 
-	// declared as "volatile" for easier debugging
-	volatile uint8_t ret_code;
+	uint8_t ret_code;
 
-	//uint16_t config_address;
+	view.size = data ? size : sizeof(status);
+	view.data = data ? data : &status;
 
-	// Make the command buffer the size of the Read command.
-	uint8_t command[READ_COUNT];
+	ret_code = sha204m_execute_view_P(op_code, param1, param2, datalen1, data1, datalen2, data2, datalen3, data3,
+				progmem, &view);
+	executed(op_code, param1, param2, datalen1, data1, progmem, ret_code);
 
-	// Make the response buffer the size of the maximum Read response.
-	uint8_t response[READ_32_RSP_SIZE];
+	return ret_code;
+}
 
-	// Use this buffer to read the last 24 bytes in 4-byte junks.
-	uint8_t response_read_4[READ_4_RSP_SIZE];
 
-	uint8_t* p_response;
+/** \brief This function keeps what this instance knows of the device in step with a command.
+	\param[in] op_code command op-code
+	\param[in] param1 first parameter
+	\param[in] param2 second parameter
+	\param[in] datalen1 number of bytes in first data block
+	\param[in] data1 pointer to first data block
+	\param[in] progmem data blocks in program memory, see #SHA204_DATA_PROGMEM
+	\param[in] ret_code status of the command
+*/
+void AtSha204::executed(uint8_t op_code, uint8_t param1, uint16_t param2, uint8_t datalen1, const uint8_t* data1,
+			uint8_t progmem, uint8_t ret_code)
+{
+#ifdef SHA204_CONFIG_SHADOW
+	update_config(op_code, param1, param2, datalen1, data1, progmem & SHA204_DATA_PROGMEM(0), ret_code);
+#endif
+	if (op_code == SHA204_MAC || op_code == SHA204_CHECKMAC || op_code == SHA204_GENDIG
+			|| op_code == SHA204_DERIVE_KEY || op_code == SHA204_HMAC)
+		forget_counters();
+}
 
-	setSwiPorts();	
 
-	// Read first 32 bytes. Put a breakpoint after the read and inspect "response" to obtain the data.
-	ret_code = sha204c_wakeup(response);
-	if (ret_code != SHA204_SUCCESS)
+#ifdef SHA204_I2C_NON_BLOCKING
+/** \brief This function starts a command and returns without waiting for its response.
+ *
+		   It takes the parameters of execute(). The TWI interrupt sends the
+		   command and receives the response while the CPU does other work.
+		   Call poll() until it no longer returns #SHA204_PENDING. The data
+		   blocks and \a data have to stay valid until then, and no other
+		   command may be sent in the meantime. The device has to be awake.
+	\param[in] op_code command op-code
+	\param[in] param1 first parameter
+	\param[in] param2 second parameter
+	\param[in] size number of response data bytes, 1 for the status byte of a status response
+	\param[out] data where the response data go, can be NULL if they are not needed
+	\param[in] datalen1 number of bytes in first data block
+	\param[in] data1 pointer to first data block
+	\param[in] datalen2 number of bytes in second data block
+	\param[in] data2 pointer to second data block
+	\param[in] datalen3 number of bytes in third data block
+	\param[in] data3 pointer to third data block
+	\param[in] progmem data blocks in program memory, see #SHA204_DATA_PROGMEM
+	\return #SHA204_PENDING if the command is running, otherwise its status
+*/
+uint8_t AtSha204::start(uint8_t op_code, uint8_t param1, uint16_t param2, uint8_t size, uint8_t* data,
+			uint8_t datalen1, uint8_t* data1, uint8_t datalen2, uint8_t* data2, uint8_t datalen3, uint8_t* data3,
+			uint8_t progmem)
+{
+	uint8_t ret_code;
+
+	this->started_view.size = data ? size : sizeof(this->started_status);
+	this->started_view.data = data ? data : &this->started_status;
+
+	ret_code = sha204m_start_view_P(&this->exchange, &this->started, op_code, param1, param2,
+				datalen1, data1, datalen2, data2, datalen3, data3, progmem, &this->started_view);
+	this->running = (ret_code == SHA204_PENDING);
+	if (!this->running)
+		executed(op_code, param1, param2, datalen1, data1, progmem, ret_code);
+
+	return ret_code;
+}
+
+
+/** \brief This function advances the command started by start() without blocking.
+	\return #SHA204_PENDING while the command is running, otherwise its status,
+	        #SHA204_FUNC_FAIL if no command was started
+*/
+uint8_t AtSha204::poll(void)
+{
+	uint8_t* header = this->started.header;
+	uint8_t ret_code;
+
+	if (!this->running)
+		return SHA204_FUNC_FAIL;
+
+	ret_code = sha204c_poll(&this->exchange);
+	if (ret_code == SHA204_PENDING)
 		return ret_code;
 
+	this->running = 0;
+	executed(header[SHA204_OPCODE_IDX], header[SHA204_PARAM1_IDX],
+				header[SHA204_PARAM2_IDX] | (header[SHA204_PARAM2_IDX + 1] << 8),
+				this->started.datalen[0], this->started.data[0], this->started.progmem, ret_code);
 
-	memset(response, 0, sizeof(response));
-	//config_address = 0;
-	ret_code = sha204m_read(command, response, zone | READ_ZONE_MODE_32_BYTES, address);
-	sha204p_sleep();	
+	return ret_code;
+}
+#endif
+
+
+/** \brief This function sends a command packet built at compile time, see Sha204Packet.h.
+	\param[in] packet pointer to the packet in program memory
+	\param[in] size number of response data bytes, 1 for the status byte of a status response
+	\param[out] data where the response data go, can be NULL if they are not needed
+	\return status of the operation
+*/
+uint8_t AtSha204::execute_packet(const uint8_t* packet, uint8_t size, uint8_t* data)
+{
+	struct sha204_response_view view;
+	uint8_t status;
+
+	view.size = data ? size : sizeof(status);
+	view.data = data ? data : &status;
+
+	return sha204m_execute_packet_P(packet, &view);
+}
+
+
+/** \brief This function reads 4 or 32 bytes of a zone straight into a buffer.
+	\param[in] zone zone and length flag
+	\param[in] address byte address
+	\param[out] data where the bytes go
+	\return status of the operation
+*/
+uint8_t AtSha204::read_into(uint8_t zone, uint16_t address, uint8_t* data)
+{
+	uint8_t size = (zone & READ_ZONE_MODE_32_BYTES) ? SHA204_ZONE_ACCESS_32 : SHA204_ZONE_ACCESS_4;
+
+	return execute(SHA204_READ, zone, (address >> 2) & SHA204_ADDRESS_MASK, size, data);
+}
+
+
+/** \brief This function writes 4 or 32 bytes to a zone straight from a buffer.
+	\param[in] zone zone and length flag
+	\param[in] address byte address
+	\param[in] data bytes to write
+	\return status of the operation
+*/
+uint8_t AtSha204::write_from(uint8_t zone, uint16_t address, uint8_t* data)
+{
+	uint8_t size = (zone & SHA204_ZONE_COUNT_FLAG) ? SHA204_ZONE_ACCESS_32 : SHA204_ZONE_ACCESS_4;
+
+	return execute(SHA204_WRITE, zone, (address >> 2) & SHA204_ADDRESS_MASK, 0, NULL, size, data);
+}
+
+
+/** \brief This function writes 4 or 32 bytes to a zone straight from program memory.
+	\param[in] zone zone and length flag
+	\param[in] address byte address
+	\param[in] data bytes to write, in program memory
+	\return status of the operation
+*/
+uint8_t AtSha204::write_from_P(uint8_t zone, uint16_t address, const uint8_t* data)
+{
+	uint8_t size = (zone & SHA204_ZONE_COUNT_FLAG) ? SHA204_ZONE_ACCESS_32 : SHA204_ZONE_ACCESS_4;
+
+	return execute(SHA204_WRITE, zone, (address >> 2) & SHA204_ADDRESS_MASK, 0, NULL, size, (uint8_t*) data,
+				0, NULL, 0, NULL, SHA204_DATA_PROGMEM(0));
+}
+
+
+/** \brief This function checks the arguments of a byte range read.
+	\param[in] zone #SHA204_ZONE_CONFIG, #SHA204_ZONE_OTP or #SHA204_ZONE_DATA
+	\param[in] address byte address of the first byte
+	\param[in] length number of bytes to read
+	\param[in] data where the bytes go
+	\return 1 if the range can be read
+*/
+static uint8_t is_readable(uint8_t zone, uint16_t address, uint16_t length, const uint8_t* data)
+{
+	uint16_t read_address;
+
+	zone &= SHA204_ZONE_MASK;
+
+	return data && length <= sha204m_zone_size(zone)
+		&& sha204m_plan_read(zone, address, address + length, &read_address);
+}
+
+
+/** \brief This function reads a byte range of a zone in one wake session.
+ *
+ *  sha204m_plan_read() picks the 32-byte and 4-byte Reads. Bytes of a
+ *  Read that are not asked for are dropped.
+	\param[in] zone #SHA204_ZONE_CONFIG, #SHA204_ZONE_OTP or #SHA204_ZONE_DATA
+	\param[in] address byte address of the first byte
+	\param[in] length number of bytes to read
+	\param[out] data where the bytes go
+	\return status of the operation
+*/
+uint8_t AtSha204::read_bytes(uint8_t zone, uint16_t address, uint16_t length, uint8_t* data)
+{
+	uint8_t ret_code;
+
+	if (!is_readable(zone, address, length, data))
+		return SHA204_BAD_PARAM;
+
+	setSwiPorts();
+
+	ret_code = wakeup();
 	if (ret_code != SHA204_SUCCESS)
 		return ret_code;
-	
-	
 
-	if (zone_data) {
-		memcpy(zone_data, &response[SHA204_BUFFER_POS_DATA], SHA204_ZONE_ACCESS_32);
-		zone_data += SHA204_ZONE_ACCESS_32;
+	ret_code = read_bytes_awake(zone, address, length, data);
+
+	sha204p_sleep();
+
+	return ret_code;
+}
+
+
+/** \brief This function reads a byte range of a zone while the device is awake.
+ *
+ *  Like read_bytes(), but the device is neither woken up nor put to sleep.
+	\param[in] zone #SHA204_ZONE_CONFIG, #SHA204_ZONE_OTP or #SHA204_ZONE_DATA
+	\param[in] address byte address of the first byte
+	\param[in] length number of bytes to read
+	\param[out] data where the bytes go
+	\return status of the operation
+*/
+uint8_t AtSha204::read_bytes_awake(uint8_t zone, uint16_t address, uint16_t length, uint8_t* data)
+{
+	uint8_t block[SHA204_ZONE_ACCESS_32];
+	uint16_t end = address + length;
+	uint16_t read_address;
+	uint8_t size, offset, count;
+	uint8_t ret_code = SHA204_SUCCESS;
+
+	if (!is_readable(zone, address, length, data))
+		return SHA204_BAD_PARAM;
+
+	zone &= SHA204_ZONE_MASK;
+	while (address < end) {
+		size = sha204m_plan_read(zone, address, end, &read_address);
+		offset = address - read_address;
+		count = (end - address < size - offset) ? end - address : size - offset;
+
+		// Read straight into data if all bytes of the Read are needed.
+		if (count == size) {
+			ret_code = read_into(zone | (size == SHA204_ZONE_ACCESS_32 ? READ_ZONE_MODE_32_BYTES : 0),
+						read_address, data);
+		}
+		else {
+			ret_code = read_into(zone | (size == SHA204_ZONE_ACCESS_32 ? READ_ZONE_MODE_32_BYTES : 0),
+						read_address, block);
+			memcpy(data, &block[offset], count);
+		}
+		if (ret_code != SHA204_SUCCESS)
+			break;
+
+		data += count;
+		address += count;
 	}
-	// Read second 32 bytes. Put a breakpoint after the read and inspect "response" to obtain the data.
 
-	
-	memset(response, 0, sizeof(response));
-	ret_code = sha204c_wakeup(response);
-	if (ret_code != SHA204_SUCCESS)
+	return ret_code;
+}
+
+
+/** \brief This function reads configuration bytes while the device is awake.
+ *
+ *  A range inside the bytes Sha204SerialNumberPacket or
+ *  Sha204LockStatePacket reads is read with that packet, which is built
+ *  at compile time. Other ranges are read by read_bytes_awake().
+	\param[in] address byte address of the first byte
+	\param[in] length number of bytes to read
+	\param[out] data where the bytes go
+	\return status of the operation
+*/
+uint8_t AtSha204::read_config_awake(uint16_t address, uint16_t length, uint8_t* data)
+{
+	uint8_t block[SHA204_ZONE_ACCESS_32];
+	uint8_t ret_code;
+
+	if (data && address >= SHA204_LOCK_STATE_ADDRESS
+			&& address + length <= SHA204_LOCK_STATE_ADDRESS + SHA204_ZONE_ACCESS_4) {
+		ret_code = execute_packet(Sha204LockStatePacket::bytes, SHA204_ZONE_ACCESS_4, block);
+		if (ret_code == SHA204_SUCCESS)
+			memcpy(data, &block[address - SHA204_LOCK_STATE_ADDRESS], length);
 		return ret_code;
+	}
 
-	address += SHA204_ZONE_ACCESS_32;
-	memset(response, 0, sizeof(response));
-	
-	
-	ret_code = sha204m_read(command, response, zone | READ_ZONE_MODE_32_BYTES, address);
-	
-	sha204p_sleep();
-	if (ret_code != SHA204_SUCCESS)
+	// A single word is cheaper with a 4-byte Read.
+	if (data && length > SHA204_ZONE_ACCESS_4 && address + length <= SHA204_ZONE_ACCESS_32) {
+		ret_code = execute_packet(Sha204SerialNumberPacket::bytes, SHA204_ZONE_ACCESS_32, block);
+		if (ret_code == SHA204_SUCCESS)
+			memcpy(data, &block[address], length);
 		return ret_code;
+	}
 
+	return read_bytes_awake(SHA204_ZONE_CONFIG, address, length, data);
+}
 
-	if (zone_data) {
-		memcpy(zone_data, &response[SHA204_BUFFER_POS_DATA], SHA204_ZONE_ACCESS_32);
-		zone_data += SHA204_ZONE_ACCESS_32;
-	}
-		
 
-	// Read last 24 bytes in six four-byte junks.
-	memset(response, 0, sizeof(response));
-	ret_code = sha204c_wakeup(response);
-	if (ret_code != SHA204_SUCCESS)
-		return ret_code;	
-
-	address += SHA204_ZONE_ACCESS_32;
-	response[SHA204_BUFFER_POS_COUNT] = 0;
-	p_response = &response[SHA204_BUFFER_POS_DATA];
-	memset(response, 0, sizeof(response));
-	while (address < SHA204_CONFIG_SIZE) {
-		memset(response_read_4, 0, sizeof(response_read_4));
-		ret_code = sha204m_read(command, response_read_4, zone, address);
+#ifdef SHA204_CONFIG_SHADOW
+/** \brief This function returns which words of the configuration zone a byte range touches.
+	\param[in] address byte address of the first byte
+	\param[in] length number of bytes
+	\return bit n set if the range touches the word at 4 * n
+*/
+static uint32_t config_words(uint16_t address, uint16_t length)
+{
+	uint32_t words = 0;
+	uint16_t word;
+
+	for (word = address / SHA204_ZONE_ACCESS_4; word * SHA204_ZONE_ACCESS_4 < address + length; word++)
+		words |= 1UL << word;
+
+	return words;
+}
+
+
+/** \brief This function keeps the copy of the configuration zone in step with a command.
+	\param[in] op_code command op-code
+	\param[in] param1 first parameter
+	\param[in] param2 second parameter
+	\param[in] datalen number of bytes in first data block
+	\param[in] data pointer to first data block
+	\param[in] progmem first data block in program memory
+	\param[in] ret_code status of the command
+*/
+void AtSha204::update_config(uint8_t op_code, uint8_t param1, uint16_t param2, uint8_t datalen, const uint8_t* data,
+			uint8_t progmem, uint8_t ret_code)
+{
+	uint16_t address;
+
+	switch (op_code) {
+	case SHA204_WRITE:
+		if ((param1 & SHA204_ZONE_MASK) != SHA204_ZONE_CONFIG)
+			break;
+		address = (param2 & SHA204_ADDRESS_MASK) * SHA204_ZONE_ACCESS_4;
+		if (address + datalen > SHA204_CONFIG_SIZE)
+			break;
 		if (ret_code != SHA204_SUCCESS) {
-			sha204p_sleep();
+			this->config_valid &= ~config_words(address, datalen);
+			break;
+		}
+		if (progmem)
+			memcpy_P(&this->config_shadow[address], data, datalen);
+		else
+			memcpy(&this->config_shadow[address], data, datalen);
+		this->config_valid |= config_words(address, datalen);
+		break;
+
+	case SHA204_LOCK:
+		if (ret_code != SHA204_SUCCESS)
+			this->config_valid &= ~config_words(SHA204_LOCK_STATE_ADDRESS, SHA204_ZONE_ACCESS_4);
+		else if (param1 & LOCK_ZONE_NO_CONFIG)
+			this->config_shadow[SHA204_LOCK_VALUE_ADDRESS] = SHA204_LOCK_LOCKED;
+		else
+			this->config_shadow[SHA204_LOCK_CONFIG_ADDRESS] = SHA204_LOCK_LOCKED;
+		break;
+
+	case SHA204_UPDATE_EXTRA:
+		this->config_valid &= ~config_words(SHA204_LOCK_STATE_ADDRESS, SHA204_ZONE_ACCESS_4);
+		break;
+	}
+}
+#endif
+
+
+/** \brief This function forgets what is known about UseFlag, UpdateCount and LastKeyUse.
+ *
+ *  Keys with a use limit count their uses in these bytes, so commands
+ *  that use keys call it.
+*/
+void AtSha204::forget_counters(void)
+{
+	this->mating_cycles_valid = 0;
+#ifdef SHA204_CONFIG_SHADOW
+	this->config_valid &= ~config_words(SHA204_CONFIG_COUNTERS_START,
+				SHA204_CONFIG_COUNTERS_END - SHA204_CONFIG_COUNTERS_START);
+#endif
+}
+
+
+/** \brief This function reads configuration bytes, from the copy of the zone if it has them.
+ *
+ *  Without #SHA204_CONFIG_SHADOW the bytes are always read from the
+ *  device. Otherwise the words missing in the copy are read into it
+ *  first, and the bytes are taken from the copy. While the device is
+ *  awake, the reads go through read_config_awake().
+	\param[in] address byte address of the first byte
+	\param[in] length number of bytes to read
+	\param[out] data where the bytes go, or NULL to only fill the copy with #SHA204_CONFIG_SHADOW
+	\param[in] awake 1 if the device is awake and stays awake, 0 to read in a wake session of its own
+	\return status of the operation
+*/
+uint8_t AtSha204::read_config(uint16_t address, uint8_t length, uint8_t* data, uint8_t awake)
+{
+#ifdef SHA204_CONFIG_SHADOW
+	uint32_t missing;
+	uint16_t start, end;
+	uint8_t ret_code;
+
+	if (!is_readable(SHA204_ZONE_CONFIG, address, length, data ? data : this->config_shadow))
+		return SHA204_BAD_PARAM;
+
+	missing = config_words(address, length) & ~this->config_valid;
+	// Locked zones stay locked, but UpdateExtra changes the rest of word 21.
+	if (this->locks_valid && address >= SHA204_LOCK_VALUE_ADDRESS)
+		missing = 0;
+	if (missing) {
+		// One range from the first to the last missing word.
+		for (start = 0; !(missing & (1UL << (start / SHA204_ZONE_ACCESS_4))); start += SHA204_ZONE_ACCESS_4)
+			;
+		for (end = SHA204_CONFIG_SIZE; !(missing & (1UL << (end / SHA204_ZONE_ACCESS_4 - 1))); end -= SHA204_ZONE_ACCESS_4)
+			;
+		ret_code = awake ? read_config_awake(start, end - start, &this->config_shadow[start])
+				: read_bytes(SHA204_ZONE_CONFIG, start, end - start, &this->config_shadow[start]);
+		if (ret_code != SHA204_SUCCESS)
 			return ret_code;
+		this->config_valid |= missing;
+	}
+
+	if (data)
+		memcpy(data, &this->config_shadow[address], length);
+
+	return SHA204_SUCCESS;
+#else
+	return awake ? read_config_awake(address, length, data)
+			: read_bytes(SHA204_ZONE_CONFIG, address, length, data);
+#endif
+}
+
+
+#ifdef SHA204_CONFIG_CACHE
+/** \brief This function fills the copy of the configuration zone after a reset.
+ *
+ *  The first 32 bytes of the configuration zone are read in one Read.
+ *  If they match the configuration kept in EEPROM, the other bytes of
+ *  the slot configuration and the lock bytes are taken from EEPROM.
+ *  Otherwise the whole zone is read, and kept in EEPROM if the
+ *  configuration zone is locked, which is when it cannot change any more.
+ *  LockValue and LockConfig are taken from EEPROM only if both zones are
+ *  locked. UserExtra and Selector are not kept, since UpdateExtra can
+ *  change them after the lock.
+	\param[in] eeprom_address EEPROM address of a struct sha204_config_cache
+	\return status of the operation
+*/
+uint8_t AtSha204::restore_config(uint16_t eeprom_address)
+{
+	struct sha204_config_cache cache;
+	uint8_t crc[SHA204_CRC_SIZE];
+	uint8_t ret_code;
+
+	invalidate_config();
+
+	ret_code = read_config(0, SHA204_ZONE_ACCESS_32, NULL);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+
+	eeprom_read_block(&cache, (const void*) (uintptr_t) eeprom_address, sizeof(cache));
+	sha204c_calculate_crc(sizeof(cache) - sizeof(cache.crc), (uint8_t*) &cache, crc);
+
+	if (cache.version == SHA204_CONFIG_CACHE_VERSION && !memcmp(crc, cache.crc, sizeof(crc))
+			&& !memcmp(cache.config, this->config_shadow, SHA204_ZONE_ACCESS_32)) {
+		memcpy(&this->config_shadow[SHA204_ZONE_ACCESS_32], &cache.config[SHA204_ZONE_ACCESS_32],
+					sizeof(cache.config) - SHA204_ZONE_ACCESS_32);
+		this->config_valid |= config_words(0, sizeof(cache.config));
+		if (cache.lock[0] == SHA204_LOCK_LOCKED && cache.lock[1] == SHA204_LOCK_LOCKED) {
+			memcpy(&this->config_shadow[SHA204_LOCK_VALUE_ADDRESS], cache.lock, sizeof(cache.lock));
+			this->locks_valid = 1;
 		}
-		memcpy(p_response, &response_read_4[SHA204_BUFFER_POS_DATA], SHA204_ZONE_ACCESS_4);
-		p_response += SHA204_ZONE_ACCESS_4;
-		response[SHA204_BUFFER_POS_COUNT] += SHA204_ZONE_ACCESS_4; // Update count byte in virtual response packet.
-		address += SHA204_ZONE_ACCESS_4;
+		return ret_code;
 	}
-	// Put a breakpoint here and inspect "response" to obtain the data.
+
+	ret_code = read_config(0, SHA204_CONFIG_SIZE, NULL);
+	if (ret_code != SHA204_SUCCESS
+			|| this->config_shadow[SHA204_LOCK_CONFIG_ADDRESS] == SHA204_LOCK_UNLOCKED)
+		return ret_code;
+
+	cache.version = SHA204_CONFIG_CACHE_VERSION;
+	memcpy(cache.config, this->config_shadow, sizeof(cache.config));
+	memcpy(cache.lock, &this->config_shadow[SHA204_LOCK_VALUE_ADDRESS], sizeof(cache.lock));
+	sha204c_calculate_crc(sizeof(cache) - sizeof(cache.crc), (uint8_t*) &cache, cache.crc);
+	eeprom_update_block(&cache, (void*) (uintptr_t) eeprom_address, sizeof(cache));
+
+	return ret_code;
+}
+#endif
+
+
+/** \brief This function forgets the copy of the configuration zone.
+ *
+ *  Call it if something other than this instance changed the zone, or
+ *  another device took the place of this one.
+*/
+void AtSha204::invalidate_config(void)
+{
+#ifdef SHA204_CONFIG_SHADOW
+	this->config_valid = 0;
+	this->locks_valid = 0;
+#endif
+}
+
+
+/** \brief This function reads a zone from an address to its end.
+ *
+ *  At most #SHA204_CONFIG_SIZE bytes are read, which is the whole
+ *  configuration or OTP zone.
+	\param[in] zone #SHA204_ZONE_CONFIG, #SHA204_ZONE_OTP or #SHA204_ZONE_DATA
+	\param[in] address byte address of the first byte
+	\param[out] zone_data where the bytes go, or NULL to read them into rsp only
+	\return status of the operation
+*/
+uint8_t AtSha204::read_zone(uint8_t zone, uint16_t address, uint8_t* zone_data)
+{
+	uint16_t zone_size = sha204m_zone_size(zone);
+	uint8_t length;
+	uint8_t* p_data;
+	uint8_t ret_code;
+
+	if (address >= zone_size)
+		return SHA204_BAD_PARAM;
+
+	length = (zone_size - address < SHA204_CONFIG_SIZE) ? zone_size - address : SHA204_CONFIG_SIZE;
+
+	// The zone is read straight into zone_data, or into rsp if there is none.
+	p_data = zone_data ? zone_data : this->rsp.getWritePointer(length);
+
+	if ((zone & SHA204_ZONE_MASK) == SHA204_ZONE_CONFIG)
+		ret_code = read_config(address, length, p_data);
+	else
+		ret_code = read_bytes(zone, address, length, p_data);
+	if (ret_code != SHA204_SUCCESS)
+		this->rsp.clear();
+	else if (zone_data)
+		this->rsp.copyBufferFrom(zone_data, length);
+
+	return ret_code;
+}
+
+
+/** \brief This function returns which bytes of a window the edits change.
+	\param[in] edits edits
+	\param[in] count number of edits
+	\param[in] address byte address of the window
+	\param[in] size size of the window, at most 32 bytes
+	\return bit n set if the byte at address + n is edited
+*/
+static uint32_t edited_bytes(const struct sha204_write_edit* edits, uint8_t count, uint16_t address, uint8_t size)
+{
+	uint32_t edited = 0;
+	uint16_t start, end;
+	uint8_t i;
+
+	for (i = 0; i < count; i++) {
+		start = (edits[i].address > address) ? edits[i].address : address;
+		end = (edits[i].address + edits[i].length < address + size) ? edits[i].address + edits[i].length : address + size;
+		for (; start < end; start++)
+			edited |= 1UL << (start - address);
+	}
+
+	return edited;
+}
+
+
+/** \brief This function returns which words of a block are edited.
+	\param[in] edited edited bytes of the block, see edited_bytes()
+	\return bit n set if a byte of the word at block + 4 * n is edited
+*/
+static uint8_t edited_words(uint32_t edited)
+{
+	uint8_t words = 0;
+	uint8_t i;
+
+	for (i = 0; i < SHA204_ZONE_ACCESS_32 / SHA204_ZONE_ACCESS_4; i++) {
+		if ((edited >> (i * SHA204_ZONE_ACCESS_4)) & 0x0F)
+			words |= 1 << i;
+	}
+
+	return words;
+}
+
+
+/** \brief This function applies the edits to a window. Later edits win.
+	\param[in] edits edits
+	\param[in] count number of edits
+	\param[in] address byte address of the window
+	\param[in] size size of the window
+	\param[in,out] window bytes of the window
+*/
+static void apply_edits(const struct sha204_write_edit* edits, uint8_t count, uint16_t address, uint8_t size, uint8_t* window)
+{
+	uint16_t start, end;
+	uint8_t i;
+
+	for (i = 0; i < count; i++) {
+		start = (edits[i].address > address) ? edits[i].address : address;
+		end = (edits[i].address + edits[i].length < address + size) ? edits[i].address + edits[i].length : address + size;
+		if (start >= end)
+			continue;
+		if (edits[i].progmem)
+			memcpy_P(&window[start - address], &edits[i].data[start - edits[i].address], end - start);
+		else
+			memcpy(&window[start - address], &edits[i].data[start - edits[i].address], end - start);
+	}
+}
+
+
+/** \brief This function wakes the device up again before its watchdog puts it to sleep.
+	\param[in,out] wake_time time in ms at which the device was woken up
+	\return status of the operation
+*/
+uint8_t AtSha204::keep_awake(unsigned long& wake_time)
+{
+	uint8_t ret_code;
+
+	if (millis() - wake_time <= SHA204_WATCHDOG_BUDGET_MS)
+		return SHA204_SUCCESS;
+
 	sha204p_sleep();
+	ret_code = wakeup();
+	wake_time = millis();
 
-	if (ret_code == SHA204_SUCCESS && zone_data)
-		memcpy(zone_data, &response[SHA204_BUFFER_POS_DATA], SHA204_CONFIG_SIZE - 2 * SHA204_ZONE_ACCESS_32);
+	return ret_code;
+}
+
+
+/** \brief This function writes the edits of one 32-byte block while the device is awake.
+ *
+ *  sha204m_plan_write() picks one 32-byte Write or 4-byte Writes for the
+ *  block. Bytes of a Write that are not edited keep their contents. They
+ *  are taken from \a image, or read from the device if there is no image.
+	\param[in] zone #SHA204_ZONE_CONFIG, #SHA204_ZONE_OTP or #SHA204_ZONE_DATA
+	\param[in] block byte address of the block
+	\param[in] edits edits, applied in this order
+	\param[in] count number of edits
+	\param[in] data_locked 1 if the data zone is locked
+	\param[in,out] image contents of the whole zone, updated with the edits, or NULL
+	\param[in,out] wake_time time in ms at which the device was woken up, see keep_awake()
+	\return status of the operation
+*/
+uint8_t AtSha204::write_block(uint8_t zone, uint16_t block, const struct sha204_write_edit* edits, uint8_t count,
+			uint8_t data_locked, uint8_t* image, unsigned long& wake_time)
+{
+	uint8_t buffer[SHA204_ZONE_ACCESS_32];
+	uint16_t address;
+	uint8_t words, size;
+	uint8_t ret_code = SHA204_SUCCESS;
 
-	this->rsp.copyBufferFrom(zone_data, SHA204_CONFIG_SIZE);
+	words = edited_words(edited_bytes(edits, count, block, SHA204_ZONE_ACCESS_32));
+	if (!words)
+		return ret_code;
+
+	size = sha204m_plan_write(zone, block, words, data_locked);
+	if (!size)
+		return SHA204_BAD_PARAM;
 
+	for (address = block; address < block + SHA204_ZONE_ACCESS_32; address += size) {
+		if (!(words & (1 << ((address - block) / SHA204_ZONE_ACCESS_4))) && (size == SHA204_ZONE_ACCESS_4))
+			continue;
+
+		ret_code = keep_awake(wake_time);
+		if (ret_code != SHA204_SUCCESS)
+			break;
+
+		// Bytes that are not edited keep their contents.
+		if (edited_bytes(edits, count, address, size) != (size == SHA204_ZONE_ACCESS_32 ? 0xFFFFFFFFUL : 0x0FUL)) {
+			if (image)
+				memcpy(buffer, &image[address], size);
+			else if (zone == SHA204_ZONE_CONFIG)
+				ret_code = read_config(address, size, buffer, 1);
+			else
+				ret_code = read_into(zone | (size == SHA204_ZONE_ACCESS_32 ? READ_ZONE_MODE_32_BYTES : 0),
+							address, buffer);
+			if (ret_code != SHA204_SUCCESS)
+				break;
+		}
+		apply_edits(edits, count, address, size, buffer);
+
+		ret_code = write_from(zone | (size == SHA204_ZONE_ACCESS_32 ? SHA204_ZONE_COUNT_FLAG : 0), address, buffer);
+		if (ret_code != SHA204_SUCCESS)
+			break;
+		if (image)
+			memcpy(&image[address], buffer, size);
+	}
 
 	return ret_code;
+}
+
+
+/** \brief This function writes a sparse set of byte edits to a zone in one wake session.
+ *
+ *  The edits are merged per 32-byte block and written by write_block().
+ *  The device is woken up again if the session exceeds
+ *  #SHA204_WATCHDOG_BUDGET_MS.
+	\param[in] zone #SHA204_ZONE_CONFIG, #SHA204_ZONE_OTP or #SHA204_ZONE_DATA
+	\param[in] edits edits, applied in this order
+	\param[in] count number of edits
+	\param[in,out] image contents of the whole zone, updated with the edits, or NULL
+	\return status of the operation
+*/
+uint8_t AtSha204::write_edits(uint8_t zone, const struct sha204_write_edit* edits, uint8_t count, uint8_t* image)
+{
+	uint8_t lock_value;
+	uint8_t data_locked = 0;
+	uint16_t zone_size, block;
+	uint8_t words, i;
+	unsigned long wake_time;
+	uint8_t ret_code;
+
+	zone &= SHA204_ZONE_MASK;
+	zone_size = sha204m_zone_size(zone);
+	for (i = 0; i < count; i++) {
+		if (!edits[i].data || edits[i].address + edits[i].length > zone_size)
+			return SHA204_BAD_PARAM;
+	}
+
+	// Check all blocks before anything is written.
+	for (block = 0; block < zone_size; block += SHA204_ZONE_ACCESS_32) {
+		words = edited_words(edited_bytes(edits, count, block, SHA204_ZONE_ACCESS_32));
+		if (words && !sha204m_plan_write(zone, block, words, 0))
+			return SHA204_BAD_PARAM;
+	}
+
+	setSwiPorts();
+
+	ret_code = wakeup();
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+	wake_time = millis();
 
+	// Data slots of a locked data zone take 32-byte Writes only.
+	if (zone == SHA204_ZONE_DATA) {
+		ret_code = read_config(SHA204_LOCK_VALUE_ADDRESS, sizeof(lock_value), &lock_value, 1);
+		data_locked = (lock_value != SHA204_LOCK_UNLOCKED);
+	}
+
+	for (block = 0; (block < zone_size) && (ret_code == SHA204_SUCCESS); block += SHA204_ZONE_ACCESS_32)
+		ret_code = write_block(zone, block, edits, count, data_locked, image, wake_time);
 
+	sha204p_sleep();
 
+	return ret_code;
 }
 
 
-/** \brief This function configures slots for keys
+/** \brief This function puts a digest of a key into TempKey, in the device and on the host.
  *
+ *  A Nonce with a random number is followed by a GenDig of the key.
+	\param[in] key key and NumIn
+	\param[in] seed_update 1 to update the seed of the random number generator of the device
+	\param[out] temp_key TempKey of the host, ready for sha204h_encrypt() or sha204h_decrypt()
+	\return status of the operation
 */
-uint8_t AtSha204::configure_slots(void)
+uint8_t AtSha204::gen_dig(const struct sha204_data_key* key, uint8_t seed_update, struct sha204h_temp_key* temp_key)
 {
-	// declared as "volatile" for easier debugging
-	volatile uint8_t ret_code;
-	int i = 0;
+	struct sha204h_nonce_in_out nonce_param;
+	struct sha204h_gen_dig_in_out gendig_param;
+	uint8_t rand_out[NONCE_RSP_SIZE_LONG - SHA204_PACKET_OVERHEAD];
+	uint8_t mode = seed_update ? NONCE_MODE_SEED_UPDATE : NONCE_MODE_NO_SEED_UPDATE;
+	uint8_t ret_code;
 
-	// Make the command buffer the long size (32 bytes, no MAC) of the Write command.
-	uint8_t command[WRITE_COUNT_SHORT];
+	ret_code = execute(SHA204_NONCE, mode, 0, sizeof(rand_out), rand_out, NONCE_NUMIN_SIZE, (uint8_t*) key->num_in);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
 
-	uint8_t data_load[SHA204_ZONE_ACCESS_4];
+	nonce_param.mode = mode;
+	nonce_param.num_in = (uint8_t*) key->num_in;
+	nonce_param.rand_out = rand_out;
+	nonce_param.temp_key = temp_key;
+	ret_code = sha204h_nonce(&nonce_param);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+
+	ret_code = execute(SHA204_GENDIG, GENDIG_ZONE_DATA, key->key_id, 0, NULL);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
 
-	// Make the response buffer the size of a Read response.
-	uint8_t response[READ_4_RSP_SIZE];
+	gendig_param.zone = GENDIG_ZONE_DATA;
+	gendig_param.key_id = key->key_id;
+	gendig_param.stored_value = (uint8_t*) key->key;
+	gendig_param.temp_key = temp_key;
+
+	return sha204h_gen_dig(&gendig_param);
+}
+
+
+/** \brief This function reads a byte range of the data zone in one wake session.
+ *
+ *  The bytes are passed to \a sink one 32-byte block at a time, or less
+ *  at the ends of the range. With a key, whole blocks are read encrypted
+ *  with it, each after a Nonce and a GenDig. The device is woken up again
+ *  between two blocks if the session exceeds #SHA204_WATCHDOG_BUDGET_MS.
+	\param[in] offset byte address of the first byte
+	\param[in] len number of bytes to read
+	\param[in] sink function taking the bytes, returns #SHA204_DATA_END to stop early
+	\param[in] context passed to \a sink
+	\param[in] key ReadKey of the slots if they are read encrypted, or NULL
+	\return status of the operation
+*/
+uint8_t AtSha204::readData(uint16_t offset, uint16_t len, sha204_data_sink sink, void* context,
+			const struct sha204_data_key* key)
+{
+	struct sha204h_temp_key temp_key;
+	struct sha204h_decrypt_in_out decrypt_param;
+	uint8_t block[SHA204_ZONE_ACCESS_32];
+	uint16_t end = offset + len;
+	uint16_t address;
+	uint8_t* data;
+	uint8_t count;
+	unsigned long wake_time;
+	uint8_t ret_code;
+
+	if (!sink || end > SHA204_DATA_SIZE || end < offset || (key && (!key->key || !key->num_in)))
+		return SHA204_BAD_PARAM;
 
 	setSwiPorts();
 
-	// Wake up the client device.
-	ret_code = sha204c_wakeup(response);
+	ret_code = wakeup();
 	if (ret_code != SHA204_SUCCESS)
 		return ret_code;
+	wake_time = millis();
 
-	for (i = 0; i < sizeof(smartid_slot_config) / sizeof(smartid_slot_config[0]); i++) 
-	{
+	for (address = offset; address < end; address += count) {
+		count = SHA204_ZONE_ACCESS_32 - address % SHA204_ZONE_ACCESS_32;
+		if (count > end - address)
+			count = end - address;
 
-		ret_code = sha204m_write(command, response, SHA204_ZONE_CONFIG, smartid_slot_config[i].byte_address, smartid_slot_config[i].bytes, NULL);
-		//Serial.println(ret_code);
-		if (ret_code != SHA204_SUCCESS) {			
-			sha204p_sleep();
-			return ret_code;
+		ret_code = keep_awake(wake_time);
+		if (ret_code != SHA204_SUCCESS)
+			break;
+
+		if (key) {
+			ret_code = gen_dig(key, address == offset, &temp_key);
+			if (ret_code == SHA204_SUCCESS)
+				ret_code = read_into(SHA204_ZONE_DATA | READ_ZONE_MODE_32_BYTES,
+							address - address % SHA204_ZONE_ACCESS_32, block);
+			if (ret_code == SHA204_SUCCESS) {
+				decrypt_param.crypto_data = block;
+				decrypt_param.temp_key = &temp_key;
+				ret_code = sha204h_decrypt(&decrypt_param);
+			}
+			data = &block[address % SHA204_ZONE_ACCESS_32];
+		}
+		else {
+			ret_code = read_bytes_awake(SHA204_ZONE_DATA, address, count, block);
+			data = block;
 		}
+		if (ret_code != SHA204_SUCCESS)
+			break;
+
+		ret_code = sink(context, address, data, count);
+		if (ret_code != SHA204_SUCCESS)
+			break;
+	}
+
+	sha204p_sleep();
+
+	return (ret_code == SHA204_DATA_END) ? SHA204_SUCCESS : ret_code;
+}
+
+
+//! sha204_data_sink writing to the Stream in context
+static uint8_t stream_sink(void* context, uint16_t address, const uint8_t* data, uint8_t length)
+{
+	return (((Stream*) context)->write(data, length) == length) ? SHA204_SUCCESS : SHA204_FUNC_FAIL;
+}
+
+
+/** \brief This function reads a byte range of the data zone into a Stream in one wake session.
+	\param[in] offset byte address of the first byte
+	\param[in] len number of bytes to read
+	\param[in] sink Stream the bytes are written to
+	\param[in] key ReadKey of the slots if they are read encrypted, or NULL
+	\return status of the operation
+*/
+uint8_t AtSha204::readData(uint16_t offset, uint16_t len, Stream& sink, const struct sha204_data_key* key)
+{
+	return readData(offset, len, stream_sink, &sink, key);
+}
+
+
+/** \brief This function writes a byte range of the data zone in one wake session.
+ *
+ *  \a source fills in one 32-byte block at a time, or less at the ends of
+ *  the range. Blocks are written by write_block(), so bytes of a block
+ *  that are not in the range keep their contents. With a key, the range
+ *  has to be made of whole blocks, which are written encrypted with it,
+ *  each after a Nonce and a GenDig. Encrypted Writes need a locked data
+ *  zone.
+	\param[in] offset byte address of the first byte
+	\param[in] source function filling in the bytes
+	\param[in] context passed to \a source
+	\param[in] len number of bytes to write
+	\param[in] key WriteKey of the slots if they are written encrypted, or NULL
+	\return status of the operation
+*/
+uint8_t AtSha204::writeData(uint16_t offset, sha204_data_source source, void* context, uint16_t len,
+			const struct sha204_data_key* key)
+{
+	struct sha204_write_edit edit;
+	struct sha204h_temp_key temp_key;
+	struct sha204h_encrypt_in_out encrypt_param;
+	uint8_t block[SHA204_ZONE_ACCESS_32];
+	uint8_t mac[WRITE_MAC_SIZE];
+	uint8_t lock_value;
+	uint8_t data_locked;
+	uint16_t end = offset + len;
+	uint16_t address;
+	uint8_t count;
+	unsigned long wake_time;
+	uint8_t ret_code;
+
+	if (!source || end > SHA204_DATA_SIZE || end < offset
+			|| (key && (!key->key || !key->num_in || offset % SHA204_ZONE_ACCESS_32 || len % SHA204_ZONE_ACCESS_32)))
+		return SHA204_BAD_PARAM;
+
+	setSwiPorts();
+
+	ret_code = wakeup();
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+	wake_time = millis();
 
+	ret_code = read_config(SHA204_LOCK_VALUE_ADDRESS, sizeof(lock_value), &lock_value, 1);
+	data_locked = (lock_value != SHA204_LOCK_UNLOCKED);
+	if (ret_code == SHA204_SUCCESS && key && !data_locked)
+		ret_code = SHA204_FUNC_FAIL;
+
+	for (address = offset; (address < end) && (ret_code == SHA204_SUCCESS); address += count) {
+		count = SHA204_ZONE_ACCESS_32 - address % SHA204_ZONE_ACCESS_32;
+		if (count > end - address)
+			count = end - address;
+
+		ret_code = source(context, address, block, count);
+		if (ret_code != SHA204_SUCCESS)
+			break;
+
+		if (key) {
+			ret_code = keep_awake(wake_time);
+			if (ret_code == SHA204_SUCCESS)
+				ret_code = gen_dig(key, address == offset, &temp_key);
+			if (ret_code == SHA204_SUCCESS) {
+				encrypt_param.zone = SHA204_ZONE_DATA | SHA204_ZONE_COUNT_FLAG;
+				encrypt_param.address = address >> 2;
+				encrypt_param.crypto_data = block;
+				encrypt_param.mac = mac;
+				encrypt_param.temp_key = &temp_key;
+				ret_code = sha204h_encrypt(&encrypt_param);
+			}
+			if (ret_code == SHA204_SUCCESS)
+				ret_code = execute(SHA204_WRITE, SHA204_ZONE_DATA | SHA204_ZONE_COUNT_FLAG, address >> 2, 0, NULL,
+							SHA204_ZONE_ACCESS_32, block, sizeof(mac), mac);
+		}
+		else {
+			edit.address = address;
+			edit.length = count;
+			edit.progmem = 0;
+			edit.data = block;
+			ret_code = write_block(SHA204_ZONE_DATA, address - address % SHA204_ZONE_ACCESS_32, &edit, 1,
+						data_locked, NULL, wake_time);
+		}
 	}
 
 	sha204p_sleep();
@@ -274,6 +1307,47 @@ uint8_t AtSha204::configure_slots(void)
 	return ret_code;
 }
 
+
+//! sha204_data_source reading from the Stream in context
+static uint8_t stream_source(void* context, uint16_t address, uint8_t* data, uint8_t length)
+{
+	return (((Stream*) context)->readBytes((char*) data, length) == length) ? SHA204_SUCCESS : SHA204_TIMEOUT;
+}
+
+
+/** \brief This function writes a byte range of the data zone from a Stream in one wake session.
+	\param[in] offset byte address of the first byte
+	\param[in] src Stream the bytes are read from
+	\param[in] len number of bytes to write
+	\param[in] key WriteKey of the slots if they are written encrypted, or NULL
+	\return status of the operation
+*/
+uint8_t AtSha204::writeData(uint16_t offset, Stream& src, uint16_t len, const struct sha204_data_key* key)
+{
+	return writeData(offset, stream_source, &src, len, key);
+}
+
+
+/** \brief This function configures slots for keys
+ *
+*/
+uint8_t AtSha204::configure_slots(void)
+{
+	struct sha204_write_edit edits[sizeof(smartid_slot_config) / sizeof(smartid_slot_config[0])];
+	uint8_t i;
+
+	// The words of slots 6 to 15 share a block and go out in one Write.
+	for (i = 0; i < sizeof(edits) / sizeof(edits[0]); i++)
+	{
+		edits[i].address = pgm_read_byte(&smartid_slot_config[i].byte_address);
+		edits[i].length = sizeof(smartid_slot_config[i].bytes);
+		edits[i].progmem = 1;
+		edits[i].data = smartid_slot_config[i].bytes;
+	}
+
+	return write_edits(SHA204_ZONE_CONFIG, edits, sizeof(edits) / sizeof(edits[0]));
+}
+
 /** \brief This function locks configuration zone
 	It first reads it and calculates the CRC of its content.
 	It then sends a Lock command to the device.
@@ -296,26 +1370,28 @@ uint8_t AtSha204::lock_config_zone(void)
 	uint8_t config_data[SHA204_CONFIG_SIZE];
 	uint8_t crc_array[SHA204_CRC_SIZE];
 	uint16_t crc;
-	uint8_t command[LOCK_COUNT];
-	uint8_t response[LOCK_RSP_SIZE];
 
 	setSwiPorts();
 
 	sha204p_sleep();
 
-	ret_code = this->read_zone(SHA204_ZONE_CONFIG, 0, config_data);
+	ret_code = read_config(0, sizeof(config_data), config_data);
 	if (ret_code != SHA204_SUCCESS)
 		return ret_code;
 
 	// Check whether the configuration zone is locked already.
-	if (config_data[87] == 0)
+	if (config_data[SHA204_LOCK_CONFIG_ADDRESS] != SHA204_LOCK_UNLOCKED)
 		return ret_code;
 
 	sha204c_calculate_crc(sizeof(config_data), config_data, crc_array);
 	crc = (crc_array[1] << 8) + crc_array[0];
 
-	ret_code = sha204c_wakeup(response);
-	ret_code = sha204m_lock(command, response, SHA204_ZONE_CONFIG, crc);
+	ret_code = wakeup();
+	ret_code = execute(SHA204_LOCK, SHA204_ZONE_CONFIG, crc, 0, NULL);
+
+	// Random numbers are random from now on.
+	if (ret_code == SHA204_SUCCESS)
+		resetHealthTests();
 
 	return ret_code;
 
@@ -329,29 +1405,26 @@ uint8_t AtSha204::lock_data_zone(void)
 {
 
 	uint8_t ret_code;
-	uint8_t config_data[SHA204_CONFIG_SIZE];
-	uint8_t crc_array[SHA204_CRC_SIZE];
-	uint16_t crc;
-	uint8_t command[LOCK_COUNT];
-	uint8_t response[LOCK_RSP_SIZE];
+	uint8_t lock_value;
 
 	setSwiPorts();
 
 	sha204p_sleep();
 
-	ret_code = this->read_zone(SHA204_ZONE_CONFIG, 0, config_data);
+	// The data zone is locked without a CRC, so only the lock bytes are read.
+	ret_code = wakeup();
 	if (ret_code != SHA204_SUCCESS)
 		return ret_code;
 
+	ret_code = read_config(SHA204_LOCK_VALUE_ADDRESS, sizeof(lock_value), &lock_value, 1);
+
 	// Check whether the data zone is locked already.
-	if (config_data[86] == 0)
+	if (ret_code != SHA204_SUCCESS || lock_value != SHA204_LOCK_UNLOCKED) {
+		sha204p_sleep();
 		return ret_code;
+	}
 
-	sha204c_calculate_crc(sizeof(config_data), config_data, crc_array);
-	crc = (crc_array[1] << 8) + crc_array[0];
-
-	ret_code = sha204c_wakeup(response);
-	ret_code = sha204m_lock(command, response, SHA204_ZONE_OTP | LOCK_ZONE_NO_CRC, 0x00);
+	ret_code = execute(SHA204_LOCK, SHA204_ZONE_OTP | LOCK_ZONE_NO_CRC, 0x00, 0, NULL);
 
 	return ret_code;
 
@@ -374,17 +1447,10 @@ uint8_t AtSha204::write_keys(void)
 		0x8A, 0x00, 0x2C, 0x2D, 0x94, 0xEC, 0x66, 0x8C
 	};
 
-	// Make the command buffer the long size (32 bytes, no MAC) of the Write command.
-	uint8_t command[WRITE_COUNT_LONG];
-
-
-	// Make the response buffer the size of a Read response.
-	uint8_t response[READ_32_RSP_SIZE];
-
 	setSwiPorts();
 
 	// wakeup device
-	ret_code = sha204c_wakeup(response);
+	ret_code = wakeup();
 	if (ret_code != SHA204_SUCCESS)
 		return ret_code;
 
@@ -392,7 +1458,7 @@ uint8_t AtSha204::write_keys(void)
 	for (i = 0; i < sizeof(data_address)/sizeof(data_address[0]); i++)
 	{
 
-		ret_code = sha204m_write(command, response, SHA204_ZONE_COUNT_FLAG | SHA204_ZONE_DATA, data_address[i], privkey, NULL);
+		ret_code = write_from_P(SHA204_ZONE_COUNT_FLAG | SHA204_ZONE_DATA, data_address[i], privkey);
 		if (ret_code != SHA204_SUCCESS) {
 			sha204p_sleep();
 			return ret_code;
@@ -407,28 +1473,134 @@ uint8_t AtSha204::write_keys(void)
 }
 
 
+/** \brief This function provisions a device in one wake session.
+ *
+ *  The configuration bytes of \a spec are written and the configuration
+ *  zone is locked, unless it is locked already. The CRC of the Lock
+ *  command is spec.config_crc combined with the CRC of the bytes only
+ *  the device knows, which are read before anything is written. The
+ *  device refuses the Lock if its zone does not match, so the zone is
+ *  not read back. The slots and the OTP zone are then written and the
+ *  data zone is locked if spec.lock_data is set, unless the data zone is
+ *  locked already. The Lock uses spec.data_crc if the spec holds every
+ *  slot and the OTP zone, and no CRC otherwise.
+ *  The device is woken up again if the session exceeds
+ *  #SHA204_WATCHDOG_BUDGET_MS.
+	\param[in] spec target state of the device
+	\return status of the operation
+*/
+uint8_t AtSha204::provision(const struct sha204_provisioning& spec)
+{
+	uint8_t config[SHA204_CONFIG_SIZE];
+	struct sha204_write_edit edit;
+	struct sha204_slot_contents slot;
+	unsigned long wake_time;
+	uint16_t block, crc, slots_written = 0;
+	uint8_t i;
+	uint8_t ret_code;
+
+	if (!spec.config || (spec.slot_count && !spec.slots))
+		return SHA204_BAD_PARAM;
+
+	setSwiPorts();
+
+	ret_code = wakeup();
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+	wake_time = millis();
+
+	// Only the bytes the image does not hold are read.
+	memset(config, 0, sizeof(config));
+	ret_code = read_config(0, SHA204_CONFIG_WRITABLE_START, config, 1);
+	if (ret_code == SHA204_SUCCESS)
+		ret_code = read_config(SHA204_CONFIG_WRITABLE_END, SHA204_CONFIG_SIZE - SHA204_CONFIG_WRITABLE_END,
+					&config[SHA204_CONFIG_WRITABLE_END], 1);
+
+	if (ret_code == SHA204_SUCCESS && config[SHA204_LOCK_CONFIG_ADDRESS] == SHA204_LOCK_UNLOCKED)
+	{
+		edit.address = SHA204_CONFIG_WRITABLE_START;
+		edit.length = SHA204_PROVISION_CONFIG_SIZE;
+		edit.progmem = 1;
+		edit.data = spec.config;
+
+		// The edit covers whole words, so write_block() reads nothing.
+		for (block = 0; (block < SHA204_CONFIG_SIZE) && (ret_code == SHA204_SUCCESS); block += SHA204_ZONE_ACCESS_32)
+			ret_code = write_block(SHA204_ZONE_CONFIG, block, &edit, 1, 0, NULL, wake_time);
+
+		if (ret_code == SHA204_SUCCESS)
+			ret_code = keep_awake(wake_time);
+		if (ret_code == SHA204_SUCCESS)
+		{
+			crc = sha204c_update_crc(0, sizeof(config), config) ^ spec.config_crc;
+			ret_code = execute(SHA204_LOCK, SHA204_ZONE_CONFIG, crc, 0, NULL);
+		}
+		if (ret_code == SHA204_SUCCESS)
+			resetHealthTests();
+	}
+
+	if (ret_code == SHA204_SUCCESS && config[SHA204_LOCK_VALUE_ADDRESS] == SHA204_LOCK_UNLOCKED)
+	{
+		for (i = 0; (i < spec.slot_count) && (ret_code == SHA204_SUCCESS); i++)
+		{
+			memcpy_P(&slot, &spec.slots[i], sizeof(slot));
+			if (slot.slot >= sha204m_zone_size(SHA204_ZONE_DATA) / SHA204_ZONE_ACCESS_32)
+			{
+				ret_code = SHA204_BAD_PARAM;
+				break;
+			}
+			ret_code = keep_awake(wake_time);
+			if (ret_code == SHA204_SUCCESS)
+				ret_code = write_from_P(SHA204_ZONE_COUNT_FLAG | SHA204_ZONE_DATA,
+							(uint16_t) slot.slot * SHA204_ZONE_ACCESS_32, slot.data);
+			slots_written |= 1U << slot.slot;
+		}
+
+		for (block = 0; spec.otp && (block < SHA204_OTP_SIZE) && (ret_code == SHA204_SUCCESS);
+					block += SHA204_ZONE_ACCESS_32)
+		{
+			ret_code = keep_awake(wake_time);
+			if (ret_code == SHA204_SUCCESS)
+				ret_code = write_from_P(SHA204_ZONE_COUNT_FLAG | SHA204_ZONE_OTP, block, &spec.otp[block]);
+		}
+
+		if (ret_code == SHA204_SUCCESS && spec.lock_data)
+			ret_code = keep_awake(wake_time);
+		if (ret_code == SHA204_SUCCESS && spec.lock_data)
+		{
+			// Without every slot and the OTP bytes the CRC cannot be known.
+			if (spec.otp && slots_written == (uint16_t) ((1UL << SHA204_KEY_COUNT) - 1))
+				ret_code = execute(SHA204_LOCK, LOCK_ZONE_NO_CONFIG, spec.data_crc, 0, NULL);
+			else
+				ret_code = execute(SHA204_LOCK, LOCK_ZONE_NO_CONFIG | LOCK_ZONE_NO_CRC, 0x00, 0, NULL);
+		}
+	}
+
+	sha204p_sleep();
+
+	return ret_code;
+}
+
 /** \brief This function reads the serial number from the device.
  *
 		   The serial number is stored in bytes 0 to 3 and 8 to 12
 		   of the configuration zone.
-   \param[in] tx_buffer pointer to transmit buffer.
+   \param[in] tx_buffer not used, the command is sent without a buffer
 	\param[out] sn pointer to nine-byte serial number
 	\return status of the operation
 */
 uint8_t AtSha204::read_serial_number(uint8_t* tx_buffer, uint8_t* sn)
 {
-	uint8_t rx_buffer[READ_32_RSP_SIZE];
+	uint8_t config_data[SERIAL_NUMBER_END];
 
-	uint8_t status = sha204m_read(tx_buffer, rx_buffer,
-		SHA204_ZONE_COUNT_FLAG | SHA204_ZONE_CONFIG, 0);
+	uint8_t status = read_config(0, sizeof(config_data), config_data, 1);
 
 	setSwiPorts();
 
 	if (status != SHA204_SUCCESS)
 		sha204p_sleep();
 
-	memcpy(sn, &rx_buffer[SHA204_BUFFER_POS_DATA], 4);
-	memcpy(sn + 4, &rx_buffer[SHA204_BUFFER_POS_DATA + 8], 5);
+	memcpy(sn, &config_data[0], 4);
+	memcpy(sn + 4, &config_data[8], 5);
 
 	return status;
 }
@@ -694,15 +1866,19 @@ uint8_t AtSha204::getMacDigest(uint8_t *challenge, uint8_t *response_mac, uint8_
 	// declared as "volatile" for easier debugging
 	volatile uint8_t ret_code;
 
-	// Make the command buffer the maximum command size.
-	uint8_t command[SHA204_CMD_SIZE_MAX];
+	// The MAC goes straight into the response packet of the caller.
+	struct sha204_response_view view;
 
 	setSwiPorts();
 
-	sha204p_wakeup();
+	wakeup();
 
-	
-	ret_code = sha204m_mac(command, response_mac, MAC_MODE_CHALLENGE, slot, challenge);
+	view.size = MAC_RSP_SIZE - SHA204_BUFFER_POS_DATA - SHA204_CRC_SIZE;
+	view.data = &response_mac[SHA204_BUFFER_POS_DATA];
+	ret_code = sha204m_execute_view(SHA204_MAC, MAC_MODE_CHALLENGE, slot, MAC_CHALLENGE_SIZE, challenge,
+				0, NULL, 0, NULL, &view);
+	response_mac[SHA204_BUFFER_POS_COUNT] = view.count;
+	forget_counters();
 	if (ret_code != SHA204_SUCCESS) {
 		sha204p_sleep();
 		return ret_code;
@@ -722,11 +1898,11 @@ uint8_t AtSha204::deriveKeyClient(uint8_t slot, uint8_t *serialnum)
 
 	setSwiPorts();
 
-	sha204p_wakeup();	
+	wakeup();	
 
 	// Send Nonce command in pass-through mode using the random number in preparation
 	// for DeriveKey command. TempKey holds the random number after this command succeeded.
-	ret_code = sha204m_nonce(command, response_status, NONCE_MODE_PASSTHROUGH, serialnum); 
+	ret_code = execute(SHA204_NONCE, NONCE_MODE_PASSTHROUGH, 0, 0, NULL, NONCE_NUMIN_SIZE_PASSTHROUGH, serialnum);
 	if (ret_code != SHA204_SUCCESS) {
 		sha204p_sleep();
 		return ret_code;
@@ -736,7 +1912,7 @@ uint8_t AtSha204::deriveKeyClient(uint8_t slot, uint8_t *serialnum)
 
 	// Send DeriveKey command.
 	// child key = sha256(parent key[32], DeriveKey command[4], sn[3], 0[25], TempKey[32] = random)
-	ret_code = sha204m_derive_key(command, response_status, DERIVE_KEY_RANDOM_FLAG, slot, NULL);
+	ret_code = execute(SHA204_DERIVE_KEY, DERIVE_KEY_RANDOM_FLAG, slot, 0, NULL);
 	if (ret_code != SHA204_SUCCESS) {
 		sha204p_sleep();
 		return ret_code;
@@ -878,13 +2054,13 @@ uint8_t AtSha204::status()
 	setSwiPorts();
 
 	// First attempt to wakeup tag
-	uint8_t returnCode = sha204p_wakeup();
+	uint8_t returnCode = wakeup();
 
 	if (returnCode != SHA204_SUCCESS)
 		goto Finalize;	
 
 	// Read serial number	
-	returnCode = read_serial_number(command, sn);
+	returnCode = read_serial_number(NULL, sn);
 
 	if (returnCode != SHA204_SUCCESS)
 		goto Finalize;
@@ -902,175 +2078,252 @@ Finalize:
 	return returnCode;
 }
 
-//n = 2   #auths = C1 + 8C2 + 64(UpdateCount2)
+/** \brief This function counts the mating cycles from UseFlag and UpdateCount of slots 6 and 7.
+ *
+ *  See Atmel-8863-CryptoAuth-Authentication-Counting-ApplicationNote.pdf (Section 2.3).
+	\param[in] use_flags configuration bytes from UseFlag of slot 6 to UpdateCount of slot 7
+	\return count, n = 2: #auths = C1 + 8C2 + 64(UpdateCount2)
+*/
+uint32_t AtSha204::mating_count(const uint8_t* use_flags)
+{
+	return countZeroBits(use_flags[0]) + (8 * countZeroBits(use_flags[USE_FLAG_SLOT7 - USE_FLAG_SLOT6])) +
+		(64 * (uint32_t) use_flags[UPDATE_COUNT_SLOT7 - USE_FLAG_SLOT6]);
+}
+
+
+/** \brief This function returns the mating cycles.
+ *
+ *  The count of the last call or of updateMonotonicCounter() is
+ *  returned without using the bus, unless a command that uses keys was
+ *  sent since.
+	\param[out] count mating cycles, 0xFFFFFFFF on error
+	\return status of the operation
+*/
 uint8_t AtSha204::get_mating_cycles(uint32_t& count)
 {
 	uint8_t ret_code;
-	uint8_t config_data[SHA204_CONFIG_SIZE];
+	uint8_t use_flags[UPDATE_COUNT_SLOT7 - USE_FLAG_SLOT6 + 1];
+
+	if (this->mating_cycles_valid) {
+		count = this->mating_cycles;
+		return SHA204_SUCCESS;
+	}
 
 	setSwiPorts();
 
 	sha204p_sleep();
 
-	ret_code = this->read_zone(SHA204_ZONE_CONFIG, 0, config_data);
+	ret_code = this->read_config(USE_FLAG_SLOT6, sizeof(use_flags), use_flags);
 	if (ret_code != SHA204_SUCCESS)
 	{
 		count = 0xFFFFFFFF;
 		return ret_code;
 	}
 
-	// See Atmel-8863-CryptoAuth-Authentication-Counting-ApplicationNote.pdf (Section 2.3)
-	count = countZeroBits(config_data[USE_FLAG_SLOT6]) + (8 * countZeroBits(config_data[USE_FLAG_SLOT7])) +
-		(64 * config_data[UPDATE_COUNT_SLOT7]);
+	count = this->mating_cycles = mating_count(use_flags);
+	this->mating_cycles_valid = 1;
 
 	return ret_code;
 }
 
 
-uint8_t AtSha204::authenticate(void)
+/** \brief This function returns the SlotConfig word of a slot.
+	\param[in] slot slot index
+	\param[out] config SlotConfig of the slot
+	\return status of the operation
+*/
+uint8_t AtSha204::get_slot_config(uint8_t slot, uint16_t& config)
 {
+	uint8_t slot_config[2];
 	uint8_t ret_code;
 
-	setSwiPorts();
-
-	ret_code = sha204p_wakeup();
+	if (slot > SHA204_KEY_ID_MAX)
+		return SHA204_BAD_PARAM;
 
-	// **This is currently what is doing authentication since I couldn't get digests to match**
-	ret_code = this->status();
+	ret_code = read_config(SLOT_CONFIG_START + 2 * slot, sizeof(slot_config), slot_config);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
 
+	config = slot_config[0] | (slot_config[1] << 8);
 
 	return ret_code;
 }
 
 
-uint8_t AtSha204::setUserData(char* userdata)
+uint8_t AtSha204::authenticate(void)
 {
 	uint8_t ret_code;
-	uint8_t i;
-	char strSlotString[32];
-	uint16_t numIterations;
 
+	setSwiPorts();
+
+	ret_code = wakeup();
 
-	// Make the command buffer the long size (32 bytes, no MAC) of the Write command.
-	uint8_t command[WRITE_COUNT_LONG];
+	// **This is currently what is doing authentication since I couldn't get digests to match**
+	ret_code = this->status();
 
-	// Make the response buffer the size of a Read response.
-	uint8_t response[READ_32_RSP_SIZE];
 
-	uint16_t userDataLen;
-	uint16_t remainder;
+	return ret_code;
+}
 
-	setSwiPorts();
 
-	// wakeup device
-	ret_code = sha204c_wakeup(response);
+/** \brief This function reads the record directory while the device is awake.
+ *
+ *  A directory whose CRC does not match, as on a new device, is
+ *  returned empty.
+	\param[out] directory directory
+	\return status of the operation
+*/
+uint8_t AtSha204::read_directory(struct sha204_record_directory* directory)
+{
+	uint8_t crc[SHA204_CRC_SIZE];
+	uint8_t ret_code;
+
+	ret_code = read_into(SHA204_ZONE_DATA | READ_ZONE_MODE_32_BYTES, SHA204_RECORD_DIRECTORY, (uint8_t*) directory);
 	if (ret_code != SHA204_SUCCESS)
 		return ret_code;
 
-	userDataLen = strlen(userdata);
-	remainder = userDataLen % 32;
-
-	numIterations = (remainder == 0) ? userDataLen / 32 : userDataLen / 32 + 1;	
+	sha204c_calculate_crc(sizeof(directory->entries), (uint8_t*) directory->entries, crc);
+	if (memcmp(crc, directory->crc, sizeof(crc)))
+		memset(directory, 0, sizeof(*directory));
 
-	// Write to unused slots
-	for (i = 0; i < numIterations; i++)
-	{
-		memcpy(strSlotString, userdata + (i * 32), 32);			
+	return ret_code;
+}
 
-		// Last iteration we need to put terminator in correct location
-		if (i == (numIterations - 1))
-		{
-			if (remainder == 0)
-			{
-				strSlotString[0] = '\0';
-			}
-			else
-			{
-				strSlotString[remainder] = '\0';
-			}
-		}
 
-		ret_code = sha204m_write(command, response, SHA204_ZONE_COUNT_FLAG | SHA204_ZONE_DATA, USER_DATA_START_ADDR + i * 32, (uint8_t *) strSlotString, NULL);
-		if (ret_code != SHA204_SUCCESS) {
-			sha204p_sleep();
-			return ret_code;
-		}		
+/** \brief This function finds the directory entry of a record.
+	\param[in] directory directory
+	\param[in] id record id
+	\return index of the entry, or #SHA204_RECORD_BLOCKS if there is none
+*/
+static uint8_t find_record(const struct sha204_record_directory* directory, uint8_t id)
+{
+	uint8_t i;
 
+	for (i = 0; i < SHA204_RECORD_BLOCKS; i++) {
+		if (directory->entries[i].length && directory->entries[i].id == id)
+			break;
 	}
 
-	sha204p_sleep();
-
-	return ret_code;
+	return i;
 }
 
 
-uint8_t AtSha204::getUserData(char* userdata)
+/** \brief This function finds free blocks for a record.
+	\param[in] directory directory
+	\param[in] skip index of an entry whose blocks count as free, or #SHA204_RECORD_BLOCKS
+	\param[in] blocks number of blocks needed
+	\return first of the blocks, or 0 if there are not enough
+*/
+static uint8_t find_blocks(const struct sha204_record_directory* directory, uint8_t skip, uint8_t blocks)
 {
-	uint8_t ret_code;
+	uint8_t used = 0;
+	uint8_t i, j, free_blocks;
+
+	for (i = 0; i < SHA204_RECORD_BLOCKS; i++) {
+		if (i == skip || !directory->entries[i].length)
+			continue;
+		for (j = 0; j * SHA204_ZONE_ACCESS_32 < directory->entries[i].length; j++)
+			used |= 1 << (directory->entries[i].block - SHA204_RECORD_FIRST_BLOCK + j);
+	}
+
+	free_blocks = 0;
+	for (i = 0; i < SHA204_RECORD_BLOCKS; i++) {
+		free_blocks = (used & (1 << i)) ? 0 : free_blocks + 1;
+		if (free_blocks == blocks)
+			return SHA204_RECORD_FIRST_BLOCK + i + 1 - blocks;
+	}
 
-	// Make the command buffer the size of the Read command.
-	uint8_t command[READ_COUNT];
+	return 0;
+}
 
-	// Make the response buffer the size of the maximum Read response.
-	uint8_t response[READ_32_RSP_SIZE];
 
-	uint16_t address = 0x0120;
+/** \brief This function writes a record to the record store.
+ *
+ *  Records take whole blocks of slots 10 to 15, and the directory in
+ *  slot 9 holds their id, first block, length and CRC. The blocks are
+ *  written first and the directory last, with one 32-byte Write each.
+ *  A record that is replaced keeps its blocks until the directory is
+ *  written, unless there is no room for the new blocks besides them.
+	\param[in] id record id
+	\param[in] data bytes of the record
+	\param[in] length number of bytes, 0 to remove the record
+	\return status of the operation, #SHA204_INVALID_SIZE if the store is full
+*/
+uint8_t AtSha204::write_record(uint8_t id, const uint8_t* data, uint8_t length)
+{
+	struct sha204_record_directory directory;
+	uint8_t block[SHA204_ZONE_ACCESS_32];
+	uint8_t blocks = (length + SHA204_ZONE_ACCESS_32 - 1) / SHA204_ZONE_ACCESS_32;
+	uint8_t entry, first, count, i;
+	unsigned long wake_time;
+	uint8_t ret_code;
 
-	uint8_t finished = 0;
-	uint8_t j, found;
+	if ((length && !data) || length > SHA204_RECORD_SIZE_MAX)
+		return SHA204_BAD_PARAM;
 
 	setSwiPorts();
 
-	do
-	{
-		found = 0;
-
-		ret_code = sha204c_wakeup(response);
-		if (ret_code != SHA204_SUCCESS)
-			return ret_code;
+	ret_code = wakeup();
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+	wake_time = millis();
 
-		memset(response, 0, sizeof(response));
-		ret_code = sha204m_read(command, response, SHA204_ZONE_DATA | READ_ZONE_MODE_32_BYTES, address);
+	ret_code = read_directory(&directory);
+	if (ret_code != SHA204_SUCCESS) {
 		sha204p_sleep();
-		if (ret_code != SHA204_SUCCESS)
-			return ret_code;
+		return ret_code;
+	}
 
-		if (userdata) {
+	// A new record takes the first unused entry.
+	entry = find_record(&directory, id);
+	if (entry == SHA204_RECORD_BLOCKS) {
+		for (entry = 0; entry < SHA204_RECORD_BLOCKS && directory.entries[entry].length; entry++)
+			;
+	}
 
-			for (j = 0; j < 32; j++)
-			{
-				if (response[j] == 0)
-				{
-					found = 1;
-					break;
-				}
+	first = 0;
+	if (length) {
+		first = find_blocks(&directory, SHA204_RECORD_BLOCKS, blocks);
+		if (!first && entry < SHA204_RECORD_BLOCKS)
+			first = find_blocks(&directory, entry, blocks);
+		if (!first || entry == SHA204_RECORD_BLOCKS) {
+			sha204p_sleep();
+			return SHA204_INVALID_SIZE;
+		}
+	}
+	else if (entry == SHA204_RECORD_BLOCKS || !directory.entries[entry].length) {
+		// There is nothing to remove.
+		sha204p_sleep();
+		return ret_code;
+	}
 
-			}
-	
-			if (found)
-			{
-				// found termination character
-				memcpy(userdata, &response[SHA204_BUFFER_POS_DATA], j + 1);
-				finished = 1;
-			}
-			else
-			{
-				// did not find termination character
-				memcpy(userdata, &response[SHA204_BUFFER_POS_DATA], SHA204_ZONE_ACCESS_32);
-				userdata += SHA204_ZONE_ACCESS_32;
-			}
+	for (i = 0; i < blocks; i++) {
+		ret_code = keep_awake(wake_time);
+		if (ret_code != SHA204_SUCCESS)
+			break;
 
-		}
-		else
-		{
-			finished = 1;
-		}
+		count = length - i * SHA204_ZONE_ACCESS_32;
+		if (count > SHA204_ZONE_ACCESS_32)
+			count = SHA204_ZONE_ACCESS_32;
+		memset(block, 0, sizeof(block));
+		memcpy(block, &data[i * SHA204_ZONE_ACCESS_32], count);
 
-		address += 32;
+		ret_code = write_from(SHA204_ZONE_DATA | SHA204_ZONE_COUNT_FLAG, (first + i) * SHA204_ZONE_ACCESS_32, block);
+		if (ret_code != SHA204_SUCCESS)
+			break;
+	}
 
-	} while (!finished);
-		
+	if (ret_code == SHA204_SUCCESS)
+		ret_code = keep_awake(wake_time);
 
+	if (ret_code == SHA204_SUCCESS) {
+		directory.entries[entry].id = id;
+		directory.entries[entry].block = first;
+		directory.entries[entry].length = length;
+		sha204c_calculate_crc(length, (uint8_t*) data, directory.entries[entry].crc);
+		sha204c_calculate_crc(sizeof(directory.entries), (uint8_t*) directory.entries, directory.crc);
+		ret_code = write_from(SHA204_ZONE_DATA | SHA204_ZONE_COUNT_FLAG, SHA204_RECORD_DIRECTORY, (uint8_t*) &directory);
+	}
 
 	sha204p_sleep();
 
@@ -1078,117 +2331,145 @@ uint8_t AtSha204::getUserData(char* userdata)
 }
 
 
-uint8_t AtSha204::get_mating_limit(char* userdata)
+/** \brief This function reads a record from the record store.
+ *
+ *  The directory and the blocks of the record are read in one session,
+ *  with one 32-byte Read each.
+	\param[in] id record id
+	\param[out] data where the bytes of the record go
+	\param[in] size size of \a data
+	\param[out] length number of bytes of the record
+	\return status of the operation, #SHA204_FUNC_FAIL if there is no such record
+*/
+uint8_t AtSha204::read_record(uint8_t id, uint8_t* data, uint8_t size, uint8_t& length)
 {
+	struct sha204_record_directory directory;
+	uint8_t block[SHA204_ZONE_ACCESS_32];
+	uint8_t crc[SHA204_CRC_SIZE];
+	uint16_t address;
+	uint8_t entry, count, i;
 	uint8_t ret_code;
 
-	// Make the command buffer the size of the Read command.
-	uint8_t command[READ_COUNT];
-
-	// Make the response buffer the size of the maximum Read response.
-	uint8_t response[READ_32_RSP_SIZE];
-
-	uint16_t address = 0x01E0;  
-
-	uint8_t finished = 0;
-	uint8_t j, found;
+	length = 0;
+	if (!data)
+		return SHA204_BAD_PARAM;
 
 	setSwiPorts();
 
-	
-	found = 0;
-
-	ret_code = sha204c_wakeup(response);
+	ret_code = wakeup();
 	if (ret_code != SHA204_SUCCESS)
 		return ret_code;
 
-	memset(response, 0, sizeof(response));
-	ret_code = sha204m_read(command, response, SHA204_ZONE_DATA | READ_ZONE_MODE_32_BYTES, address);
-	sha204p_sleep();
-	if (ret_code != SHA204_SUCCESS)
+	ret_code = read_directory(&directory);
+	if (ret_code != SHA204_SUCCESS) {
+		sha204p_sleep();
 		return ret_code;
+	}
 
-	if (userdata) 
-	{
-
-		for (j = 0; j < 32; j++)
-		{
-			if (response[j] == 0)
-			{
-				found = 1;
-				break;
-			}
-
-		}
+	entry = find_record(&directory, id);
+	if (entry == SHA204_RECORD_BLOCKS || directory.entries[entry].length > size) {
+		sha204p_sleep();
+		return (entry == SHA204_RECORD_BLOCKS) ? SHA204_FUNC_FAIL : SHA204_INVALID_SIZE;
+	}
 
-		if (found)
-		{
-			// found termination character
-			memcpy(userdata, &response[SHA204_BUFFER_POS_DATA], j + 1);
-			finished = 1;
+	for (i = 0; i * SHA204_ZONE_ACCESS_32 < directory.entries[entry].length; i++) {
+		address = (directory.entries[entry].block + i) * SHA204_ZONE_ACCESS_32;
+		count = directory.entries[entry].length - i * SHA204_ZONE_ACCESS_32;
+		if (count > SHA204_ZONE_ACCESS_32)
+			count = SHA204_ZONE_ACCESS_32;
+
+		// Read straight into data if all bytes of the block are needed.
+		if (count == SHA204_ZONE_ACCESS_32)
+			ret_code = read_into(SHA204_ZONE_DATA | READ_ZONE_MODE_32_BYTES, address, &data[i * SHA204_ZONE_ACCESS_32]);
+		else {
+			ret_code = read_into(SHA204_ZONE_DATA | READ_ZONE_MODE_32_BYTES, address, block);
+			memcpy(&data[i * SHA204_ZONE_ACCESS_32], block, count);
 		}
-
-	}
-	else
-	{
-		finished = 1;
+		if (ret_code != SHA204_SUCCESS)
+			break;
 	}
 
 	sha204p_sleep();
 
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+
+	sha204c_calculate_crc(directory.entries[entry].length, data, crc);
+	if (memcmp(crc, directory.entries[entry].crc, sizeof(crc)))
+		return SHA204_BAD_CRC;
+
+	length = directory.entries[entry].length;
 
 	return ret_code;
 }
 
-uint8_t AtSha204::set_mating_limit(char* userdata)
+
+/** \brief This function stores a string as the user data record.
+	\param[in] userdata string, at most #SHA204_RECORD_SIZE_MAX - 1 characters
+	\return status of the operation
+*/
+uint8_t AtSha204::setUserData(char* userdata)
 {
-	uint8_t ret_code;
-	uint8_t i;
+	uint16_t userDataLen = strlen(userdata);
 
-	uint16_t userDataLen;
-	uint16_t remainder;
-	char strSlotString[32];
+	// getUserData() adds the terminator.
+	if (userDataLen + 1 > SHA204_RECORD_SIZE_MAX)
+		return SHA204_BAD_PARAM;
 
+	return write_record(USER_DATA_RECORD, (const uint8_t*) userdata, userDataLen);
+}
 
-	// Make the command buffer the long size (32 bytes, no MAC) of the Write command.
-	uint8_t command[WRITE_COUNT_LONG];
 
-	// Make the response buffer the size of a Read response.
-	uint8_t response[READ_32_RSP_SIZE];
+/** \brief This function reads the user data record as a string.
+	\param[out] userdata where the string goes, #SHA204_RECORD_SIZE_MAX bytes
+	\return status of the operation
+*/
+uint8_t AtSha204::getUserData(char* userdata)
+{
+	uint8_t length;
+	uint8_t ret_code;
 
+	if (!userdata)
+		return SHA204_BAD_PARAM;
 
-	setSwiPorts();
+	ret_code = read_record(USER_DATA_RECORD, (uint8_t*) userdata, SHA204_RECORD_SIZE_MAX - 1, length);
+	userdata[length] = '\0';
 
-	userDataLen = strlen(userdata);
-	remainder = userDataLen % 32;
+	return ret_code;
+}
 
-	// wakeup device
-	ret_code = sha204c_wakeup(response);
-	if (ret_code != SHA204_SUCCESS)
-		return ret_code;
 
+/** \brief This function reads the mating limit record as a string.
+	\param[out] userdata where the string goes, #MATING_LIMIT_SIZE bytes
+	\return status of the operation
+*/
+uint8_t AtSha204::get_mating_limit(char* userdata)
+{
+	uint8_t length;
+	uint8_t ret_code;
 
-	memcpy(strSlotString, userdata + (i * 32), 32);
+	if (!userdata)
+		return SHA204_BAD_PARAM;
 
-	if (remainder == 0)
-	{
-		strSlotString[0] = '\0';
-	}
-	else
-	{
-		strSlotString[remainder] = '\0';
-	}
-	
+	ret_code = read_record(MATING_LIMIT_RECORD, (uint8_t*) userdata, MATING_LIMIT_SIZE - 1, length);
+	userdata[length] = '\0';
 
-	ret_code = sha204m_write(command, response, SHA204_ZONE_COUNT_FLAG | SHA204_ZONE_DATA, MATING_LIMIT_START_ADDR, (uint8_t*)strSlotString , NULL);
-	if (ret_code != SHA204_SUCCESS) {
-		sha204p_sleep();
-		return ret_code;
-	}
+	return ret_code;
+}
 
-	sha204p_sleep();
 
-	return ret_code;
+/** \brief This function stores a string as the mating limit record.
+	\param[in] userdata string, at most #MATING_LIMIT_SIZE - 1 characters
+	\return status of the operation
+*/
+uint8_t AtSha204::set_mating_limit(char* userdata)
+{
+	uint16_t userDataLen = strlen(userdata);
+
+	if (userDataLen + 1 > MATING_LIMIT_SIZE)
+		return SHA204_BAD_PARAM;
+
+	return write_record(MATING_LIMIT_RECORD, (const uint8_t*) userdata, userDataLen);
 }
 
 
@@ -1199,93 +2480,106 @@ void AtSha204::setSwiPorts(void)
 	device_port_OUT = device_port_OUT_inst;
 	device_port_IN = device_port_IN_inst;
 	device_pin = device_pin_inst;
+#ifdef SHA204_MULTI_TRANSPORT
+	sha204p_select_transport(transport_inst);
+	if (transport_inst->addressed)
+		sha204p_set_device_id(device_address_inst);
+#elif defined(SHA204_I2C)
+	sha204p_set_device_id(device_address_inst);
+#endif
 }
 
-uint8_t AtSha204::updateMonotonicCounter(void)
+/** \brief This function sets the I2C address this instance talks to.
+ *
+		   Several instances with different addresses can share one bus.
+	\param[in] address I2C address of the device
+*/
+void AtSha204::setI2cAddress(uint8_t address)
 {
-	uint8_t ret_code;
-	uint8_t serialNumber[9];
-
-	static uint8_t randomnumber[32] = { 0x71, 0xE2, 0x34, 0xF3, 0xDF, 0xD4, 0x51, 0x3B,
-							  0x6E, 0x83, 0x6D, 0xF4, 0xC7, 0xBD, 0xC2, 0x1B,
-							  0xD6, 0xE2, 0xF5, 0xA7, 0x92, 0x2C, 0x64, 0xB0,
-							  0x25, 0x57, 0x15, 0xC1, 0x04, 0x49, 0xA2, 0xD0 };
-
-	uint8_t config_data[SHA204_CONFIG_SIZE];
-	static uint8_t responseClientMac[SHA204_RSP_SIZE_MAX];
-
-	setSwiPorts();
-
-	ret_code = sha204p_wakeup();	
-
+	device_address_inst = address;
+}
 
-	ret_code = this->read_serial_number(command, serialNumber);
-	if (ret_code != SHA204_SUCCESS) {
-		sha204p_sleep();
-		return ret_code;
-	}
-	
+/** \brief This function returns the I2C address this instance talks to.
+	\return I2C address of the device
+*/
+uint8_t AtSha204::getI2cAddress(void)
+{
+	return device_address_inst;
+}
 
-	// This will update slot counter(s)
-	ret_code = this->getMacDigest(randomnumber, responseClientMac, SHA204_KEY_CHILD);
-	if (ret_code != SHA204_SUCCESS) {
-		sha204p_sleep();
-		return ret_code;
-	}
+#ifdef SHA204_MULTI_TRANSPORT
+/** \brief This function returns the transport this instance talks through.
+	\return sha204p_i2c_transport or sha204p_swi_transport
+*/
+const struct sha204_transport* AtSha204::getTransport(void)
+{
+	return transport_inst;
+}
+#endif
 
-	
+/** \brief This function counts a mating event in one wake session.
+ *
+ *  A MAC with the key of slot 6 uses it once. A slot whose UseFlag
+ *  reached 0 gets its key rolled by DeriveKey, which resets UseFlag and
+ *  uses the parent key. Slot 6 is rolled first, because its parent is
+ *  slot 7. Only the word holding UseFlag and UpdateCount of slots 6 and
+ *  7 is read, after the MAC and after each roll. The count is kept for
+ *  get_mating_cycles().
+	\return status of the operation
+*/
+uint8_t AtSha204::updateMonotonicCounter(void)
+{
+	static const uint8_t challenge[MAC_CHALLENGE_SIZE] PROGMEM = {
+		0x71, 0xE2, 0x34, 0xF3, 0xDF, 0xD4, 0x51, 0x3B,
+		0x6E, 0x83, 0x6D, 0xF4, 0xC7, 0xBD, 0xC2, 0x1B,
+		0xD6, 0xE2, 0xF5, 0xA7, 0x92, 0x2C, 0x64, 0xB0,
+		0x25, 0x57, 0x15, 0xC1, 0x04, 0x49, 0xA2, 0xD0
+	};
+	uint8_t num_in[NONCE_NUMIN_SIZE_PASSTHROUGH];
+	uint8_t mac[MAC_RSP_SIZE - SHA204_PACKET_OVERHEAD];
+	uint8_t use_flags[UPDATE_COUNT_SLOT7 - USE_FLAG_SLOT6 + 1];
+	uint8_t i;
+	unsigned long wake_time;
+	uint8_t ret_code;
 
-	ret_code = sha204p_sleep();
-	if (ret_code != SHA204_SUCCESS)
-	{
-		sha204p_sleep();
-		return ret_code;
-	}
+	setSwiPorts();
 
-	/* Send DeriveKey commands (if necessary) */
-	ret_code = this->read_zone(SHA204_ZONE_CONFIG, 0, config_data);
+	ret_code = wakeup();
 	if (ret_code != SHA204_SUCCESS)
-	{
-		sha204p_sleep();
 		return ret_code;
-	}
-
-	if (config_data[USE_FLAG_SLOT6] == 0)
-	{
-		ret_code = this->deriveKeyClient(6, serialNumber);
-
-		if (ret_code != SHA204_SUCCESS) {
-			sha204p_sleep();
-			return ret_code;
-		}
-	}
+	wake_time = millis();
 
-	ret_code = sha204p_sleep();
-	if (ret_code != SHA204_SUCCESS)
-	{
-		sha204p_sleep();
-		return ret_code;
-	}
+	// The serial number, padded with zeros, goes into TempKey for DeriveKey.
+	memset(num_in, 0, sizeof(num_in));
+	ret_code = read_serial_number(NULL, num_in);
 
-	ret_code = this->read_zone(SHA204_ZONE_CONFIG, 0, config_data);
-	if (ret_code != SHA204_SUCCESS)
-	{
-		sha204p_sleep();
-		return ret_code;
+	// This will update slot counter(s)
+	if (ret_code == SHA204_SUCCESS)
+		ret_code = execute(SHA204_MAC, MAC_MODE_CHALLENGE, SHA204_KEY_CHILD, sizeof(mac), mac,
+					sizeof(challenge), (uint8_t*) challenge, 0, NULL, 0, NULL, SHA204_DATA_PROGMEM(0));
+	if (ret_code == SHA204_SUCCESS)
+		ret_code = read_config(USE_FLAG_SLOT6, sizeof(use_flags), use_flags, 1);
+
+	for (i = 0; (i < 2) && (ret_code == SHA204_SUCCESS); i++) {
+		if (use_flags[i * (USE_FLAG_SLOT7 - USE_FLAG_SLOT6)] != 0)
+			continue;
+
+		ret_code = keep_awake(wake_time);
+		if (ret_code == SHA204_SUCCESS)
+			ret_code = execute(SHA204_NONCE, NONCE_MODE_PASSTHROUGH, 0, 0, NULL, sizeof(num_in), num_in);
+		if (ret_code == SHA204_SUCCESS)
+			ret_code = execute(SHA204_DERIVE_KEY, DERIVE_KEY_RANDOM_FLAG, SHA204_KEY_CHILD + i, 0, NULL);
+		if (ret_code == SHA204_SUCCESS)
+			ret_code = read_config(USE_FLAG_SLOT6, sizeof(use_flags), use_flags, 1);
 	}
 
-	if (config_data[USE_FLAG_SLOT7] == 0)
-	{
-		ret_code = this->deriveKeyClient(7, serialNumber);
+	sha204p_sleep();
 
-		if (ret_code != SHA204_SUCCESS) {
-			sha204p_sleep();
-			return ret_code;
-		}
+	if (ret_code == SHA204_SUCCESS) {
+		this->mating_cycles = mating_count(use_flags);
+		this->mating_cycles_valid = 1;
 	}
 
-	sha204p_sleep();	
-
 	return ret_code;
 }
 
@@ -1295,17 +2589,13 @@ uint8_t AtSha204::authenticate_mac(AtSha204& hostTag)
 	// declared as "volatile" for easier debugging
 	volatile uint8_t ret_code;
 
-	static uint8_t response_random[RANDOM_RSP_SIZE];
-	uint8_t* random = &response_random[SHA204_BUFFER_POS_DATA];
-
-	// Make the command buffer the minimum size of the Write command.
-	uint8_t command[SHA204_CMD_SIZE_MAX];
+	static uint8_t random[32];
 
-	// Make the response buffer the maximum size.
-	uint8_t response_status[SHA204_RSP_SIZE_MIN];
+	// status byte of the CheckMac response
+	uint8_t response_status;
 
-	// MAC response buffer
-	uint8_t response_mac[SHA204_RSP_SIZE_MAX];
+	// MAC response data
+	uint8_t response_mac[CHECKMAC_CLIENT_RESPONSE_SIZE];
 
 	// We need this buffer for the DeriveKey, GenDig, and CheckMac command.
 	uint8_t other_data[CHECKMAC_OTHER_DATA_SIZE];
@@ -1343,7 +2633,7 @@ uint8_t AtSha204::authenticate_mac(AtSha204& hostTag)
 	hostTag.setSwiPorts();
 
 
-	ret_code = sha204c_wakeup(response_status);
+	ret_code = hostTag.wakeup();
 	//if (ret_code != SHA204_SUCCESS)
 	//	return ret_code;
 	
@@ -1353,7 +2643,7 @@ uint8_t AtSha204::authenticate_mac(AtSha204& hostTag)
 	// No need to update the seed because it gets updated with every wake / sleep
 	// cycle anyway.
 	// ---------------------------------------------------------------------------
-	ret_code = sha204m_random(command, response_random, RANDOM_NO_SEED_UPDATE);
+	ret_code = execute(SHA204_RANDOM, RANDOM_NO_SEED_UPDATE, 0, sizeof(random), random);
 	if (ret_code != SHA204_SUCCESS) {
 		sha204p_sleep();
 		Serial.println(ret_code);
@@ -1385,12 +2675,15 @@ uint8_t AtSha204::authenticate_mac(AtSha204& hostTag)
 		return ret_code;
 	}*/
 
-	// Copy op-code and parameters to command_derive_key to be used in subsequent GenDig and CheckMac
+	// Op-code and parameters of the DeriveKey command to be used in subsequent GenDig and CheckMac
 	// host commands.
-	memcpy(command_derive_key, &command[SHA204_OPCODE_IDX], sizeof(command_derive_key));
+	command_derive_key[0] = SHA204_DERIVE_KEY;
+	command_derive_key[1] = DERIVE_KEY_RANDOM_FLAG;
+	command_derive_key[2] = SHA204_KEY_CHILD;
+	command_derive_key[3] = 0;
 
 	// Send Nonce command in preparation for MAC command.
-	ret_code = sha204m_nonce(command, response_status, NONCE_MODE_PASSTHROUGH, random);
+	ret_code = execute(SHA204_NONCE, NONCE_MODE_PASSTHROUGH, 0, 0, NULL, NONCE_NUMIN_SIZE_PASSTHROUGH, random);
 	if (ret_code != SHA204_SUCCESS) {
 		sha204p_sleep();
 		return ret_code;
@@ -1401,15 +2694,18 @@ uint8_t AtSha204::authenticate_mac(AtSha204& hostTag)
 	// Send MAC command.
 	// MAC = sha256(child key[32], TempKey[32] = random, MAC command[4], 0[11], sn8[1], 0[4], sn0_1[2], 0[2])
 	// mode: first 32 bytes data slot (= child key), second 32 bytes TempKey (= random), TempKey.SourceFlag = Input
-	ret_code = sha204m_mac(command, response_mac, MAC_MODE_BLOCK2_TEMPKEY | MAC_MODE_SOURCE_FLAG_MATCH,
-		2 /*TBD*/, NULL);
+	ret_code = execute(SHA204_MAC, MAC_MODE_BLOCK2_TEMPKEY | MAC_MODE_SOURCE_FLAG_MATCH,
+		2 /*TBD*/, sizeof(response_mac), response_mac);
 	if (ret_code != SHA204_SUCCESS) {
 		sha204p_sleep();
 		return ret_code;
 	}
 
 	// Save op-code and parameters to be used in the CheckMac command for the host.
-	memcpy(command_mac, &command[SHA204_OPCODE_IDX], sizeof(command_mac));
+	command_mac[0] = SHA204_MAC;
+	command_mac[1] = MAC_MODE_BLOCK2_TEMPKEY | MAC_MODE_SOURCE_FLAG_MATCH;
+	command_mac[2] = 2 /*TBD*/;
+	command_mac[3] = 0;
 
 	// Put client device to sleep.
 	sha204p_sleep();
@@ -1423,13 +2719,13 @@ uint8_t AtSha204::authenticate_mac(AtSha204& hostTag)
 	// for GenDig command. TempKey holds the random number after this command succeeded.
 	//sha204p_set_device_id(SHA204_HOST_ADDRESS);
 
-	ret_code = sha204c_wakeup(response_status);
+	ret_code = hostTag.wakeup();
 	//if (ret_code != SHA204_SUCCESS)
 	//	return ret_code;
 
 	hostTag.setSwiPorts();
 
-	ret_code = sha204m_nonce(command, response_status, NONCE_MODE_PASSTHROUGH, random);
+	ret_code = execute(SHA204_NONCE, NONCE_MODE_PASSTHROUGH, 0, 0, NULL, NONCE_NUMIN_SIZE_PASSTHROUGH, random);
 	if (ret_code != SHA204_SUCCESS) {
 		sha204p_sleep();
 		return ret_code;
@@ -1455,12 +2751,16 @@ uint8_t AtSha204::authenticate_mac(AtSha204& hostTag)
 	//ret_code = sha204m_check_mac(command, response_status, CHECKMAC_MODE_BLOCK1_TEMPKEY| CHECKMAC_MODE_SOURCE_FLAG_MATCH,
 	//	2 /*TBD*/, random, &response_mac[SHA204_BUFFER_POS_DATA], other_data);
 
-	ret_code = sha204m_check_mac(command, response_status, CHECKMAC_MODE_BLOCK2_TEMPKEY | CHECKMAC_MODE_SOURCE_FLAG_MATCH,
-			2 /*TBD*/, random, &response_mac[SHA204_BUFFER_POS_DATA], other_data);
+	ret_code = execute(SHA204_CHECKMAC, CHECKMAC_MODE_BLOCK2_TEMPKEY | CHECKMAC_MODE_SOURCE_FLAG_MATCH,
+			2 /*TBD*/, sizeof(response_status), &response_status,
+			CHECKMAC_CLIENT_CHALLENGE_SIZE, random, CHECKMAC_CLIENT_RESPONSE_SIZE, response_mac,
+			CHECKMAC_OTHER_DATA_SIZE, other_data);
 
 	sha204p_sleep();	
 
-	ret_code = this->check_response_status(ret_code, response_status);
+	// A MAC that does not match comes back as status byte.
+	if (ret_code == SHA204_SUCCESS)
+		ret_code = response_status;
 
 	Serial.println(ret_code);
 
@@ -22,26 +22,232 @@
 
 #include <Arduino.h>
 #include "CryptoBuffer.h"
+#include "Sha204Packet.h"
 #include "../atsha204-atmel/sha204_comm_marshaling.h"
+#include "../atsha204-atmel/sha204_physical.h"
 
+/** \brief Time in ms a wake session may spend sending commands.
+ *
+ *  The watchdog puts a device to sleep 0.7 s at the earliest after it was
+ *  woken up. The budget leaves room for the longest command to finish.
+ *  Longer sessions put the device to sleep and wake it up again.
+ */
+#define SHA204_WATCHDOG_BUDGET_MS   (600)
+
+/** \brief Define this to keep a copy of the configuration zone in RAM.
+ *
+ *  The copy is filled word by word as the zone is read, and the Writes
+ *  and Locks sent by this class update it. Configuration bytes that are
+ *  in the copy are returned without using the bus. Commands that use keys
+ *  can change UseFlag, UpdateCount and LastKeyUse, so these are read from
+ *  the device again after such a command. The copy takes 92 bytes of RAM
+ *  per instance.
+ */
+// #define SHA204_CONFIG_SHADOW
+
+#define SHA204_CONFIG_COUNTERS_START  (52)  //!< byte address of UseFlag of slot 0
+#define SHA204_CONFIG_COUNTERS_END    (84)  //!< byte address following LastKeyUse
+
+/** \brief Define this to keep the locked configuration of the device in EEPROM.
+ *
+ *  restore_config() fills the copy of the configuration zone from EEPROM
+ *  after a reset, if the first 32 bytes of the zone, which include the
+ *  serial number, still match. It needs avr/eeprom.h and turns on
+ *  #SHA204_CONFIG_SHADOW.
+ */
+// #define SHA204_CONFIG_CACHE
+
+#if defined(SHA204_CONFIG_CACHE) && !defined(SHA204_CONFIG_SHADOW)
+#define SHA204_CONFIG_SHADOW
+#endif
+
+#define SHA204_CONFIG_CACHE_VERSION   (2)   //!< changes when the layout of sha204_config_cache changes
+
+//! configuration kept in EEPROM by restore_config()
+struct sha204_config_cache
+{
+  uint8_t version;                                   //!< #SHA204_CONFIG_CACHE_VERSION
+  uint8_t config[SHA204_CONFIG_COUNTERS_START];      //!< bytes 0 to 51: serial number, revision, I2C, OTP mode and slot configuration
+  uint8_t lock[SHA204_LOCK_CONFIG_ADDRESS + 1 - SHA204_LOCK_VALUE_ADDRESS]; //!< bytes 86 and 87: LockValue and LockConfig
+  uint8_t crc[SHA204_CRC_SIZE];                      //!< CRC of the bytes above
+};
+
+
+/** \brief Status a sha204_data_sink returns to end AtSha204::readData() early.
+ *
+ *  readData() then succeeds.
+ */
+#define SHA204_DATA_END               ((uint8_t) 0x01)
+
+//! takes bytes read by AtSha204::readData(), returns #SHA204_SUCCESS to go on
+typedef uint8_t (*sha204_data_sink)(void* context, uint16_t address, const uint8_t* data, uint8_t length);
+//! fills in bytes written by AtSha204::writeData(), returns #SHA204_SUCCESS to go on
+typedef uint8_t (*sha204_data_source)(void* context, uint16_t address, uint8_t* data, uint8_t length);
+
+//! key of data slots that are read or written encrypted
+struct sha204_data_key
+{
+  uint8_t key_id;                     //!< slot of the key, ReadKey or WriteKey of the data slots
+  const uint8_t* key;                 //!< 32 bytes of the key
+  const uint8_t* num_in;              //!< 20 bytes of NumIn for the Nonce commands, best random
+};
+
+struct sha204h_temp_key;
+
+#define SHA204_RECORD_DIRECTORY       (0x120) //!< byte address of the record directory, slot 9
+#define SHA204_RECORD_FIRST_BLOCK     (10)    //!< first block records are stored in, slot 10
+#define SHA204_RECORD_BLOCKS          (6)     //!< number of blocks records are stored in, slots 10 to 15
+#define SHA204_RECORD_SIZE_MAX        (SHA204_RECORD_BLOCKS * SHA204_ZONE_ACCESS_32) //!< maximum size of a record
+
+//! directory entry of a record, unused if length is 0
+struct sha204_record_entry
+{
+  uint8_t id;                         //!< record id
+  uint8_t block;                      //!< first block of the record
+  uint8_t length;                     //!< number of bytes
+  uint8_t crc[SHA204_CRC_SIZE];       //!< CRC of the bytes
+};
+
+//! record directory, one 32-byte block
+struct sha204_record_directory
+{
+  struct sha204_record_entry entries[SHA204_RECORD_BLOCKS];  //!< one entry per block at most
+  uint8_t crc[SHA204_CRC_SIZE];       //!< CRC of the entries
+};
+
+//! number of configuration bytes a provisioning image holds, bytes 16 to 83
+#define SHA204_PROVISION_CONFIG_SIZE  (SHA204_CONFIG_WRITABLE_END - SHA204_CONFIG_WRITABLE_START)
+
+/** \brief CRC of a configuration zone holding \a config, with zeros in the bytes that cannot be written.
+ *
+ *  The CRC of the Lock command is linear in the bytes of the zone, so
+ *  the CRC of the device is this one XOR the CRC of a zone holding only
+ *  the serial number, revision and lock bytes of the device.
+ */
+constexpr uint16_t sha204ProvisionCrc(const uint8_t* config)
+{
+  return sha204CrcZeros(sha204CrcArray(sha204CrcZeros(0, SHA204_CONFIG_WRITABLE_START),
+                                       config, SHA204_PROVISION_CONFIG_SIZE),
+                        SHA204_CONFIG_SIZE - SHA204_CONFIG_WRITABLE_END);
+}
+
+//! contents of a data slot, see sha204_provisioning
+struct sha204_slot_contents
+{
+  uint8_t slot;                       //!< slot index
+  const uint8_t* data;                //!< 32 bytes in program memory
+};
+
+//! data of \a slot in \a slots, the last entry wins as in AtSha204::provision(), or NULL
+constexpr const uint8_t* sha204ProvisionSlot(const struct sha204_slot_contents* slots, uint8_t count, uint8_t slot)
+{
+  return !count ? nullptr
+    : slots[count - 1].slot == slot ? slots[count - 1].data
+    : sha204ProvisionSlot(slots, count - 1, slot);
+}
+
+/** \brief CRC of the data zone holding \a slots, followed by the OTP zone holding \a otp.
+ *
+ *  It is the CRC the Lock command of the data and OTP zones expects, and
+ *  only means something if \a slots holds all #SHA204_KEY_COUNT slots.
+ *  Missing slots count as zeros.
+ */
+constexpr uint16_t sha204ProvisionDataCrc(const struct sha204_slot_contents* slots, uint8_t count,
+                                          const uint8_t* otp, uint16_t crc = 0, uint8_t slot = 0)
+{
+  return slot == SHA204_KEY_COUNT ? sha204CrcArray(crc, otp, SHA204_OTP_SIZE)
+    : sha204ProvisionDataCrc(slots, count, otp,
+                             sha204ProvisionSlot(slots, count, slot)
+                               ? sha204CrcArray(crc, sha204ProvisionSlot(slots, count, slot), SHA204_KEY_SIZE)
+                               : sha204CrcZeros(crc, SHA204_KEY_SIZE),
+                             slot + 1);
+}
+
+/** \brief Target state of a device, see AtSha204::provision().
+ *
+ *  Declare it constexpr so that the CRCs are computed at compile time:
+ *
+ *      constexpr uint8_t config[SHA204_PROVISION_CONFIG_SIZE] PROGMEM = { ... };
+ *      constexpr struct sha204_slot_contents slots[] PROGMEM = { {0, key}, {1, key}, ... {15, key} };
+ *      constexpr uint8_t otp[SHA204_OTP_SIZE] PROGMEM = { ... };
+ *      constexpr struct sha204_provisioning spec = {
+ *        config, sha204ProvisionCrc(config), slots, 16, 1, otp, sha204ProvisionDataCrc(slots, 16, otp)
+ *      };
+ *
+ *  The data and OTP zones are locked with data_crc only if slots holds
+ *  all #SHA204_KEY_COUNT slots and otp is set, since the CRC covers both
+ *  zones and the factory contents of the others are not known. A partial
+ *  spec leaves otp and data_crc out and is locked without a CRC, so
+ *  nothing checks that the device received what was sent.
+ */
+struct sha204_provisioning
+{
+  const uint8_t* config;              //!< configuration bytes 16 to 83 in program memory
+  uint16_t config_crc;                //!< sha204ProvisionCrc(config)
+  const struct sha204_slot_contents* slots;  //!< data slots to write, in program memory
+  uint8_t slot_count;                 //!< number of entries in slots
+  uint8_t lock_data;                  //!< 1 to lock the data and OTP zones after the slots are written
+  const uint8_t* otp;                 //!< 64 OTP bytes in program memory, or NULL to leave the OTP zone alone
+  uint16_t data_crc;                  //!< sha204ProvisionDataCrc(slots, slot_count, otp) for a full spec
+};
+
+/** \brief Cutoff of the repetition count test on Random bytes.
+ *
+ *  The health tests of NIST SP 800-90B 4.4 assume 4 bits of min-entropy
+ *  per byte and a false alarm probability of 2^-20: 1 + 20 / 4.
+ */
+#define SHA204_HEALTH_RCT_CUTOFF      (6)
+#define SHA204_HEALTH_APT_WINDOW      (512)   //!< window of the adaptive proportion test in bytes
+#define SHA204_HEALTH_APT_CUTOFF      (62)    //!< cutoff of the adaptive proportion test for the same assumptions
+
+//! state of the health tests on Random bytes, see AtSha204::check_random()
+struct sha204_health
+{
+  uint8_t rct_value;                  //!< byte repeated in the current run
+  uint8_t rct_count;                  //!< length of the current run
+  uint8_t apt_value;                  //!< first byte of the current window
+  uint8_t apt_count;                  //!< occurrences of apt_value in the window
+  uint16_t apt_index;                 //!< bytes of the window seen, 0 to start a new one
+  uint8_t failed;                     //!< 1 once a test failed, until AtSha204::resetHealthTests()
+};
 
 class AtSha204
 {
 public:
   AtSha204(uint8_t pin);
+#ifdef SHA204_MULTI_TRANSPORT
+  AtSha204(const struct sha204_transport* transport, uint8_t id);
+#endif
   AtSha204();
   ~AtSha204();
 
   CryptoBuffer rsp;
   uint8_t getRandom();
+  uint8_t getRandom(uint8_t* random);
+  void resetHealthTests(void);
   uint8_t macBasic(uint8_t *to_mac, int len);
   uint8_t checkMacBasic(uint8_t *to_mac, int len, uint8_t *rsp);
   void enableDebug(Stream* stream);
+  uint8_t read_bytes(uint8_t zone, uint16_t address, uint16_t length, uint8_t* data);
   uint8_t read_zone(uint8_t zone, uint16_t address, uint8_t* zone_data);
+  void invalidate_config(void);
+#ifdef SHA204_CONFIG_CACHE
+  uint8_t restore_config(uint16_t eeprom_address);
+#endif
+  uint8_t write_edits(uint8_t zone, const struct sha204_write_edit* edits, uint8_t count, uint8_t* image = NULL);
+  uint8_t readData(uint16_t offset, uint16_t len, sha204_data_sink sink, void* context,
+                   const struct sha204_data_key* key = NULL);
+  uint8_t readData(uint16_t offset, uint16_t len, Stream& sink, const struct sha204_data_key* key = NULL);
+  uint8_t writeData(uint16_t offset, sha204_data_source source, void* context, uint16_t len,
+                    const struct sha204_data_key* key = NULL);
+  uint8_t writeData(uint16_t offset, Stream& src, uint16_t len, const struct sha204_data_key* key = NULL);
+  uint8_t write_record(uint8_t id, const uint8_t* data, uint8_t length);
+  uint8_t read_record(uint8_t id, uint8_t* data, uint8_t size, uint8_t& length);
   uint8_t configure_slots(void);
   uint8_t lock_config_zone(void);
   uint8_t lock_data_zone(void);
   uint8_t write_keys(void);
+  uint8_t provision(const struct sha204_provisioning& spec);
   uint8_t read_serial_number(uint8_t* tx_buffer, uint8_t* sn);
   uint8_t check_response_status(uint8_t ret_code, uint8_t* response);
   uint8_t getMacDigest(uint8_t* challenge, uint8_t* response_mac, uint8_t slot);
@@ -50,6 +256,7 @@ public:
   uint8_t countZeroBits(uint8_t number);
   uint8_t status();
   uint8_t get_mating_cycles(uint32_t& count);
+  uint8_t get_slot_config(uint8_t slot, uint16_t& config);
   uint8_t authenticate(void);
   uint8_t setUserData(char* userdata);
   uint8_t getUserData(char* userdata);
@@ -58,17 +265,71 @@ public:
   uint8_t updateMonotonicCounter(void);
   void setSwiPorts(void);
   uint8_t authenticate_mac(AtSha204& hostTag);
+  void setI2cAddress(uint8_t address);
+  uint8_t getI2cAddress(void);
+  void setSelector(uint8_t selector);
+  uint8_t getSelector(void);
+#ifdef SHA204_MULTI_TRANSPORT
+  const struct sha204_transport* getTransport(void);
+#endif
+  uint8_t wakeup(void);
+#ifdef SHA204_I2C_NON_BLOCKING
+  uint8_t start(uint8_t op_code, uint8_t param1, uint16_t param2, uint8_t size, uint8_t* data,
+                uint8_t datalen1 = 0, uint8_t* data1 = NULL, uint8_t datalen2 = 0, uint8_t* data2 = NULL,
+                uint8_t datalen3 = 0, uint8_t* data3 = NULL, uint8_t progmem = 0);
+  uint8_t poll(void);
+#endif
 
 
 protected:
-  uint8_t command[SHA204_CMD_SIZE_MAX];
-  uint8_t temp[SHA204_RSP_SIZE_MAX];
-  uint8_t response_status[SHA204_RSP_SIZE_MIN];
   Stream *debugStream = NULL;
   volatile uint8_t* device_port_DDR_inst, * device_port_OUT_inst, * device_port_IN_inst;
   uint8_t device_pin_inst;
+  uint8_t device_address_inst;
+  uint8_t selector_inst;
+  uint32_t mating_cycles = 0;             //!< count kept by get_mating_cycles() and updateMonotonicCounter()
+  uint8_t mating_cycles_valid = 0;        //!< 1 if mating_cycles is up to date
+  struct sha204_health health = {};      //!< health tests on the output of Random
+#ifdef SHA204_MULTI_TRANSPORT
+  const struct sha204_transport* transport_inst;
+#endif
+#ifdef SHA204_CONFIG_SHADOW
+  uint8_t config_shadow[SHA204_CONFIG_SIZE];
+  uint32_t config_valid = 0;              //!< bit n set if word n of config_shadow is known
+  uint8_t locks_valid = 0;                //!< 1 if LockValue and LockConfig in config_shadow are known, but not word 21
+
+  void update_config(uint8_t op_code, uint8_t param1, uint16_t param2, uint8_t datalen, const uint8_t* data,
+                     uint8_t progmem, uint8_t ret_code);
+#endif
+#ifdef SHA204_I2C_NON_BLOCKING
+  struct sha204c_exchange exchange;       //!< state of the command run by start() and poll()
+  struct sha204_command_view started;     //!< header and data blocks of that command
+  struct sha204_response_view started_view; //!< where its response goes
+  uint8_t started_status;                 //!< status byte of its response if the caller wants no data
+  uint8_t running = 0;                    //!< 1 until poll() has returned the status of that command
+#endif
 
   void idle();
+  uint8_t execute(uint8_t op_code, uint8_t param1, uint16_t param2, uint8_t size, uint8_t* data,
+                  uint8_t datalen1 = 0, uint8_t* data1 = NULL, uint8_t datalen2 = 0, uint8_t* data2 = NULL,
+                  uint8_t datalen3 = 0, uint8_t* data3 = NULL, uint8_t progmem = 0);
+  void executed(uint8_t op_code, uint8_t param1, uint16_t param2, uint8_t datalen1, const uint8_t* data1,
+                uint8_t progmem, uint8_t ret_code);
+  uint8_t execute_packet(const uint8_t* packet, uint8_t size, uint8_t* data);
+  uint8_t check_random(const uint8_t* random, uint8_t length);
+  uint8_t read_into(uint8_t zone, uint16_t address, uint8_t* data);
+  uint8_t read_bytes_awake(uint8_t zone, uint16_t address, uint16_t length, uint8_t* data);
+  uint8_t read_config_awake(uint16_t address, uint16_t length, uint8_t* data);
+  uint8_t read_config(uint16_t address, uint8_t length, uint8_t* data, uint8_t awake = 0);
+  uint8_t keep_awake(unsigned long& wake_time);
+  void forget_counters(void);
+  uint32_t mating_count(const uint8_t* use_flags);
+  uint8_t read_directory(struct sha204_record_directory* directory);
+  uint8_t write_block(uint8_t zone, uint16_t block, const struct sha204_write_edit* edits, uint8_t count,
+                      uint8_t data_locked, uint8_t* image, unsigned long& wake_time);
+  uint8_t gen_dig(const struct sha204_data_key* key, uint8_t seed_update, struct sha204h_temp_key* temp_key);
+  uint8_t write_from(uint8_t zone, uint16_t address, uint8_t* data);
+  uint8_t write_from_P(uint8_t zone, uint16_t address, const uint8_t* data);
 
 
 };
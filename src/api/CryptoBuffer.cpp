@@ -57,6 +57,17 @@ void CryptoBuffer::copyBufferFrom(uint8_t *src, int len)
         }
 }
 
+/* Returns the buffer for len bytes to be written straight into it, or
+   NULL if they do not fit. */
+uint8_t *CryptoBuffer::getWritePointer(int len)
+{
+    if (len > this->getMaxBufferSize())
+        return NULL;
+
+    this->len = len;
+    return this->buf;
+}
+
 const void CryptoBuffer::dumpHex(Stream* stream)
 {
   char temp[3] = {};
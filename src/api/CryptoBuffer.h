@@ -32,6 +32,7 @@ public:
   const int getMaxBufferSize();
   const int getLength();
   void copyBufferFrom(uint8_t *src, int len);
+  uint8_t *getWritePointer(int len);
   const void dumpHex(Stream* stream);
   void clear();
 
@@ -0,0 +1,442 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "DevicePool.h"
+
+#ifdef SHA204_LINUX_HOST
+
+#include <string.h>
+#include "../atsha204-atmel/sha204_physical.h"
+#include "../atsha204-atmel/sha204_lib_return_codes.h"
+
+using std::chrono::steady_clock;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+DevicePool::DevicePool()
+{
+  this->stopping = false;
+  this->running = false;
+}
+
+DevicePool::~DevicePool()
+{
+  stop();
+}
+
+/** \brief This function adds a bus. It has to be called before start().
+	\param[in] open function that opens the bus in the worker thread
+	\return index of the bus, or -1 if the pool is running or full
+*/
+int DevicePool::addBus(Opener open)
+{
+	Bus* bus;
+
+	if (this->running || this->buses.size() >= UINT8_MAX)
+		return -1;
+
+	bus = new Bus;
+	bus->open = open;
+	bus->next = 0;
+	bus->jobs = bus->stolen = bus->sessions = bus->busy_us = 0;
+	this->buses.push_back(std::unique_ptr<Bus>(bus));
+
+	return this->buses.size() - 1;
+}
+
+/** \brief This function adds a device. It has to be called before start().
+	\param[in] bus index returned by addBus
+	\param[in] id I2C address of the device, ignored for SWI
+	\return index of the device, or -1 on error
+*/
+int DevicePool::addDevice(uint8_t bus, uint8_t id)
+{
+	Device* device;
+
+	if (this->running || bus >= this->buses.size() || this->devices.size() >= UINT16_MAX)
+		return -1;
+
+	device = new Device;
+	device->index = this->devices.size();
+	device->bus = bus;
+	device->id = id;
+	this->devices.push_back(std::unique_ptr<Device>(device));
+	this->buses[bus]->devices.push_back(device->index);
+
+	return device->index;
+}
+
+/** \brief This function starts one worker thread per bus. */
+void DevicePool::start(void)
+{
+	uint8_t i;
+
+	if (this->running)
+		return;
+
+	this->stopping = false;
+	for (i = 0; i < this->buses.size(); i++)
+	{
+		this->buses[i]->started = steady_clock::now();
+		this->buses[i]->worker = std::thread(&DevicePool::work, this, i);
+	}
+	this->running = true;
+}
+
+/** \brief This function runs the queued jobs to completion and stops the workers. */
+void DevicePool::stop(void)
+{
+	uint8_t i;
+
+	if (!this->running)
+		return;
+
+	this->stopping = true;
+	for (i = 0; i < this->buses.size(); i++)
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->buses[i]->mutex);
+		}
+		this->buses[i]->wake.notify_one();
+	}
+	for (i = 0; i < this->buses.size(); i++)
+		this->buses[i]->worker.join();
+
+	this->running = false;
+}
+
+/** \brief This function queues a job for a device.
+	\param[in] device index returned by addDevice
+	\param[in] job function to run while the device is awake
+	\param[in] stealable true if the job may run on any device, like
+	           Random, or a Read or MAC on identically provisioned devices
+	\return future for the result of the job
+*/
+std::future<Sha204PoolResult> DevicePool::submit(uint16_t device, Sha204PoolJob job, bool stealable)
+{
+	Task task;
+	std::future<Sha204PoolResult> result = task.promise.get_future();
+	Sha204PoolResult failed;
+	Bus* bus;
+	uint8_t i;
+
+	if (device >= this->devices.size() || !job)
+	{
+		memset(&failed, 0, sizeof(failed));
+		failed.status = SHA204_BAD_PARAM;
+		failed.device = device;
+		task.promise.set_value(failed);
+		return result;
+	}
+
+	task.job = job;
+	task.stealable = stealable;
+
+	bus = this->buses[this->devices[device]->bus].get();
+	{
+		std::lock_guard<std::mutex> lock(bus->mutex);
+		this->devices[device]->queue.push_back(std::move(task));
+	}
+	bus->wake.notify_one();
+
+	// Idle workers of other buses may take it.
+	if (stealable)
+	{
+		for (i = 0; i < this->buses.size(); i++)
+			if (this->buses[i].get() != bus)
+				this->buses[i]->wake.notify_one();
+	}
+
+	return result;
+}
+
+/** \brief This function returns the utilization of a bus.
+ *
+ *  busy_us / elapsed_us is the share of time the bus had a device awake.
+	\param[in] bus index returned by addBus
+	\return counters of the bus
+*/
+Sha204BusStats DevicePool::stats(uint8_t bus)
+{
+	Sha204BusStats stats;
+	Bus* b;
+
+	memset(&stats, 0, sizeof(stats));
+	if (bus >= this->buses.size())
+		return stats;
+
+	b = this->buses[bus].get();
+	stats.jobs = b->jobs;
+	stats.stolen = b->stolen;
+	stats.sessions = b->sessions;
+	stats.busy_us = b->busy_us;
+	if (this->running)
+		stats.elapsed_us = std::chrono::duration_cast<microseconds>(steady_clock::now() - b->started).count();
+
+	return stats;
+}
+
+/** \brief This function returns the next device of a bus with queued jobs.
+ *
+ *  Devices are served round-robin. The mutex of the bus has to be held.
+	\param[in] bus bus to look at
+	\return device, or NULL if no jobs are queued
+*/
+DevicePool::Device* DevicePool::pending(Bus& bus)
+{
+	Device* device;
+	size_t i;
+
+	for (i = 0; i < bus.devices.size(); i++)
+	{
+		device = this->devices[bus.devices[(bus.next + i) % bus.devices.size()]].get();
+		if (!device->queue.empty())
+		{
+			bus.next = (bus.next + i + 1) % bus.devices.size();
+			return device;
+		}
+	}
+
+	return NULL;
+}
+
+/** \brief This function tells whether a device of a bus has queued jobs.
+ *
+ *  Unlike pending(), it leaves the round-robin position alone. The mutex
+ *  of the bus has to be held.
+	\param[in] bus bus to look at
+	\return true if a job is queued
+*/
+bool DevicePool::has_pending(Bus& bus)
+{
+	size_t i;
+
+	for (i = 0; i < bus.devices.size(); i++)
+		if (!this->devices[bus.devices[i]]->queue.empty())
+			return true;
+
+	return false;
+}
+
+/** \brief This function takes the next job queued for a device.
+	\param[in] bus bus of the device
+	\param[in] device device to take the job from
+	\param[out] task job taken
+	\return false if no job is queued
+*/
+bool DevicePool::dequeue(Bus& bus, Device& device, Task& task)
+{
+	std::lock_guard<std::mutex> lock(bus.mutex);
+
+	if (device.queue.empty())
+		return false;
+
+	task = std::move(device.queue.front());
+	device.queue.pop_front();
+
+	return true;
+}
+
+/** \brief This function takes a stealable job from another bus.
+ *
+ *  Busy buses are skipped instead of waited for. The job is taken
+ *  from the back of the longest queue, while its own worker takes
+ *  jobs from the front.
+	\param[in] thief index of the bus looking for work
+	\param[out] task job taken
+	\return true if a job was taken
+*/
+bool DevicePool::steal(uint8_t thief, Task& task)
+{
+	std::deque<Task>* longest;
+	std::deque<Task>::reverse_iterator it;
+	Bus* bus;
+	uint8_t i;
+	size_t j;
+
+	for (i = 1; i < this->buses.size(); i++)
+	{
+		bus = this->buses[(thief + i) % this->buses.size()].get();
+		std::unique_lock<std::mutex> lock(bus->mutex, std::try_to_lock);
+		if (!lock.owns_lock())
+			continue;
+
+		longest = NULL;
+		for (j = 0; j < bus->devices.size(); j++)
+		{
+			std::deque<Task>& queue = this->devices[bus->devices[j]]->queue;
+			if (!queue.empty() && (!longest || queue.size() > longest->size()))
+				longest = &queue;
+		}
+		if (!longest)
+			continue;
+
+		for (it = longest->rbegin(); it != longest->rend(); it++)
+		{
+			if (it->stealable)
+			{
+				task = std::move(*it);
+				longest->erase(--(it.base()));
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+/** \brief This function runs the jobs of a device in one session.
+ *
+ *  The device is woken up, runs the jobs queued for it, and is put to
+ *  sleep again. An exception thrown by a job goes into its future. A session that starts with a stolen job keeps stealing
+ *  once the queue of the device is empty. If the session
+ *  lasts longer than #DEVICE_POOL_WATCHDOG_BUDGET_MS, the device is
+ *  put to sleep and woken up again between two jobs.
+	\param[in] bus bus of the device
+	\param[in] device device to run the jobs on
+	\param[in] stolen job taken from another bus, or NULL
+*/
+void DevicePool::run(Bus& bus, Device& device, Task* stolen)
+{
+	Sha204Session session;
+	Sha204PoolResult result;
+	Task task;
+	steady_clock::time_point start = steady_clock::now();
+	steady_clock::time_point awake = start;
+	bool stealing = false;
+	uint8_t ret_code;
+
+	session.device = device.index;
+	session.bus = device.bus;
+	session.id = device.id;
+
+	sha204p_set_device_id(device.id);
+	ret_code = sha204c_wakeup(session.rx);
+
+	for (;;)
+	{
+		if (stolen)
+		{
+			task = std::move(*stolen);
+			stolen = NULL;
+			stealing = true;
+			bus.stolen++;
+		}
+		else if (!dequeue(bus, device, task))
+		{
+			// Keep stealing while the device is awake anyway.
+			if (!stealing || !steal(device.bus, task))
+				break;
+			bus.stolen++;
+		}
+
+		if (ret_code == SHA204_SUCCESS
+				&& steady_clock::now() - awake > milliseconds(DEVICE_POOL_WATCHDOG_BUDGET_MS))
+		{
+			sha204p_sleep();
+			awake = steady_clock::now();
+			ret_code = sha204c_wakeup(session.rx);
+		}
+
+		memset(session.rx, 0, sizeof(session.rx));
+		try
+		{
+			result.status = (ret_code == SHA204_SUCCESS) ? task.job(session) : ret_code;
+			result.device = device.index;
+			memcpy(result.response, session.rx, sizeof(result.response));
+			task.promise.set_value(result);
+		}
+		catch (...)
+		{
+			// The future rethrows it, and the worker goes on with the next job.
+			task.promise.set_exception(std::current_exception());
+		}
+		bus.jobs++;
+	}
+
+	sha204p_sleep();
+
+	bus.sessions++;
+	bus.busy_us += std::chrono::duration_cast<microseconds>(steady_clock::now() - start).count();
+}
+
+/** \brief This function fails all jobs queued for a device.
+	\param[in] bus bus of the device
+	\param[in] device device whose jobs fail
+	\param[in] status status to report
+*/
+void DevicePool::fail(Bus& bus, Device& device, uint8_t status)
+{
+	Sha204PoolResult result;
+	Task task;
+
+	memset(&result, 0, sizeof(result));
+	result.status = status;
+	result.device = device.index;
+
+	while (dequeue(bus, device, task))
+		task.promise.set_value(result);
+}
+
+/** \brief This function is the worker thread of a bus.
+	\param[in] index index of the bus
+*/
+void DevicePool::work(uint8_t index)
+{
+	Bus& bus = *this->buses[index];
+	Device* device;
+	Task task;
+	uint8_t status = bus.open ? bus.open() : SHA204_SUCCESS;
+
+	for (;;)
+	{
+		{
+			std::lock_guard<std::mutex> lock(bus.mutex);
+			device = pending(bus);
+			if (!device && this->stopping)
+				break;
+		}
+
+		if (device)
+		{
+			if (status == SHA204_SUCCESS)
+				run(bus, *device, NULL);
+			else
+				fail(bus, *device, status);
+			continue;
+		}
+
+		if (status == SHA204_SUCCESS && !bus.devices.empty() && steal(index, task))
+		{
+			{
+				std::lock_guard<std::mutex> lock(bus.mutex);
+				device = this->devices[bus.devices[bus.next]].get();
+				bus.next = (bus.next + 1) % bus.devices.size();
+			}
+			run(bus, *device, &task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(bus.mutex);
+		if (!has_pending(bus) && !this->stopping)
+			bus.wake.wait_for(lock, milliseconds(DEVICE_POOL_IDLE_WAIT_MS));
+	}
+}
+
+#endif
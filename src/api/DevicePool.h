@@ -0,0 +1,148 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIB_DEVICEPOOL_H_
+#define LIB_DEVICEPOOL_H_
+
+#include "../atsha204-atmel/sha204_comm_marshaling.h"
+
+#ifdef SHA204_LINUX_HOST
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define DEVICE_POOL_WATCHDOG_BUDGET_MS  (600)  //!< time a device may stay awake, see Sha204Bus.h
+#define DEVICE_POOL_IDLE_WAIT_MS        (10)   //!< time an idle worker waits before looking for work to steal
+
+/** \brief The device a job runs on and its command buffers.
+ *
+ *  The device is awake and selected when the job runs. The job sends
+ *  commands with the sha204m_... functions and must neither wake up
+ *  the device nor put it to sleep. The pool returns the contents of
+ *  rx as the result.
+ */
+struct Sha204Session
+{
+  uint16_t device;                      //!< index returned by DevicePool::addDevice
+  uint8_t bus;                          //!< index returned by DevicePool::addBus
+  uint8_t id;                           //!< I2C address of the device
+  uint8_t tx[SHA204_CMD_SIZE_MAX];      //!< command buffer
+  uint8_t rx[SHA204_RSP_SIZE_MAX];      //!< response buffer
+};
+
+typedef std::function<uint8_t(Sha204Session& session)> Sha204PoolJob;
+
+//! result of a job
+struct Sha204PoolResult
+{
+  uint8_t status;                       //!< return code of the job, or of waking up the device
+  uint16_t device;                      //!< device the job ran on
+  uint8_t response[SHA204_RSP_SIZE_MAX];  //!< rx buffer of the session
+};
+
+//! utilization of one bus
+struct Sha204BusStats
+{
+  uint64_t jobs;                        //!< jobs run by the worker of the bus
+  uint64_t stolen;                      //!< of these, jobs taken from other buses
+  uint64_t sessions;                    //!< Wake-up to Sleep sessions
+  uint64_t busy_us;                     //!< time spent in sessions
+  uint64_t elapsed_us;                  //!< time since the worker started
+};
+
+/** \brief Runs jobs on many devices spread over several buses.
+ *
+ *  Every bus gets a worker thread that opens the bus itself, so the
+ *  per-thread state of the Linux physical layers keeps the buses apart.
+ *  Jobs queue per device. A worker wakes up a device, runs the jobs
+ *  queued for it back-to-back and puts it to sleep again. A worker
+ *  without work takes stealable jobs, which do not care about the
+ *  device they run on, from the devices of other buses.
+ */
+class DevicePool
+{
+public:
+  //! opens a bus in its worker thread, e.g. by calling sha204p_linux_i2c_open()
+  typedef std::function<uint8_t(void)> Opener;
+
+  DevicePool();
+  ~DevicePool();
+
+  int addBus(Opener open);
+  int addDevice(uint8_t bus, uint8_t id);
+  void start(void);
+  void stop(void);
+
+  std::future<Sha204PoolResult> submit(uint16_t device, Sha204PoolJob job, bool stealable = false);
+  Sha204BusStats stats(uint8_t bus);
+
+protected:
+  struct Task
+  {
+    Sha204PoolJob job;
+    std::promise<Sha204PoolResult> promise;
+    bool stealable;
+  };
+
+  struct Device
+  {
+    uint16_t index;
+    uint8_t bus;
+    uint8_t id;
+    std::deque<Task> queue;             // guarded by the mutex of its bus
+  };
+
+  struct Bus
+  {
+    Opener open;
+    std::vector<uint16_t> devices;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread worker;
+    uint16_t next;                      // round-robin position, guarded by mutex
+    std::atomic<uint64_t> jobs, stolen, sessions, busy_us;
+    std::chrono::steady_clock::time_point started;
+  };
+
+  std::vector<std::unique_ptr<Bus> > buses;
+  std::vector<std::unique_ptr<Device> > devices;
+  std::atomic<bool> stopping;
+  bool running;
+
+  void work(uint8_t bus);
+  Device* pending(Bus& bus);
+  bool has_pending(Bus& bus);
+  bool dequeue(Bus& bus, Device& device, Task& task);
+  bool steal(uint8_t thief, Task& task);
+  void run(Bus& bus, Device& device, Task* stolen);
+  void fail(Bus& bus, Device& device, uint8_t status);
+
+};
+
+#endif
+
+#endif
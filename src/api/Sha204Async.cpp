@@ -0,0 +1,314 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "Sha204Async.h"
+
+#if defined(SHA204_LINUX_HOST) && defined(__cpp_impl_coroutine)
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "../atsha204-atmel/sha204_physical.h"
+#include "../atsha204-atmel/sha204_lib_return_codes.h"
+
+#define SHA204_ASYNC_EVENTS  (16)  // events taken from epoll at once
+
+Sha204EventLoop::Sha204EventLoop()
+{
+  struct epoll_event event;
+
+  this->sequence = 0;
+  this->readers = 0;
+  this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  this->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.ptr = NULL;
+  epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, this->timer_fd, &event);
+}
+
+Sha204EventLoop::~Sha204EventLoop()
+{
+  close(this->timer_fd);
+  close(this->epoll_fd);
+}
+
+/** \brief This function returns the time of the monotonic clock.
+	\return time in us
+*/
+uint64_t Sha204EventLoop::now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/** \brief This function suspends the awaiting coroutine.
+	\param[in] ms time in ms after which the coroutine is resumed
+	\return awaitable
+*/
+Sha204EventLoop::SleepAwaiter Sha204EventLoop::sleep(uint32_t ms)
+{
+	return SleepAwaiter{*this, now() + (uint64_t) ms * 1000};
+}
+
+/** \brief This function suspends the awaiting coroutine until a file descriptor is readable.
+	\param[in] fd file descriptor
+	\return awaitable, which returns false if the descriptor cannot be waited for
+*/
+Sha204EventLoop::ReadableAwaiter Sha204EventLoop::readable(int fd)
+{
+	return ReadableAwaiter{*this, fd, false};
+}
+
+void Sha204EventLoop::addTimer(uint64_t deadline_us, std::coroutine_handle<> h)
+{
+	this->timers.push(Timer{deadline_us, this->sequence++, h});
+}
+
+bool Sha204EventLoop::addReader(int fd, std::coroutine_handle<> h)
+{
+	struct epoll_event event;
+
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN | EPOLLONESHOT;
+	event.data.ptr = h.address();
+	if (epoll_ctl(this->epoll_fd, EPOLL_CTL_MOD, fd, &event) < 0
+			&& epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+		return false;
+
+	this->readers++;
+	return true;
+}
+
+/** \brief This function resumes coroutines until none is waiting any more.
+ *
+ *  All timers that are due when the loop wakes up are resumed in the
+ *  order of their deadlines, before the loop waits again.
+ */
+void Sha204EventLoop::run(void)
+{
+	struct epoll_event events[SHA204_ASYNC_EVENTS];
+	struct itimerspec spec;
+	uint64_t expirations;
+	uint64_t now_us;
+	Timer timer;
+	int n, i;
+
+	while (!this->timers.empty() || this->readers)
+	{
+		if (!this->timers.empty())
+		{
+			// A deadline in the past still has to arm the timer.
+			memset(&spec, 0, sizeof(spec));
+			spec.it_value.tv_sec = this->timers.top().deadline_us / 1000000;
+			spec.it_value.tv_nsec = (this->timers.top().deadline_us % 1000000) * 1000 + 1;
+			timerfd_settime(this->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+		}
+
+		n = epoll_wait(this->epoll_fd, events, SHA204_ASYNC_EVENTS, -1);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (i = 0; i < n; i++)
+		{
+			if (!events[i].data.ptr)
+			{
+				(void) read(this->timer_fd, &expirations, sizeof(expirations));
+				continue;
+			}
+			this->readers--;
+			std::coroutine_handle<>::from_address(events[i].data.ptr).resume();
+		}
+
+		now_us = now();
+		while (!this->timers.empty() && this->timers.top().deadline_us <= now_us)
+		{
+			timer = this->timers.top();
+			this->timers.pop();
+			timer.handle.resume();
+		}
+	}
+}
+
+
+Sha204AsyncDevice::Sha204AsyncDevice(Sha204EventLoop& loop, uint8_t id) : loop(loop)
+{
+  this->id = id;
+  memset(this->tx, 0, sizeof(this->tx));
+  memset(this->rx, 0, sizeof(this->rx));
+}
+
+/** \brief This function wakes up the device. It blocks the loop.
+	\return status of the operation
+*/
+uint8_t Sha204AsyncDevice::wakeup(void)
+{
+	sha204p_set_device_id(this->id);
+	return sha204c_wakeup(this->rx);
+}
+
+/** \brief This function puts the device into idle state.
+	\return status of the operation
+*/
+uint8_t Sha204AsyncDevice::idle(void)
+{
+	sha204p_set_device_id(this->id);
+	return sha204p_idle();
+}
+
+/** \brief This function puts the device into low-power state.
+	\return status of the operation
+*/
+uint8_t Sha204AsyncDevice::sleep(void)
+{
+	sha204p_set_device_id(this->id);
+	return sha204p_sleep();
+}
+
+uint8_t Sha204AsyncDevice::resync(uint8_t size)
+{
+	sha204p_set_device_id(this->id);
+	return sha204c_resync(size, this->rx);
+}
+
+/** \brief This function runs a command.
+ *
+ *  The data blocks are copied into the command when the task is
+ *  awaited, so they have to stay valid until then.
+	\param[in] op_code command op-code
+	\param[in] param1 first parameter
+	\param[in] param2 second parameter
+	\param[in] datalen1 number of bytes in first data block
+	\param[in] data1 pointer to first data block
+	\param[in] datalen2 number of bytes in second data block
+	\param[in] data2 pointer to second data block
+	\param[in] datalen3 number of bytes in third data block
+	\param[in] data3 pointer to third data block
+	\return task returning the status of the operation
+*/
+Sha204Task<uint8_t> Sha204AsyncDevice::execute(uint8_t op_code, uint8_t param1, uint16_t param2,
+			uint8_t datalen1, uint8_t *data1, uint8_t datalen2, uint8_t *data2, uint8_t datalen3, uint8_t *data3)
+{
+	struct sha204c_retry retry;
+	uint8_t ret_code;
+	uint8_t response_size, execution_delay, execution_timeout;
+	uint64_t deadline_us;
+
+	ret_code = sha204m_build_command(op_code, param1, param2,
+				datalen1, data1, datalen2, data2, datalen3, data3,
+				sizeof(this->tx), this->tx, sizeof(this->rx), this->rx,
+				&response_size, &execution_delay, &execution_timeout);
+	if (ret_code != SHA204_SUCCESS)
+		co_return ret_code;
+
+	// The comm layer decides the retries, see sha204c_retry_step().
+	sha204c_retry_init(&retry);
+	for (;;)
+	{
+		switch (retry.action)
+		{
+		case SHA204C_ACTION_SEND:
+			sha204p_set_device_id(this->id);
+			ret_code = sha204p_send_command(this->tx[SHA204_BUFFER_POS_COUNT], this->tx);
+			if (ret_code == SHA204_SUCCESS)
+				// Other devices use the bus while this one executes the command.
+				co_await this->loop.sleep(execution_delay);
+			break;
+
+		case SHA204C_ACTION_RECEIVE:
+			memset(this->rx, 0, response_size);
+
+			deadline_us = Sha204EventLoop::now() + (uint64_t) execution_timeout * 1000;
+			for (;;)
+			{
+				sha204p_set_device_id(this->id);
+				ret_code = sha204p_receive_response(response_size, this->rx);
+				if (ret_code != SHA204_RX_NO_RESPONSE || Sha204EventLoop::now() >= deadline_us)
+					break;
+				co_await this->loop.sleep(SHA204_ASYNC_POLL_MS);
+			}
+			if (ret_code == SHA204_SUCCESS)
+				ret_code = sha204c_check_response(this->rx);
+			break;
+
+		case SHA204C_ACTION_RESYNC:
+			ret_code = resync(response_size);
+			break;
+
+		default:
+			co_return retry.ret_code;
+		}
+		(void) sha204c_retry_step(&retry, ret_code);
+	}
+}
+
+/** \brief This function runs a MAC command.
+	\param[in] challenge 32 bytes of challenge, ignored if mode bit 0 is set
+	\param[in] slot slot index of the key
+	\param[in] mode selects the hash inputs
+	\return task returning the status of the operation
+*/
+Sha204Task<uint8_t> Sha204AsyncDevice::mac(uint8_t *challenge, uint16_t slot, uint8_t mode)
+{
+	return execute(SHA204_MAC, mode, slot,
+			(mode & MAC_MODE_BLOCK2_TEMPKEY) ? 0 : MAC_CHALLENGE_SIZE, challenge);
+}
+
+/** \brief This function runs a Nonce command.
+	\param[in] numin 20 bytes of input, or 32 bytes in pass-through mode
+	\param[in] mode Nonce mode
+	\return task returning the status of the operation
+*/
+Sha204Task<uint8_t> Sha204AsyncDevice::nonce(uint8_t *numin, uint8_t mode)
+{
+	return execute(SHA204_NONCE, mode, 0,
+			(mode == NONCE_MODE_PASSTHROUGH) ? NONCE_NUMIN_SIZE_PASSTHROUGH : NONCE_NUMIN_SIZE, numin);
+}
+
+/** \brief This function runs a Random command.
+	\param[in] mode Random mode
+	\return task returning the status of the operation
+*/
+Sha204Task<uint8_t> Sha204AsyncDevice::random(uint8_t mode)
+{
+	return execute(SHA204_RANDOM, mode, 0);
+}
+
+/** \brief This function runs a Read command.
+	\param[in] zone zone and length flag
+	\param[in] address byte address
+	\return task returning the status of the operation
+*/
+Sha204Task<uint8_t> Sha204AsyncDevice::read(uint8_t zone, uint16_t address)
+{
+	return execute(SHA204_READ, zone, address >> 2);
+}
+
+#endif
@@ -0,0 +1,196 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIB_SHA204ASYNC_H_
+#define LIB_SHA204ASYNC_H_
+
+#include "../atsha204-atmel/sha204_comm_marshaling.h"
+
+#if defined(SHA204_LINUX_HOST) && defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <exception>
+#include <queue>
+#include <vector>
+
+#define SHA204_ASYNC_POLL_MS  (1)  //!< time between two polls for a response that is not ready yet
+
+/** \brief Coroutine returning a value to the coroutine awaiting it.
+ *
+ *  A task starts when it is awaited, or when start() is called for a
+ *  task that nobody awaits.
+ */
+template <typename T>
+class Sha204Task
+{
+public:
+  struct promise_type
+  {
+    T value;
+    std::coroutine_handle<> continuation;
+
+    Sha204Task get_return_object()
+    {
+      return Sha204Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    struct FinalAwaiter
+    {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept
+      {
+        if (h.promise().continuation)
+          return h.promise().continuation;
+        return std::noop_coroutine();
+      }
+      void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void return_value(T v) { value = v; }
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  Sha204Task(Sha204Task&& other) : handle(other.handle) { other.handle = nullptr; }
+  Sha204Task(const Sha204Task&) = delete;
+  Sha204Task& operator=(const Sha204Task&) = delete;
+  ~Sha204Task() { if (handle) handle.destroy(); }
+
+  //! starts a task that is not awaited
+  void start(void) { handle.resume(); }
+  bool done(void) const { return handle.done(); }
+  //! result of a task that is done
+  T result(void) const { return handle.promise().value; }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+  {
+    handle.promise().continuation = awaiting;
+    return handle;
+  }
+  T await_resume() { return handle.promise().value; }
+
+private:
+  explicit Sha204Task(std::coroutine_handle<promise_type> h) : handle(h) {}
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+/** \brief Single-threaded event loop resuming coroutines on timers and file descriptors.
+ *
+ *  Timers share one timerfd that is armed for the earliest deadline.
+ *  The timerfd and the awaited file descriptors are waited for with epoll.
+ */
+class Sha204EventLoop
+{
+public:
+  Sha204EventLoop();
+  ~Sha204EventLoop();
+
+  struct SleepAwaiter
+  {
+    Sha204EventLoop& loop;
+    uint64_t deadline_us;
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) { loop.addTimer(deadline_us, h); }
+    void await_resume() const noexcept {}
+  };
+
+  struct ReadableAwaiter
+  {
+    Sha204EventLoop& loop;
+    int fd;
+    bool failed;
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> h) { failed = !loop.addReader(fd, h); return !failed; }
+    //! false if the descriptor could not be waited for
+    bool await_resume() const noexcept { return !failed; }
+  };
+
+  SleepAwaiter sleep(uint32_t ms);
+  ReadableAwaiter readable(int fd);
+  void run(void);
+  static uint64_t now(void);
+
+protected:
+  struct Timer
+  {
+    uint64_t deadline_us;
+    uint64_t sequence;                  // keeps timers with the same deadline in order
+    std::coroutine_handle<> handle;
+    bool operator>(const Timer& other) const
+    {
+      return deadline_us != other.deadline_us
+        ? deadline_us > other.deadline_us : sequence > other.sequence;
+    }
+  };
+
+  int epoll_fd;
+  int timer_fd;
+  uint64_t sequence;
+  uint32_t readers;
+  std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer> > timers;
+
+  void addTimer(uint64_t deadline_us, std::coroutine_handle<> h);
+  bool addReader(int fd, std::coroutine_handle<> h);
+};
+
+/** \brief Device whose commands suspend the awaiting coroutine while the device executes them.
+ *
+ *  Commands are built by sha204m_build_command() and the response is
+ *  checked by sha204c_check_response(), with the retry and
+ *  re-synchronization rules of sha204c_send_and_receive(). Only the
+ *  execution delay and the wait between polls suspend; transfers on the
+ *  bus, waking up and re-synchronizing block the loop. All devices of
+ *  a loop have to be on the bus opened by the thread running the loop.
+ */
+class Sha204AsyncDevice
+{
+public:
+  Sha204AsyncDevice(Sha204EventLoop& loop, uint8_t id);
+
+  uint8_t wakeup(void);
+  uint8_t idle(void);
+  uint8_t sleep(void);
+
+  Sha204Task<uint8_t> execute(uint8_t op_code, uint8_t param1, uint16_t param2,
+                              uint8_t datalen1 = 0, uint8_t *data1 = NULL,
+                              uint8_t datalen2 = 0, uint8_t *data2 = NULL,
+                              uint8_t datalen3 = 0, uint8_t *data3 = NULL);
+  Sha204Task<uint8_t> mac(uint8_t *challenge, uint16_t slot, uint8_t mode = 0);
+  Sha204Task<uint8_t> nonce(uint8_t *numin, uint8_t mode = NONCE_MODE_SEED_UPDATE);
+  Sha204Task<uint8_t> random(uint8_t mode = RANDOM_SEED_UPDATE);
+  Sha204Task<uint8_t> read(uint8_t zone, uint16_t address);
+
+  //! response of the last command
+  const uint8_t* response(void) const { return this->rx; }
+
+protected:
+  Sha204EventLoop& loop;
+  uint8_t id;
+  uint8_t tx[SHA204_CMD_SIZE_MAX];
+  uint8_t rx[SHA204_RSP_SIZE_MAX];
+
+  uint8_t resync(uint8_t size);
+};
+
+#endif
+
+#endif
@@ -0,0 +1,255 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "Sha204Bus.h"
+#include "../atsha204-atmel/sha204_physical.h"
+#include "../atsha204-atmel/sha204_comm_marshaling.h"
+#include "../atsha204-atmel/sha204_lib_return_codes.h"
+
+#if defined(SHA204_I2C) || defined(SHA204_SWI_MULTIDROP)
+
+Sha204Bus::Sha204Bus()
+{
+  this->devices = 0;
+}
+
+Sha204Bus::~Sha204Bus() { }
+
+/** \brief This function adds a device to the bus.
+	\param[in] device device with its I2C address or Selector set
+	\return index of the device, or SHA204_BAD_PARAM if the bus is full.
+	        With SHA204_MULTI_TRANSPORT also if the device does not use the
+	        transport of the devices added before, or is an SWI device
+	        without SHA204_SWI_MULTIDROP.
+*/
+uint8_t Sha204Bus::addDevice(AtSha204& device)
+{
+	Slot* slot;
+
+	if (this->devices >= SHA204_BUS_DEVICES_MAX)
+		return SHA204_BAD_PARAM;
+
+#ifdef SHA204_MULTI_TRANSPORT
+	// A bus is one I2C bus or one signal wire, so its devices share a transport.
+	if (this->devices && device.getTransport() != this->slots[0].device->getTransport())
+		return SHA204_BAD_PARAM;
+#ifndef SHA204_SWI_MULTIDROP
+	if (!device.getTransport()->addressed)
+		return SHA204_BAD_PARAM;
+#endif
+#endif
+
+	slot = &this->slots[this->devices];
+	slot->device = &device;
+	slot->head = 0;
+	slot->count = 0;
+	slot->status = SHA204_SUCCESS;
+
+	return this->devices++;
+}
+
+/** \brief This function queues a job for the next round.
+	\param[in] index index returned by addDevice
+	\param[in] job function to run while the device is awake
+	\param[in] context pointer passed to the job
+	\return status of the operation
+*/
+uint8_t Sha204Bus::queue(uint8_t index, Sha204Job job, void* context)
+{
+	Slot* slot;
+	QueuedJob* queued;
+
+	if (index >= this->devices || !job)
+		return SHA204_BAD_PARAM;
+
+	slot = &this->slots[index];
+	if (slot->count >= SHA204_BUS_QUEUE_SIZE)
+		return SHA204_FUNC_FAIL;
+
+	queued = &slot->jobs[(slot->head + slot->count) % SHA204_BUS_QUEUE_SIZE];
+	queued->job = job;
+	queued->context = context;
+	slot->count++;
+
+	return SHA204_SUCCESS;
+}
+
+/** \brief This function returns the number of jobs still queued for a device.
+	\param[in] index index returned by addDevice
+	\return number of queued jobs
+*/
+uint8_t Sha204Bus::pending(uint8_t index)
+{
+	return (index < this->devices) ? this->slots[index].count : 0;
+}
+
+/** \brief This function returns the status of the last round for a device.
+	\param[in] index index returned by addDevice
+	\return status of the last job run, or of the Wake-up if that failed
+*/
+uint8_t Sha204Bus::lastStatus(uint8_t index)
+{
+	return (index < this->devices) ? this->slots[index].status : SHA204_BAD_PARAM;
+}
+
+/** \brief This function runs one round of queued jobs.
+ *
+		   The round is run the way the transport of the devices needs,
+		   see runI2c() and runSwi().
+	\return status of the first device that failed, or SHA204_SUCCESS
+*/
+uint8_t Sha204Bus::run(void)
+{
+#ifdef SHA204_MULTI_TRANSPORT
+#ifdef SHA204_SWI_MULTIDROP
+	if (this->devices && !this->slots[0].device->getTransport()->addressed)
+		return runSwi();
+#endif
+	return runI2c();
+#elif defined(SHA204_I2C)
+	return runI2c();
+#else
+	return runSwi();
+#endif
+}
+
+#ifdef SHA204_I2C
+/** \brief This function runs one round of queued jobs on an I2C bus.
+ *
+		   A single Wake-up pulse wakes up every device on the bus. The
+		   devices then run their jobs back-to-back and are put to sleep
+		   one after the other. Jobs that do not fit into
+		   #SHA204_BUS_WATCHDOG_BUDGET_MS stay queued for the next round.
+	\return status of the first device that failed, or SHA204_SUCCESS
+*/
+uint8_t Sha204Bus::runI2c(void)
+{
+	uint8_t ret_code = SHA204_SUCCESS;
+	uint8_t status;
+	uint8_t response[SHA204_RSP_SIZE_MIN];
+	unsigned long wakeTime;
+	uint8_t i;
+	Slot* slot;
+
+	if (this->devices == 0)
+		return ret_code;
+
+	// All devices share SDA, so this wakes up all of them.
+	sha204p_wakeup();
+	wakeTime = millis();
+
+	for (i = 0; i < this->devices; i++)
+	{
+		slot = &this->slots[i];
+		slot->device->setSwiPorts();
+
+		// The device still holds its Wake-up response.
+		status = sha204p_receive_response(sizeof(response), response);
+		if (status == SHA204_SUCCESS)
+			status = sha204c_check_crc(response);
+		if (status == SHA204_SUCCESS
+				&& response[SHA204_BUFFER_POS_STATUS] != SHA204_STATUS_BYTE_WAKEUP)
+			status = SHA204_COMM_FAIL;
+
+		status = runJobs(*slot, wakeTime, status);
+		sha204p_sleep();
+
+		if (ret_code == SHA204_SUCCESS)
+			ret_code = status;
+	}
+
+	return ret_code;
+}
+#endif
+
+#ifdef SHA204_SWI_MULTIDROP
+/** \brief This function runs one round of queued jobs on a signal wire.
+ *
+		   All devices share the signal wire. Every device with queued
+		   jobs is selected once per round with a Wake-up token and a
+		   Pause command that idles all other devices, and runs all its
+		   jobs back-to-back. The Wake-up responses are not read, since
+		   all devices would answer at once, see AtSha204::wakeup().
+		   Devices without jobs are skipped. At the end, one Wake-up
+		   token and one Sleep flag put all devices, including the idle
+		   ones, to sleep.
+	\return status of the first device that failed, or SHA204_SUCCESS
+*/
+uint8_t Sha204Bus::runSwi(void)
+{
+	uint8_t ret_code = SHA204_SUCCESS;
+	uint8_t status;
+	uint8_t selected = 0;
+	uint8_t i;
+	Slot* slot;
+
+	for (i = 0; i < this->devices; i++)
+	{
+		slot = &this->slots[i];
+		if (slot->count == 0)
+			continue;
+
+		slot->device->setSwiPorts();
+		status = slot->device->wakeup();
+		status = runJobs(*slot, millis(), status);
+		selected = 1;
+
+		if (ret_code == SHA204_SUCCESS)
+			ret_code = status;
+	}
+
+	if (selected)
+	{
+		status = sha204p_wakeup();
+		if (status == SHA204_SUCCESS)
+			status = sha204p_sleep();
+		if (ret_code == SHA204_SUCCESS)
+			ret_code = status;
+	}
+
+	return ret_code;
+}
+#endif
+
+/** \brief This function runs the queued jobs of a selected device.
+	\param[in] slot device and its job queue
+	\param[in] wakeTime millis() when the device was woken up
+	\param[in] ret_code status of waking up the device
+	\return status of the operation
+*/
+uint8_t Sha204Bus::runJobs(Slot& slot, unsigned long wakeTime, uint8_t ret_code)
+{
+	QueuedJob* queued;
+
+	while (ret_code == SHA204_SUCCESS && slot.count > 0
+			&& millis() - wakeTime < SHA204_BUS_WATCHDOG_BUDGET_MS)
+	{
+		queued = &slot.jobs[slot.head];
+		slot.head = (slot.head + 1) % SHA204_BUS_QUEUE_SIZE;
+		slot.count--;
+
+		ret_code = queued->job(*slot.device, queued->context);
+	}
+
+	slot.status = ret_code;
+
+	return ret_code;
+}
+
+#endif
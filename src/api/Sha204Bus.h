@@ -0,0 +1,84 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIB_SHA204BUS_H_
+#define LIB_SHA204BUS_H_
+
+#include <Arduino.h>
+#include "AtSha204.h"
+
+#if defined(SHA204_I2C) || defined(SHA204_SWI_MULTIDROP)
+
+#define SHA204_BUS_DEVICES_MAX     (8)    //!< number of devices a bus manager can hold
+#define SHA204_BUS_QUEUE_SIZE      (4)    //!< number of jobs that can be queued per device
+
+//! Time in ms a round may spend running jobs after the Wake-up pulse.
+#define SHA204_BUS_WATCHDOG_BUDGET_MS   SHA204_WATCHDOG_BUDGET_MS
+
+/** \brief A job runs on an awake device that is already selected.
+ *
+ *  It sends commands with the sha204m_... functions and must neither
+ *  wake up the device nor put it to sleep.
+ */
+typedef uint8_t (*Sha204Job)(AtSha204& device, void* context);
+
+class Sha204Bus
+{
+public:
+  Sha204Bus();
+  ~Sha204Bus();
+
+  uint8_t addDevice(AtSha204& device);
+  uint8_t queue(uint8_t index, Sha204Job job, void* context);
+  uint8_t pending(uint8_t index);
+  uint8_t lastStatus(uint8_t index);
+  uint8_t run(void);
+
+protected:
+  struct QueuedJob
+  {
+    Sha204Job job;
+    void* context;
+  };
+
+  struct Slot
+  {
+    AtSha204* device;
+    QueuedJob jobs[SHA204_BUS_QUEUE_SIZE];
+    uint8_t head;
+    uint8_t count;
+    uint8_t status;
+  };
+
+  Slot slots[SHA204_BUS_DEVICES_MAX];
+  uint8_t devices;
+
+#ifdef SHA204_I2C
+  uint8_t runI2c(void);
+#endif
+#ifdef SHA204_SWI_MULTIDROP
+  uint8_t runSwi(void);
+#endif
+  uint8_t runJobs(Slot& slot, unsigned long wakeTime, uint8_t ret_code);
+
+};
+
+#endif
+
+#endif
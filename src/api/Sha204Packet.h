@@ -0,0 +1,94 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIB_SHA204PACKET_H_
+#define LIB_SHA204PACKET_H_
+
+#include "../atsha204-atmel/sha204_comm_marshaling.h"
+
+//! CRC register after feeding the bits of a byte from \a bit on, see sha204c_update_crc()
+constexpr uint16_t sha204CrcBits(uint16_t crc, uint8_t data, uint8_t bit)
+{
+  return bit == 8 ? crc
+    : sha204CrcBits(((data >> bit) & 1) != (crc >> 15)
+                    ? (uint16_t) ((crc << 1) ^ 0x8005) : (uint16_t) (crc << 1),
+                    data, bit + 1);
+}
+
+//! CRC register after feeding no more bytes
+constexpr uint16_t sha204Crc(uint16_t crc)
+{
+  return crc;
+}
+
+//! CRC register after feeding bytes, evaluated at compile time
+template <typename... Bytes>
+constexpr uint16_t sha204Crc(uint16_t crc, uint8_t first, Bytes... rest)
+{
+  return sha204Crc(sha204CrcBits(crc, first, 0), rest...);
+}
+
+//! CRC register after feeding \a length bytes of a constant array
+constexpr uint16_t sha204CrcArray(uint16_t crc, const uint8_t* data, uint8_t length)
+{
+  return length ? sha204CrcArray(sha204CrcBits(crc, *data, 0), data + 1, length - 1) : crc;
+}
+
+//! CRC register after feeding \a length zero bytes
+constexpr uint16_t sha204CrcZeros(uint16_t crc, uint8_t length)
+{
+  return length ? sha204CrcZeros(sha204CrcBits(crc, 0, 0), length - 1) : crc;
+}
+
+/** \brief Command packet that is built, CRC included, at compile time.
+ *
+ *  The packet resides in program memory and is sent as it is by
+ *  sha204m_execute_packet_P(), e.g.
+ *  sha204m_execute_packet_P(Sha204RandomPacket::bytes, &view).
+ *  Use it for commands whose op-code, parameters and data never change.
+ */
+template <uint8_t OpCode, uint8_t Param1, uint16_t Param2, uint8_t... Data>
+struct Sha204Packet
+{
+  static constexpr uint8_t count = SHA204_CMD_SIZE_MIN + sizeof...(Data);
+  static constexpr uint16_t crc = sha204Crc(0, count, OpCode, Param1,
+                                            (uint8_t) (Param2 & 0xFF), (uint8_t) (Param2 >> 8), Data...);
+  static const uint8_t bytes[count];
+};
+
+template <uint8_t OpCode, uint8_t Param1, uint16_t Param2, uint8_t... Data>
+const uint8_t Sha204Packet<OpCode, Param1, Param2, Data...>::bytes[] PROGMEM = {
+  count, OpCode, Param1, (uint8_t) (Param2 & 0xFF), (uint8_t) (Param2 >> 8), Data...,
+  (uint8_t) (crc & 0xFF), (uint8_t) (crc >> 8)
+};
+
+#define SHA204_LOCK_STATE_ADDRESS  ((uint16_t) 84)  //!< byte address of the config word holding the lock bytes
+#define SHA204_LOCK_VALUE_ADDRESS  ((uint16_t) 86)  //!< byte address of LockValue, the lock byte of the data and OTP zones
+#define SHA204_LOCK_CONFIG_ADDRESS ((uint16_t) 87)  //!< byte address of LockConfig, the lock byte of the configuration zone
+#define SHA204_LOCK_UNLOCKED       ((uint8_t) 0x55) //!< value of a lock byte while its zones are unlocked
+#define SHA204_LOCK_LOCKED         ((uint8_t) 0x00) //!< value of a lock byte after a Lock command
+
+//! Random without updating the seed
+typedef Sha204Packet<SHA204_RANDOM, RANDOM_NO_SEED_UPDATE, 0> Sha204RandomPacket;
+//! Read of the first 32 configuration bytes, which hold the serial number
+typedef Sha204Packet<SHA204_READ, SHA204_ZONE_CONFIG | READ_ZONE_MODE_32_BYTES, 0> Sha204SerialNumberPacket;
+//! Read of UserExtra, Selector, LockValue and LockConfig
+typedef Sha204Packet<SHA204_READ, SHA204_ZONE_CONFIG, (SHA204_LOCK_STATE_ADDRESS >> 2)> Sha204LockStatePacket;
+
+#endif
@@ -0,0 +1,225 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "Sha204RandomPool.h"
+#include "../atsha204-atmel/sha204_lib_return_codes.h"
+
+#define SHA204_POOL_NONCE_SIZE     (16)     // bytes of a second Random taken as DRBG nonce
+
+Sha204RandomPool::Sha204RandomPool(AtSha204& device, uint32_t reseed_bytes, uint32_t reseed_ms) : device(device)
+{
+  this->reseed_bytes = reseed_bytes;
+  this->reseed_ms = reseed_ms;
+  this->served = 0;
+  this->seeded_at = 0;
+  this->seeded = 0;
+  this->available = 0;
+}
+
+Sha204RandomPool::~Sha204RandomPool()
+{
+  memset(this->key, 0, sizeof(this->key));
+  memset(this->value, 0, sizeof(this->value));
+  memset(this->pool, 0, sizeof(this->pool));
+}
+
+/** \brief This function runs the update function of the DRBG.
+ *
+ *  K = HMAC(K, V || 0x00 || data), V = HMAC(K, V), and with data a second
+ *  round with 0x01. The data are the two blocks one after the other.
+	\param[in] data1 first block of data, can be NULL if length1 is 0
+	\param[in] length1 number of bytes in the first block
+	\param[in] data2 second block of data, can be NULL if length2 is 0
+	\param[in] length2 number of bytes in the second block
+*/
+void Sha204RandomPool::update(const uint8_t* data1, uint8_t length1, const uint8_t* data2, uint8_t length2)
+{
+	uint8_t round;
+
+	for (round = 0; round < 2; round++)
+	{
+		Sha256.initHmac(this->key, sizeof(this->key));
+		Sha256.write(this->value, sizeof(this->value));
+		Sha256.write(round);
+		Sha256.write(data1, length1);
+		Sha256.write(data2, length2);
+		memcpy(this->key, Sha256.resultHmac(), sizeof(this->key));
+
+		Sha256.initHmac(this->key, sizeof(this->key));
+		Sha256.write(this->value, sizeof(this->value));
+		memcpy(this->value, Sha256.resultHmac(), sizeof(this->value));
+
+		if (!length1 && !length2)
+			break;
+	}
+}
+
+/** \brief This function runs the generate function of the DRBG.
+	\param[out] data where the bytes go
+	\param[in] length number of bytes
+*/
+void Sha204RandomPool::generate(uint8_t* data, uint16_t length)
+{
+	uint8_t count;
+
+	while (length)
+	{
+		Sha256.initHmac(this->key, sizeof(this->key));
+		Sha256.write(this->value, sizeof(this->value));
+		memcpy(this->value, Sha256.resultHmac(), sizeof(this->value));
+
+		count = (length < sizeof(this->value)) ? length : sizeof(this->value);
+		memcpy(data, this->value, count);
+		data += count;
+		length -= count;
+	}
+
+	update(NULL, 0, NULL, 0);
+}
+
+/** \brief This function seeds the DRBG from the device.
+ *
+ *  The entropy input is a Random of the device, the nonce half of a
+ *  second one.
+	\param[in] personalization personalization string, can be NULL
+	\param[in] length number of bytes in the personalization string
+	\return status of the operation
+*/
+uint8_t Sha204RandomPool::begin(const uint8_t* personalization, uint8_t length)
+{
+	uint8_t seed[HASH_LENGTH + HASH_LENGTH];
+	uint8_t ret_code;
+
+	ret_code = this->device.getRandom(seed);
+	if (ret_code == SHA204_SUCCESS)
+		ret_code = this->device.getRandom(&seed[HASH_LENGTH]);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+
+	memset(this->key, 0x00, sizeof(this->key));
+	memset(this->value, 0x01, sizeof(this->value));
+	update(seed, HASH_LENGTH + SHA204_POOL_NONCE_SIZE, personalization, length);
+	memset(seed, 0, sizeof(seed));
+
+	memset(this->pool, 0, sizeof(this->pool));
+	this->available = 0;
+	this->served = 0;
+	this->seeded_at = millis();
+	this->seeded = 1;
+
+	return ret_code;
+}
+
+/** \brief This function reseeds the DRBG with a Random of the device.
+	\return status of the operation
+*/
+uint8_t Sha204RandomPool::reseed(void)
+{
+	uint8_t entropy[HASH_LENGTH];
+	uint8_t ret_code;
+
+	if (!this->seeded)
+		return SHA204_FUNC_FAIL;
+
+	ret_code = this->device.getRandom(entropy);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+
+	update(entropy, sizeof(entropy), NULL, 0);
+	memset(entropy, 0, sizeof(entropy));
+
+	// Bytes generated before the reseed are not served any more.
+	memset(this->pool, 0, sizeof(this->pool));
+	this->available = 0;
+	this->served = 0;
+	this->seeded_at = millis();
+
+	return ret_code;
+}
+
+/** \brief This function reseeds the DRBG if it served enough bytes or ran long enough.
+
+	Call it from the main loop, where the time the device takes does not hurt.
+	\return status of the operation
+*/
+uint8_t Sha204RandomPool::service(void)
+{
+	if (!this->seeded)
+		return SHA204_FUNC_FAIL;
+
+	if (this->served < this->reseed_bytes && millis() - this->seeded_at < this->reseed_ms)
+		return SHA204_SUCCESS;
+
+	return reseed();
+}
+
+/** \brief This function serves random bytes.
+ *
+ *  Unused bytes of the last generated block are served first. Whole
+ *  blocks of the rest are generated straight into \a data, and a tail is
+ *  taken from a new block.
+	\param[out] data where the bytes go
+	\param[in] length number of bytes
+	\return status of the operation
+*/
+uint8_t Sha204RandomPool::read(uint8_t* data, uint16_t length)
+{
+	uint16_t count;
+	uint8_t ret_code;
+
+	if (!this->seeded)
+		return SHA204_FUNC_FAIL;
+	if (!data && length)
+		return SHA204_BAD_PARAM;
+
+	// service() was not called for too long.
+	if (this->served >= 2 * this->reseed_bytes)
+	{
+		ret_code = reseed();
+		if (ret_code != SHA204_SUCCESS)
+			return ret_code;
+	}
+	this->served += length;
+
+	while (length)
+	{
+		if (this->available)
+		{
+			count = (length < this->available) ? length : this->available;
+			memcpy(data, &this->pool[sizeof(this->pool) - this->available], count);
+			memset(&this->pool[sizeof(this->pool) - this->available], 0, count);
+			this->available -= count;
+		}
+		else if (length >= sizeof(this->pool))
+		{
+			count = length - length % sizeof(this->pool);
+			generate(data, count);
+		}
+		else
+		{
+			generate(this->pool, sizeof(this->pool));
+			this->available = sizeof(this->pool);
+			continue;
+		}
+		data += count;
+		length -= count;
+	}
+
+	return SHA204_SUCCESS;
+}
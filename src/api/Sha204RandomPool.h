@@ -0,0 +1,67 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LIB_SHA204RANDOMPOOL_H_
+#define LIB_SHA204RANDOMPOOL_H_
+
+#include <Arduino.h>
+#include "AtSha204.h"
+#include "../softcrypto/sha_256.h"
+
+#define SHA204_POOL_RESEED_BYTES   (1024)   //!< default number of bytes served before service() reseeds
+#define SHA204_POOL_RESEED_MS      (60000)  //!< default time in ms after which service() reseeds
+
+/** \brief Random bytes from an HMAC-DRBG (NIST SP 800-90A) seeded by the Random command.
+ *
+ *  Requests are served in software from HMAC-SHA256 of Sha256Class, so
+ *  they do not wait for the bus. Bytes of a generated block that a
+ *  request does not take are kept for the next request and erased as
+ *  they are served. Call service() from the main loop. It reseeds from
+ *  the device after the configured number of bytes or time. If it is not
+ *  called, read() reseeds itself once twice as many bytes were served.
+ */
+class Sha204RandomPool
+{
+public:
+  Sha204RandomPool(AtSha204& device, uint32_t reseed_bytes = SHA204_POOL_RESEED_BYTES,
+                   uint32_t reseed_ms = SHA204_POOL_RESEED_MS);
+  ~Sha204RandomPool();
+
+  uint8_t begin(const uint8_t* personalization = NULL, uint8_t length = 0);
+  uint8_t read(uint8_t* data, uint16_t length);
+  uint8_t reseed(void);
+  uint8_t service(void);
+
+protected:
+  AtSha204& device;
+  uint32_t reseed_bytes;
+  uint32_t reseed_ms;
+  uint32_t served;                      // bytes served since the last reseed
+  unsigned long seeded_at;              // millis() of the last reseed
+  uint8_t seeded;
+  uint8_t key[HASH_LENGTH];             // K of the DRBG
+  uint8_t value[HASH_LENGTH];           // V of the DRBG
+  uint8_t pool[HASH_LENGTH];            // generated bytes, the last available ones are unused
+  uint8_t available;
+
+  void update(const uint8_t* data1, uint8_t length1, const uint8_t* data2, uint8_t length2);
+  void generate(uint8_t* data, uint16_t length);
+};
+
+#endif
@@ -38,9 +38,73 @@
  * \atsha204_library_license_stop
  */
 
+#include <string.h>                    // needed for memcpy()
 #include "sha204_comm.h"                // definitions and declarations for the Communication module
 #include "../common-atmel/timer_utilities.h"            // definitions for delay functions
 #include "sha204_lib_return_codes.h"    // declarations of function return codes
+#ifdef SHA204_I2C_NON_BLOCKING
+#   include "Arduino.h"                 // micros()
+#endif
+
+
+/** \brief This function feeds one byte into a CRC register.
+ * \param[in] crc_register CRC of the bytes fed so far
+ * \param[in] data byte to feed
+ * \return CRC of all bytes fed
+ */
+static uint16_t sha204c_update_crc_byte(uint16_t crc_register, uint8_t data)
+{
+	uint16_t polynom = 0x8005;
+	uint8_t shift_register;
+	uint8_t data_bit, crc_bit;
+
+	for (shift_register = 0x01; shift_register > 0x00; shift_register <<= 1) {
+		data_bit = (data & shift_register) ? 1 : 0;
+		crc_bit = crc_register >> 15;
+		crc_register <<= 1;
+		if (data_bit != crc_bit)
+			crc_register ^= polynom;
+	}
+
+	return crc_register;
+}
+
+
+/** \brief This function feeds bytes into a CRC register.
+ *
+ * Start with a register of zero. Data that is not contiguous can be fed
+ * in pieces.
+ * \param[in] crc_register CRC of the bytes fed so far
+ * \param[in] length number of bytes in buffer
+ * \param[in] data pointer to data for which CRC should be calculated
+ * \return CRC of all bytes fed
+ */
+uint16_t sha204c_update_crc(uint16_t crc_register, uint8_t length, uint8_t *data)
+{
+	uint8_t counter;
+
+	for (counter = 0; counter < length; counter++)
+		crc_register = sha204c_update_crc_byte(crc_register, data[counter]);
+
+	return crc_register;
+}
+
+
+/** \brief This function feeds bytes that reside in program memory into a CRC register.
+ * \param[in] crc_register CRC of the bytes fed so far
+ * \param[in] length number of bytes in buffer
+ * \param[in] data pointer to data in program memory
+ * \return CRC of all bytes fed
+ */
+static uint16_t sha204c_update_crc_P(uint16_t crc_register, uint8_t length, const uint8_t *data)
+{
+	uint8_t counter;
+
+	for (counter = 0; counter < length; counter++)
+		crc_register = sha204c_update_crc_byte(crc_register, SHA204_READ_PROGMEM(&data[counter]));
+
+	return crc_register;
+}
 
 
 /** \brief This function calculates CRC.
@@ -50,21 +114,8 @@
  * \param[out] crc pointer to 16-bit CRC
  */
 void sha204c_calculate_crc(uint8_t length, uint8_t *data, uint8_t *crc) {
-	uint8_t counter;
-	uint16_t crc_register = 0;
-	uint16_t polynom = 0x8005;
-	uint8_t shift_register;
-	uint8_t data_bit, crc_bit;
+	uint16_t crc_register = sha204c_update_crc(0, length, data);
 
-	for (counter = 0; counter < length; counter++) {
-	  for (shift_register = 0x01; shift_register > 0x00; shift_register <<= 1) {
-		 data_bit = (data[counter] & shift_register) ? 1 : 0;
-		 crc_bit = crc_register >> 15;
-		 crc_register <<= 1;
-		 if (data_bit != crc_bit)
-			crc_register ^= polynom;
-	  }
-	}
 	crc[0] = (uint8_t) (crc_register & 0x00FF);
 	crc[1] = (uint8_t) (crc_register >> 8);
 }
@@ -167,147 +218,512 @@ uint8_t sha204c_resync(uint8_t size, uint8_t *response)
 }
 
 
-/** \brief This function runs a communication sequence.
+/** \brief This function starts the retry state of a communication sequence.
+ * \ingroup atsha204_communication
+ *
+ * The first action is #SHA204C_ACTION_SEND.
+ * \param[out] retry retry state
+ */
+void sha204c_retry_init(struct sha204c_retry *retry)
+{
+	retry->action = SHA204C_ACTION_SEND;
+	retry->ret_code = SHA204_FUNC_FAIL;
+	retry->n_retries_send = SHA204_RETRY_COUNT;
+	retry->n_retries_receive = 0;
+	retry->receive_again = 0;
+}
+
+
+/** \brief This function sends the command again if retries are left.
+ * \param[in,out] retry retry state
+ * \return next action
+ */
+static uint8_t sha204c_retry_send(struct sha204c_retry *retry)
+{
+	if (retry->n_retries_send == 0)
+		return retry->action = SHA204C_ACTION_DONE;
+
+	retry->n_retries_send--;
+	return retry->action = SHA204C_ACTION_SEND;
+}
+
+
+/** \brief This function decides the next action of a communication sequence.
+ * \ingroup atsha204_communication
+ *
+ * It does not touch the bus, so blocking loops, state machines and
+ * coroutines all retry by the same rules:
+ * - If sending fails, re-synchronize and send again.
+ * - If the device does not respond until the execution timeout,
+ *   re-synchronize and send again.
+ * - If count or CRC of the response is wrong, re-synchronize and receive
+ *   the response again, or send the command again if the device had to
+ *   be woken up.
+ * - If the device received the command with a communication error,
+ *   send it again.
+ * - Give up if the device does not respond to a resync.
+ *
+ * \param[in,out] retry retry state
+ * \param[in] ret_code result of sha204c_retry::action. For
+ *            #SHA204C_ACTION_RECEIVE this is the status of the checked
+ *            response, see #sha204c_check_view, or the error of receiving it.
+ * \return next action, see #sha204c_action
+ */
+uint8_t sha204c_retry_step(struct sha204c_retry *retry, uint8_t ret_code)
+{
+	switch (retry->action) {
+	case SHA204C_ACTION_SEND:
+		if (ret_code == SHA204_SUCCESS) {
+			retry->n_retries_receive = SHA204_RETRY_COUNT;
+			return retry->action = SHA204C_ACTION_RECEIVE;
+		}
+		retry->ret_code = ret_code;
+		retry->receive_again = 0;
+		return retry->action = SHA204C_ACTION_RESYNC;
+
+	case SHA204C_ACTION_RECEIVE:
+		retry->ret_code = ret_code;
+		if (ret_code == SHA204_SUCCESS || ret_code == SHA204_PARSE_ERROR || ret_code == SHA204_CMD_FAIL)
+			return retry->action = SHA204C_ACTION_DONE;
+		if (ret_code == SHA204_STATUS_CRC)
+			// The device status byte indicates a communication error.
+			return sha204c_retry_send(retry);
+
+		// We did not receive a response, or count or CRC are wrong.
+		retry->receive_again = (ret_code != SHA204_RX_NO_RESPONSE);
+		return retry->action = SHA204C_ACTION_RESYNC;
+
+	case SHA204C_ACTION_RESYNC:
+		if (ret_code == SHA204_RX_NO_RESPONSE)
+			// The device seems to be dead in the water.
+			return retry->action = SHA204C_ACTION_DONE;
+		if (!retry->receive_again)
+			return sha204c_retry_send(retry);
+
+		if (ret_code == SHA204_SUCCESS) {
+			// We did not have to wake up the device. Try receiving the response again.
+			if (retry->n_retries_receive == 0)
+				return sha204c_retry_send(retry);
+			retry->n_retries_receive--;
+			return retry->action = SHA204C_ACTION_RECEIVE;
+		}
+		if (ret_code == SHA204_RESYNC_WITH_WAKEUP)
+			// We could re-synchronize, but only after waking up the device.
+			return sha204c_retry_send(retry);
+
+		// We failed to re-synchronize.
+		return retry->action = SHA204C_ACTION_DONE;
+
+	default:
+		return SHA204C_ACTION_DONE;
+	}
+}
+
+
+/** \brief This function translates the status of a response with valid CRC.
+ * \param[in] count count byte of the response
+ * \param[in] status_byte first byte after the count byte
+ * \return status of the operation, see #sha204c_check_response
+ */
+static uint8_t sha204c_check_status(uint8_t count, uint8_t status_byte)
+{
+	if (count > SHA204_RSP_SIZE_MIN)
+		// Received non-status response.
+		return SHA204_SUCCESS;
+
+	// Translate the three possible device status error codes
+	// into library return codes.
+	if (status_byte == SHA204_STATUS_BYTE_PARSE)
+		return SHA204_PARSE_ERROR;
+	if (status_byte == SHA204_STATUS_BYTE_EXEC)
+		return SHA204_CMD_FAIL;
+	if (status_byte == SHA204_STATUS_BYTE_COMM)
+		return SHA204_STATUS_CRC;
+
+	// Received status response from CheckMAC, DeriveKey, GenDig,
+	// Lock, Nonce, Pause, UpdateExtra, or Write command.
+	return SHA204_SUCCESS;
+}
+
+
+/** \brief This function checks a response of valid size.
+ *
+ * Status responses are translated into library return codes.
+ * \param[in] response pointer to response
+ * \return #SHA204_SUCCESS for a data response or a status response that
+ *         does not signal an error, #SHA204_PARSE_ERROR or #SHA204_CMD_FAIL for
+ *         the matching device status, #SHA204_STATUS_CRC if the device
+ *         received the command with a communication error and it has to be
+ *         sent again, #SHA204_BAD_CRC if the response has to be read again
+ */
+uint8_t sha204c_check_response(uint8_t *response)
+{
+	if (sha204c_check_crc(response) != SHA204_SUCCESS)
+		return SHA204_BAD_CRC;
+
+	return sha204c_check_status(response[SHA204_BUFFER_POS_COUNT], response[SHA204_BUFFER_POS_STATUS]);
+}
+
+
+/** \brief This function returns where a byte of a response is stored in a view.
+ * \param[in] view response view
+ * \param[in] index position of the byte in the response packet
+ * \return pointer to the byte
+ */
+static uint8_t *sha204c_view_byte(struct sha204_response_view *view, uint8_t index)
+{
+	if (index == SHA204_BUFFER_POS_COUNT)
+		return &view->count;
+	if (index <= view->size)
+		return &view->data[index - SHA204_BUFFER_POS_DATA];
+	return &view->crc[index - view->size - SHA204_BUFFER_POS_DATA];
+}
+
+
+/** \brief This function checks a response received into a view.
+ *
+ * The count byte has to be valid. CRC and status byte of a response
+ * shorter than \a size are moved into the view first.
+ * \param[in,out] view response view
+ * \return status of the operation, see #sha204c_check_response
+ */
+uint8_t sha204c_check_view(struct sha204_response_view *view)
+{
+	uint8_t length = view->count - SHA204_BUFFER_POS_DATA - SHA204_CRC_SIZE;
+	uint16_t crc_register;
+	uint8_t crc_lsb, crc_msb;
+
+	if (length < view->size) {
+		// With a count of size + 2 the CRC position overlaps view->crc itself,
+		// so both bytes are read before either gets assigned.
+		crc_lsb = *sha204c_view_byte(view, view->count - SHA204_CRC_SIZE);
+		crc_msb = *sha204c_view_byte(view, view->count - 1);
+		view->crc[0] = crc_lsb;
+		view->crc[1] = crc_msb;
+	}
+	view->status = view->data[0];
+
+	crc_register = sha204c_update_crc(0, 1, &view->count);
+	crc_register = sha204c_update_crc(crc_register, length, view->data);
+	if (view->crc[0] != (uint8_t) (crc_register & 0x00FF) || view->crc[1] != (uint8_t) (crc_register >> 8))
+		return SHA204_BAD_CRC;
+
+	return sha204c_check_status(view->count, view->status);
+}
+
+
+/** \brief This function calculates the CRC over header and data blocks of a command.
+ * \param[in,out] command command, its CRC goes into command->crc
+ */
+static void sha204c_calculate_command_crc(struct sha204_command_view *command)
+{
+	uint16_t crc_register;
+	uint8_t i;
+
+	crc_register = sha204c_update_crc(0, SHA204_CMD_HEADER_SIZE, command->header);
+	for (i = 0; i < SHA204_CMD_DATA_BLOCKS; i++) {
+		if (command->progmem & SHA204_DATA_PROGMEM(i))
+			crc_register = sha204c_update_crc_P(crc_register, command->datalen[i], command->data[i]);
+		else
+			crc_register = sha204c_update_crc(crc_register, command->datalen[i], command->data[i]);
+	}
+	command->crc[0] = (uint8_t) (crc_register & 0x00FF);
+	command->crc[1] = (uint8_t) (crc_register >> 8);
+}
+
+
+/** \brief This function calculates the CRC of a command and runs its communication sequence.
  *
- * Append CRC to tx buffer, send command, delay, and verify response after receiving it.
+ * Calculate the CRC of the command into command->crc and run
+ * #sha204c_send_and_receive_prebuilt.
  *
- * The first byte in tx buffer must be the byte count of the packet.
+ * \param[in,out] command header and data blocks of the command, see #sha204_command_view
+ * \param[in,out] view where the response goes, see #sha204_response_view
+ * \param[in] execution_delay Start polling for a response after this many ms.
+ * \param[in] execution_timeout polling timeout in ms
+ * \return status of the operation
+ */
+uint8_t sha204c_send_and_receive_view(struct sha204_command_view *command, struct sha204_response_view *view,
+			uint8_t execution_delay, uint8_t execution_timeout)
+{
+	sha204c_calculate_command_crc(command);
+
+	return sha204c_send_and_receive_prebuilt(command, view, execution_delay, execution_timeout);
+}
+
+
+/** \brief This function runs a communication sequence and receives the response into a view.
+ *
+ * Send a command whose CRC is already in command->crc from where its parts are,
+ * delay, and verify response after receiving it. Commands built at compile time
+ * come with their CRC and are sent as they are.
+ *
+ * The first header byte of the command must be the byte count of the packet.
  * If CRC or count of the response is incorrect, or a command byte did not get acknowledged
  * (I<SUP>2</SUP>), this function requests the device to resend the response.
  * If the response contains an error status, this function resends the command.
+ * The retries are decided by #sha204c_retry_step.
  *
- * \param[in] tx_buffer pointer to command
- * \param[in] rx_size size of response buffer
- * \param[out] rx_buffer pointer to response buffer
+ * \param[in,out] command header and data blocks of the command, see #sha204_command_view
+ * \param[in,out] view where the response goes, see #sha204_response_view
  * \param[in] execution_delay Start polling for a response after this many ms.
  * \param[in] execution_timeout polling timeout in ms
  * \return status of the operation
  */
-uint8_t sha204c_send_and_receive(uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer,
+uint8_t sha204c_send_and_receive_prebuilt(struct sha204_command_view *command, struct sha204_response_view *view,
 			uint8_t execution_delay, uint8_t execution_timeout)
 {
+	struct sha204c_retry retry;
 	uint8_t ret_code = SHA204_FUNC_FAIL;
-	uint8_t ret_code_resync;
-	uint8_t n_retries_send;
-	uint8_t n_retries_receive;
-	uint8_t i;
-	uint8_t status_byte;
-	uint8_t count = tx_buffer[SHA204_BUFFER_POS_COUNT];
-	uint8_t count_minus_crc = count - SHA204_CRC_SIZE;
+	uint8_t wakeup_response[SHA204_RSP_SIZE_MIN];
+#ifndef SHA204_I2C_ACK_POLLING
 	uint16_t execution_timeout_us = (uint16_t) (execution_timeout * 1000) + SHA204_RESPONSE_TIMEOUT;
 	volatile uint16_t timeout_countdown;
+#endif
 
-	// Append CRC.
-	sha204c_calculate_crc(count_minus_crc, tx_buffer, tx_buffer + count_minus_crc);
+	view->count = 0;
+	view->crc[0] = view->crc[1] = 0;
 
 	// Retry loop for sending a command and receiving a response.
-	n_retries_send = SHA204_RETRY_COUNT + 1;
-
-	while ((n_retries_send-- > 0) && (ret_code != SHA204_SUCCESS)) {
-
-		// Send command.
-		ret_code = sha204p_send_command(count, tx_buffer);
-		if (ret_code != SHA204_SUCCESS) {
-			if (sha204c_resync(rx_size, rx_buffer) == SHA204_RX_NO_RESPONSE)
-				// The device seems to be dead in the water.
-				return ret_code;
-			else
-				continue;
-		}
-
-		// Wait minimum command execution time and then start polling for a response.
-		delay_ms(execution_delay);
-
-		// Retry loop for receiving a response.
-		n_retries_receive = SHA204_RETRY_COUNT + 1;
-		while (n_retries_receive-- > 0) {
-
-			// Reset response buffer.
-			for (i = 0; i < rx_size; i++)
-				rx_buffer[i] = 0;
-
+	sha204c_retry_init(&retry);
+	for (;;) {
+		switch (retry.action) {
+		case SHA204C_ACTION_SEND:
+			ret_code = sha204p_send_view(command);
+#ifndef SHA204_I2C_ACK_POLLING
+			if (ret_code == SHA204_SUCCESS)
+				// Wait minimum command execution time and then start polling for a response.
+				delay_ms(execution_delay);
+#endif
+			break;
+
+		case SHA204C_ACTION_RECEIVE:
+#ifdef SHA204_I2C_ACK_POLLING
+			// Poll the device address until the device has finished
+			// executing the command and read the response right away.
+			ret_code = sha204p_poll_view(view, (uint16_t) execution_delay + execution_timeout);
+#else
 			// Poll for response.
 			timeout_countdown = execution_timeout_us;
 			do {
-				ret_code = sha204p_receive_response(rx_size, rx_buffer);
+				ret_code = sha204p_receive_view(view);
 				timeout_countdown -= SHA204_RESPONSE_TIMEOUT;
 			} while ((timeout_countdown > SHA204_RESPONSE_TIMEOUT) && (ret_code == SHA204_RX_NO_RESPONSE));
+#endif
+			if (ret_code == SHA204_SUCCESS)
+				// We received a response of valid size.
+				// Check the consistency of the response.
+				ret_code = sha204c_check_view(view);
+			break;
+
+		case SHA204C_ACTION_RESYNC:
+			ret_code = sha204c_resync(sizeof(wakeup_response), wakeup_response);
+			break;
+
+		default:
+			return retry.ret_code;
+		}
+		(void) sha204c_retry_step(&retry, ret_code);
+	}
+}
 
-			if (ret_code == SHA204_RX_NO_RESPONSE) {
-				// We did not receive a response. Re-synchronize and send command again.
-				if (sha204c_resync(rx_size, rx_buffer) == SHA204_RX_NO_RESPONSE)
-					// The device seems to be dead in the water.
-					return ret_code;
-				else
-					break;
-			}
 
-			// Check whether we received a valid response.
-			if (ret_code == SHA204_INVALID_SIZE) {
-				// We see 0xFF for the count when communication got out of sync.
-				ret_code_resync = sha204c_resync(rx_size, rx_buffer);
-				if (ret_code_resync == SHA204_SUCCESS)
-					// We did not have to wake up the device. Try receiving response again.
-					continue;
-				if (ret_code_resync == SHA204_RESYNC_WITH_WAKEUP)
-					// We could re-synchronize, but only after waking up the device.
-					// Re-send command.
-					break;
-				else
-					// We failed to re-synchronize.
-					return ret_code;
-			}
+/** \brief This function runs a communication sequence.
+ *
+ * It sends the command in \a tx_buffer and appends its CRC there.
+ * It receives the response into a view over \a rx_buffer and puts count
+ * byte and CRC around the data, see #sha204c_send_and_receive_view.
+ *
+ * \param[in] tx_buffer pointer to command
+ * \param[in] rx_size size of response buffer
+ * \param[out] rx_buffer pointer to response buffer
+ * \param[in] execution_delay Start polling for a response after this many ms.
+ * \param[in] execution_timeout polling timeout in ms
+ * \return status of the operation
+ */
+uint8_t sha204c_send_and_receive(uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer,
+			uint8_t execution_delay, uint8_t execution_timeout)
+{
+	struct sha204_command_view command;
+	struct sha204_response_view view;
+	uint8_t count = tx_buffer[SHA204_BUFFER_POS_COUNT];
+	uint8_t ret_code;
+
+	if (count < SHA204_CMD_SIZE_MIN)
+		return SHA204_BAD_PARAM;
+
+	// The header is copied. The rest of the command is sent from tx_buffer.
+	memcpy(command.header, tx_buffer, SHA204_CMD_HEADER_SIZE);
+	command.datalen[0] = count - SHA204_CMD_SIZE_MIN;
+	command.data[0] = &tx_buffer[SHA204_CMD_HEADER_SIZE];
+	command.datalen[1] = command.datalen[2] = 0;
+	command.progmem = 0;
+
+	view.size = rx_size - SHA204_BUFFER_POS_DATA - SHA204_CRC_SIZE;
+	view.data = &rx_buffer[SHA204_BUFFER_POS_DATA];
+
+	ret_code = sha204c_send_and_receive_view(&command, &view, execution_delay, execution_timeout);
+
+	tx_buffer[count - SHA204_CRC_SIZE] = command.crc[0];
+	tx_buffer[count - 1] = command.crc[1];
+
+	rx_buffer[SHA204_BUFFER_POS_COUNT] = view.count;
+	if ((view.count >= SHA204_RSP_SIZE_MIN) && (view.count <= rx_size)) {
+		rx_buffer[view.count - SHA204_CRC_SIZE] = view.crc[0];
+		rx_buffer[view.count - 1] = view.crc[1];
+	}
 
-			// We received a response of valid size.
-			// Check the consistency of the response.
-			ret_code = sha204c_check_crc(rx_buffer);
+	return ret_code;
+}
+
+
+#ifdef SHA204_I2C_NON_BLOCKING
+//! steps of the action a communication sequence run by #sha204c_poll is carrying out
+enum sha204c_exchange_state {
+	SHA204C_SENDING,      //!< The command is being sent.
+	SHA204C_WAITING,      //!< The device is executing the command or was busy when polled.
+	SHA204C_RECEIVING,    //!< The response is being received.
+	SHA204C_RESYNCING,    //!< Communication gets re-synchronized with the next poll.
+	SHA204C_DONE          //!< No action is running.
+};
+
+
+/** \brief This function starts the action the retry state of a sequence asks for.
+ *
+ * Sending runs in the background. Polling for the response starts after
+ * the execution delay if the command has just been sent. A resync is left
+ * to the next call of #sha204c_poll.
+ * \param[in,out] exchange communication sequence
+ * \return #SHA204_PENDING while the sequence is running, otherwise its status
+ */
+static uint8_t sha204c_begin(struct sha204c_exchange *exchange)
+{
+	uint8_t ret_code;
+
+	for (;;) {
+		switch (exchange->retry.action) {
+		case SHA204C_ACTION_SEND:
+			ret_code = sha204p_start_view(exchange->command);
 			if (ret_code == SHA204_SUCCESS) {
-				// Received valid response.
-				if (rx_buffer[SHA204_BUFFER_POS_COUNT] > SHA204_RSP_SIZE_MIN)
-					// Received non-status response. We are done.
-					return ret_code;
-
-				// Received status response.
-				status_byte = rx_buffer[SHA204_BUFFER_POS_STATUS];
-
-				// Translate the three possible device status error codes
-				// into library return codes.
-				if (status_byte == SHA204_STATUS_BYTE_PARSE)
-					return SHA204_PARSE_ERROR;
-				if (status_byte == SHA204_STATUS_BYTE_EXEC)
-					return SHA204_CMD_FAIL;
-				if (status_byte == SHA204_STATUS_BYTE_COMM) {
-					// In case of the device status byte indicating a communication
-					// error this function exits the retry loop for receiving a response
-					// and enters the overall retry loop
-					// (send command / receive response).
-					ret_code = SHA204_STATUS_CRC;
-					break;
-				}
-
-				// Received status response from CheckMAC, DeriveKey, GenDig,
-				// Lock, Nonce, Pause, UpdateExtra, or Write command.
-				return ret_code;
+				exchange->state = SHA204C_SENDING;
+				return SHA204_PENDING;
 			}
+			break;
+
+		case SHA204C_ACTION_RECEIVE:
+			exchange->receive_us = micros();
+			if (exchange->state == SHA204C_SENDING)
+				// Wait minimum command execution time and then start polling for a response.
+				exchange->receive_us += (uint32_t) exchange->execution_delay * 1000;
+			exchange->next_poll_us = exchange->receive_us;
+			exchange->state = SHA204C_WAITING;
+			return SHA204_PENDING;
+
+		case SHA204C_ACTION_RESYNC:
+			exchange->state = SHA204C_RESYNCING;
+			return SHA204_PENDING;
+
+		default:
+			exchange->state = SHA204C_DONE;
+			return exchange->retry.ret_code;
+		}
+		(void) sha204c_retry_step(&exchange->retry, ret_code);
+	}
+}
 
-			else {
-				// Received response with incorrect CRC.
-				ret_code_resync = sha204c_resync(rx_size, rx_buffer);
-				if (ret_code_resync == SHA204_SUCCESS)
-					// We did not have to wake up the device. Try receiving response again.
-					continue;
-				if (ret_code_resync == SHA204_RESYNC_WITH_WAKEUP)
-					// We could re-synchronize, but only after waking up the device.
-					// Re-send command.
-					break;
-				else
-					// We failed to re-synchronize.
-					return ret_code;
-			} // block end of check response consistency
-
-		} // block end of receive retry loop
-
-	} // block end of send and receive retry loop
 
-	return ret_code;
+/** \brief This function starts a communication sequence and returns without waiting.
+ *
+ * The command is sent by the interrupt routine. Call #sha204c_poll until
+ * it no longer returns #SHA204_PENDING. The CPU is free for other work
+ * while the command is sent, while the device executes it and while the
+ * response is received. No other command may be sent in the meantime.
+ *
+ * \param[out] exchange state of the sequence
+ * \param[in,out] command header and data blocks of the command, see #sha204_command_view
+ * \param[in,out] view where the response goes, see #sha204_response_view
+ * \param[in] execution_delay Start polling for a response after this many ms.
+ * \param[in] execution_timeout polling timeout in ms
+ * \return #SHA204_PENDING while the sequence is running, otherwise its status
+ */
+uint8_t sha204c_start(struct sha204c_exchange *exchange, struct sha204_command_view *command,
+			struct sha204_response_view *view, uint8_t execution_delay, uint8_t execution_timeout)
+{
+	exchange->command = command;
+	exchange->view = view;
+	exchange->execution_delay = execution_delay;
+	exchange->execution_timeout = execution_timeout;
+	exchange->state = SHA204C_DONE;
+	view->count = 0;
+	view->crc[0] = view->crc[1] = 0;
+
+	sha204c_calculate_command_crc(command);
+
+	sha204c_retry_init(&exchange->retry);
+	return sha204c_begin(exchange);
+}
+
+
+/** \brief This function advances a communication sequence without blocking.
+ *
+ * The device is addressed at most every #SHA204_RESPONSE_TIMEOUT us while
+ * it is busy. Errors are retried the way #sha204c_retry_step decides, so
+ * the sequence ends like #sha204c_send_and_receive_view would. Only a
+ * resync blocks, for the reset sequence on the bus and, if the device
+ * has to be woken up, for its Wake-up delay. It runs in a call of its own.
+ * \param[in,out] exchange sequence started by #sha204c_start
+ * \return #SHA204_PENDING while the sequence is running, otherwise its status
+ */
+uint8_t sha204c_poll(struct sha204c_exchange *exchange)
+{
+	uint8_t wakeup_response[SHA204_RSP_SIZE_MIN];
+	uint8_t ret_code;
+
+	switch (exchange->state) {
+	case SHA204C_SENDING:
+		ret_code = sha204p_poll();
+		if (ret_code == SHA204_PENDING)
+			return ret_code;
+		break;
+
+	case SHA204C_WAITING:
+		if ((int32_t) (micros() - exchange->next_poll_us) < 0)
+			return SHA204_PENDING;
+
+		ret_code = sha204p_start_receive_view(exchange->view);
+		if (ret_code == SHA204_SUCCESS) {
+			exchange->state = SHA204C_RECEIVING;
+			return SHA204_PENDING;
+		}
+		break;
+
+	case SHA204C_RECEIVING:
+		ret_code = sha204p_poll();
+		if (ret_code == SHA204_PENDING)
+			return ret_code;
+
+		if (ret_code == SHA204_RX_NO_RESPONSE) {
+			// The device is still busy. Poll again until the execution timeout.
+			if (micros() - exchange->receive_us < (uint32_t) exchange->execution_timeout * 1000) {
+				exchange->next_poll_us = micros() + SHA204_RESPONSE_TIMEOUT;
+				exchange->state = SHA204C_WAITING;
+				return SHA204_PENDING;
+			}
+		}
+		else if (ret_code == SHA204_SUCCESS)
+			ret_code = (exchange->view->count < SHA204_RSP_SIZE_MIN)
+						? SHA204_INVALID_SIZE : sha204c_check_view(exchange->view);
+		break;
+
+	case SHA204C_RESYNCING:
+		ret_code = sha204c_resync(sizeof(wakeup_response), wakeup_response);
+		break;
+
+	default:
+		return exchange->retry.ret_code;
+	}
+
+	(void) sha204c_retry_step(&exchange->retry, ret_code);
+	return sha204c_begin(exchange);
 }
+#endif
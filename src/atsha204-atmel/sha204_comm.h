@@ -1,3 +1,6 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
 /** \file
  *  \brief  Definitions and Prototypes for Communication Layer of ATSHA204 Library
  *  \author Atmel Crypto Products
@@ -93,11 +96,71 @@
 #define SHA204_STATUS_BYTE_COMM      ((uint8_t) 0xFF)
 
 
+//! next action of a communication sequence, see #sha204c_retry_step
+enum sha204c_action {
+	SHA204C_ACTION_SEND,         //!< Send the command and wait for its execution delay.
+	SHA204C_ACTION_RECEIVE,      //!< Poll for the response until the execution timeout and check it.
+	SHA204C_ACTION_RESYNC,       //!< Re-synchronize communication, see #sha204c_resync.
+	SHA204C_ACTION_DONE          //!< The sequence has ended with sha204c_retry::ret_code.
+};
+
+/** \brief This structure holds the retry state of a communication sequence.
+ *
+ * Initialize it with #sha204c_retry_init, carry out sha204c_retry::action
+ * and pass its result to #sha204c_retry_step until the action is
+ * #SHA204C_ACTION_DONE. Whoever drives the sequence, blocking or not,
+ * retries the same way.
+ */
+struct sha204c_retry {
+	uint8_t action;              //!< action to carry out, see #sha204c_action
+	uint8_t ret_code;            //!< status of the sequence so far
+	uint8_t n_retries_send;      //!< attempts left to send the command again
+	uint8_t n_retries_receive;   //!< attempts left to receive the response again
+	uint8_t receive_again;       //!< The resync is for a response that can be received again.
+};
+
+
+uint16_t sha204c_update_crc(uint16_t crc_register, uint8_t length, uint8_t *data);
 void sha204c_calculate_crc(uint8_t length, uint8_t *data, uint8_t *crc);
+uint8_t sha204c_check_crc(uint8_t *response);
+uint8_t sha204c_check_response(uint8_t *response);
+uint8_t sha204c_check_view(struct sha204_response_view *view);
 uint8_t sha204c_wakeup(uint8_t *response);
+uint8_t sha204c_resync(uint8_t size, uint8_t *response);
+void sha204c_retry_init(struct sha204c_retry *retry);
+uint8_t sha204c_retry_step(struct sha204c_retry *retry, uint8_t ret_code);
 uint8_t sha204c_send_and_receive(uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer,
 				uint8_t execution_delay, uint8_t execution_timeout);
+uint8_t sha204c_send_and_receive_view(struct sha204_command_view *command, struct sha204_response_view *view,
+				uint8_t execution_delay, uint8_t execution_timeout);
+uint8_t sha204c_send_and_receive_prebuilt(struct sha204_command_view *command, struct sha204_response_view *view,
+				uint8_t execution_delay, uint8_t execution_timeout);
+
+#ifdef SHA204_I2C_NON_BLOCKING
+/** \brief This structure holds a command that runs without blocking, see #sha204c_start.
+ *
+ * It, the command and the view have to stay valid until #sha204c_poll
+ * no longer returns #SHA204_PENDING.
+ */
+struct sha204c_exchange {
+	struct sha204_command_view *command;      //!< command being run
+	struct sha204_response_view *view;        //!< where the response goes
+	struct sha204c_retry retry;               //!< retry state, see #sha204c_retry_step
+	uint8_t state;                            //!< step of the action being carried out
+	uint8_t execution_delay;                  //!< time in ms after which the response is polled
+	uint8_t execution_timeout;                //!< polling timeout in ms
+	uint32_t receive_us;                      //!< time stamp at which polling for the response started
+	uint32_t next_poll_us;                    //!< time stamp before which the device is not addressed
+};
+
+uint8_t sha204c_start(struct sha204c_exchange *exchange, struct sha204_command_view *command,
+				struct sha204_response_view *view, uint8_t execution_delay, uint8_t execution_timeout);
+uint8_t sha204c_poll(struct sha204c_exchange *exchange);
+#endif
 
 /** @} */
 
 #endif
+#ifdef __cplusplus
+}
+#endif
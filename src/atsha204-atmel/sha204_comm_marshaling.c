@@ -174,8 +174,9 @@ uint8_t sha204m_check_parameters(uint8_t op_code, uint8_t param1, uint16_t param
 }
 
 
-/** \brief This function creates a command packet, sends it, and receives its response.
+/** \brief This function describes a command and supplies its timing.
  *
+ * The command refers to the data blocks instead of copying them.
  * \param[in] op_code command op-code
  * \param[in] param1 first parameter
  * \param[in] param2 second parameter
@@ -185,139 +186,208 @@ uint8_t sha204m_check_parameters(uint8_t op_code, uint8_t param1, uint16_t param
  * \param[in] data2 pointer to second data block
  * \param[in] datalen3 number of bytes in third data block
  * \param[in] data3 pointer to third data block
- * \param[in] tx_size size of tx buffer
- * \param[in] tx_buffer pointer to tx buffer
  * \param[in] rx_size size of rx buffer
- * \param[out] rx_buffer pointer to rx buffer
- * \return status of the operation
+ * \param[out] command header and data blocks of the command
+ * \param[out] response_size size of the response to the command
+ * \param[out] execution_delay Start polling for a response after this many ms.
+ * \param[out] execution_timeout polling timeout in ms
  */
-uint8_t sha204m_execute(uint8_t op_code, uint8_t param1, uint16_t param2,
+static void sha204m_build_view(uint8_t op_code, uint8_t param1, uint16_t param2,
 			uint8_t datalen1, uint8_t *data1, uint8_t datalen2, uint8_t *data2, uint8_t datalen3, uint8_t *data3,
-			uint8_t tx_size, uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer)
+			uint8_t rx_size, struct sha204_command_view *command,
+			uint8_t *response_size, uint8_t *execution_delay, uint8_t *execution_timeout)
 {
-	uint8_t poll_delay, poll_timeout, response_size;
-	uint8_t *p_buffer;
-	uint8_t len;
-
-	// Define SHA204_CHECK_PARAMETERS to compile and link this feature.
-	uint8_t ret_code = sha204m_check_parameters(op_code, param1, param2,
-				datalen1, data1, datalen2, data2, datalen3, data3, 
-				tx_size, tx_buffer, rx_size, rx_buffer);
-	if (ret_code != SHA204_SUCCESS)
-		return ret_code;
-
 	// Supply delays and response size.
 	switch (op_code) {
 	case SHA204_CHECKMAC:
-		poll_delay = CHECKMAC_DELAY;
-		poll_timeout = CHECKMAC_EXEC_MAX - CHECKMAC_DELAY;
-		response_size = CHECKMAC_RSP_SIZE;
+		*execution_delay = CHECKMAC_DELAY;
+		*execution_timeout = CHECKMAC_EXEC_MAX - CHECKMAC_DELAY;
+		*response_size = CHECKMAC_RSP_SIZE;
 		break;
 
 	case SHA204_DERIVE_KEY:
-		poll_delay = DERIVE_KEY_DELAY;
-		poll_timeout = DERIVE_KEY_EXEC_MAX - DERIVE_KEY_DELAY;
-		response_size = DERIVE_KEY_RSP_SIZE;
+		*execution_delay = DERIVE_KEY_DELAY;
+		*execution_timeout = DERIVE_KEY_EXEC_MAX - DERIVE_KEY_DELAY;
+		*response_size = DERIVE_KEY_RSP_SIZE;
 		break;
 
 	case SHA204_DEVREV:
-		poll_delay = DEVREV_DELAY;
-		poll_timeout = DEVREV_EXEC_MAX - DEVREV_DELAY;
-		response_size = DEVREV_RSP_SIZE;
+		*execution_delay = DEVREV_DELAY;
+		*execution_timeout = DEVREV_EXEC_MAX - DEVREV_DELAY;
+		*response_size = DEVREV_RSP_SIZE;
 		break;
 
 	case SHA204_GENDIG:
-		poll_delay = GENDIG_DELAY;
-		poll_timeout = GENDIG_EXEC_MAX - GENDIG_DELAY;
-		response_size = GENDIG_RSP_SIZE;
+		*execution_delay = GENDIG_DELAY;
+		*execution_timeout = GENDIG_EXEC_MAX - GENDIG_DELAY;
+		*response_size = GENDIG_RSP_SIZE;
 		break;
 
 	case SHA204_HMAC:
-		poll_delay = HMAC_DELAY;
-		poll_timeout = HMAC_EXEC_MAX - HMAC_DELAY;
-		response_size = HMAC_RSP_SIZE;
+		*execution_delay = HMAC_DELAY;
+		*execution_timeout = HMAC_EXEC_MAX - HMAC_DELAY;
+		*response_size = HMAC_RSP_SIZE;
 		break;
 
 	case SHA204_LOCK:
-		poll_delay = LOCK_DELAY;
-		poll_timeout = LOCK_EXEC_MAX - LOCK_DELAY;
-		response_size = LOCK_RSP_SIZE;
+		*execution_delay = LOCK_DELAY;
+		*execution_timeout = LOCK_EXEC_MAX - LOCK_DELAY;
+		*response_size = LOCK_RSP_SIZE;
 		break;
 
 	case SHA204_MAC:
-		poll_delay = MAC_DELAY;
-		poll_timeout = MAC_EXEC_MAX - MAC_DELAY;
-		response_size = MAC_RSP_SIZE;
+		*execution_delay = MAC_DELAY;
+		*execution_timeout = MAC_EXEC_MAX - MAC_DELAY;
+		*response_size = MAC_RSP_SIZE;
 		break;
 
 	case SHA204_NONCE:
-		poll_delay = NONCE_DELAY;
-		poll_timeout = NONCE_EXEC_MAX - NONCE_DELAY;
-		response_size = param1 == NONCE_MODE_PASSTHROUGH
+		*execution_delay = NONCE_DELAY;
+		*execution_timeout = NONCE_EXEC_MAX - NONCE_DELAY;
+		*response_size = param1 == NONCE_MODE_PASSTHROUGH
 							? NONCE_RSP_SIZE_SHORT : NONCE_RSP_SIZE_LONG;
 		break;
 
 	case SHA204_PAUSE:
-		poll_delay = PAUSE_DELAY;
-		poll_timeout = PAUSE_EXEC_MAX - PAUSE_DELAY;
-		response_size = PAUSE_RSP_SIZE;
+		*execution_delay = PAUSE_DELAY;
+		*execution_timeout = PAUSE_EXEC_MAX - PAUSE_DELAY;
+		*response_size = PAUSE_RSP_SIZE;
 		break;
 
 	case SHA204_RANDOM:
-		poll_delay = RANDOM_DELAY;
-		poll_timeout = RANDOM_EXEC_MAX - RANDOM_DELAY;
-		response_size = RANDOM_RSP_SIZE;
+		*execution_delay = RANDOM_DELAY;
+		*execution_timeout = RANDOM_EXEC_MAX - RANDOM_DELAY;
+		*response_size = RANDOM_RSP_SIZE;
 		break;
 
 	case SHA204_READ:
-		poll_delay = READ_DELAY;
-		poll_timeout = READ_EXEC_MAX - READ_DELAY;
-		response_size = (param1 & SHA204_ZONE_COUNT_FLAG)
+		*execution_delay = READ_DELAY;
+		*execution_timeout = READ_EXEC_MAX - READ_DELAY;
+		*response_size = (param1 & SHA204_ZONE_COUNT_FLAG)
 							? READ_32_RSP_SIZE : READ_4_RSP_SIZE;
 		break;
 
 	case SHA204_UPDATE_EXTRA:
-		poll_delay = UPDATE_DELAY;
-		poll_timeout = UPDATE_EXEC_MAX - UPDATE_DELAY;
-		response_size = UPDATE_RSP_SIZE;
+		*execution_delay = UPDATE_DELAY;
+		*execution_timeout = UPDATE_EXEC_MAX - UPDATE_DELAY;
+		*response_size = UPDATE_RSP_SIZE;
 		break;
 
 	case SHA204_WRITE:
-		poll_delay = WRITE_DELAY;
-		poll_timeout = WRITE_EXEC_MAX - WRITE_DELAY;
-		response_size = WRITE_RSP_SIZE;
+		*execution_delay = WRITE_DELAY;
+		*execution_timeout = WRITE_EXEC_MAX - WRITE_DELAY;
+		*response_size = WRITE_RSP_SIZE;
 		break;
 
 	default:
-		poll_delay = 0;
-		poll_timeout = SHA204_COMMAND_EXEC_MAX;
-		response_size = rx_size;
+		*execution_delay = 0;
+		*execution_timeout = SHA204_COMMAND_EXEC_MAX;
+		*response_size = rx_size;
 		break;
 	}
 
+	command->header[SHA204_COUNT_IDX] = datalen1 + datalen2 + datalen3 + SHA204_CMD_SIZE_MIN;
+	command->header[SHA204_OPCODE_IDX] = op_code;
+	command->header[SHA204_PARAM1_IDX] = param1;
+	command->header[SHA204_PARAM2_IDX] = param2 & 0xFF;
+	command->header[SHA204_PARAM2_IDX + 1] = param2 >> 8;
+
+	command->datalen[0] = datalen1;
+	command->data[0] = data1;
+	command->datalen[1] = datalen2;
+	command->data[1] = data2;
+	command->datalen[2] = datalen3;
+	command->data[2] = data3;
+	command->progmem = 0;
+}
+
+
+/** \brief This function creates a command packet and supplies its timing.
+ *
+ * sha204m_execute() sends the packet right away. Callers that do not want
+ * to block during command execution send it themselves.
+ * \param[in] op_code command op-code
+ * \param[in] param1 first parameter
+ * \param[in] param2 second parameter
+ * \param[in] datalen1 number of bytes in first data block
+ * \param[in] data1 pointer to first data block
+ * \param[in] datalen2 number of bytes in second data block
+ * \param[in] data2 pointer to second data block
+ * \param[in] datalen3 number of bytes in third data block
+ * \param[in] data3 pointer to third data block
+ * \param[in] tx_size size of tx buffer
+ * \param[in] tx_buffer pointer to tx buffer
+ * \param[in] rx_size size of rx buffer
+ * \param[out] rx_buffer pointer to rx buffer
+ * \param[out] response_size size of the response to the command
+ * \param[out] execution_delay Start polling for a response after this many ms.
+ * \param[out] execution_timeout polling timeout in ms
+ * \return status of the operation
+ */
+uint8_t sha204m_build_command(uint8_t op_code, uint8_t param1, uint16_t param2,
+			uint8_t datalen1, uint8_t *data1, uint8_t datalen2, uint8_t *data2, uint8_t datalen3, uint8_t *data3,
+			uint8_t tx_size, uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer,
+			uint8_t *response_size, uint8_t *execution_delay, uint8_t *execution_timeout)
+{
+	struct sha204_command_view command;
+	uint8_t *p_buffer;
+	uint8_t i;
+
+	// Define SHA204_CHECK_PARAMETERS to compile and link this feature.
+	uint8_t ret_code = sha204m_check_parameters(op_code, param1, param2,
+				datalen1, data1, datalen2, data2, datalen3, data3, 
+				tx_size, tx_buffer, rx_size, rx_buffer);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+
+	sha204m_build_view(op_code, param1, param2, datalen1, data1, datalen2, data2, datalen3, data3,
+				rx_size, &command, response_size, execution_delay, execution_timeout);
+
 	// Assemble command.
-	len = datalen1 + datalen2 + datalen3 + SHA204_CMD_SIZE_MIN;
-	p_buffer = tx_buffer;
-	*p_buffer++ = len;
-	*p_buffer++ = op_code;
-	*p_buffer++ = param1;
-	*p_buffer++ = param2 & 0xFF;
-	*p_buffer++ = param2 >> 8;
-
-	if (datalen1 > 0) {
-		memcpy(p_buffer, data1, datalen1);
-		p_buffer += datalen1;
-	}
-	if (datalen2 > 0) {
-		memcpy(p_buffer, data2, datalen2);
-		p_buffer += datalen2;
-	}
-	if (datalen3 > 0) {
-		memcpy(p_buffer, data3, datalen3);
-		p_buffer += datalen3;
+	memcpy(tx_buffer, command.header, SHA204_CMD_HEADER_SIZE);
+	p_buffer = &tx_buffer[SHA204_CMD_HEADER_SIZE];
+	for (i = 0; i < SHA204_CMD_DATA_BLOCKS; i++) {
+		if (command.datalen[i] > 0) {
+			memcpy(p_buffer, command.data[i], command.datalen[i]);
+			p_buffer += command.datalen[i];
+		}
 	}
 
-	sha204c_calculate_crc(len - SHA204_CRC_SIZE, tx_buffer, p_buffer);
+	sha204c_calculate_crc(command.header[SHA204_COUNT_IDX] - SHA204_CRC_SIZE, tx_buffer, p_buffer);
+
+	return SHA204_SUCCESS;
+}
+
+
+/** \brief This function creates a command packet, sends it, and receives its response.
+ *
+ * \param[in] op_code command op-code
+ * \param[in] param1 first parameter
+ * \param[in] param2 second parameter
+ * \param[in] datalen1 number of bytes in first data block
+ * \param[in] data1 pointer to first data block
+ * \param[in] datalen2 number of bytes in second data block
+ * \param[in] data2 pointer to second data block
+ * \param[in] datalen3 number of bytes in third data block
+ * \param[in] data3 pointer to third data block
+ * \param[in] tx_size size of tx buffer
+ * \param[in] tx_buffer pointer to tx buffer
+ * \param[in] rx_size size of rx buffer
+ * \param[out] rx_buffer pointer to rx buffer
+ * \return status of the operation
+ */
+uint8_t sha204m_execute(uint8_t op_code, uint8_t param1, uint16_t param2,
+			uint8_t datalen1, uint8_t *data1, uint8_t datalen2, uint8_t *data2, uint8_t datalen3, uint8_t *data3,
+			uint8_t tx_size, uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer)
+{
+	uint8_t poll_delay, poll_timeout, response_size;
+
+	uint8_t ret_code = sha204m_build_command(op_code, param1, param2,
+				datalen1, data1, datalen2, data2, datalen3, data3,
+				tx_size, tx_buffer, rx_size, rx_buffer,
+				&response_size, &poll_delay, &poll_timeout);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
 
 	// Send command and receive response.
 	return sha204c_send_and_receive(&tx_buffer[0], response_size,
@@ -325,6 +395,201 @@ uint8_t sha204m_execute(uint8_t op_code, uint8_t param1, uint16_t param2,
 }
 
 
+/** \brief This function sends a command from where its parts are and receives the data of its response into a view.
+ *
+ * The command is not assembled in a buffer. Its header is sent, followed
+ * by the data blocks and the CRC, see #sha204_command_view. The data blocks
+ * have to stay valid until this function returns. The response data go
+ * straight to view->data, see #sha204_response_view. A status response
+ * leaves its status byte in view->status.
+ *
+ * \param[in] op_code command op-code
+ * \param[in] param1 first parameter
+ * \param[in] param2 second parameter
+ * \param[in] datalen1 number of bytes in first data block
+ * \param[in] data1 pointer to first data block
+ * \param[in] datalen2 number of bytes in second data block
+ * \param[in] data2 pointer to second data block
+ * \param[in] datalen3 number of bytes in third data block
+ * \param[in] data3 pointer to third data block
+ * \param[in,out] view size and data pointer for the response data
+ * \return status of the operation
+ */
+uint8_t sha204m_execute_view(uint8_t op_code, uint8_t param1, uint16_t param2,
+			uint8_t datalen1, uint8_t *data1, uint8_t datalen2, uint8_t *data2, uint8_t datalen3, uint8_t *data3,
+			struct sha204_response_view *view)
+{
+	return sha204m_execute_view_P(op_code, param1, param2,
+				datalen1, data1, datalen2, data2, datalen3, data3, 0, view);
+}
+
+
+/** \brief This function checks the parameters of a command and assembles it in a view.
+ *
+ * \param[in] op_code command op-code
+ * \param[in] param1 first parameter
+ * \param[in] param2 second parameter
+ * \param[in] datalen1 number of bytes in first data block
+ * \param[in] data1 pointer to first data block
+ * \param[in] datalen2 number of bytes in second data block
+ * \param[in] data2 pointer to second data block
+ * \param[in] datalen3 number of bytes in third data block
+ * \param[in] data3 pointer to third data block
+ * \param[in] progmem data blocks in program memory
+ * \param[in] view size and data pointer for the response data
+ * \param[out] command header and data blocks of the command
+ * \param[out] execution_delay Start polling for a response after this many ms.
+ * \param[out] execution_timeout polling timeout in ms
+ * \return status of the operation
+ */
+static uint8_t sha204m_prepare_view(uint8_t op_code, uint8_t param1, uint16_t param2,
+			uint8_t datalen1, uint8_t *data1, uint8_t datalen2, uint8_t *data2, uint8_t datalen3, uint8_t *data3,
+			uint8_t progmem, struct sha204_response_view *view,
+			struct sha204_command_view *command, uint8_t *execution_delay, uint8_t *execution_timeout)
+{
+	uint8_t response_size;
+	uint8_t rx_size;
+	uint8_t ret_code;
+
+	if (!view)
+		return SHA204_BAD_PARAM;
+
+	rx_size = view->size + SHA204_BUFFER_POS_DATA + SHA204_CRC_SIZE;
+
+	// Define SHA204_CHECK_PARAMETERS to compile and link this feature.
+	ret_code = sha204m_check_parameters(op_code, param1, param2,
+				datalen1, data1, datalen2, data2, datalen3, data3,
+				SHA204_CMD_SIZE_MAX, command->header, rx_size, view->data);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+
+	sha204m_build_view(op_code, param1, param2, datalen1, data1, datalen2, data2, datalen3, data3,
+				rx_size, command, &response_size, execution_delay, execution_timeout);
+	command->progmem = progmem;
+
+	return SHA204_SUCCESS;
+}
+
+
+/** \brief This function sends a command whose data blocks may reside in program memory.
+ *
+ * It works like #sha204m_execute_view. Data blocks marked in \a progmem
+ * are read from program memory while they are sent, so keys, challenges
+ * and provisioning tables kept in flash never have to be copied into RAM.
+ *
+ * \param[in] op_code command op-code
+ * \param[in] param1 first parameter
+ * \param[in] param2 second parameter
+ * \param[in] datalen1 number of bytes in first data block
+ * \param[in] data1 pointer to first data block
+ * \param[in] datalen2 number of bytes in second data block
+ * \param[in] data2 pointer to second data block
+ * \param[in] datalen3 number of bytes in third data block
+ * \param[in] data3 pointer to third data block
+ * \param[in] progmem data blocks in program memory, combination of
+ *            SHA204_DATA_PROGMEM(0) to SHA204_DATA_PROGMEM(2)
+ * \param[in,out] view size and data pointer for the response data
+ * \return status of the operation
+ */
+uint8_t sha204m_execute_view_P(uint8_t op_code, uint8_t param1, uint16_t param2,
+			uint8_t datalen1, uint8_t *data1, uint8_t datalen2, uint8_t *data2, uint8_t datalen3, uint8_t *data3,
+			uint8_t progmem, struct sha204_response_view *view)
+{
+	struct sha204_command_view command;
+	uint8_t poll_delay, poll_timeout;
+
+	uint8_t ret_code = sha204m_prepare_view(op_code, param1, param2,
+				datalen1, data1, datalen2, data2, datalen3, data3, progmem, view,
+				&command, &poll_delay, &poll_timeout);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+
+	// Send command and receive response.
+	return sha204c_send_and_receive_view(&command, view, poll_delay, poll_timeout);
+}
+
+
+#ifdef SHA204_I2C_NON_BLOCKING
+/** \brief This function starts a command like #sha204m_execute_view_P
+ *         and returns without waiting for its response.
+ *
+ * Call #sha204c_poll with \a exchange until it no longer returns
+ * #SHA204_PENDING. Exchange, command, view and data blocks have to stay
+ * valid until then.
+ *
+ * \param[out] exchange state of the communication sequence
+ * \param[out] command where the command is assembled
+ * \param[in] op_code command op-code
+ * \param[in] param1 first parameter
+ * \param[in] param2 second parameter
+ * \param[in] datalen1 number of bytes in first data block
+ * \param[in] data1 pointer to first data block
+ * \param[in] datalen2 number of bytes in second data block
+ * \param[in] data2 pointer to second data block
+ * \param[in] datalen3 number of bytes in third data block
+ * \param[in] data3 pointer to third data block
+ * \param[in] progmem data blocks in program memory, see #sha204m_execute_view_P
+ * \param[in,out] view size and data pointer for the response data
+ * \return #SHA204_PENDING while the command is running, otherwise its status
+ */
+uint8_t sha204m_start_view_P(struct sha204c_exchange *exchange, struct sha204_command_view *command,
+			uint8_t op_code, uint8_t param1, uint16_t param2,
+			uint8_t datalen1, uint8_t *data1, uint8_t datalen2, uint8_t *data2, uint8_t datalen3, uint8_t *data3,
+			uint8_t progmem, struct sha204_response_view *view)
+{
+	uint8_t poll_delay, poll_timeout;
+
+	uint8_t ret_code = sha204m_prepare_view(op_code, param1, param2,
+				datalen1, data1, datalen2, data2, datalen3, data3, progmem, view,
+				command, &poll_delay, &poll_timeout);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+
+	return sha204c_start(exchange, command, view, poll_delay, poll_timeout);
+}
+#endif
+
+
+/** \brief This function sends a complete command packet that resides in program memory.
+ *
+ * The packet holds count byte, op-code, parameters, data and CRC, like
+ * the packets built at compile time by Sha204Packet.h. It goes onto the
+ * wire as it is. Only the timing of the command is looked up, so the
+ * parameters are not checked and the CRC is not calculated.
+ *
+ * \param[in] packet pointer to the packet in program memory
+ * \param[in,out] view size and data pointer for the response data
+ * \return status of the operation
+ */
+uint8_t sha204m_execute_packet_P(const uint8_t *packet, struct sha204_response_view *view)
+{
+	struct sha204_command_view command;
+	uint8_t poll_delay, poll_timeout, response_size;
+	uint8_t count;
+
+	if (!packet || !view || !view->data)
+		return SHA204_BAD_PARAM;
+
+	count = SHA204_READ_PROGMEM(&packet[SHA204_COUNT_IDX]);
+	if ((count < SHA204_CMD_SIZE_MIN) || (count > SHA204_CMD_SIZE_MAX))
+		return SHA204_BAD_PARAM;
+
+	sha204m_build_view(SHA204_READ_PROGMEM(&packet[SHA204_OPCODE_IDX]),
+				SHA204_READ_PROGMEM(&packet[SHA204_PARAM1_IDX]),
+				SHA204_READ_PROGMEM(&packet[SHA204_PARAM2_IDX])
+					| (SHA204_READ_PROGMEM(&packet[SHA204_PARAM2_IDX + 1]) << 8),
+				count - SHA204_CMD_SIZE_MIN, (uint8_t *) &packet[SHA204_CMD_HEADER_SIZE], 0, NULL, 0, NULL,
+				view->size + SHA204_BUFFER_POS_DATA + SHA204_CRC_SIZE,
+				&command, &response_size, &poll_delay, &poll_timeout);
+	command.progmem = SHA204_DATA_PROGMEM(0);
+	command.crc[0] = SHA204_READ_PROGMEM(&packet[count - SHA204_CRC_SIZE]);
+	command.crc[1] = SHA204_READ_PROGMEM(&packet[count - 1]);
+
+	// Send command and receive response.
+	return sha204c_send_and_receive_prebuilt(&command, view, poll_delay, poll_timeout);
+}
+
+
 /** \brief This function sends a CheckMAC command to the device.
  *
  * \param[in]  tx_buffer pointer to transmit buffer
@@ -785,3 +1050,111 @@ uint8_t sha204m_write(uint8_t *tx_buffer, uint8_t *rx_buffer,
 	return sha204c_send_and_receive(&tx_buffer[0], WRITE_RSP_SIZE, &rx_buffer[0],
 				WRITE_DELAY, WRITE_EXEC_MAX - WRITE_DELAY);
 }
+
+
+/** \brief This function returns the size of a zone.
+ * \param[in] zone #SHA204_ZONE_CONFIG, #SHA204_ZONE_OTP or #SHA204_ZONE_DATA
+ * \return size of the zone in bytes, 0 for an invalid zone
+ */
+uint16_t sha204m_zone_size(uint8_t zone)
+{
+	switch (zone & SHA204_ZONE_MASK) {
+	case SHA204_ZONE_CONFIG:
+		return SHA204_CONFIG_SIZE;
+
+	case SHA204_ZONE_OTP:
+		return SHA204_OTP_SIZE;
+
+	case SHA204_ZONE_DATA:
+		return SHA204_DATA_SIZE;
+
+	default:
+		return 0;
+	}
+}
+
+
+/** \brief This function plans the next Read command for a byte range of a zone.
+ *
+ * Call it with the first byte still missing until the range is read.
+ * The 32-byte block holding that byte is read at once if it lies within
+ * the zone and #SHA204_READ_32_MIN_WORDS of its words are needed.
+ * Otherwise the word holding the byte is read. This takes the fewest
+ * bytes on the bus, ties going to fewer commands.
+ * \param[in] zone #SHA204_ZONE_CONFIG, #SHA204_ZONE_OTP or #SHA204_ZONE_DATA
+ * \param[in] address first byte still to read
+ * \param[in] end byte address after the range
+ * \param[out] read_address byte address of the Read, aligned to its size
+ * \return number of bytes the Read returns (4 or 32), 0 if the range is empty or exceeds the zone
+ */
+uint8_t sha204m_plan_read(uint8_t zone, uint16_t address, uint16_t end, uint16_t *read_address)
+{
+	uint16_t zone_size = sha204m_zone_size(zone);
+	uint16_t block = address & ~(SHA204_ZONE_ACCESS_32 - 1);
+	uint16_t last;
+
+	if ((address >= end) || (end > zone_size))
+		return 0;
+
+	if (block + SHA204_ZONE_ACCESS_32 <= zone_size) {
+		// last byte needed from this block
+		last = (end < block + SHA204_ZONE_ACCESS_32) ? end - 1 : block + SHA204_ZONE_ACCESS_32 - 1;
+		if (last / SHA204_ZONE_ACCESS_4 - address / SHA204_ZONE_ACCESS_4 + 1 >= SHA204_READ_32_MIN_WORDS) {
+			*read_address = block;
+			return SHA204_ZONE_ACCESS_32;
+		}
+	}
+
+	*read_address = address & ~(SHA204_ZONE_ACCESS_4 - 1);
+	return SHA204_ZONE_ACCESS_4;
+}
+
+
+/** \brief This function checks whether the Write command can change a byte range.
+ * \param[in] zone #SHA204_ZONE_CONFIG, #SHA204_ZONE_OTP or #SHA204_ZONE_DATA
+ * \param[in] address first byte
+ * \param[in] end byte address after the range
+ * \return 1 if the range can be written, 0 otherwise
+ */
+static uint8_t sha204m_is_writable(uint8_t zone, uint16_t address, uint16_t end)
+{
+	if ((zone & SHA204_ZONE_MASK) == SHA204_ZONE_CONFIG)
+		return (address >= SHA204_CONFIG_WRITABLE_START) && (end <= SHA204_CONFIG_WRITABLE_END);
+
+	return end <= sha204m_zone_size(zone);
+}
+
+
+/** \brief This function plans the Write commands for the words edited in a 32-byte block.
+ *
+ * The block is written at once if #SHA204_WRITE_32_MIN_WORDS of its words
+ * are edited and the whole block can be written. Otherwise every edited
+ * word is written by itself. Bytes of a Write that are not edited have to
+ * be read first, so that they keep their contents.
+ * \param[in] zone #SHA204_ZONE_CONFIG, #SHA204_ZONE_OTP or #SHA204_ZONE_DATA
+ * \param[in] block byte address of the block, a multiple of 32
+ * \param[in] words edited words, bit n for the word at block + 4 * n
+ * \param[in] data_locked The data zone is locked. Data slots then take 32-byte Writes only.
+ * \return number of bytes per Write (4 or 32), 0 if an edited word cannot be written
+ */
+uint8_t sha204m_plan_write(uint8_t zone, uint16_t block, uint8_t words, uint8_t data_locked)
+{
+	uint8_t n_words = 0;
+	uint8_t i;
+
+	for (i = 0; i < SHA204_ZONE_ACCESS_32 / SHA204_ZONE_ACCESS_4; i++) {
+		if (!(words & (1 << i)))
+			continue;
+		if (!sha204m_is_writable(zone, block + i * SHA204_ZONE_ACCESS_4, block + (i + 1) * SHA204_ZONE_ACCESS_4))
+			return 0;
+		n_words++;
+	}
+
+	if (data_locked && ((zone & SHA204_ZONE_MASK) == SHA204_ZONE_DATA))
+		return SHA204_ZONE_ACCESS_32;
+
+	if ((n_words >= SHA204_WRITE_32_MIN_WORDS) && sha204m_is_writable(zone, block, block + SHA204_ZONE_ACCESS_32))
+		return SHA204_ZONE_ACCESS_32;
+
+	return SHA204_ZONE_ACCESS_4;
+}
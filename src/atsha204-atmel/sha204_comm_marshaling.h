@@ -181,6 +181,24 @@ extern "C" {
 #define SHA204_ADDRESS_MASK             (         0x007F)      //!< Address bit 7 to 15 are always 0.
 /** @} */
 
+/** \name Definitions for Read Planning
+@{ */
+//! A 32-byte Read moves as many bytes over the bus as three 4-byte Reads, so it is used from three words on.
+#define SHA204_READ_32_MIN_WORDS        ( 3)
+//! Programming time dominates a Write, so a 32-byte Write replaces two or more 4-byte Writes.
+#define SHA204_WRITE_32_MIN_WORDS       ( 2)
+#define SHA204_CONFIG_WRITABLE_START    (16)                   //!< first configuration byte the Write command can change
+#define SHA204_CONFIG_WRITABLE_END      (84)                   //!< configuration byte after the last one the Write command can change
+/** @} */
+
+//! bytes to write to a zone, see sha204m_plan_write
+struct sha204_write_edit {
+	uint16_t address;                    //!< byte address of the first byte
+	uint8_t length;                      //!< number of bytes
+	uint8_t progmem;                     //!< The bytes reside in program memory.
+	const uint8_t *data;                 //!< bytes to write
+};
+
 /** \name Definitions for the CheckMac Command
 @{ */
 #define CHECKMAC_MODE_IDX               SHA204_PARAM1_IDX      //!< CheckMAC command index for mode
@@ -408,10 +426,32 @@ uint8_t sha204m_update_extra(uint8_t *tx_buffer, uint8_t *rx_buffer, uint8_t mod
 uint8_t sha204m_write(uint8_t *tx_buffer, uint8_t *rx_buffer,
 			uint8_t zone, uint16_t address, uint8_t *value, uint8_t *mac);
 
+uint8_t sha204m_build_command(uint8_t op_code, uint8_t param1, uint16_t param2,
+			uint8_t datalen1, uint8_t *data1, uint8_t datalen2, uint8_t *data2, uint8_t datalen3, uint8_t *data3,
+			uint8_t tx_size, uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer,
+			uint8_t *response_size, uint8_t *execution_delay, uint8_t *execution_timeout);
+
 // Use this function instead of the command wrapper functions above which are easier to read and use if you are code space constrained.
 uint8_t sha204m_execute(uint8_t op_code, uint8_t param1, uint16_t param2,
 			uint8_t datalen1, uint8_t *data1, uint8_t datalen2, uint8_t *data2, uint8_t datalen3, uint8_t *data3,
 			uint8_t tx_size, uint8_t *tx_buffer, uint8_t rx_size, uint8_t *rx_buffer);
+uint8_t sha204m_execute_view(uint8_t op_code, uint8_t param1, uint16_t param2,
+			uint8_t datalen1, uint8_t *data1, uint8_t datalen2, uint8_t *data2, uint8_t datalen3, uint8_t *data3,
+			struct sha204_response_view *view);
+uint8_t sha204m_execute_view_P(uint8_t op_code, uint8_t param1, uint16_t param2,
+			uint8_t datalen1, uint8_t *data1, uint8_t datalen2, uint8_t *data2, uint8_t datalen3, uint8_t *data3,
+			uint8_t progmem, struct sha204_response_view *view);
+uint8_t sha204m_execute_packet_P(const uint8_t *packet, struct sha204_response_view *view);
+#ifdef SHA204_I2C_NON_BLOCKING
+uint8_t sha204m_start_view_P(struct sha204c_exchange *exchange, struct sha204_command_view *command,
+			uint8_t op_code, uint8_t param1, uint16_t param2,
+			uint8_t datalen1, uint8_t *data1, uint8_t datalen2, uint8_t *data2, uint8_t datalen3, uint8_t *data3,
+			uint8_t progmem, struct sha204_response_view *view);
+#endif
+
+uint16_t sha204m_zone_size(uint8_t zone);
+uint8_t sha204m_plan_read(uint8_t zone, uint16_t address, uint16_t end, uint16_t *read_address);
+uint8_t sha204m_plan_write(uint8_t zone, uint16_t block, uint8_t words, uint8_t data_locked);
 
 /** @} */
 
@@ -91,16 +91,62 @@
  * - SHA204_SWI_BITBANG (SWI using GPIO peripheral)
  * - SHA204_SWI_UART (SWI using UART peripheral)
  * - SHA204_I2C (I<SUP>2</SUP>C using I<SUP>2</SUP>C peripheral)
+ * - SHA204_LINUX_I2C (I<SUP>2</SUP>C using a Linux i2c-dev adapter, see sha204_linux_i2c.c)
+ * - SHA204_SWI_LINUX_UART (SWI using a serial port of a Linux host, see uart_linux_phys.c)
  *
 @{ */
 //! Dummy macro that allow Doxygen to parse this group.
 #define DOXYGEN_DUMMY 0
+// The default gives way to an interface chosen in the project settings.
+#if !defined(SHA204_SWI_UART) && !defined(SHA204_I2C) && !defined(SHA204_LINUX_I2C) && !defined(SHA204_SWI_LINUX_UART)
 #define SHA204_SWI_BITBANG
+#endif
 // #define SHA204_SWI_UART
 // #define SHA204_I2C
+// #define SHA204_LINUX_I2C
+// #define SHA204_SWI_LINUX_UART
+
+/** \brief Define this to build the I<SUP>2</SUP>C interface next to the selected SWI interface.
+ *
+ * Every AtSha204 instance then carries the transport it talks through,
+ * and the sha204p_... functions dispatch to the transport selected last
+ * (see sha204_transport.c). Without this definition the sha204p_...
+ * functions are implemented directly by the one selected interface.
+ */
+// #define SHA204_MULTI_TRANSPORT
 
 /** @} */
 
+#ifdef SHA204_MULTI_TRANSPORT
+#   define SHA204_I2C
+//! Response polling time depends on the selected transport.
+#   define SHA204_RESPONSE_TIMEOUT       sha204p_response_timeout()
+#endif
+
+#ifdef SHA204_LINUX_I2C
+#   ifdef SHA204_MULTI_TRANSPORT
+#      error SHA204_LINUX_I2C cannot be combined with SHA204_MULTI_TRANSPORT.
+#   endif
+#   undef SHA204_SWI_BITBANG
+#   undef SHA204_SWI_UART
+#   define SHA204_I2C
+#endif
+
+#ifdef SHA204_SWI_LINUX_UART
+#   ifdef SHA204_MULTI_TRANSPORT
+#      error SHA204_SWI_LINUX_UART cannot be combined with SHA204_MULTI_TRANSPORT.
+#   endif
+#   undef SHA204_SWI_BITBANG
+#   define SHA204_SWI_UART
+#endif
+
+#if defined(SHA204_LINUX_I2C) || defined(SHA204_SWI_LINUX_UART)
+//! The library runs on a Linux host instead of an Arduino.
+#   define SHA204_LINUX_HOST
+//! Interface state is per thread, so threads can drive different buses.
+#   define SHA204_THREAD_LOCAL      __thread
+#endif
+
 #ifndef SHA204_SWI_BITBANG
 #ifndef SHA204_SWI_UART
 /* If not otherwise specified, this is an i2c library */
@@ -133,6 +179,24 @@
 //! receive timeout in us instead of loop counts
 #   define SWI_RECEIVE_TIME_OUT      ((uint16_t) 153)
 
+#   ifdef SHA204_SWI_LINUX_UART
+//! serial port the device is connected to
+#      ifndef SWI_LINUX_UART_PORT
+#         define SWI_LINUX_UART_PORT      "/dev/ttyUSB0"
+#      endif
+
+/** \brief Time in ms to wait for a response character.
+ *
+ *         USB-serial adapters deliver received characters in
+ *         USB frames, so this covers their latency. It replaces
+ *         the SWI response polling time.
+ */
+#      define SWI_LINUX_UART_RX_TIMEOUT_MS  (5)
+#      ifndef SHA204_RESPONSE_TIMEOUT
+#         define SHA204_RESPONSE_TIMEOUT  ((uint16_t) SWI_LINUX_UART_RX_TIMEOUT_MS * 1000)
+#      endif
+#   endif
+
 //! It takes 312.5 us to send a byte (9 single-wire bits / 230400 Baud * 8 flag bits).
 #   define SWI_US_PER_BYTE           ((uint16_t) 313)
 
@@ -159,6 +223,14 @@
 #      define SHA204_RESPONSE_TIMEOUT   ((uint16_t) SWI_RECEIVE_TIME_OUT + SWI_US_PER_BYTE)
 #   endif
 
+/** \brief Define this when several devices share one signal wire.
+ *
+ *  Every device needs a unique Selector byte (configuration zone address 85).
+ *  A Wake-up token wakes up all devices. A Pause command with the Selector
+ *  of the device to talk to then puts all other devices into Idle mode.
+ */
+// #define SHA204_SWI_MULTIDROP
+
 /** @} */
 
 #endif
@@ -174,8 +246,46 @@
  *
  *         This value is used to timeout when waiting for a response.
  */
+#   define SHA204_I2C_RESPONSE_TIMEOUT    ((uint16_t) 37)
+
+#   ifdef SHA204_LINUX_I2C
+//! i2c-dev device file of the adapter the device is connected to
+#      ifndef SHA204_LINUX_I2C_BUS
+#         define SHA204_LINUX_I2C_BUS     "/dev/i2c-1"
+#      endif
+
+/** \brief Time in us to sleep after the device did not acknowledge its address.
+ *
+ *         Every address poll costs a system call, so a busy device is
+ *         polled at this interval instead of back-to-back. It replaces
+ *         the I<SUP>2</SUP>C response polling time.
+ */
+#      define SHA204_LINUX_I2C_POLL_US    ((uint16_t) 500)
+#      ifndef SHA204_RESPONSE_TIMEOUT
+#         define SHA204_RESPONSE_TIMEOUT  SHA204_LINUX_I2C_POLL_US
+#      endif
+#   endif
 #   ifndef SHA204_RESPONSE_TIMEOUT
-#      define SHA204_RESPONSE_TIMEOUT     ((uint16_t) 37)
+#      define SHA204_RESPONSE_TIMEOUT     SHA204_I2C_RESPONSE_TIMEOUT
+#   endif
+
+/** \brief Define this to detect command completion by polling the device address.
+ *
+ *         The device does not acknowledge its address while it is executing
+ *         a command. With this option the response is read through a repeated
+ *         Start as soon as the address gets acknowledged instead of waiting
+ *         the typical execution time first.
+ */
+// #define SHA204_I2C_ACK_POLLING
+
+/** \brief Commands can run without blocking the CPU, see sha204c_start().
+ *
+ *         This needs the interrupt-driven transfers of i2c_isr_phys.c.
+ *         Define I2C_USE_INTERRUPTS in the project settings so that this
+ *         header sees it. It is not available with SHA204_MULTI_TRANSPORT.
+ */
+#   if defined(I2C_USE_INTERRUPTS) && !defined(SHA204_LINUX_I2C) && !defined(SHA204_MULTI_TRANSPORT)
+#      define SHA204_I2C_NON_BLOCKING
 #   endif
 
 /** @} */
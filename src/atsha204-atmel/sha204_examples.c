@@ -1166,38 +1166,119 @@ uint8_t sha204e_checkmac_diversified_key(void)
 }
 
 
+#ifdef SHA204_I2C
+/** \brief This function reads the Wake-up response of the devices at
+ *         an I<SUP>2</SUP>C address and puts them back to sleep.
+ *
+ * All devices on the bus have to be woken up before calling this function.
+ * If more than one device answers at the same address, their responses
+ * get mixed on the bus and the check of the response fails.
+ * \param[in] address I<SUP>2</SUP>C address to probe
+ * \return #SHA204_SUCCESS if one device answered, #SHA204_RX_NO_RESPONSE if none did,
+ *         otherwise the error of the response check
+ */
+static uint8_t sha204e_probe_i2c_address(uint8_t address)
+{
+	uint8_t ret_code;
+	uint8_t response[SHA204_RSP_SIZE_MIN];
+
+	sha204p_set_device_id(address);
+
+	memset(response, 0, sizeof(response));
+	ret_code = sha204p_receive_response(sizeof(response), response);
+	if (ret_code == SHA204_RX_NO_RESPONSE)
+		return ret_code;
+
+	// Something acknowledged the address. Put it back to sleep.
+	(void) sha204p_sleep();
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+
+	// Verify status response.
+	if (response[SHA204_BUFFER_POS_COUNT] != SHA204_RSP_SIZE_MIN)
+		return SHA204_INVALID_SIZE;
+	if (response[SHA204_BUFFER_POS_STATUS] != SHA204_STATUS_BYTE_WAKEUP)
+		return SHA204_COMM_FAIL;
+
+	return sha204c_check_crc(response);
+}
+
+
+/** \brief This function lists the I<SUP>2</SUP>C addresses of all devices on the bus.
+
+One Wake-up pulse wakes up every device on the bus. The function then reads the
+Wake-up response at every address from #SHA204_I2C_ADDRESS_FIRST to #SHA204_I2C_ADDRESS_LAST
+and puts the devices found back to sleep. An address is listed when anything
+acknowledged it, even if the response was corrupted by more than one device
+answering.
+ * \param[out] addresses pointer to array that receives the addresses found
+ * \param[in] size size of the address array
+ * \param[out] count number of addresses found, may be larger than size
+ * \return #SHA204_SUCCESS, or #SHA204_BAD_CRC if more than one device
+ *         seems to share an address
+ */
+uint8_t sha204e_scan_i2c_bus(uint8_t *addresses, uint8_t size, uint8_t *count)
+{
+	uint8_t ret_code = SHA204_SUCCESS;
+	uint8_t probe_status;
+	uint8_t address = SHA204_I2C_ADDRESS_FIRST;
+
+	*count = 0;
+
+	(void) sha204p_wakeup();
+
+	do {
+		probe_status = sha204e_probe_i2c_address(address);
+		if (probe_status == SHA204_RX_NO_RESPONSE)
+			continue;
+
+		if (probe_status != SHA204_SUCCESS)
+			ret_code = SHA204_BAD_CRC;
+
+		if (*count < size)
+			addresses[*count] = address;
+		(*count)++;
+	} while ((address += 2) <= SHA204_I2C_ADDRESS_LAST);
+
+	return ret_code;
+}
+
+
 /** \brief This function changes the I<SUP>2</SUP>C address of a device.
 
-Running it will access the device with I<SUP>2</SUP>C address SHA204_CLIENT_ADDRESS
-and change it to SHA204_HOST_ADDRESS as long as the configuration zone is
+Running it will access the device with I<SUP>2</SUP>C address old_address
+and change it to new_address as long as the configuration zone is
 not locked (byte at address 87 = 0x55). Be aware that bit 3 of the I<SUP>2</SUP>C
 address is also used as a TTL enable bit. So make sure you give it a value that
-agrees with your system (see data sheet).
+agrees with your system (see data sheet).\n
+The function reads the first 32 bytes of the configuration zone before writing.
+They contain the serial number, so the CRC of the response fails if more than one
+device sits at old_address. In that case nothing gets written.
+ * \param[in] old_address current I<SUP>2</SUP>C address of the device
+ * \param[in] new_address I<SUP>2</SUP>C address to assign
  * \return status of the operation
  */
-uint8_t sha204e_change_i2c_address(void)
+uint8_t sha204e_set_i2c_address(uint8_t old_address, uint8_t new_address)
 {
 	// declared as "volatile" for easier debugging
 	volatile uint8_t ret_code;
-	
+
 	uint16_t config_address;
-	
+
 	// Make the command buffer the minimum size of the Write command.
 	uint8_t command[WRITE_COUNT_SHORT];
-	
+
 	uint8_t config_data[SHA204_ZONE_ACCESS_4];
 
-	// Make the response buffer the size of a Read response.
-	uint8_t response[READ_4_RSP_SIZE];
+	// Make the response buffer the size of a 32-byte Read response.
+	uint8_t response[READ_32_RSP_SIZE];
 
-	sha204p_init();
+	sha204p_set_device_id(old_address);
 
-	sha204p_set_device_id(SHA204_CLIENT_ADDRESS);
-	
 	ret_code = sha204c_wakeup(response);
 	if (ret_code != SHA204_SUCCESS)
 		return ret_code;
-		
+
 	// Make sure that configuration zone is not locked.
 	memset(response, 0, sizeof(response));
 	config_address = 84;
@@ -1211,17 +1292,18 @@ uint8_t sha204e_change_i2c_address(void)
 		sha204p_sleep();
 		return SHA204_FUNC_FAIL;
 	}
-	
-	// Read device configuration at address 16 that contains the I2C address.
+
+	// Read the first block of the device configuration. It contains the
+	// serial number and, at address 16, the I2C address.
 	memset(response, 0, sizeof(response));
-	config_address = 16;
-	ret_code = sha204m_read(command, response, SHA204_ZONE_CONFIG, config_address);
+	ret_code = sha204m_read(command, response, SHA204_ZONE_CONFIG | SHA204_ZONE_COUNT_FLAG, 0);
 	if (ret_code != SHA204_SUCCESS) {
 		sha204p_sleep();
 		return ret_code;
 	}
-	config_data[0] = SHA204_HOST_ADDRESS;
-	memcpy(&config_data[1], &response[SHA204_BUFFER_POS_DATA + 1], sizeof(config_data - 1));
+	config_address = 16;
+	config_data[0] = new_address;
+	memcpy(&config_data[1], &response[SHA204_BUFFER_POS_DATA + config_address + 1], sizeof(config_data) - 1);
 
 	ret_code = sha204m_write(command, response, SHA204_ZONE_CONFIG, config_address, config_data, NULL);
 
@@ -1230,7 +1312,7 @@ uint8_t sha204e_change_i2c_address(void)
 		return ret_code;
 
 	// Check whether we had success.
-	sha204p_set_device_id(SHA204_HOST_ADDRESS);
+	sha204p_set_device_id(new_address);
 	ret_code = sha204c_wakeup(response);
 	sha204p_sleep();
 
@@ -1238,6 +1320,65 @@ uint8_t sha204e_change_i2c_address(void)
 }
 
 
+/** \brief This function changes the I<SUP>2</SUP>C address of a device
+ *         from SHA204_CLIENT_ADDRESS to SHA204_HOST_ADDRESS.
+ * \return status of the operation
+ */
+uint8_t sha204e_change_i2c_address(void)
+{
+	sha204p_init();
+
+	return sha204e_set_i2c_address(SHA204_CLIENT_ADDRESS, SHA204_HOST_ADDRESS);
+}
+
+
+/** \brief This function moves a device from a shared address to the
+ *         lowest free I<SUP>2</SUP>C address.
+
+Use it to provision a fleet of devices that all ship with the same address:
+attach the devices one after the other and call this function after every one.
+Devices that already received their address are left alone. Free addresses keep
+bit 3 (TTL enable) of default_address.\n
+Devices that share an address cannot be told apart on the bus. If more than one
+device sits at default_address, the function detects this through the CRC of the
+configuration read and returns without writing anything.
+ * \param[in] default_address I<SUP>2</SUP>C address the new device is shipped with
+ * \param[out] new_address address assigned to the device
+ * \return status of the operation
+ */
+uint8_t sha204e_assign_i2c_address(uint8_t default_address, uint8_t *new_address)
+{
+	uint8_t ret_code;
+	uint8_t address = SHA204_I2C_ADDRESS_FIRST;
+
+	// Find the lowest free address with the same input level setting.
+	(void) sha204p_wakeup();
+	ret_code = SHA204_FUNC_FAIL;
+	do {
+		if (((address ^ default_address) & SHA204_I2C_ADDRESS_TTL_ENABLE) || (address == default_address))
+			continue;
+		if (sha204e_probe_i2c_address(address) == SHA204_RX_NO_RESPONSE) {
+			ret_code = SHA204_SUCCESS;
+			break;
+		}
+	} while ((address += 2) <= SHA204_I2C_ADDRESS_LAST);
+
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+
+	// The device at default_address is still awake and has not
+	// sent its Wake-up response yet, so the Wake-up in
+	// sha204e_set_i2c_address reads it as usual.
+
+	ret_code = sha204e_set_i2c_address(default_address, address);
+	if (ret_code == SHA204_SUCCESS)
+		*new_address = address;
+
+	return ret_code;
+}
+#endif
+
+
 /** \brief This function reads all 88 bytes from the configuration zone.
  *
 Obtain the data by putting a breakpoint after every read and inspecting "response".
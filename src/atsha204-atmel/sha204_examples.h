@@ -1,3 +1,6 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
 /** \file
  *  \brief  Application Examples That Use the ATSHA204 Library
  *  \author Atmel Crypto Products
@@ -133,6 +136,16 @@ same as the client address. See \ref SHA204_CLIENT_ADDRESS.
 */
 //#   define SHA204_HOST_ADDRESS          SHA204_CLIENT_ADDRESS
 #   define SHA204_HOST_ADDRESS          (0xCA)
+
+/** \ingroup  sha204_examples I2C Address Range
+Range of I2C addresses searched by \ref sha204e_scan_i2c_bus and
+\ref sha204e_assign_i2c_address. Addresses below and above are reserved
+by the I2C specification.
+@{ */
+#   define SHA204_I2C_ADDRESS_FIRST          (0x10)  //!< lowest address searched
+#   define SHA204_I2C_ADDRESS_LAST           (0xEE)  //!< highest address searched
+#   define SHA204_I2C_ADDRESS_TTL_ENABLE     (0x08)  //!< address bit that selects the input level reference
+/** @} */
 #else
 /** \ingroup  sha204_examples Device Selectors
 These settings have an effect only when using bit-banging where the SDA of every 
@@ -174,7 +187,16 @@ uint8_t sha204e_checkmac_device(void);
 uint8_t sha204e_checkmac_firmware(void);
 uint8_t sha204e_checkmac_derived_key(void);
 uint8_t sha204e_checkmac_diversified_key(void);
+#ifdef SHA204_I2C
 uint8_t sha204e_change_i2c_address(void);
+uint8_t sha204e_set_i2c_address(uint8_t old_address, uint8_t new_address);
+uint8_t sha204e_scan_i2c_bus(uint8_t *addresses, uint8_t size, uint8_t *count);
+uint8_t sha204e_assign_i2c_address(uint8_t default_address, uint8_t *new_address);
+#endif
 uint8_t sha204e_read_config_zone(uint8_t device_id, uint8_t *config_data);
 
 #endif
+
+#ifdef __cplusplus
+}
+#endif
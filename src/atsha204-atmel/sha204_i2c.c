@@ -49,7 +49,28 @@
                                         // Functions
 #include "Arduino.h"
 
-#if defined(SHA204_I2C)
+#if defined(SHA204_I2C) && !defined(SHA204_LINUX_I2C)
+
+#ifdef SHA204_MULTI_TRANSPORT
+// Export the interface functions under their own names.
+// sha204_transport.c dispatches the sha204p_... names to them.
+#   define sha204p_set_device_id     sha204p_i2c_set_device_id
+#   define sha204p_init              sha204p_i2c_init
+#   define sha204p_wakeup            sha204p_i2c_wakeup
+#   define sha204p_send_command      sha204p_i2c_send_command
+#   define sha204p_send_view         sha204p_i2c_send_view
+#   define sha204p_idle              sha204p_i2c_idle
+#   define sha204p_sleep             sha204p_i2c_sleep
+#   define sha204p_reset_io          sha204p_i2c_reset_io
+#   define sha204p_receive_response  sha204p_i2c_receive_response
+#   define sha204p_receive_view      sha204p_i2c_receive_view
+#   define sha204p_poll_view         sha204p_i2c_poll_view
+#   define sha204p_start_view        sha204p_i2c_start_view
+#   define sha204p_start_receive     sha204p_i2c_start_receive
+#   define sha204p_start_receive_view sha204p_i2c_start_receive_view
+#   define sha204p_poll              sha204p_i2c_poll
+#   define sha204p_resync            sha204p_i2c_resync
+#endif
 
 /** \defgroup sha204_i2c Module 05: I2C Abstraction Module
  *
@@ -58,10 +79,6 @@
 @{ */
 
 
-/** \brief I<SUP>2</SUP>C address used at ATSHA204 library startup. */
-#define SHA204_I2C_DEFAULT_ADDRESS   ((uint8_t) 0xC8)
-
-
 /** \brief This enumeration lists all packet types sent to a SHA204 device.
  *
  * The following byte stream is sent to a ATSHA204 I<SUP>2</SUP>C device:
@@ -86,6 +103,45 @@ enum i2c_read_write_flag {
 //! I<SUP>2</SUP>C address is set when calling #sha204p_init or #sha204p_set_device_id.
 static uint8_t device_address;
 
+#ifdef I2C_USE_INTERRUPTS
+//! descriptor for the interrupt-driven transfers of this module
+static struct i2c_transfer transfer;
+
+//! data blocks and CRC of the command being sent or parts of the view being received into,
+//! they have to live as long as the transfer
+static struct i2c_segment segments[SHA204_CMD_DATA_BLOCKS + 1];
+
+
+/** \brief This function translates the result of a transfer.
+ *
+ * \param[in] i2c_status result of #i2c_transfer_poll
+ * \return #SHA204_PENDING while the transfer is running, otherwise the
+ *         status of the operation, #SHA204_RX_NO_RESPONSE if the device
+ *         did not acknowledge its address for reading
+ */
+static uint8_t sha204p_transfer_status(uint8_t i2c_status)
+{
+	switch (i2c_status) {
+	case I2C_FUNCTION_RETCODE_SUCCESS:
+		return SHA204_SUCCESS;
+
+	case I2C_FUNCTION_RETCODE_BUSY:
+		return SHA204_PENDING;
+
+	case I2C_FUNCTION_RETCODE_NACK:
+		// The device does not acknowledge its address while busy.
+		return ((transfer.flags & I2C_TRANSFER_READ) && (transfer.rx_count == 0))
+					? SHA204_RX_NO_RESPONSE : SHA204_COMM_FAIL;
+
+	case I2C_FUNCTION_RETCODE_BAD_COUNT:
+		return SHA204_INVALID_SIZE;
+
+	default:
+		return SHA204_COMM_FAIL;
+	}
+}
+#endif
+
 
 /** \brief This function sets the I<SUP>2</SUP>C address.
  *         Communication functions will use this address.
@@ -187,6 +243,24 @@ expected to be non-zero.
  */
 static uint8_t sha204p_i2c_send(uint8_t word_address, uint8_t count, uint8_t *buffer)
 {
+#ifdef I2C_USE_INTERRUPTS
+	uint8_t i2c_status;
+
+	transfer.address = device_address;
+	transfer.flags = I2C_TRANSFER_WRITE | I2C_TRANSFER_WORD_ADDRESS;
+	transfer.word_address = word_address;
+	transfer.tx_count = count;
+	transfer.tx_data = buffer;
+	transfer.tx_segments = 0;
+	transfer.rx_size = 0;
+	transfer.complete = NULL;
+
+	i2c_status = i2c_transfer_start(&transfer);
+	if (i2c_status == I2C_FUNCTION_RETCODE_SUCCESS)
+		i2c_status = i2c_transfer_wait(&transfer);
+
+	return (i2c_status == I2C_FUNCTION_RETCODE_SUCCESS) ? SHA204_SUCCESS : SHA204_COMM_FAIL;
+#else
 	uint8_t i2c_status = sha204p_send_slave_address(I2C_WRITE);
 	if (i2c_status != I2C_FUNCTION_RETCODE_SUCCESS)
 		return SHA204_COMM_FAIL;
@@ -209,6 +283,7 @@ static uint8_t sha204p_i2c_send(uint8_t word_address, uint8_t count, uint8_t *bu
 		return SHA204_COMM_FAIL;
 	else
 		return SHA204_SUCCESS;
+#endif
 }
 
 
@@ -223,6 +298,183 @@ uint8_t sha204p_send_command(uint8_t count, uint8_t *command)
 }
 
 
+#ifndef I2C_USE_INTERRUPTS
+/** \brief This function sends bytes that reside in program memory.
+ *
+ * The bytes are copied to the stack in small chunks.
+ * \param[in] count number of bytes to send
+ * \param[in] data pointer to the bytes in program memory
+ * \return status of the operation
+ */
+static uint8_t sha204p_send_bytes_P(uint8_t count, const uint8_t *data)
+{
+	uint8_t chunk[SHA204_PROGMEM_CHUNK_SIZE];
+	uint8_t chunk_size, i;
+	uint8_t i2c_status = I2C_FUNCTION_RETCODE_SUCCESS;
+
+	while (count && (i2c_status == I2C_FUNCTION_RETCODE_SUCCESS)) {
+		chunk_size = (count < sizeof(chunk)) ? count : sizeof(chunk);
+		for (i = 0; i < chunk_size; i++)
+			chunk[i] = SHA204_READ_PROGMEM(data++);
+		i2c_status = i2c_send_bytes(chunk_size, chunk);
+		count -= chunk_size;
+	}
+
+	return i2c_status;
+}
+#endif
+
+
+#ifdef I2C_USE_INTERRUPTS
+/** \brief This function starts sending a command from where its parts are
+ *         and returns without waiting.
+ *
+ * Header, data blocks and CRC go out in one write sequence. The interrupt
+ * routine reads data blocks in program memory as it sends them. The
+ * command has to stay valid until #sha204p_poll no longer returns
+ * #SHA204_PENDING.
+ * \param[in] command header, data blocks and CRC of the command
+ * \return status of the operation
+ */
+uint8_t sha204p_start_view(struct sha204_command_view *command)
+{
+	uint8_t n_segments = 0;
+	uint8_t i;
+
+	for (i = 0; i < SHA204_CMD_DATA_BLOCKS; i++) {
+		if (command->datalen[i]) {
+			segments[n_segments].count = command->datalen[i];
+			segments[n_segments].data = command->data[i];
+			segments[n_segments++].progmem = command->progmem & SHA204_DATA_PROGMEM(i);
+		}
+	}
+	segments[n_segments].count = sizeof(command->crc);
+	segments[n_segments].data = command->crc;
+	segments[n_segments++].progmem = 0;
+
+	transfer.address = device_address;
+	transfer.flags = I2C_TRANSFER_WRITE | I2C_TRANSFER_WORD_ADDRESS;
+	transfer.word_address = SHA204_I2C_PACKET_FUNCTION_NORMAL;
+	transfer.tx_count = SHA204_CMD_HEADER_SIZE;
+	transfer.tx_data = command->header;
+	transfer.tx_segments = n_segments;
+	transfer.tx_segment = segments;
+	transfer.rx_size = 0;
+	transfer.complete = NULL;
+
+	return (i2c_transfer_start(&transfer) == I2C_FUNCTION_RETCODE_SUCCESS) ? SHA204_SUCCESS : SHA204_COMM_FAIL;
+}
+
+
+/** \brief This function starts receiving a response into a buffer
+ *         and returns without waiting.
+ *
+ * \param[in] size size of rx buffer
+ * \param[out] response pointer to rx buffer, valid once #sha204p_poll
+ *             returned #SHA204_SUCCESS
+ * \return status of the operation
+ */
+uint8_t sha204p_start_receive(uint8_t size, uint8_t *response)
+{
+	transfer.address = device_address;
+	transfer.flags = I2C_TRANSFER_READ | I2C_TRANSFER_COUNTED;
+	transfer.tx_count = 0;
+	transfer.tx_segments = 0;
+	transfer.rx_size = size;
+	transfer.rx_data = response;
+	transfer.rx_segments = 0;
+	transfer.complete = NULL;
+
+	return (i2c_transfer_start(&transfer) == I2C_FUNCTION_RETCODE_SUCCESS) ? SHA204_SUCCESS : SHA204_COMM_FAIL;
+}
+
+
+/** \brief This function starts receiving a response into a view
+ *         and returns without waiting.
+ *
+ * The interrupt routine puts the count byte into the view, up to
+ * \a size bytes into its buffer and the remaining bytes into its CRC.
+ * \param[in,out] view where the response goes, valid once #sha204p_poll
+ *                returned #SHA204_SUCCESS
+ * \return status of the operation
+ */
+uint8_t sha204p_start_receive_view(struct sha204_response_view *view)
+{
+	segments[0].count = view->size;
+	segments[0].data = view->data;
+	segments[0].progmem = 0;
+	segments[1].count = sizeof(view->crc);
+	segments[1].data = view->crc;
+	segments[1].progmem = 0;
+
+	transfer.address = device_address;
+	transfer.flags = I2C_TRANSFER_READ | I2C_TRANSFER_COUNTED;
+	transfer.tx_count = 0;
+	transfer.tx_segments = 0;
+	transfer.rx_size = 1;
+	transfer.rx_data = &view->count;
+	transfer.rx_segments = 2;
+	transfer.rx_segment = segments;
+	transfer.complete = NULL;
+
+	return (i2c_transfer_start(&transfer) == I2C_FUNCTION_RETCODE_SUCCESS) ? SHA204_SUCCESS : SHA204_COMM_FAIL;
+}
+
+
+/** \brief This function checks the transfer started last without blocking.
+ *
+ * \return #SHA204_PENDING while the transfer is running, otherwise its status,
+ *         #SHA204_RX_NO_RESPONSE if the device is still busy
+ */
+uint8_t sha204p_poll(void)
+{
+	return sha204p_transfer_status(i2c_transfer_poll(&transfer));
+}
+#endif
+
+
+/** \brief This function sends a command from where its parts are.
+ *
+ * Header, data blocks and CRC go out in one write sequence.
+ * \param[in] command header, data blocks and CRC of the command
+ * \return status of the operation
+ */
+uint8_t sha204p_send_view(struct sha204_command_view *command)
+{
+#ifdef I2C_USE_INTERRUPTS
+	uint8_t ret_code = sha204p_start_view(command);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+
+	return sha204p_transfer_status(i2c_transfer_wait(&transfer));
+#else
+	uint8_t word_address = SHA204_I2C_PACKET_FUNCTION_NORMAL;
+	uint8_t i;
+	uint8_t i2c_status = sha204p_send_slave_address(I2C_WRITE);
+	if (i2c_status != I2C_FUNCTION_RETCODE_SUCCESS)
+		return SHA204_COMM_FAIL;
+
+	i2c_status = i2c_send_bytes(1, &word_address);
+	if (i2c_status == I2C_FUNCTION_RETCODE_SUCCESS)
+		i2c_status = i2c_send_bytes(SHA204_CMD_HEADER_SIZE, command->header);
+	for (i = 0; (i < SHA204_CMD_DATA_BLOCKS) && (i2c_status == I2C_FUNCTION_RETCODE_SUCCESS); i++) {
+		if (!command->datalen[i])
+			continue;
+		if (command->progmem & SHA204_DATA_PROGMEM(i))
+			i2c_status = sha204p_send_bytes_P(command->datalen[i], command->data[i]);
+		else
+			i2c_status = i2c_send_bytes(command->datalen[i], command->data[i]);
+	}
+	if (i2c_status == I2C_FUNCTION_RETCODE_SUCCESS)
+		i2c_status = i2c_send_bytes(sizeof(command->crc), command->crc);
+
+	(void) i2c_send_stop();
+
+	return (i2c_status == I2C_FUNCTION_RETCODE_SUCCESS) ? SHA204_SUCCESS : SHA204_COMM_FAIL;
+#endif
+}
+
+
 /** \brief This function puts the device into idle state.
  * \return status of the operation
  */
@@ -250,6 +502,83 @@ uint8_t sha204p_reset_io(void)
 }
 
 
+#ifndef I2C_USE_INTERRUPTS
+/** \brief This function receives a response after the device has
+ *         acknowledged its address and sends a Stop.
+ *
+ * \param[in] size size of rx buffer
+ * \param[out] response pointer to rx buffer
+ * \return status of the operation
+ */
+static uint8_t sha204p_read_response(uint8_t size, uint8_t *response)
+{
+	uint8_t count;
+
+	// Receive count byte.
+	uint8_t i2c_status = i2c_receive_byte(response);
+	if (i2c_status != I2C_FUNCTION_RETCODE_SUCCESS)
+		return SHA204_COMM_FAIL;
+
+	count = response[SHA204_BUFFER_POS_COUNT];
+	if ((count < SHA204_RSP_SIZE_MIN) || (count > size)) {
+		(void) i2c_send_stop();
+		return SHA204_INVALID_SIZE;
+	}
+
+	i2c_status = i2c_receive_bytes(count - 1, &response[SHA204_BUFFER_POS_DATA]);
+
+	if (i2c_status != I2C_FUNCTION_RETCODE_SUCCESS)
+		return SHA204_COMM_FAIL;
+	else
+		return SHA204_SUCCESS;
+}
+#endif
+
+
+#if !defined(I2C_USE_INTERRUPTS) || defined(SHA204_I2C_ACK_POLLING)
+/** \brief This function receives a response into a view after the device
+ *         has acknowledged its address and sends a Stop.
+ *
+ * \param[in,out] view where the response goes
+ * \return status of the operation
+ */
+static uint8_t sha204p_read_view(struct sha204_response_view *view)
+{
+	uint8_t n_data;
+	uint8_t i;
+
+	// Receive count byte.
+	uint8_t i2c_status = i2c_receive_byte(&view->count);
+	if (i2c_status != I2C_FUNCTION_RETCODE_SUCCESS)
+		return SHA204_COMM_FAIL;
+
+	if ((view->count < SHA204_RSP_SIZE_MIN) || (view->count > view->size + 1 + sizeof(view->crc))) {
+		(void) i2c_send_stop();
+		return SHA204_INVALID_SIZE;
+	}
+
+	// Data bytes go into the buffer of the view, the remaining bytes into its CRC.
+	n_data = view->count - 1;
+	if (n_data > view->size)
+		n_data = view->size;
+
+	if (n_data == view->count - 1)
+		i2c_status = i2c_receive_bytes(n_data, view->data);
+	else {
+		for (i = 0; (i < n_data) && (i2c_status == I2C_FUNCTION_RETCODE_SUCCESS); i++)
+			i2c_status = i2c_receive_byte(&view->data[i]);
+		if (i2c_status == I2C_FUNCTION_RETCODE_SUCCESS)
+			i2c_status = i2c_receive_bytes(view->count - 1 - n_data, view->crc);
+	}
+
+	if (i2c_status != I2C_FUNCTION_RETCODE_SUCCESS)
+		return SHA204_COMM_FAIL;
+	else
+		return SHA204_SUCCESS;
+}
+#endif
+
+
 /** \brief This function receives a response from the device.
  *
  * \param[in] size size of rx buffer
@@ -258,8 +587,13 @@ uint8_t sha204p_reset_io(void)
  */
 uint8_t sha204p_receive_response(uint8_t size, uint8_t *response)
 {
-	uint8_t count;
+#ifdef I2C_USE_INTERRUPTS
+	uint8_t ret_code = sha204p_start_receive(size, response);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
 
+	return sha204p_transfer_status(i2c_transfer_wait(&transfer));
+#else
 	// Address the device and indicate that bytes are to be read.
 	uint8_t i2c_status = sha204p_send_slave_address(I2C_READ);
 	if (i2c_status != I2C_FUNCTION_RETCODE_SUCCESS) {
@@ -272,24 +606,79 @@ uint8_t sha204p_receive_response(uint8_t size, uint8_t *response)
 		return i2c_status;
 	}
 
-	// Receive count byte.
-	i2c_status = i2c_receive_byte(response);
-	if (i2c_status != I2C_FUNCTION_RETCODE_SUCCESS)
-		return SHA204_COMM_FAIL;
+	return sha204p_read_response(size, response);
+#endif
+}
 
-	count = response[SHA204_BUFFER_POS_COUNT];
-	if ((count < SHA204_RSP_SIZE_MIN) || (count > size)) {
-		(void) i2c_send_stop();
+
+/** \brief This function receives a response into a view.
+ * \param[in,out] view where the response goes
+ * \return status of the operation
+ */
+uint8_t sha204p_receive_view(struct sha204_response_view *view)
+{
+#ifdef I2C_USE_INTERRUPTS
+	uint8_t ret_code = sha204p_start_receive_view(view);
+	if (ret_code != SHA204_SUCCESS)
+		return ret_code;
+
+	ret_code = sha204p_transfer_status(i2c_transfer_wait(&transfer));
+	if (ret_code == SHA204_SUCCESS && view->count < SHA204_RSP_SIZE_MIN)
 		return SHA204_INVALID_SIZE;
+
+	return ret_code;
+#else
+	// Address the device and indicate that bytes are to be read.
+	uint8_t i2c_status = sha204p_send_slave_address(I2C_READ);
+	if (i2c_status != I2C_FUNCTION_RETCODE_SUCCESS) {
+		if (i2c_status == I2C_FUNCTION_RETCODE_NACK)
+			i2c_status = SHA204_RX_NO_RESPONSE;
+
+		return i2c_status;
 	}
 
-	i2c_status = i2c_receive_bytes(count - 1, &response[SHA204_BUFFER_POS_DATA]);
+	return sha204p_read_view(view);
+#endif
+}
 
-	if (i2c_status != I2C_FUNCTION_RETCODE_SUCCESS)
-		return SHA204_COMM_FAIL;
-	else
-		return SHA204_SUCCESS;
+
+#ifdef SHA204_I2C_ACK_POLLING
+/** \brief This function polls the device address until the device
+ *         acknowledges it and then receives the response.
+ *
+ * The device does not acknowledge its address while it is busy executing
+ * a command. No Stop condition is sent after a nacked address, so every
+ * poll after the first one starts with a repeated Start and the response
+ * is read as soon as the command has completed.
+ * \param[in,out] view where the response goes
+ * \param[in] timeout_ms maximum time in ms to wait for the device
+ * \return status of the operation
+ */
+uint8_t sha204p_poll_view(struct sha204_response_view *view, uint16_t timeout_ms)
+{
+	uint8_t sla = device_address | I2C_READ;
+	uint32_t timeout_us = (uint32_t) timeout_ms * 1000 + SHA204_RESPONSE_TIMEOUT;
+	uint32_t start_us = micros();
+	uint8_t i2c_status;
+
+	do {
+		i2c_status = i2c_send_start();
+		if (i2c_status != I2C_FUNCTION_RETCODE_SUCCESS)
+			break;
+
+		i2c_status = i2c_send_bytes(1, &sla);
+		if (i2c_status == I2C_FUNCTION_RETCODE_SUCCESS)
+			return sha204p_read_view(view);
+
+		if (i2c_status != I2C_FUNCTION_RETCODE_NACK)
+			break;
+	} while (micros() - start_us < timeout_us);
+
+	(void) i2c_send_stop();
+
+	return (i2c_status == I2C_FUNCTION_RETCODE_NACK) ? SHA204_RX_NO_RESPONSE : SHA204_COMM_FAIL;
 }
+#endif
 
 
 /** \brief This function resynchronizes communication.
@@ -367,5 +756,30 @@ uint8_t sha204p_resync(uint8_t size, uint8_t *response)
 	return sha204p_reset_io();
 }
 
+
+#ifdef SHA204_MULTI_TRANSPORT
+//! functions of the I<SUP>2</SUP>C interface for #sha204p_select_transport
+const struct sha204_transport sha204p_i2c_transport = {
+	sha204p_send_command,
+	sha204p_send_view,
+	sha204p_receive_response,
+	sha204p_receive_view,
+	sha204p_init,
+	sha204p_set_device_id,
+	sha204p_wakeup,
+	sha204p_idle,
+	sha204p_sleep,
+	sha204p_reset_io,
+	sha204p_resync,
+#ifdef SHA204_I2C_ACK_POLLING
+	sha204p_poll_view,
+#else
+	NULL,
+#endif
+	SHA204_I2C_RESPONSE_TIMEOUT,
+	1
+};
+#endif
+
 /** @} */
 #endif
\ No newline at end of file
@@ -66,6 +66,8 @@ extern "C" {
 #define SHA204_RX_FAIL              ((uint8_t)  0xE6) //!< Timed out while waiting for response. Number of bytes received is > 0.
 #define SHA204_RX_NO_RESPONSE       ((uint8_t)  0xE7) //!< Not an error while the Command layer is polling for a command response.
 #define SHA204_RESYNC_WITH_WAKEUP   ((uint8_t)  0xE8) //!< Re-synchronization succeeded, but only after generating a Wake-up
+#define SHA204_HEALTH_FAIL          ((uint8_t)  0xE9) //!< Random numbers of the device failed a health test.
+#define SHA204_PENDING              ((uint8_t)  0xEA) //!< Operation started without blocking has not completed yet.
 
 #define SHA204_COMM_FAIL            ((uint8_t)  0xF0) //!< Communication with device failed. Same as in hardware dependent modules.
 #define SHA204_TIMEOUT              ((uint8_t)  0xF1) //!< Timed out while waiting for response. Number of bytes received is 0.
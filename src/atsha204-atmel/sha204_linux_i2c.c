@@ -0,0 +1,709 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/** \file
+ *  \brief Physical Layer Functions for a Linux i2c-dev Adapter
+ *
+ *         Only built with #SHA204_LINUX_I2C. It replaces sha204_i2c.c and
+ *         the hardware dependent I<SUP>2</SUP>C module when the library runs
+ *         on a Linux host. Together with the Communication, Marshaling and
+ *         Helper modules and timer_utilities.c it needs no Arduino core.
+ *
+ *         Every packet costs one system call. The word address and the
+ *         command go out in a single I2C_RDWR message, and a response is
+ *         read with a single transfer of the size the caller expects. A busy
+ *         device is polled every #SHA204_LINUX_I2C_POLL_US instead of
+ *         back-to-back.
+ *
+ *         Adapters that only implement SMBus transfers, like the i2c-stub
+ *         driver, are supported for packets of up to 32 bytes. Commands are
+ *         then written as one I<SUP>2</SUP>C block write and responses are
+ *         read one byte at a time. Longer packets are not split and fail with
+ *         #SHA204_INVALID_SIZE. That rules out every Write of 32 bytes, and
+ *         with it data zone writes, AtSha204::provision() and
+ *         AtSha204::write_record(), as well as Nonce with 32 input bytes, MAC
+ *         with a challenge, CheckMac and DeriveKey with a MAC. These need an
+ *         adapter with plain I<SUP>2</SUP>C transfers.
+ *
+ *         extras/linux/linux_i2c_test.c runs this module against a device
+ *         emulator, with and without plain I<SUP>2</SUP>C transfers.
+ *
+ *         The Wake-up pulse is the zero-length write to the general call
+ *         address, which holds SDA low long enough at 100 kHz or slower. On
+ *         faster buses, wire a GPIO to SDA and call
+ *         #sha204p_linux_i2c_set_wake_gpio.
+ *
+ *         The state of this module is per thread, so several threads can
+ *         each open their own adapter.
+ */
+
+#include "sha204_physical.h"            // declarations that are common to all interface implementations
+#include "sha204_lib_return_codes.h"    // declarations of function return codes
+
+#ifdef SHA204_LINUX_I2C
+
+#include <errno.h>                      // errno values
+#include <fcntl.h>                      // open()
+#include <string.h>                     // memcpy(), memset()
+#include <time.h>                       // clock_nanosleep()
+#include <unistd.h>                     // close()
+#include <sys/ioctl.h>                  // ioctl()
+#include <linux/i2c.h>                  // I2C message definitions
+#include <linux/i2c-dev.h>              // i2c-dev ioctl definitions
+#include <linux/gpio.h>                 // GPIO character device definitions
+
+
+//! word addresses of the packet types, see sha204_i2c.c
+enum linux_i2c_word_address {
+	SHA204_LINUX_I2C_PACKET_FUNCTION_RESET,
+	SHA204_LINUX_I2C_PACKET_FUNCTION_SLEEP,
+	SHA204_LINUX_I2C_PACKET_FUNCTION_IDLE,
+	SHA204_LINUX_I2C_PACKET_FUNCTION_NORMAL
+};
+
+//! file descriptor of the i2c-dev device, -1 if not open
+static SHA204_THREAD_LOCAL int bus_fd = -1;
+
+//! file descriptor of the requested wake-up GPIO line, -1 if not used
+static SHA204_THREAD_LOCAL int wake_fd = -1;
+
+//! adapter supports plain I<SUP>2</SUP>C transfers, otherwise SMBus only
+static SHA204_THREAD_LOCAL uint8_t plain_i2c;
+
+//! address last set with I2C_SLAVE_FORCE for SMBus transfers, -1 if none
+static SHA204_THREAD_LOCAL int smbus_address = -1;
+
+//! I<SUP>2</SUP>C address is set when calling #sha204p_init or #sha204p_set_device_id.
+static SHA204_THREAD_LOCAL uint8_t device_address = SHA204_I2C_DEFAULT_ADDRESS;
+
+//! cost counters
+static SHA204_THREAD_LOCAL struct sha204_linux_i2c_stats stats;
+
+
+/** \brief This function issues an ioctl and counts it.
+ * \param[in] fd file descriptor
+ * \param[in] request ioctl request
+ * \param[in,out] arg ioctl argument
+ * \return result of the ioctl
+ */
+static int sha204p_ioctl(int fd, unsigned long request, void *arg)
+{
+	int ret;
+
+	do {
+		stats.syscalls++;
+		ret = ioctl(fd, request, arg);
+	} while (ret < 0 && errno == EINTR);
+
+	return ret;
+}
+
+
+/** \brief This function sleeps and counts the system call.
+ * \param[in] delay_us time to sleep in us
+ */
+static void sha204p_delay_us(uint32_t delay_us)
+{
+	struct timespec delay;
+
+	delay.tv_sec = delay_us / 1000000;
+	delay.tv_nsec = (long) (delay_us % 1000000) * 1000;
+
+	stats.syscalls++;
+	while (clock_nanosleep(CLOCK_MONOTONIC, 0, &delay, &delay) == EINTR)
+		stats.syscalls++;
+}
+
+
+#ifdef SHA204_I2C_ACK_POLLING
+/** \brief This function returns the time of the monotonic clock.
+ * \return time in us
+ */
+static uint64_t sha204p_now_us(void)
+{
+	struct timespec now;
+
+	// served by the vDSO, so not counted as a system call
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+#endif
+
+
+/** \brief This function runs I2C_RDWR messages as one combined transfer.
+ * \param[in] msgs messages
+ * \param[in] count number of messages
+ * \return result of the ioctl
+ */
+static int sha204p_rdwr(struct i2c_msg *msgs, uint32_t count)
+{
+	struct i2c_rdwr_ioctl_data data;
+
+	data.msgs = msgs;
+	data.nmsgs = count;
+
+	return sha204p_ioctl(bus_fd, I2C_RDWR, &data);
+}
+
+
+/** \brief This function runs an SMBus transfer.
+ * \param[in] address 7-bit address
+ * \param[in] read_write I2C_SMBUS_READ or I2C_SMBUS_WRITE
+ * \param[in] command SMBus command, the word address for the device
+ * \param[in] size SMBus transaction type
+ * \param[in,out] data transfer data, NULL for byte and quick transfers
+ * \return result of the ioctl
+ */
+static int sha204p_smbus(uint8_t address, uint8_t read_write, uint8_t command,
+			uint32_t size, union i2c_smbus_data *data)
+{
+	struct i2c_smbus_ioctl_data args;
+
+	if (smbus_address != address) {
+		if (sha204p_ioctl(bus_fd, I2C_SLAVE_FORCE, (void *) (unsigned long) address) < 0)
+			return -1;
+		smbus_address = address;
+	}
+
+	args.read_write = read_write;
+	args.command = command;
+	args.size = size;
+	args.data = data;
+
+	return sha204p_ioctl(bus_fd, I2C_SMBUS, &args);
+}
+
+
+/** \brief This function receives one byte with an SMBus Receive Byte transfer.
+ * \param[out] value received byte
+ * \return result of the ioctl
+ */
+static int sha204p_smbus_receive(uint8_t *value)
+{
+	union i2c_smbus_data data;
+	int ret = sha204p_smbus(device_address >> 1, I2C_SMBUS_READ, 0, I2C_SMBUS_BYTE, &data);
+
+	*value = data.byte;
+
+	return ret;
+}
+
+
+/** \brief This function opens an i2c-dev adapter.
+ *
+ * #sha204p_init opens #SHA204_LINUX_I2C_BUS if no adapter is open.
+ * \param[in] bus path of the i2c-dev device file, e.g. "/dev/i2c-1"
+ * \return status of the operation
+ */
+uint8_t sha204p_linux_i2c_open(const char *bus)
+{
+	unsigned long funcs;
+
+	if (!bus)
+		return SHA204_BAD_PARAM;
+
+	if (bus_fd >= 0) {
+		stats.syscalls++;
+		close(bus_fd);
+		smbus_address = -1;
+	}
+
+	stats.syscalls++;
+	bus_fd = open(bus, O_RDWR | O_CLOEXEC);
+	if (bus_fd < 0)
+		return SHA204_COMM_FAIL;
+
+	if (sha204p_ioctl(bus_fd, I2C_FUNCS, &funcs) < 0)
+		funcs = 0;
+
+	plain_i2c = (funcs & I2C_FUNC_I2C) ? 1 : 0;
+	if (!plain_i2c && (funcs & (I2C_FUNC_SMBUS_WRITE_I2C_BLOCK | I2C_FUNC_SMBUS_READ_BYTE))
+				!= (I2C_FUNC_SMBUS_WRITE_I2C_BLOCK | I2C_FUNC_SMBUS_READ_BYTE)) {
+		stats.syscalls++;
+		close(bus_fd);
+		bus_fd = -1;
+		return SHA204_FUNC_FAIL;
+	}
+
+	return SHA204_SUCCESS;
+}
+
+
+/** \brief This function closes the adapter and releases the wake-up GPIO. */
+void sha204p_linux_i2c_close(void)
+{
+	if (bus_fd >= 0) {
+		stats.syscalls++;
+		close(bus_fd);
+		bus_fd = -1;
+	}
+	if (wake_fd >= 0) {
+		stats.syscalls++;
+		close(wake_fd);
+		wake_fd = -1;
+	}
+	smbus_address = -1;
+}
+
+
+/** \brief This function selects a GPIO for the Wake-up pulse.
+ *
+ * The line is requested once as an open-drain output that idles high,
+ * so it can be wired to SDA without disturbing the adapter.
+ * \param[in] chip path of the GPIO character device, e.g. "/dev/gpiochip0"
+ * \param[in] line offset of the line on that chip
+ * \return status of the operation
+ */
+uint8_t sha204p_linux_i2c_set_wake_gpio(const char *chip, uint32_t line)
+{
+	struct gpio_v2_line_request request;
+	int chip_fd;
+	int ret;
+
+	if (!chip)
+		return SHA204_BAD_PARAM;
+
+	if (wake_fd >= 0) {
+		stats.syscalls++;
+		close(wake_fd);
+		wake_fd = -1;
+	}
+
+	memset(&request, 0, sizeof(request));
+	request.offsets[0] = line;
+	request.num_lines = 1;
+	request.config.flags = GPIO_V2_LINE_FLAG_OUTPUT | GPIO_V2_LINE_FLAG_OPEN_DRAIN;
+	request.config.num_attrs = 1;
+	request.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+	request.config.attrs[0].attr.values = 1;
+	request.config.attrs[0].mask = 1;
+	strncpy(request.consumer, "atsha204 wake-up", sizeof(request.consumer) - 1);
+
+	stats.syscalls++;
+	chip_fd = open(chip, O_RDWR | O_CLOEXEC);
+	if (chip_fd < 0)
+		return SHA204_COMM_FAIL;
+
+	ret = sha204p_ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &request);
+
+	stats.syscalls++;
+	close(chip_fd);
+
+	if (ret < 0)
+		return SHA204_COMM_FAIL;
+
+	wake_fd = request.fd;
+
+	return SHA204_SUCCESS;
+}
+
+
+/** \brief This function reads the cost counters of the calling thread.
+ *
+ * Divide syscalls by commands for the system calls per command.
+ * \param[out] counters copy of the counters
+ * \param[in] reset non-zero to clear the counters after copying them
+ */
+void sha204p_linux_i2c_get_stats(struct sha204_linux_i2c_stats *counters, uint8_t reset)
+{
+	if (counters)
+		*counters = stats;
+	if (reset)
+		memset(&stats, 0, sizeof(stats));
+}
+
+
+/** \brief This function sets the I<SUP>2</SUP>C address.
+ *         Communication functions will use this address.
+ *
+ *  \param[in] id I<SUP>2</SUP>C address
+ */
+void sha204p_set_device_id(uint8_t id)
+{
+	device_address = id;
+}
+
+
+/** \brief This function opens the default adapter if none is open.
+ */
+void sha204p_init(void)
+{
+	if (bus_fd < 0)
+		(void) sha204p_linux_i2c_open(SHA204_LINUX_I2C_BUS);
+	device_address = SHA204_I2C_DEFAULT_ADDRESS;
+}
+
+
+/** \brief This function generates a Wake-up pulse and delays.
+ * \return status of the operation
+ */
+uint8_t sha204p_wakeup(void)
+{
+	struct gpio_v2_line_values values;
+	struct i2c_msg msg;
+
+	if (bus_fd < 0)
+		return SHA204_COMM_FAIL;
+
+	if (wake_fd >= 0) {
+		values.mask = 1;
+		values.bits = 0;
+		if (sha204p_ioctl(wake_fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) < 0)
+			return SHA204_COMM_FAIL;
+
+		sha204p_delay_us(SHA204_WAKEUP_PULSE_WIDTH * 10);
+
+		values.bits = 1;
+		if (sha204p_ioctl(wake_fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) < 0)
+			return SHA204_COMM_FAIL;
+	}
+	else {
+		// Start condition, seven address bits and the write bit keep SDA
+		// low for nine clocks. Nobody acknowledges, so ignore the result.
+		if (plain_i2c) {
+			msg.addr = 0;
+			msg.flags = 0;
+			msg.len = 0;
+			msg.buf = NULL;
+			(void) sha204p_rdwr(&msg, 1);
+		}
+		else
+			(void) sha204p_smbus(0, I2C_SMBUS_WRITE, 0, I2C_SMBUS_QUICK, NULL);
+	}
+
+	sha204p_delay_us((uint32_t) SHA204_WAKEUP_DELAY * 1000);
+
+	return SHA204_SUCCESS;
+}
+
+
+/** \brief This function sends a packet to the device in one transfer.
+ *
+ * @param[in] word_address packet function code
+ * @param[in] count number of bytes in data buffer
+ * @param[in] buffer pointer to data buffer
+ * @return status of the operation
+ */
+static uint8_t sha204p_linux_i2c_send(uint8_t word_address, uint8_t count, uint8_t *buffer)
+{
+	uint8_t packet[1 + UINT8_MAX];
+	union i2c_smbus_data data;
+	struct i2c_msg msg;
+	int ret;
+
+	if (bus_fd < 0)
+		return SHA204_COMM_FAIL;
+
+	if (plain_i2c) {
+		packet[0] = word_address;
+		if (count)
+			memcpy(&packet[1], buffer, count);
+
+		msg.addr = device_address >> 1;
+		msg.flags = 0;
+		msg.len = count + 1;
+		msg.buf = packet;
+		ret = sha204p_rdwr(&msg, 1);
+	}
+	else if (count == 0)
+		// An SMBus Send Byte transfer sends only the word address.
+		ret = sha204p_smbus(device_address >> 1, I2C_SMBUS_WRITE, word_address, I2C_SMBUS_BYTE, NULL);
+	else {
+		// An SMBus block holds at most 32 bytes, see the file comment.
+		if (count > I2C_SMBUS_BLOCK_MAX)
+			return SHA204_INVALID_SIZE;
+
+		data.block[0] = count;
+		memcpy(&data.block[1], buffer, count);
+		ret = sha204p_smbus(device_address >> 1, I2C_SMBUS_WRITE, word_address,
+					I2C_SMBUS_I2C_BLOCK_DATA, &data);
+	}
+
+	return (ret < 0) ? SHA204_COMM_FAIL : SHA204_SUCCESS;
+}
+
+
+/** \brief This function sends a command to the device.
+ * \param[in] count number of bytes to send
+ * \param[in] command pointer to command buffer
+ * \return status of the operation
+ */
+uint8_t sha204p_send_command(uint8_t count, uint8_t *command)
+{
+	stats.commands++;
+
+	return sha204p_linux_i2c_send(SHA204_LINUX_I2C_PACKET_FUNCTION_NORMAL, count, command);
+}
+
+
+/** \brief This function sends a command from where its parts are.
+ *
+ * A write() needs the whole packet in one buffer, so the parts are
+ * gathered on the stack. Data blocks in program memory are ordinary
+ * memory on a Linux host.
+ * \param[in] command header, data blocks and CRC of the command
+ * \return status of the operation
+ */
+uint8_t sha204p_send_view(struct sha204_command_view *command)
+{
+	uint8_t packet[UINT8_MAX];
+	uint8_t *p_packet = packet;
+	uint8_t i;
+
+	memcpy(p_packet, command->header, SHA204_CMD_HEADER_SIZE);
+	p_packet += SHA204_CMD_HEADER_SIZE;
+	for (i = 0; i < SHA204_CMD_DATA_BLOCKS; i++) {
+		if (command->datalen[i])
+			memcpy(p_packet, command->data[i], command->datalen[i]);
+		p_packet += command->datalen[i];
+	}
+	memcpy(p_packet, command->crc, sizeof(command->crc));
+	p_packet += sizeof(command->crc);
+
+	return sha204p_send_command((uint8_t) (p_packet - packet), packet);
+}
+
+
+/** \brief This function puts the device into idle state.
+ * \return status of the operation
+ */
+uint8_t sha204p_idle(void)
+{
+	return sha204p_linux_i2c_send(SHA204_LINUX_I2C_PACKET_FUNCTION_IDLE, 0, NULL);
+}
+
+
+/** \brief This function puts the device into low-power state.
+ *  \return status of the operation
+ */
+uint8_t sha204p_sleep(void)
+{
+	return sha204p_linux_i2c_send(SHA204_LINUX_I2C_PACKET_FUNCTION_SLEEP, 0, NULL);
+}
+
+
+/** \brief This function resets the I/O buffer of the device.
+ * \return status of the operation
+ */
+uint8_t sha204p_reset_io(void)
+{
+	return sha204p_linux_i2c_send(SHA204_LINUX_I2C_PACKET_FUNCTION_RESET, 0, NULL);
+}
+
+
+/** \brief This function reads a response without waiting.
+ *
+ * Adapters report a missing acknowledge with different error codes,
+ * so every failed read counts as the device being busy.
+ * \param[in] size size of rx buffer
+ * \param[out] response pointer to rx buffer
+ * \return status of the operation
+ */
+static uint8_t sha204p_read_response(uint8_t size, uint8_t *response)
+{
+	struct i2c_msg msg;
+	uint8_t count;
+	uint8_t i;
+
+	if (bus_fd < 0)
+		return SHA204_COMM_FAIL;
+
+	stats.polls++;
+
+	if (plain_i2c) {
+		// Read the whole buffer in one transfer. The count byte
+		// tells how much of it the device has filled.
+		msg.addr = device_address >> 1;
+		msg.flags = I2C_M_RD;
+		msg.len = size;
+		msg.buf = response;
+		if (sha204p_rdwr(&msg, 1) < 0)
+			return SHA204_RX_NO_RESPONSE;
+	}
+	else {
+		// The device keeps its read position between transfers,
+		// so SMBus adapters read the response byte by byte.
+		if (sha204p_smbus_receive(&response[SHA204_BUFFER_POS_COUNT]) < 0)
+			return SHA204_RX_NO_RESPONSE;
+
+		count = response[SHA204_BUFFER_POS_COUNT];
+		if ((count < SHA204_RSP_SIZE_MIN) || (count > size))
+			return SHA204_INVALID_SIZE;
+
+		for (i = SHA204_BUFFER_POS_DATA; i < count; i++) {
+			if (sha204p_smbus_receive(&response[i]) < 0)
+				return SHA204_COMM_FAIL;
+		}
+	}
+
+	count = response[SHA204_BUFFER_POS_COUNT];
+	if ((count < SHA204_RSP_SIZE_MIN) || (count > size))
+		return SHA204_INVALID_SIZE;
+
+	return SHA204_SUCCESS;
+}
+
+
+/** \brief This function reads a response into a view without waiting.
+ *
+ * The device keeps its read position between messages, so count byte,
+ * data and CRC are read with three messages into their destinations in
+ * one transfer.
+ * \param[in,out] view where the response goes
+ * \return status of the operation
+ */
+static uint8_t sha204p_read_view(struct sha204_response_view *view)
+{
+	struct i2c_msg msgs[3];
+	uint8_t count;
+	uint8_t i;
+
+	if (bus_fd < 0)
+		return SHA204_COMM_FAIL;
+
+	stats.polls++;
+
+	if (plain_i2c) {
+		msgs[0].addr = msgs[1].addr = msgs[2].addr = device_address >> 1;
+		msgs[0].flags = msgs[1].flags = msgs[2].flags = I2C_M_RD;
+		msgs[0].len = 1;
+		msgs[0].buf = &view->count;
+		msgs[1].len = view->size;
+		msgs[1].buf = view->data;
+		msgs[2].len = sizeof(view->crc);
+		msgs[2].buf = view->crc;
+		if (sha204p_rdwr(msgs, 3) < 0)
+			return SHA204_RX_NO_RESPONSE;
+
+		count = view->count;
+		if ((count < SHA204_RSP_SIZE_MIN) || (count > view->size + 1 + sizeof(view->crc)))
+			return SHA204_INVALID_SIZE;
+	}
+	else {
+		if (sha204p_smbus_receive(&view->count) < 0)
+			return SHA204_RX_NO_RESPONSE;
+
+		count = view->count;
+		if ((count < SHA204_RSP_SIZE_MIN) || (count > view->size + 1 + sizeof(view->crc)))
+			return SHA204_INVALID_SIZE;
+
+		for (i = SHA204_BUFFER_POS_DATA; i < count; i++) {
+			if (sha204p_smbus_receive(i <= view->size ? &view->data[i - 1] : &view->crc[i - 1 - view->size]) < 0)
+				return SHA204_COMM_FAIL;
+		}
+	}
+
+	return SHA204_SUCCESS;
+}
+
+
+/** \brief This function receives a response from the device.
+ *
+ * If the device is busy, it sleeps for #SHA204_LINUX_I2C_POLL_US before
+ * returning, which is the response polling time the Communication layer
+ * counts down.
+ * \param[in] size size of rx buffer
+ * \param[out] response pointer to rx buffer
+ * \return status of the operation
+ */
+uint8_t sha204p_receive_response(uint8_t size, uint8_t *response)
+{
+	uint8_t ret_code = sha204p_read_response(size, response);
+
+	if (ret_code == SHA204_RX_NO_RESPONSE)
+		sha204p_delay_us(SHA204_LINUX_I2C_POLL_US);
+
+	return ret_code;
+}
+
+
+/** \brief This function receives a response into a view.
+ *
+ * If the device is busy, it sleeps for #SHA204_LINUX_I2C_POLL_US before
+ * returning.
+ * \param[in,out] view where the response goes
+ * \return status of the operation
+ */
+uint8_t sha204p_receive_view(struct sha204_response_view *view)
+{
+	uint8_t ret_code = sha204p_read_view(view);
+
+	if (ret_code == SHA204_RX_NO_RESPONSE)
+		sha204p_delay_us(SHA204_LINUX_I2C_POLL_US);
+
+	return ret_code;
+}
+
+
+#ifdef SHA204_I2C_ACK_POLLING
+/** \brief This function polls the device until it acknowledges its address
+ *         and returns the response.
+ *
+ * \param[in,out] view where the response goes
+ * \param[in] timeout_ms maximum time in ms to wait for the device
+ * \return status of the operation
+ */
+uint8_t sha204p_poll_view(struct sha204_response_view *view, uint16_t timeout_ms)
+{
+	uint64_t deadline_us = sha204p_now_us() + (uint64_t) timeout_ms * 1000 + SHA204_LINUX_I2C_POLL_US;
+	uint8_t ret_code;
+
+	while ((ret_code = sha204p_read_view(view)) == SHA204_RX_NO_RESPONSE) {
+		if (sha204p_now_us() >= deadline_us)
+			break;
+		sha204p_delay_us(SHA204_LINUX_I2C_POLL_US);
+	}
+
+	return ret_code;
+}
+#endif
+
+
+/** \brief This function resynchronizes communication.
+ *
+ * A read from address 0x7F clocks nine bits with SDA released, which
+ * is the I<SUP>2</SUP>C software reset sequence described in
+ * sha204_i2c.c. Resetting the I/O buffer tells whether the device
+ * is listening again.
+ * \param[in] size not used
+ * \param[in] response not used
+ * \return status of the operation
+ */
+uint8_t sha204p_resync(uint8_t size, uint8_t *response)
+{
+	struct i2c_msg msg;
+
+	if (bus_fd < 0)
+		return SHA204_COMM_FAIL;
+
+	if (plain_i2c) {
+		msg.addr = 0x7F;
+		msg.flags = I2C_M_RD;
+		msg.len = 0;
+		msg.buf = NULL;
+		(void) sha204p_rdwr(&msg, 1);
+	}
+	else
+		(void) sha204p_smbus(0x7F, I2C_SMBUS_READ, 0, I2C_SMBUS_QUICK, NULL);
+
+	return sha204p_reset_io();
+}
+
+#endif
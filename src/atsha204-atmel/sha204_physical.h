@@ -60,15 +60,78 @@ extern "C" {
 #define SHA204_BUFFER_POS_COUNT      (0)             //!< buffer index of count byte in command or response
 #define SHA204_BUFFER_POS_DATA       (1)             //!< buffer index of data in response
 
+#define SHA204_CMD_HEADER_SIZE       ((uint8_t)  5)  //!< count byte, op-code, param1 and param2 of a command
+#define SHA204_CMD_DATA_BLOCKS       (3)             //!< maximum number of data blocks in a command
+
+//! bit in sha204_command_view::progmem that marks data block \a i as residing in program memory
+#define SHA204_DATA_PROGMEM(i)       ((uint8_t) (1 << (i)))
+
+#ifdef SHA204_LINUX_HOST
+//! Program memory is ordinary memory on a Linux host.
+#   define SHA204_READ_PROGMEM(address)  (*(const uint8_t *) (address))
+#   ifndef PROGMEM
+#      define PROGMEM
+#   endif
+#else
+#   include <avr/pgmspace.h>
+//! reads a byte of a data block that resides in program memory
+#   define SHA204_READ_PROGMEM(address)  pgm_read_byte(address)
+#endif
+
+//! number of bytes copied from program memory to the stack at a time while sending
+#define SHA204_PROGMEM_CHUNK_SIZE    ((uint8_t)  8)
+
 //! width of Wakeup pulse in 10 us units
 #define SHA204_WAKEUP_PULSE_WIDTH    (uint8_t) (6.0 * CPU_CLOCK_DEVIATION_POSITIVE + 0.5)
 
 //! delay between Wakeup pulse and communication in ms
 #define SHA204_WAKEUP_DELAY          (uint8_t) (3.0 * CPU_CLOCK_DEVIATION_POSITIVE + 0.5)
 
+//! I<SUP>2</SUP>C address of a device as shipped
+#define SHA204_I2C_DEFAULT_ADDRESS   ((uint8_t) 0xC8)
+
+//! Selector byte of a device as shipped
+#define SHA204_SELECTOR_DEFAULT      ((uint8_t) 0x00)
+
+
+/** \brief This structure describes where the bytes of a response go.
+ *
+ * The data bytes are received straight into the buffer of the caller.
+ * Count byte, status byte and CRC go into the members of the structure.
+ * The physical layer stores the bytes of a response in this order:
+ * count byte, up to \a size bytes into \a data, the rest into \a crc.
+ * #sha204c_check_view then moves the CRC of a short response out of
+ * \a data and its status byte into \a status, so the first three bytes
+ * of \a data get overwritten if the device returns a status.
+ */
+struct sha204_response_view {
+	uint8_t count;                       //!< count byte of the response
+	uint8_t status;                      //!< status byte of a status response
+	uint8_t crc[2];                      //!< CRC of the response
+	uint8_t size;                        //!< number of data bytes expected, at least one
+	uint8_t *data;                       //!< destination of the data bytes
+};
+
+/** \brief This structure describes a command that is sent from where its parts are.
+ *
+ * The physical layer sends the header, the data blocks and the CRC one
+ * after another, so the command is never assembled in a buffer.
+ * #sha204c_send_and_receive_view calculates the CRC. Data blocks marked
+ * in \a progmem are read with #SHA204_READ_PROGMEM while they are sent,
+ * so keys and provisioning tables do not have to be copied into RAM.
+ */
+struct sha204_command_view {
+	uint8_t header[SHA204_CMD_HEADER_SIZE];    //!< count byte, op-code, param1 and param2
+	uint8_t datalen[SHA204_CMD_DATA_BLOCKS];   //!< number of bytes in each data block
+	uint8_t *data[SHA204_CMD_DATA_BLOCKS];     //!< data blocks, ignored if their length is 0
+	uint8_t progmem;                           //!< data blocks in program memory, see #SHA204_DATA_PROGMEM
+	uint8_t crc[2];                            //!< CRC of the command
+};
 
 uint8_t sha204p_send_command(uint8_t count, uint8_t *command);
+uint8_t sha204p_send_view(struct sha204_command_view *command);
 uint8_t sha204p_receive_response(uint8_t size, uint8_t *response);
+uint8_t sha204p_receive_view(struct sha204_response_view *view);
 void    sha204p_init(void);
 void    sha204p_set_device_id(uint8_t id);
 uint8_t sha204p_wakeup(void);
@@ -76,6 +139,60 @@ uint8_t sha204p_idle(void);
 uint8_t sha204p_sleep(void);
 uint8_t sha204p_reset_io(void);
 uint8_t sha204p_resync(uint8_t size, uint8_t *response);
+#ifdef SHA204_I2C_ACK_POLLING
+uint8_t sha204p_poll_view(struct sha204_response_view *view, uint16_t timeout_ms);
+#endif
+#ifdef SHA204_I2C_NON_BLOCKING
+uint8_t sha204p_start_view(struct sha204_command_view *command);
+uint8_t sha204p_start_receive(uint8_t size, uint8_t *response);
+uint8_t sha204p_start_receive_view(struct sha204_response_view *view);
+uint8_t sha204p_poll(void);
+#endif
+
+#ifdef SHA204_MULTI_TRANSPORT
+/** \brief This structure holds the functions of one physical interface.
+ *
+ * Every interface module exports one of these. The sha204p_... functions
+ * above dispatch to the one selected by #sha204p_select_transport.
+ */
+struct sha204_transport {
+	uint8_t (*send_command)(uint8_t count, uint8_t *command);      //!< implements #sha204p_send_command
+	uint8_t (*send_view)(struct sha204_command_view *command);     //!< implements #sha204p_send_view
+	uint8_t (*receive_response)(uint8_t size, uint8_t *response);  //!< implements #sha204p_receive_response
+	uint8_t (*receive_view)(struct sha204_response_view *view);    //!< implements #sha204p_receive_view
+	void    (*init)(void);                                         //!< implements #sha204p_init
+	void    (*set_device_id)(uint8_t id);                          //!< implements #sha204p_set_device_id
+	uint8_t (*wakeup)(void);                                       //!< implements #sha204p_wakeup
+	uint8_t (*idle)(void);                                         //!< implements #sha204p_idle
+	uint8_t (*sleep)(void);                                        //!< implements #sha204p_sleep
+	uint8_t (*reset_io)(void);                                     //!< implements #sha204p_reset_io
+	uint8_t (*resync)(uint8_t size, uint8_t *response);            //!< implements #sha204p_resync
+	//! implements sha204p_poll_view, NULL if the interface cannot poll for completion
+	uint8_t (*poll_view)(struct sha204_response_view *view, uint16_t timeout_ms);
+	uint16_t response_timeout;                                     //!< response polling time in us
+	uint8_t addressed;                                             //!< devices share the bus and are selected by id
+};
+
+extern const struct sha204_transport sha204p_swi_transport;
+extern const struct sha204_transport sha204p_i2c_transport;
+
+void     sha204p_select_transport(const struct sha204_transport *transport);
+uint16_t sha204p_response_timeout(void);
+#endif
+
+#ifdef SHA204_LINUX_I2C
+//! This structure counts what the Linux i2c-dev interface costs.
+struct sha204_linux_i2c_stats {
+	uint32_t commands;   //!< number of commands sent
+	uint32_t polls;      //!< number of response reads, including the ones not acknowledged
+	uint32_t syscalls;   //!< number of system calls made by the interface
+};
+
+uint8_t sha204p_linux_i2c_open(const char *bus);
+void    sha204p_linux_i2c_close(void);
+uint8_t sha204p_linux_i2c_set_wake_gpio(const char *chip, uint32_t line);
+void    sha204p_linux_i2c_get_stats(struct sha204_linux_i2c_stats *stats, uint8_t reset);
+#endif
 
 /** @} */
 
@@ -43,12 +43,30 @@
  * \atsha204_library_license_stop
 */
 
+#include <string.h>                                              // needed for memcpy()
 #include "../common-atmel/swi_phys.h"                            // hardware dependent declarations for SWI
 #include "sha204_physical.h"                     // declarations that are common to all interface implementations
 #include "sha204_lib_return_codes.h"             // declarations of function return codes
 #include "../common-atmel/timer_utilities.h"                     // definitions for delay functions
 
 #if defined(SHA204_SWI_BITBANG) || defined(SHA204_SWI_UART)
+
+#ifdef SHA204_MULTI_TRANSPORT
+// Export the interface functions under their own names.
+// sha204_transport.c dispatches the sha204p_... names to them.
+#   define sha204p_init              sha204p_swi_init
+#   define sha204p_set_device_id     sha204p_swi_set_device_id
+#   define sha204p_send_command      sha204p_swi_send_command
+#   define sha204p_send_view         sha204p_swi_send_view
+#   define sha204p_receive_response  sha204p_swi_receive_response
+#   define sha204p_receive_view      sha204p_swi_receive_view
+#   define sha204p_wakeup            sha204p_swi_wakeup
+#   define sha204p_idle              sha204p_swi_idle
+#   define sha204p_sleep             sha204p_swi_sleep
+#   define sha204p_reset_io          sha204p_swi_reset_io
+#   define sha204p_resync            sha204p_swi_resync
+#endif
+
 /** \defgroup sha204_swi Module 04: SWI Abstraction Module
  *
  * These functions and definitions abstract the SWI hardware. They implement the functions
@@ -89,34 +107,116 @@ void sha204p_set_device_id(uint8_t id)
  */
 uint8_t sha204p_send_command(uint8_t count, uint8_t *command)
 {
+#ifdef SHA204_SWI_LINUX_UART
+	// Flag and command go out in a single write().
+	return swi_send_packet(SHA204_SWI_FLAG_CMD, count, command);
+#else
 	uint8_t ret_code = swi_send_byte(SHA204_SWI_FLAG_CMD);
 	if (ret_code != SWI_FUNCTION_RETCODE_SUCCESS)
 		return SHA204_COMM_FAIL;
 
 	return swi_send_bytes(count, command);
+#endif
 }
 
 
-/** \brief This function receives a response from the device.
+#ifndef SHA204_SWI_LINUX_UART
+/** \brief This function sends bytes that reside in program memory.
  *
- * \param[in] size number of bytes to receive
- * \param[out] response pointer to response buffer
+ * The bytes are copied to the stack in small chunks, so the hardware
+ * module turns the line around once per chunk instead of once per byte.
+ * \param[in] count number of bytes to send
+ * \param[in] buffer pointer to the bytes in program memory
  * \return status of the operation
  */
-uint8_t sha204p_receive_response(uint8_t size, uint8_t *response)
+static uint8_t sha204p_send_bytes_P(uint8_t count, const uint8_t *buffer)
+{
+	uint8_t chunk[SHA204_PROGMEM_CHUNK_SIZE];
+	uint8_t chunk_size, i;
+	uint8_t ret_code = SWI_FUNCTION_RETCODE_SUCCESS;
+
+	while (count && (ret_code == SWI_FUNCTION_RETCODE_SUCCESS)) {
+		chunk_size = (count < sizeof(chunk)) ? count : sizeof(chunk);
+		for (i = 0; i < chunk_size; i++)
+			chunk[i] = SHA204_READ_PROGMEM(buffer++);
+		ret_code = swi_send_bytes(chunk_size, chunk);
+		count -= chunk_size;
+	}
+
+	return ret_code;
+}
+#endif
+
+
+/** \brief This function sends a command from where its parts are.
+ *
+ * The hardware module sends header, data blocks and CRC one after another.
+ * Gaps between the parts are far shorter than the time-out of the device.
+ * Data blocks in program memory are sent by #sha204p_send_bytes_P.
+ * \param[in] command header, data blocks and CRC of the command
+ * \return status of the operation
+ */
+uint8_t sha204p_send_view(struct sha204_command_view *command)
 {
-	uint8_t count_byte;
 	uint8_t i;
-	uint8_t ret_code;
+#ifdef SHA204_SWI_LINUX_UART
+	// Flag and command go out in a single write(), so the parts are gathered.
+	// Data blocks in program memory are ordinary memory on a Linux host.
+	uint8_t packet[UINT8_MAX];
+	uint8_t *p_packet = packet;
+
+	memcpy(p_packet, command->header, SHA204_CMD_HEADER_SIZE);
+	p_packet += SHA204_CMD_HEADER_SIZE;
+	for (i = 0; i < SHA204_CMD_DATA_BLOCKS; i++) {
+		if (command->datalen[i])
+			memcpy(p_packet, command->data[i], command->datalen[i]);
+		p_packet += command->datalen[i];
+	}
+	memcpy(p_packet, command->crc, sizeof(command->crc));
+	p_packet += sizeof(command->crc);
+
+	return swi_send_packet(SHA204_SWI_FLAG_CMD, (uint8_t) (p_packet - packet), packet);
+#else
+	uint8_t ret_code = swi_send_byte(SHA204_SWI_FLAG_CMD);
+	if (ret_code != SWI_FUNCTION_RETCODE_SUCCESS)
+		return SHA204_COMM_FAIL;
+
+	ret_code = swi_send_bytes(SHA204_CMD_HEADER_SIZE, command->header);
+	for (i = 0; (i < SHA204_CMD_DATA_BLOCKS) && (ret_code == SWI_FUNCTION_RETCODE_SUCCESS); i++) {
+		if (!command->datalen[i])
+			continue;
+		if (command->progmem & SHA204_DATA_PROGMEM(i))
+			ret_code = sha204p_send_bytes_P(command->datalen[i], command->data[i]);
+		else
+			ret_code = swi_send_bytes(command->datalen[i], command->data[i]);
+	}
+	if (ret_code != SWI_FUNCTION_RETCODE_SUCCESS)
+		return ret_code;
+
+	return swi_send_bytes(sizeof(command->crc), command->crc);
+#endif
+}
 
-	for (i = 0; i < size; i++)
-		response[i] = 0;
+
+/** \brief This function requests a response and receives it.
+ *
+ * The hardware module stores every byte it receives, so the
+ * buffers do not need to be cleared beforehand.
+ * \param[in] n_segments number of segments
+ * \param[out] segments where the response goes, starting with the count byte
+ * \param[in] size number of bytes to receive at most
+ * \return status of the operation
+ */
+static uint8_t sha204p_receive_segments(uint8_t n_segments, const struct swi_segment *segments, uint8_t size)
+{
+	uint8_t count_byte;
+	uint8_t ret_code;
 
 	(void) swi_send_byte(SHA204_SWI_FLAG_TX);
 
-	ret_code = swi_receive_bytes(size, response);
+	ret_code = swi_receive_segments(n_segments, segments);
 	if (ret_code == SWI_FUNCTION_RETCODE_SUCCESS || ret_code == SWI_FUNCTION_RETCODE_RX_FAIL) {
-		count_byte = response[SHA204_BUFFER_POS_COUNT];
+		count_byte = *segments[0].buffer;
 		if ((count_byte < SHA204_RSP_SIZE_MIN) || (count_byte > size))
 			return SHA204_INVALID_SIZE;
 
@@ -133,6 +233,38 @@ uint8_t sha204p_receive_response(uint8_t size, uint8_t *response)
 }
 
 
+/** \brief This function receives a response from the device.
+ *
+ * \param[in] size number of bytes to receive
+ * \param[out] response pointer to response buffer
+ * \return status of the operation
+ */
+uint8_t sha204p_receive_response(uint8_t size, uint8_t *response)
+{
+	struct swi_segment segment = {response, size};
+
+	return sha204p_receive_segments(1, &segment, size);
+}
+
+
+/** \brief This function receives a response into a view.
+ *
+ * The data bytes go straight into the buffer of the view.
+ * \param[in,out] view where the response goes
+ * \return status of the operation
+ */
+uint8_t sha204p_receive_view(struct sha204_response_view *view)
+{
+	struct swi_segment segments[3] = {
+		{&view->count, 1},
+		{view->data, view->size},
+		{view->crc, sizeof(view->crc)}
+	};
+
+	return sha204p_receive_segments(3, segments, view->size + 1 + sizeof(view->crc));
+}
+
+
 /** \brief This function generates a Wake-up pulse and delays.
  *
  * \return success
@@ -216,6 +348,27 @@ uint8_t sha204p_resync(uint8_t size, uint8_t *response)
 	return sha204p_receive_response(size, response);
 }
 
+
+#ifdef SHA204_MULTI_TRANSPORT
+//! functions of the SWI interface for #sha204p_select_transport
+const struct sha204_transport sha204p_swi_transport = {
+	sha204p_send_command,
+	sha204p_send_view,
+	sha204p_receive_response,
+	sha204p_receive_view,
+	sha204p_init,
+	sha204p_set_device_id,
+	sha204p_wakeup,
+	sha204p_idle,
+	sha204p_sleep,
+	sha204p_reset_io,
+	sha204p_resync,
+	NULL,
+	SWI_RECEIVE_TIME_OUT + SWI_US_PER_BYTE,
+	0
+};
+#endif
+
 #endif
 
 /** @} */
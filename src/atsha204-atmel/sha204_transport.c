@@ -0,0 +1,150 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/** \file
+ *  \brief Dispatch of the Physical Layer Functions to the Selected Transport
+ *
+ *         Only built with #SHA204_MULTI_TRANSPORT. The interface modules then
+ *         export their functions through a struct sha204_transport, and the
+ *         functions below forward to the transport selected last. The
+ *         Communication layer keeps calling the sha204p_... names.
+ */
+
+#include "sha204_physical.h"            // declarations that are common to all interface implementations
+#include "sha204_lib_return_codes.h"    // declarations of function return codes
+#include "Arduino.h"
+
+#ifdef SHA204_MULTI_TRANSPORT
+
+//! transport the sha204p_... functions dispatch to
+static const struct sha204_transport *transport = &sha204p_swi_transport;
+
+
+/** \brief This function selects the transport for the following calls.
+ *
+ * \param[in] selected transport of the device to talk to
+ */
+void sha204p_select_transport(const struct sha204_transport *selected)
+{
+	transport = selected;
+}
+
+
+/** \brief This function returns the response polling time of the selected transport.
+ * \return response polling time in us
+ */
+uint16_t sha204p_response_timeout(void)
+{
+	return transport->response_timeout;
+}
+
+
+void sha204p_init(void)
+{
+	transport->init();
+}
+
+
+void sha204p_set_device_id(uint8_t id)
+{
+	transport->set_device_id(id);
+}
+
+
+uint8_t sha204p_send_command(uint8_t count, uint8_t *command)
+{
+	return transport->send_command(count, command);
+}
+
+
+uint8_t sha204p_send_view(struct sha204_command_view *command)
+{
+	return transport->send_view(command);
+}
+
+
+uint8_t sha204p_receive_response(uint8_t size, uint8_t *response)
+{
+	return transport->receive_response(size, response);
+}
+
+
+uint8_t sha204p_receive_view(struct sha204_response_view *view)
+{
+	return transport->receive_view(view);
+}
+
+
+uint8_t sha204p_wakeup(void)
+{
+	return transport->wakeup();
+}
+
+
+uint8_t sha204p_idle(void)
+{
+	return transport->idle();
+}
+
+
+uint8_t sha204p_sleep(void)
+{
+	return transport->sleep();
+}
+
+
+uint8_t sha204p_reset_io(void)
+{
+	return transport->reset_io();
+}
+
+
+uint8_t sha204p_resync(uint8_t size, uint8_t *response)
+{
+	return transport->resync(size, response);
+}
+
+
+#ifdef SHA204_I2C_ACK_POLLING
+/** \brief This function waits for a response.
+ *
+ * Transports that cannot detect completion of a command
+ * poll for the response instead.
+ * \param[in,out] view where the response goes
+ * \param[in] timeout_ms maximum time in ms to wait for the device
+ * \return status of the operation
+ */
+uint8_t sha204p_poll_view(struct sha204_response_view *view, uint16_t timeout_ms)
+{
+	uint8_t ret_code;
+	uint32_t start_us;
+
+	if (transport->poll_view)
+		return transport->poll_view(view, timeout_ms);
+
+	start_us = micros();
+	do {
+		ret_code = transport->receive_view(view);
+	} while ((ret_code == SHA204_RX_NO_RESPONSE) && (micros() - start_us < (uint32_t) timeout_ms * 1000));
+
+	return ret_code;
+}
+#endif
+
+#endif
@@ -83,6 +83,11 @@
 
 // The ATSHA204 interface module does not use UART control and status register C.
 
+// definitions for UART interrupt vectors
+#define UART_RX_vect    USART1_RX_vect     //!< UART receive-complete interrupt
+#define UART_TX_vect    USART1_TX_vect     //!< UART transmit-complete interrupt
+#define UART_UDRE_vect  USART1_UDRE_vect   //!< UART data-register-empty interrupt
+
 /** @} */
 
 #endif
@@ -38,6 +38,7 @@
  * \atsha204_library_license_stop
  */
 
+#include <stddef.h>          // NULL
 #include <stdint.h>          // data type definitions
 
 #include "swi_phys.h"        // hardware dependent declarations for SWI
@@ -174,13 +175,36 @@ uint8_t swi_send_byte(uint8_t value)
  *  \param[out] buffer pointer to rx buffer
  * \return status of the operation
  */
-uint8_t swi_receive_bytes(uint8_t count, uint8_t *buffer) {
+uint8_t swi_receive_bytes(uint8_t count, uint8_t *buffer)
+{
+	struct swi_segment segment = {buffer, count};
+
+	return swi_receive_segments(1, &segment);
+}
+
+
+/** \brief This GPIO function receives bytes from an SWI device into several buffers.
+ *
+ *  The bytes fill the segments one after the other. Moving on to the
+ *  next segment happens between two bytes, where the bit timing leaves
+ *  enough time.
+ *  \param[in] n_segments number of segments
+ *  \param[out] segments segments to receive into
+ * \return status of the operation
+ */
+uint8_t swi_receive_segments(uint8_t n_segments, const struct swi_segment *segments) {
 	uint8_t status = SWI_FUNCTION_RETCODE_SUCCESS;
 	uint8_t i;
+	uint8_t count = 0;
+	uint8_t *byte = NULL;
+	uint8_t *end = NULL;
 	uint8_t bit_mask;
 	uint8_t pulse_count;
 	uint8_t timeout_count;
 
+	for (i = 0; i < n_segments; i++)
+		count += segments[i].count;
+
 	// Disable interrupts while receiving.
 	swi_disable_interrupts();
 
@@ -190,7 +214,13 @@ uint8_t swi_receive_bytes(uint8_t count, uint8_t *buffer) {
 #ifndef DEBUG_BITBANG
 
 	// Receive bits and store in buffer.
-	for (i = 0; i < count; i++) {
+	for (i = 0; i < count; i++, byte++) {
+		while (byte == end) {
+			byte = segments->buffer;
+			end = byte + segments->count;
+			segments++;
+		}
+		*byte = 0;
 		for (bit_mask = 1; bit_mask > 0; bit_mask <<= 1) {
 			pulse_count = 0;
 
@@ -260,7 +290,7 @@ uint8_t swi_receive_bytes(uint8_t count, uint8_t *buffer) {
 			// Update byte at current buffer index.
 			else
 				// received "one" bit
-				buffer[i] |= bit_mask;
+				*byte |= bit_mask;
 		}
 
 		if (status != SWI_FUNCTION_RETCODE_SUCCESS)
@@ -288,8 +318,13 @@ uint8_t swi_receive_bytes(uint8_t count, uint8_t *buffer) {
 	volatile uint8_t start_pulse_width = 0;
 #endif
 
-	for (i = 0; i < count; i++) {
-		buffer[i] = 0;
+	for (i = 0; i < count; i++, byte++) {
+		while (byte == end) {
+			byte = segments->buffer;
+			end = byte + segments->count;
+			segments++;
+		}
+		*byte = 0;
 		for (bit_mask = 1; bit_mask > 0; bit_mask <<= 1) {
 			pulse_count = 0;
 
@@ -376,7 +411,7 @@ uint8_t swi_receive_bytes(uint8_t count, uint8_t *buffer) {
 			// Update byte at current buffer index.
 			else
 				// received "one" bit
-				buffer[i] |= bit_mask;
+				*byte |= bit_mask;
 
 			DEBUG_LOW;
 		}
@@ -0,0 +1,268 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/** \file
+ *  \brief Interrupt-Driven Part of the I<SUP>2</SUP>C Physical Layer
+ *
+ *         A transfer is described by a struct i2c_transfer. Once started
+ *         with #i2c_transfer_start, the TWI interrupt walks through the
+ *         Start condition, address, word address, data and Stop condition
+ *         without further CPU involvement. Timeouts are real-time deadlines
+ *         derived from the number of bytes and the SCL clock instead of
+ *         polling loop counts.
+ */
+
+#include <avr/io.h>          // GPIO definitions
+#include <avr/interrupt.h>   // interrupt definitions
+#include <util/twi.h>        // I2C definitions
+#include <avr/pgmspace.h>    // program memory access
+#include "i2c_phys.h"        // definitions and declarations for the hardware dependent I2C module
+#include "Arduino.h"
+
+#ifdef I2C_USE_INTERRUPTS
+
+//! TWCR value that keeps the peripheral and its interrupt enabled
+#define I2C_TWCR_RUN        (_BV(TWEN) | _BV(TWIE) | _BV(TWINT))
+
+//! transfer the interrupt routine is working on, NULL if idle
+static struct i2c_transfer *volatile active_transfer;
+
+
+/** \brief This function finishes the active transfer.
+ *
+ * \param[in] transfer active transfer
+ * \param[in] status result of the transfer
+ * \param[in] twcr value written to TWCR, normally a Stop condition
+ */
+static void i2c_transfer_finish(struct i2c_transfer *transfer, uint8_t status, uint8_t twcr)
+{
+	TWCR = twcr;
+	active_transfer = NULL;
+	transfer->status = status;
+	if (transfer->complete)
+		transfer->complete(transfer);
+}
+
+
+/** \brief This function stores a received byte.
+ *
+ * Bytes go into rx data and then into the rx segments, one after the other.
+ * \param[in,out] transfer active transfer
+ * \param[in] data received byte
+ */
+static void i2c_transfer_store(struct i2c_transfer *transfer, uint8_t data)
+{
+	// Continue with the next segment once rx data are full.
+	while (transfer->index == transfer->rx_size && transfer->rx_segments) {
+		transfer->rx_size = transfer->rx_segment->count;
+		transfer->rx_data = transfer->rx_segment->data;
+		transfer->rx_segment++;
+		transfer->rx_segments--;
+		transfer->index = 0;
+	}
+	if (transfer->index < transfer->rx_size)
+		transfer->rx_data[transfer->index++] = data;
+	transfer->rx_count++;
+}
+
+
+/** \brief This function starts an interrupt-driven transfer.
+ *
+ * The deadline is the time it takes to clock all bytes at the current
+ * bit rate, doubled, plus #I2C_TRANSFER_MARGIN_US.
+ * \param[in,out] transfer transfer descriptor
+ * \return #I2C_FUNCTION_RETCODE_SUCCESS if started, #I2C_FUNCTION_RETCODE_BUSY
+ *         if another transfer is running
+ */
+uint8_t i2c_transfer_start(struct i2c_transfer *transfer)
+{
+	uint16_t bytes;
+	uint32_t scl_period_ns;
+	uint8_t i;
+
+	if (active_transfer)
+		return I2C_FUNCTION_RETCODE_BUSY;
+
+	// Wait for a Stop condition of a previous transfer to complete.
+	// This takes one SCL period at most.
+	transfer->start_us = micros();
+	while (TWCR & _BV(TWSTO)) {
+		if (micros() - transfer->start_us > I2C_TRANSFER_MARGIN_US)
+			return I2C_FUNCTION_RETCODE_TIMEOUT;
+	}
+
+	transfer->rx_total = transfer->rx_size;
+	for (i = 0; i < transfer->rx_segments; i++)
+		transfer->rx_total += transfer->rx_segment[i].count;
+	bytes = 1 + transfer->tx_count + transfer->rx_total
+				+ ((transfer->flags & I2C_TRANSFER_WORD_ADDRESS) ? 1 : 0);
+	for (i = 0; i < transfer->tx_segments; i++)
+		bytes += transfer->tx_segment[i].count;
+	scl_period_ns = (16UL + 2UL * TWBR) * 1000UL / (F_CPU / 1000000UL);
+	transfer->timeout_us = (uint16_t) ((2UL * 9UL * bytes * scl_period_ns) / 1000UL) + I2C_TRANSFER_MARGIN_US;
+
+	transfer->index = 0;
+	transfer->tx_progmem = 0;
+	transfer->rx_count = 0;
+	transfer->status = I2C_FUNCTION_RETCODE_BUSY;
+	active_transfer = transfer;
+
+	TWCR = I2C_TWCR_RUN | _BV(TWSTA);
+
+	return I2C_FUNCTION_RETCODE_SUCCESS;
+}
+
+
+/** \brief This function checks a transfer without blocking.
+ *
+ * If the deadline has passed, the transfer is aborted with a Stop condition.
+ * \param[in,out] transfer transfer descriptor
+ * \return #I2C_FUNCTION_RETCODE_BUSY while running, otherwise the result
+ */
+uint8_t i2c_transfer_poll(struct i2c_transfer *transfer)
+{
+	uint8_t status = transfer->status;
+
+	if (status != I2C_FUNCTION_RETCODE_BUSY)
+		return status;
+
+	if (micros() - transfer->start_us <= transfer->timeout_us)
+		return status;
+
+	noInterrupts();
+	if (active_transfer == transfer)
+		i2c_transfer_finish(transfer, I2C_FUNCTION_RETCODE_TIMEOUT,
+					_BV(TWEN) | _BV(TWSTO) | _BV(TWINT));
+	interrupts();
+
+	return transfer->status;
+}
+
+
+/** \brief This function waits for a transfer to complete.
+ *
+ * It calls yield() while waiting so that cooperative tasks keep running.
+ * \param[in,out] transfer transfer descriptor
+ * \return result of the transfer
+ */
+uint8_t i2c_transfer_wait(struct i2c_transfer *transfer)
+{
+	uint8_t status;
+
+	while ((status = i2c_transfer_poll(transfer)) == I2C_FUNCTION_RETCODE_BUSY)
+		yield();
+
+	return status;
+}
+
+
+/** \brief TWI interrupt routine that runs the state machine of the active transfer. */
+ISR(TWI_vect)
+{
+	struct i2c_transfer *transfer = active_transfer;
+	uint8_t count;
+
+	if (!transfer) {
+		// Spurious interrupt. Release the bus.
+		TWCR = _BV(TWEN) | _BV(TWINT);
+		return;
+	}
+
+	switch (TW_STATUS) {
+	case TW_START:
+	case TW_REP_START:
+		TWDR = transfer->address | ((transfer->flags & I2C_TRANSFER_WRITE) ? 0 : 1);
+		TWCR = I2C_TWCR_RUN;
+		break;
+
+	case TW_MT_SLA_ACK:
+		if (transfer->flags & I2C_TRANSFER_WORD_ADDRESS) {
+			TWDR = transfer->word_address;
+			TWCR = I2C_TWCR_RUN;
+			break;
+		}
+		// no word address: fall through and send the first data byte
+
+	case TW_MT_DATA_ACK:
+		// Continue with the next segment once tx data are sent.
+		while (transfer->index == transfer->tx_count && transfer->tx_segments) {
+			transfer->tx_count = transfer->tx_segment->count;
+			transfer->tx_data = transfer->tx_segment->data;
+			transfer->tx_progmem = transfer->tx_segment->progmem;
+			transfer->tx_segment++;
+			transfer->tx_segments--;
+			transfer->index = 0;
+		}
+		if (transfer->index < transfer->tx_count) {
+			TWDR = transfer->tx_progmem ? pgm_read_byte(&transfer->tx_data[transfer->index])
+						: transfer->tx_data[transfer->index];
+			transfer->index++;
+			TWCR = I2C_TWCR_RUN;
+		}
+		else
+			i2c_transfer_finish(transfer, I2C_FUNCTION_RETCODE_SUCCESS,
+						_BV(TWEN) | _BV(TWSTO) | _BV(TWINT));
+		break;
+
+	case TW_MR_SLA_ACK:
+		// Acknowledge unless only one byte is to be received.
+		TWCR = (transfer->rx_total > 1) ? (I2C_TWCR_RUN | _BV(TWEA)) : I2C_TWCR_RUN;
+		break;
+
+	case TW_MR_DATA_ACK:
+		count = TWDR;
+		i2c_transfer_store(transfer, count);
+		if (transfer->rx_count == 1 && (transfer->flags & I2C_TRANSFER_COUNTED)) {
+			if (count < 2 || count > transfer->rx_total) {
+				i2c_transfer_finish(transfer, I2C_FUNCTION_RETCODE_BAD_COUNT,
+							_BV(TWEN) | _BV(TWSTO) | _BV(TWINT));
+				break;
+			}
+			transfer->rx_total = count;
+		}
+		// Do not acknowledge the last byte.
+		TWCR = (transfer->rx_count < transfer->rx_total - 1) ? (I2C_TWCR_RUN | _BV(TWEA)) : I2C_TWCR_RUN;
+		break;
+
+	case TW_MR_DATA_NACK:
+		i2c_transfer_store(transfer, TWDR);
+		i2c_transfer_finish(transfer, I2C_FUNCTION_RETCODE_SUCCESS,
+					_BV(TWEN) | _BV(TWSTO) | _BV(TWINT));
+		break;
+
+	case TW_MT_SLA_NACK:
+	case TW_MR_SLA_NACK:
+	case TW_MT_DATA_NACK:
+		i2c_transfer_finish(transfer, I2C_FUNCTION_RETCODE_NACK,
+					_BV(TWEN) | _BV(TWSTO) | _BV(TWINT));
+		break;
+
+	case TW_MT_ARB_LOST:
+		// Release the bus without a Stop condition.
+		i2c_transfer_finish(transfer, I2C_FUNCTION_RETCODE_COMM_FAIL, _BV(TWEN) | _BV(TWINT));
+		break;
+
+	default:
+		i2c_transfer_finish(transfer, I2C_FUNCTION_RETCODE_COMM_FAIL,
+					_BV(TWEN) | _BV(TWSTO) | _BV(TWINT));
+		break;
+	}
+}
+
+#endif
@@ -62,6 +62,21 @@ void i2c_enable(void)
 }
 
 
+/** \brief This function changes the I<SUP>2</SUP>C clock after #i2c_enable.
+ *
+ * The prescaler is set to 1. Clocks that need a negative bit rate
+ * register value are limited to F_CPU / 16 (1 MHz at 16 MHz).
+ * \param[in] clock SCL frequency in Hz, e.g. #I2C_CLOCK_FAST or #I2C_CLOCK_FAST_PLUS
+ */
+void i2c_set_clock(uint32_t clock)
+{
+	uint32_t ticks = F_CPU / clock;
+
+	TWSR &= ~(_BV(TWPS0) | _BV(TWPS1));
+	TWBR = (ticks > 16) ? (uint8_t) ((ticks - 16 + 1) / 2) : 0;
+}
+
+
 /** \brief This function disables the I<SUP>2</SUP>C peripheral. */
 void i2c_disable(void)
 {
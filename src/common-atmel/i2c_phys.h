@@ -49,7 +49,19 @@
 */
 
 //! I2C clock
-#define I2C_CLOCK                         (400000.0)
+#ifndef I2C_CLOCK
+#   define I2C_CLOCK                      (400000.0)
+#endif
+
+//! I2C clock for Fast-mode
+#define I2C_CLOCK_FAST                    (400000UL)
+
+/** \brief I2C clock for Fast-mode Plus
+ *
+ * The TWI prescaler is 1 and TWBR is 0 at this clock, so the CPU
+ * has to run at 16 MHz to reach it.
+ */
+#define I2C_CLOCK_FAST_PLUS               (1000000UL)
 
 //! Use pull-up resistors.
 #define I2C_PULLUP
@@ -89,6 +101,73 @@
 #define I2C_FUNCTION_RETCODE_COMM_FAIL   ((uint8_t) 0xF0) //!< Communication with device failed.
 #define I2C_FUNCTION_RETCODE_TIMEOUT     ((uint8_t) 0xF1) //!< Communication timed out.
 #define I2C_FUNCTION_RETCODE_NACK        ((uint8_t) 0xF8) //!< TWI nack
+#define I2C_FUNCTION_RETCODE_BAD_COUNT   ((uint8_t) 0xF9) //!< count byte of a counted read is out of range
+#define I2C_FUNCTION_RETCODE_BUSY        ((uint8_t) 0xFA) //!< interrupt-driven transfer is still running
+
+
+/** \brief Un-comment this definition or place it in your project settings
+ *         to run transfers from the TWI interrupt (#i2c_transfer_start).
+ *
+ * It is off by default because the TWI interrupt vector cannot be shared
+ * with other libraries (e.g. Wire).
+ */
+// #define I2C_USE_INTERRUPTS
+
+/** \brief time in us added to the calculated duration of an
+ *         interrupt-driven transfer before it is aborted
+ *
+ * It covers the Start and Stop conditions and interrupt latency.
+ */
+#define I2C_TRANSFER_MARGIN_US           ((uint16_t) 500)
+
+/** \name Flags for Interrupt-Driven Transfers
+@{ */
+#define I2C_TRANSFER_WRITE               ((uint8_t) 0x01) //!< address the device for writing and send tx data
+#define I2C_TRANSFER_READ                ((uint8_t) 0x02) //!< address the device for reading and receive rx data
+#define I2C_TRANSFER_WORD_ADDRESS        ((uint8_t) 0x04) //!< send word_address before tx data
+#define I2C_TRANSFER_COUNTED             ((uint8_t) 0x08) //!< first byte read is the number of bytes to read
+/** @} */
+
+struct i2c_transfer;
+
+//! part of a transfer that is sent after tx_data or received after rx_data
+struct i2c_segment {
+	uint8_t count;                   //!< number of bytes
+	uint8_t *data;                   //!< pointer to the bytes
+	uint8_t progmem;                 //!< The bytes reside in program memory. Ignored for rx segments.
+};
+
+//! function called from interrupt context when a transfer has completed
+typedef void (*i2c_transfer_callback)(struct i2c_transfer *transfer);
+
+/** \brief This structure describes one interrupt-driven transfer,
+ *         enclosed by a Start and a Stop condition.
+ *
+ * The caller fills in the fields up to \ref complete. The interrupt
+ * routine updates the remaining fields. The structure has to stay
+ * valid until the transfer has completed.
+ */
+struct i2c_transfer {
+	uint8_t address;                 //!< I2C address of the device, read / write bit cleared
+	uint8_t flags;                   //!< combination of I2C_TRANSFER_... flags
+	uint8_t word_address;            //!< byte sent after the address if #I2C_TRANSFER_WORD_ADDRESS is set
+	uint8_t tx_count;                //!< number of bytes in tx_data
+	uint8_t *tx_data;                //!< pointer to tx data
+	uint8_t tx_segments;             //!< number of segments sent after tx data
+	const struct i2c_segment *tx_segment;  //!< segments sent after tx data, can be NULL if tx_segments is 0
+	uint8_t rx_size;                 //!< size of rx buffer
+	uint8_t *rx_data;                //!< pointer to rx buffer
+	uint8_t rx_segments;             //!< number of segments received into after rx data
+	const struct i2c_segment *rx_segment;  //!< segments received into after rx data, can be NULL if rx_segments is 0
+	i2c_transfer_callback complete;  //!< completion callback, can be NULL
+	volatile uint8_t status;         //!< #I2C_FUNCTION_RETCODE_BUSY while running, then the result
+	volatile uint8_t rx_count;       //!< number of bytes received into rx data and segments
+	uint8_t rx_total;                //!< number of bytes to receive
+	uint8_t index;                   //!< index of the next byte to send or receive
+	uint8_t tx_progmem;              //!< The tx data being sent reside in program memory.
+	uint16_t timeout_us;             //!< deadline relative to start_us
+	uint32_t start_us;               //!< time stamp taken when the transfer was started
+};
 
 
 void    i2c_enable(void);
@@ -98,6 +177,13 @@ uint8_t i2c_send_stop(void);
 uint8_t i2c_send_bytes(uint8_t count, uint8_t *data);
 uint8_t i2c_receive_byte(uint8_t *data);
 uint8_t i2c_receive_bytes(uint8_t count, uint8_t *data);
+void    i2c_set_clock(uint32_t clock);
+
+#ifdef I2C_USE_INTERRUPTS
+uint8_t i2c_transfer_start(struct i2c_transfer *transfer);
+uint8_t i2c_transfer_poll(struct i2c_transfer *transfer);
+uint8_t i2c_transfer_wait(struct i2c_transfer *transfer);
+#endif
 
 
 /** @} */
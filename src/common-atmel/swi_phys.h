@@ -56,6 +56,12 @@ Codes in the range 0xF8 to 0xFF are special for the particular interface.
 
 /** @} */
 
+//! part of a receive buffer, see #swi_receive_segments
+struct swi_segment {
+	uint8_t *buffer;     //!< destination of the bytes
+	uint8_t count;       //!< number of bytes
+};
+
 // Function Prototypes
 void    swi_enable(void);
 void    swi_set_device_id(uint8_t id);
@@ -63,6 +69,21 @@ void    swi_set_signal_pin(uint8_t end);
 uint8_t swi_send_bytes(uint8_t count, uint8_t *buffer);
 uint8_t swi_send_byte(uint8_t value);
 uint8_t swi_receive_bytes(uint8_t count, uint8_t *buffer);
+uint8_t swi_receive_segments(uint8_t n_segments, const struct swi_segment *segments);
+
+// Serial port of a Linux host (uart_linux_phys.c)
+/** \brief This structure counts what the serial port costs. */
+struct swi_linux_uart_stats {
+	uint32_t packets;    //!< number of packets written, each with one write()
+	uint32_t reads;      //!< number of read() calls
+	uint32_t syscalls;   //!< number of system calls made by the module
+	uint32_t wait_us;    //!< time slept waiting for characters to arrive, in us
+};
+
+uint8_t swi_send_packet(uint8_t flag, uint8_t count, uint8_t *buffer);
+uint8_t swi_linux_uart_open(const char *port);
+void    swi_linux_uart_close(void);
+void    swi_linux_uart_get_stats(struct swi_linux_uart_stats *stats, uint8_t reset);
 
 extern volatile uint8_t* device_port_DDR, * device_port_OUT, * device_port_IN;
 extern uint8_t device_pin;
@@ -38,7 +38,11 @@
  */
 
 #include <stdint.h>                           // data type definitions
+#include "../atsha204-atmel/sha204_config.h"  // interface selection
+
+#ifndef SHA204_LINUX_HOST
 #include <arduino.h>
+#endif
 
 /** \defgroup timer_utilities Module 09: Timers
  *
@@ -47,6 +51,36 @@
  * timers available, you can implement the functions using them.
 @{ */
 
+#ifdef SHA204_LINUX_HOST
+#include <time.h>                             // clock_nanosleep()
+
+/** \brief This function sleeps for a number of microseconds on a Linux host.
+ * \param[in] delay_us number of microseconds to sleep
+ */
+static void delay_us(uint32_t delay_us)
+{
+	struct timespec delay;
+
+	delay.tv_sec = delay_us / 1000000;
+	delay.tv_nsec = (long) (delay_us % 1000000) * 1000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, 0, &delay, &delay) != 0)
+		;
+}
+
+
+void delay_10us(uint8_t delay_10s_usec)
+{
+	delay_us(10 * (uint32_t) delay_10s_usec);
+}
+
+
+void delay_ms(uint8_t delay_in_ms)
+{
+	delay_us(1000 * (uint32_t) delay_in_ms);
+}
+
+#else
+
 // The values below are valid for an AVR 8-bit processor running at 16 MHz.
 // Code is compiled with optimization set to -O1.
 
@@ -129,4 +163,6 @@ void delay_ms(uint8_t delay_in_ms)
 
 }
 
+#endif
+
 /** @} */
@@ -71,6 +71,30 @@
 //! Delay for this many loop iterations before sending.
 #define RX_TX_DELAY              ((uint8_t)  (15.0 / TIME_PER_LOOP_ITERATION))
 
+/** \brief Define this to run the UART from interrupts.
+ *
+ * Command bytes are queued into a ring buffer and expanded into
+ * UART characters by the data-register-empty interrupt. Received
+ * characters are decoded into bits by the receive interrupt.
+ * The Wake-up pulse is generated by the UART at half the baud rate.
+ */
+// #define SWI_UART_USE_INTERRUPTS
+
+//! size of transmit ring buffer in bytes, must be a power of two
+#define SWI_UART_TX_BUFFER_SIZE  (32)
+
+//! size of receive ring buffer in bytes, must be a power of two
+#define SWI_UART_RX_BUFFER_SIZE  (64)
+
+//! time in us without a received character before a reception times out
+#define SWI_UART_BIT_TIMEOUT_US  (250)
+
+//! time in us to wait for room in the transmit ring buffer
+#define SWI_UART_BYTE_TIMEOUT_US (1000)
+
+//! delay in us after turning on the transmitter
+#define SWI_UART_RX_TX_DELAY_US  (15)
+
 //! direction register when using UART pin for Wake-up
 #define UART_GPIO_DDR            DDRD
 
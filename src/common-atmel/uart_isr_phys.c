@@ -0,0 +1,328 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/** \file
+ *  \brief Interrupt-Driven UART Implementation of the Single-Wire Interface
+ *
+ *         Bytes to send are queued into a ring buffer and #swi_send_bytes
+ *         returns as soon as they are queued. The data-register-empty
+ *         interrupt expands every bit into a UART character. Once the last
+ *         character has left the shift register, the transmit-complete
+ *         interrupt turns the line around if a reception is pending. The
+ *         receive interrupt decodes characters into bits and stores
+ *         completed bytes in a second ring buffer.
+ */
+
+#include <avr/io.h>          // GPIO definitions
+#include <avr/interrupt.h>   // interrupt definitions
+#include <stddef.h>          // NULL
+#include "swi_phys.h"        // hardware dependent declarations for SWI
+#include "uart_config.h"     // UART definitions
+#include "avr_compatible.h"  // translates generic AVR UART macros into specific ones
+#include "Arduino.h"
+
+#if defined(SHA204_SWI_UART) && defined(SWI_UART_USE_INTERRUPTS) && !defined(SHA204_SWI_LINUX_UART)
+
+#define SWI_UART_TX_MASK    (SWI_UART_TX_BUFFER_SIZE - 1)   //!< index mask for transmit ring buffer
+#define SWI_UART_RX_MASK    (SWI_UART_RX_BUFFER_SIZE - 1)   //!< index mask for receive ring buffer
+
+static volatile uint8_t tx_buffer[SWI_UART_TX_BUFFER_SIZE];  //!< transmit ring buffer
+static volatile uint8_t tx_head;                             //!< index where the next byte gets queued
+static volatile uint8_t tx_tail;                             //!< index of the byte being sent
+static volatile uint8_t tx_bit_mask;                         //!< next bit of the byte being sent
+static volatile uint8_t tx_busy;                             //!< transmitter is running
+
+static volatile uint8_t rx_buffer[SWI_UART_RX_BUFFER_SIZE];  //!< receive ring buffer
+static volatile uint8_t rx_head;                             //!< index where the next byte gets stored
+static volatile uint8_t rx_tail;                             //!< index of the next byte to read
+static volatile uint8_t rx_byte;                             //!< byte being received
+static volatile uint8_t rx_bit_mask;                         //!< next bit of the byte being received
+static volatile uint8_t rx_armed;                            //!< turn on receiver after transmission
+static volatile uint32_t rx_activity_us;                     //!< micros() at last received character
+
+//! baud rate register value for communication
+static uint8_t baud_register;
+
+
+/** \brief This UART function turns on the receiver.
+ *
+ *  It has to be called with interrupts disabled.
+ */
+static void swi_start_receive(void)
+{
+	// Disable pull-up resistor.
+	UART_GPIO_DDR &= ~UART_GPIO_PIN_TX;
+	UART_GPIO_OUT &= ~UART_GPIO_PIN_TX;
+
+	rx_activity_us = micros();
+	UCSRB |= _BV(RXEN) | _BV(RXCIE);
+}
+
+
+/** \brief This UART function waits until all queued bytes are sent. */
+static void swi_wait_transmit(void)
+{
+	while (tx_busy)
+		;
+}
+
+
+/** \brief This UART function is a dummy to satisfy the SWI module interface.
+ *
+ *  \param[in] id not used in this UART module, only used in SWI bit-banging module
+ */
+void swi_set_device_id(uint8_t id) {
+}
+
+
+/** \brief This UART function initializes the hardware.
+ */
+void swi_enable(void) {
+	UCSRA = _BV(U2X);
+
+	// See uart_phys.c for why the result is not decremented.
+	baud_register = (uint8_t) (F_CPU / (8UL * BAUD_RATE));
+	UBRRL = baud_register;
+
+	// one start bit, seven character bits, and one stop bit
+	UCSRC = _BV(UCSZ11);
+
+	UCSRB &= ~(_BV(TXCIE) | _BV(RXCIE) | _BV(UDRIE) | _BV(RXEN) | _BV(TXEN));
+
+	tx_head = tx_tail = 0;
+	tx_bit_mask = 1;
+	tx_busy = 0;
+	rx_armed = 0;
+}
+
+
+/** \brief This UART function generates the Wake-up pulse.
+ *
+	With the UART running at half the baud rate, sending a 0 keeps
+	the signal wire low for eight bits (start bit and seven data bits),
+	or 69.4 us. Setting the signal low starts that character, setting it
+	high waits for the character to complete and restores the baud rate.
+ * \param[in] is_high 0: start Wake-up pulse, otherwise end it
+ */
+void swi_set_signal_pin(uint8_t is_high)
+{
+	uint32_t start_us;
+
+	if (is_high == 0) {
+		swi_wait_transmit();
+
+		UCSRB &= ~(_BV(RXEN) | _BV(RXCIE));
+		UBRRL = 2 * baud_register + 1;
+		UCSRB |= _BV(TXEN);
+		UCSRA |= _BV(TXC);
+		UDR = 0;
+		return;
+	}
+
+	start_us = micros();
+	while ((UCSRA & _BV(TXC)) == 0) {
+		if (micros() - start_us > SWI_UART_BYTE_TIMEOUT_US)
+			break;
+	}
+	UCSRA |= _BV(TXC);
+	UCSRB &= ~_BV(TXEN);
+	UBRRL = baud_register;
+}
+
+
+/** \brief This UART function queues bytes to send to an SWI device.
+ *
+ *  It returns as soon as the last byte is queued.
+ * \param[in] count number of bytes to send
+ * \param[in] buffer pointer to transmit buffer
+ * \return status of the operation
+ */
+uint8_t swi_send_bytes(uint8_t count, uint8_t *buffer)
+{
+	uint8_t i, next, sreg;
+	uint32_t start_us;
+
+	for (i = 0; i < count; i++) {
+		next = (tx_head + 1) & SWI_UART_TX_MASK;
+		start_us = micros();
+		while (next == tx_tail) {
+			if (micros() - start_us > SWI_UART_BYTE_TIMEOUT_US)
+				return SWI_FUNCTION_RETCODE_TIMEOUT;
+		}
+		tx_buffer[tx_head] = buffer[i];
+		tx_head = next;
+
+		sreg = SREG;
+		cli();
+		if (!tx_busy) {
+			tx_busy = 1;
+			UCSRB &= ~(_BV(RXEN) | _BV(RXCIE));
+			UCSRB |= _BV(TXEN);
+			UCSRA |= _BV(TXC);
+			delayMicroseconds(SWI_UART_RX_TX_DELAY_US);
+			UCSRB |= _BV(TXCIE);
+		}
+		UCSRB |= _BV(UDRIE);
+		SREG = sreg;
+	}
+
+	return SWI_FUNCTION_RETCODE_SUCCESS;
+}
+
+
+/** \brief This UART function queues one byte to send to an SWI device.
+ * \param[in] value byte to send
+ * \return status of the operation
+ */
+uint8_t swi_send_byte(uint8_t value)
+{
+	return swi_send_bytes(1, &value);
+}
+
+
+/** \brief This UART function receives bytes from an SWI device.
+ *
+ *  The receiver is turned on once all queued bytes are sent.
+ *  \param[in] count number of bytes to receive
+ *  \param[out] buffer pointer to receive buffer
+ * \return status of the operation
+ */
+uint8_t swi_receive_bytes(uint8_t count, uint8_t *buffer)
+{
+	struct swi_segment segment = {buffer, count};
+
+	return swi_receive_segments(1, &segment);
+}
+
+
+/** \brief This UART function receives bytes from an SWI device into several buffers.
+ *  \param[in] n_segments number of segments
+ *  \param[out] segments segments to receive into, filled one after the other
+ * \return status of the operation
+ */
+uint8_t swi_receive_segments(uint8_t n_segments, const struct swi_segment *segments) {
+	uint8_t i, sreg;
+	uint8_t count = 0;
+	uint8_t *byte = NULL;
+	uint8_t *end = NULL;
+
+	for (i = 0; i < n_segments; i++)
+		count += segments[i].count;
+
+	sreg = SREG;
+	cli();
+	rx_head = rx_tail = 0;
+	rx_byte = 0;
+	rx_bit_mask = 1;
+	if (tx_busy)
+		rx_armed = 1;
+	else
+		swi_start_receive();
+	SREG = sreg;
+
+	for (i = 0; i < count; i++, byte++) {
+		while (byte == end) {
+			byte = segments->buffer;
+			end = byte + segments->count;
+			segments++;
+		}
+		while (rx_tail == rx_head) {
+			sreg = SREG;
+			cli();
+			if (!tx_busy && (micros() - rx_activity_us > SWI_UART_BIT_TIMEOUT_US)) {
+				SREG = sreg;
+				return (i == 0 ? SWI_FUNCTION_RETCODE_TIMEOUT : SWI_FUNCTION_RETCODE_RX_FAIL);
+			}
+			SREG = sreg;
+		}
+		*byte = rx_buffer[rx_tail];
+		rx_tail = (rx_tail + 1) & SWI_UART_RX_MASK;
+	}
+
+	return SWI_FUNCTION_RETCODE_SUCCESS;
+}
+
+
+/** \brief This interrupt routine sends the next bit of the byte being sent. */
+ISR(UART_UDRE_vect)
+{
+	uint8_t tail = tx_tail;
+
+	if (tail == tx_head) {
+		UCSRB &= ~_BV(UDRIE);
+		return;
+	}
+
+	// Create a start pulse only ("zero" bit)
+	// or a start pulse and a zero pulse ("one" bit).
+	// The zero pulse is placed at UDR bit 2 (lsb first).
+	UDR = (tx_buffer[tail] & tx_bit_mask) ? 0x7F : 0x7D;
+
+	tx_bit_mask <<= 1;
+	if (tx_bit_mask == 0) {
+		tx_bit_mask = 1;
+		tx_tail = tail = (tail + 1) & SWI_UART_TX_MASK;
+		if (tail == tx_head)
+			UCSRB &= ~_BV(UDRIE);
+	}
+}
+
+
+/** \brief This interrupt routine ends a transmission and turns the line around. */
+ISR(UART_TX_vect)
+{
+	// More bytes were queued while the last character was shifted out.
+	if (tx_tail != tx_head)
+		return;
+
+	UCSRB &= ~(_BV(TXEN) | _BV(TXCIE));
+	tx_busy = 0;
+
+	if (rx_armed) {
+		rx_armed = 0;
+		swi_start_receive();
+	}
+}
+
+
+/** \brief This interrupt routine decodes a received character into a bit. */
+ISR(UART_RX_vect)
+{
+	uint8_t next;
+	uint8_t bit_data = UDR;
+
+	rx_activity_us = micros();
+
+	// If the device sends a "one" bit, UDR bits 1 to 6 are set (0x7E).
+	if ((bit_data & 0x7E) == 0x7E)
+		rx_byte |= rx_bit_mask;
+
+	rx_bit_mask <<= 1;
+	if (rx_bit_mask == 0) {
+		next = (rx_head + 1) & SWI_UART_RX_MASK;
+		if (next != rx_tail) {
+			rx_buffer[rx_head] = rx_byte;
+			rx_head = next;
+		}
+		rx_byte = 0;
+		rx_bit_mask = 1;
+	}
+}
+
+#endif
@@ -0,0 +1,450 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014 Cryptotronix, LLC.
+ *
+ * This file is part of cryptoauth-arduino.
+ *
+ * cryptoauth-arduino is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * cryptoauth-arduino is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptoauth-arduino.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/** \file
+ *  \brief Single-Wire Interface over the Serial Port of a Linux Host
+ *
+ *         Only built with #SHA204_SWI_LINUX_UART. The port is configured
+ *         through termios for 7N1 at 230400 baud, and every bit is one
+ *         character as in uart_phys.c: 0x7F for a one, 0x7D for a zero.
+ *         TX and RX are tied to the signal wire, so everything sent is
+ *         echoed back. The echo is counted and skipped when reading.
+ *
+ *         Every packet is expanded into one buffer and sent with one
+ *         write(). Before reading the module sleeps for the time the
+ *         outstanding characters take on the wire, so a response usually
+ *         takes two read() calls: one up to its count byte, one for the
+ *         rest. The Wake-up pulse is a break condition.
+ *
+ *         A pseudo-terminal works as well: an emulator on the master side
+ *         has to echo every character it receives and ignores breaks.
+ *         extras/linux/swi_pty_emulator.c is one, and
+ *         extras/linux/swi_uart_test.c runs this module against it.
+ *
+ *         The state of this module is per thread, so several threads can
+ *         each open their own port.
+ */
+
+#include "../atsha204-atmel/sha204_comm.h"    // packet sizes and interface selection
+#include "swi_phys.h"                         // hardware dependent declarations for SWI
+
+#ifdef SHA204_SWI_LINUX_UART
+
+#include <errno.h>                            // errno values
+#include <fcntl.h>                            // open()
+#include <poll.h>                             // poll()
+#include <string.h>                           // memset()
+#include <termios.h>                          // serial port configuration
+#include <time.h>                             // clock_nanosleep()
+#include <unistd.h>                           // read(), write(), close()
+#include <sys/ioctl.h>                        // ioctl()
+#include <linux/serial.h>                     // ASYNC_LOW_LATENCY
+
+//! It takes 39 us to send one character (nine bits at 230400 baud).
+#define SWI_LINUX_UART_US_PER_CHAR   (39)
+
+//! characters per byte, one per bit
+#define SWI_LINUX_UART_CHARS_PER_BYTE  (8)
+
+//! largest packet: flag and maximum command size
+#define SWI_LINUX_UART_PACKET_MAX    (1 + SHA204_CMD_SIZE_MAX)
+
+//! file descriptor of the serial port, -1 if not open
+static SHA204_THREAD_LOCAL int port_fd = -1;
+
+//! number of characters sent but not yet read back
+static SHA204_THREAD_LOCAL uint16_t echo_pending;
+
+//! cost counters
+static SHA204_THREAD_LOCAL struct swi_linux_uart_stats stats;
+
+
+/** \brief This function sleeps and counts the system call.
+ * \param[in] delay_us time to sleep in us
+ */
+static void swi_delay_us(uint32_t delay_us)
+{
+	struct timespec delay;
+
+	delay.tv_sec = delay_us / 1000000;
+	delay.tv_nsec = (long) (delay_us % 1000000) * 1000;
+
+	stats.syscalls++;
+	while (clock_nanosleep(CLOCK_MONOTONIC, 0, &delay, &delay) == EINTR)
+		stats.syscalls++;
+}
+
+
+/** \brief This function discards received characters after an error. */
+static void swi_discard_input(void)
+{
+	stats.syscalls++;
+	(void) tcflush(port_fd, TCIFLUSH);
+	echo_pending = 0;
+}
+
+
+/** \brief This function opens and configures a serial port.
+ *
+ * #swi_enable opens #SWI_LINUX_UART_PORT if no port is open.
+ * \param[in] port path of the serial device, e.g. "/dev/ttyUSB0"
+ * \return status of the operation
+ */
+uint8_t swi_linux_uart_open(const char *port)
+{
+	struct termios tio;
+	struct serial_struct serial;
+
+	swi_linux_uart_close();
+
+	if (!port)
+		return SWI_FUNCTION_RETCODE_TIMEOUT;
+
+	stats.syscalls++;
+	port_fd = open(port, O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (port_fd < 0)
+		return SWI_FUNCTION_RETCODE_TIMEOUT;
+
+	stats.syscalls++;
+	if (tcgetattr(port_fd, &tio) < 0) {
+		swi_linux_uart_close();
+		return SWI_FUNCTION_RETCODE_TIMEOUT;
+	}
+
+	// one start bit, seven character bits, and one stop bit,
+	// reads return whatever has arrived without blocking
+	cfmakeraw(&tio);
+	tio.c_cflag &= ~(CSIZE | CSTOPB | PARENB | CRTSCTS);
+	tio.c_cflag |= CS7 | CREAD | CLOCAL;
+	tio.c_iflag |= IGNBRK;
+	tio.c_cc[VMIN] = 0;
+	tio.c_cc[VTIME] = 0;
+	cfsetispeed(&tio, B230400);
+	cfsetospeed(&tio, B230400);
+
+	stats.syscalls++;
+	if (tcsetattr(port_fd, TCSANOW, &tio) < 0) {
+		swi_linux_uart_close();
+		return SWI_FUNCTION_RETCODE_TIMEOUT;
+	}
+
+	// Ask USB-serial drivers to hand over characters right away.
+	// Pseudo-terminals and some drivers do not support this.
+	stats.syscalls++;
+	if (ioctl(port_fd, TIOCGSERIAL, &serial) == 0) {
+		serial.flags |= ASYNC_LOW_LATENCY;
+		stats.syscalls++;
+		(void) ioctl(port_fd, TIOCSSERIAL, &serial);
+	}
+
+	swi_discard_input();
+
+	return SWI_FUNCTION_RETCODE_SUCCESS;
+}
+
+
+/** \brief This function closes the serial port. */
+void swi_linux_uart_close(void)
+{
+	if (port_fd < 0)
+		return;
+
+	stats.syscalls++;
+	close(port_fd);
+	port_fd = -1;
+	echo_pending = 0;
+}
+
+
+/** \brief This function reads the cost counters of the calling thread.
+ * \param[out] counters copy of the counters
+ * \param[in] reset non-zero to clear the counters after copying them
+ */
+void swi_linux_uart_get_stats(struct swi_linux_uart_stats *counters, uint8_t reset)
+{
+	if (counters)
+		*counters = stats;
+	if (reset)
+		memset(&stats, 0, sizeof(stats));
+}
+
+
+/** \brief This function is a dummy to satisfy the SWI module interface.
+ *
+ *  \param[in] id not used in this module
+ */
+void swi_set_device_id(uint8_t id)
+{
+}
+
+
+/** \brief This function opens the default serial port if none is open.
+ */
+void swi_enable(void)
+{
+	if (port_fd < 0)
+		(void) swi_linux_uart_open(SWI_LINUX_UART_PORT);
+}
+
+
+/** \brief This function starts or ends the Wake-up pulse.
+ *
+ * The pulse is a break condition. Characters still queued are sent
+ * first, so a Sleep flag right before the pulse is not cut off.
+ * \param[in] is_high 0: start Wake-up pulse, otherwise end it
+ */
+void swi_set_signal_pin(uint8_t is_high)
+{
+	if (port_fd < 0)
+		return;
+
+	stats.syscalls++;
+	if (is_high == 0) {
+		(void) tcdrain(port_fd);
+		stats.syscalls++;
+		(void) ioctl(port_fd, TIOCSBRK);
+	}
+	else
+		(void) ioctl(port_fd, TIOCCBRK);
+}
+
+
+/** \brief This function expands bytes into one character per bit.
+ * \param[in] count number of bytes
+ * \param[in] buffer bytes to expand
+ * \param[out] chars expanded characters
+ * \return number of characters
+ */
+static uint16_t swi_expand(uint8_t count, uint8_t *buffer, uint8_t *chars)
+{
+	uint16_t n = 0;
+	uint8_t i, bit_mask;
+
+	for (i = 0; i < count; i++) {
+		for (bit_mask = 1; bit_mask > 0; bit_mask <<= 1)
+			// Create a start pulse only ("zero" bit)
+			// or a start pulse and a zero pulse ("one" bit).
+			chars[n++] = (bit_mask & buffer[i]) ? 0x7F : 0x7D;
+	}
+
+	return n;
+}
+
+
+/** \brief This function writes expanded characters.
+ * \param[in] count number of characters
+ * \param[in] chars characters to write
+ * \return status of the operation
+ */
+static uint8_t swi_write(uint16_t count, uint8_t *chars)
+{
+	ssize_t n;
+	uint16_t sent = 0;
+
+	if (port_fd < 0)
+		return SWI_FUNCTION_RETCODE_TIMEOUT;
+
+	stats.packets++;
+	while (sent < count) {
+		stats.syscalls++;
+		n = write(port_fd, chars + sent, count - sent);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return SWI_FUNCTION_RETCODE_TIMEOUT;
+		}
+		sent += n;
+	}
+	echo_pending += count;
+
+	return SWI_FUNCTION_RETCODE_SUCCESS;
+}
+
+
+/** \brief This function sends a flag and a packet with one write().
+ * \param[in] flag flag preceding the packet
+ * \param[in] count number of bytes in packet
+ * \param[in] buffer pointer to packet
+ * \return status of the operation
+ */
+uint8_t swi_send_packet(uint8_t flag, uint8_t count, uint8_t *buffer)
+{
+	uint8_t chars[SWI_LINUX_UART_PACKET_MAX * SWI_LINUX_UART_CHARS_PER_BYTE];
+	uint16_t n;
+
+	if (count >= SWI_LINUX_UART_PACKET_MAX)
+		return SWI_FUNCTION_RETCODE_RX_FAIL;
+
+	n = swi_expand(1, &flag, chars);
+	n += swi_expand(count, buffer, chars + n);
+
+	return swi_write(n, chars);
+}
+
+
+/** \brief This function sends bytes with one write().
+ * \param[in] count number of bytes to send
+ * \param[in] buffer pointer to transmit buffer
+ * \return status of the operation
+ */
+uint8_t swi_send_bytes(uint8_t count, uint8_t *buffer)
+{
+	uint8_t chars[SWI_LINUX_UART_PACKET_MAX * SWI_LINUX_UART_CHARS_PER_BYTE];
+
+	if (count > SWI_LINUX_UART_PACKET_MAX)
+		return SWI_FUNCTION_RETCODE_RX_FAIL;
+
+	return swi_write(swi_expand(count, buffer, chars), chars);
+}
+
+
+/** \brief This function sends one byte.
+ * \param[in] value byte to send
+ * \return status of the operation
+ */
+uint8_t swi_send_byte(uint8_t value)
+{
+	return swi_send_bytes(1, &value);
+}
+
+
+/** \brief This function receives bytes from an SWI device.
+ *  \param[in] count number of bytes to receive
+ *  \param[out] buffer pointer to receive buffer
+ * \return status of the operation
+ */
+uint8_t swi_receive_bytes(uint8_t count, uint8_t *buffer)
+{
+	struct swi_segment segment = {buffer, count};
+
+	return swi_receive_segments(1, &segment);
+}
+
+
+/** \brief This function receives bytes from an SWI device into several buffers.
+ *
+ *  The echo of previously sent characters is skipped first. Once the
+ *  count byte has arrived, reception ends after as many bytes as it
+ *  announces, so a short response does not have to wait for a timeout.
+ *  Before each read the module sleeps for what is sure to come: the echo
+ *  and the count byte at first, then the rest of the announced response.
+ *  Segments larger than the response therefore cost no extra wait.
+ *  \param[in] n_segments number of segments
+ *  \param[out] segments segments to receive into, filled one after the
+ *             other, starting with the count byte
+ * \return status of the operation
+ */
+uint8_t swi_receive_segments(uint8_t n_segments, const struct swi_segment *segments)
+{
+	// the echo of the largest packet and a Transmit flag, and the largest response
+	uint8_t chars[(SWI_LINUX_UART_PACKET_MAX + 1 + SHA204_RSP_SIZE_MAX) * SWI_LINUX_UART_CHARS_PER_BYTE];
+	struct pollfd readable;
+	uint8_t count = 0;
+	uint8_t expected;
+	uint8_t received = 0;
+	uint8_t bit_mask = 1;
+	uint8_t *byte = NULL;
+	uint8_t *end = NULL;
+	uint16_t decoded = 0;
+	uint16_t outstanding;
+	ssize_t n, i;
+	int ready;
+
+	if (port_fd < 0)
+		return SWI_FUNCTION_RETCODE_TIMEOUT;
+
+	for (i = 0; i < n_segments; i++)
+		count += segments[i].count;
+	expected = count;
+
+	readable.fd = port_fd;
+	readable.events = POLLIN;
+
+	while (received < expected) {
+		stats.syscalls++;
+		ready = poll(&readable, 1, SWI_LINUX_UART_RX_TIMEOUT_MS);
+		if (ready < 0 && errno == EINTR)
+			continue;
+		if (ready <= 0)
+			break;
+
+		// Let the characters known to be on their way arrive, so that one
+		// read gets them all. Until the count byte is in, that is only the
+		// echo and the count byte.
+		outstanding = echo_pending
+			+ (received ? expected : 1) * SWI_LINUX_UART_CHARS_PER_BYTE - decoded;
+		if (outstanding > 1) {
+			stats.wait_us += (uint32_t) (outstanding - 1) * SWI_LINUX_UART_US_PER_CHAR;
+			swi_delay_us((uint32_t) (outstanding - 1) * SWI_LINUX_UART_US_PER_CHAR);
+		}
+
+		stats.reads++;
+		stats.syscalls++;
+		n = read(port_fd, chars, (outstanding < sizeof(chars)) ? outstanding : sizeof(chars));
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (i = 0; i < n && received < expected; i++) {
+			if (echo_pending) {
+				echo_pending--;
+				continue;
+			}
+
+			if (bit_mask == 1) {
+				while (byte == end) {
+					byte = segments->buffer;
+					end = byte + segments->count;
+					segments++;
+				}
+				*byte = 0;
+			}
+
+			// If the device sends a "one" bit, bits 1 to 6 are set (0x7E).
+			if ((chars[i] & 0x7E) == 0x7E)
+				*byte |= bit_mask;
+			decoded++;
+
+			bit_mask <<= 1;
+			if (bit_mask == 0) {
+				bit_mask = 1;
+				if (received++ == 0) {
+					// The first byte is the count of the response.
+					if ((*byte < SHA204_RSP_SIZE_MIN) || (*byte > count)) {
+						swi_discard_input();
+						return SWI_FUNCTION_RETCODE_RX_FAIL;
+					}
+					expected = *byte;
+				}
+				byte++;
+			}
+		}
+	}
+
+	if (received == expected)
+		return SWI_FUNCTION_RETCODE_SUCCESS;
+
+	swi_discard_input();
+
+	return (received == 0) ? SWI_FUNCTION_RETCODE_TIMEOUT : SWI_FUNCTION_RETCODE_RX_FAIL;
+}
+
+#endif
@@ -41,11 +41,12 @@
  * \atsha204_library_license_stop
  */
 
+#include <stddef.h>          // NULL
 #include "swi_phys.h"        // hardware dependent declarations for SWI
 #include "uart_config.h"     // UART definitions
 #include "avr_compatible.h"  // translates generic AVR UART macros into specific ones
 
-#ifdef SHA204_SWI_UART
+#if defined(SHA204_SWI_UART) && !defined(SWI_UART_USE_INTERRUPTS) && !defined(SHA204_SWI_LINUX_UART)
 /** \defgroup atsha204_swi_uart Module 13: UART Interface
  *
  * This module implements the single-wire interface using a UART
@@ -197,8 +198,27 @@ uint8_t swi_send_byte(uint8_t value)
  *  \param[out] buffer pointer to receive buffer
  * \return status of the operation
  */
-uint8_t swi_receive_bytes(uint8_t count, uint8_t *buffer) {
+uint8_t swi_receive_bytes(uint8_t count, uint8_t *buffer)
+{
+	struct swi_segment segment = {buffer, count};
+
+	return swi_receive_segments(1, &segment);
+}
+
+
+/** \brief This UART function receives bytes from an SWI device into several buffers.
+ *  \param[in] n_segments number of segments
+ *  \param[out] segments segments to receive into, filled one after the other
+ * \return status of the operation
+ */
+uint8_t swi_receive_segments(uint8_t n_segments, const struct swi_segment *segments) {
 	uint8_t i, bit_mask, bit_data, timeout;
+	uint8_t count = 0;
+	uint8_t *byte = NULL;
+	uint8_t *end = NULL;
+
+	for (i = 0; i < n_segments; i++)
+		count += segments[i].count;
 
 	// Turn off transmit. The transmitter will not turn off until transmit is complete.
 	UCSRB &= ~_BV(TXEN);
@@ -212,8 +232,13 @@ uint8_t swi_receive_bytes(uint8_t count, uint8_t *buffer) {
 
 	DEBUG_HIGH;
 
-	for (i = 0; i < count; i++) {
-		buffer[i] = 0;
+	for (i = 0; i < count; i++, byte++) {
+		while (byte == end) {
+			byte = segments->buffer;
+			end = byte + segments->count;
+			segments++;
+		}
+		*byte = 0;
 		for (bit_mask = 1; bit_mask > 0; bit_mask <<= 1) {
 			timeout = BIT_TIMEOUT;
 			while (bit_is_clear(UCSRA, RXC)) {
@@ -225,7 +250,7 @@ uint8_t swi_receive_bytes(uint8_t count, uint8_t *buffer) {
 			// LSB comes first. Reversing 0x7E results in 0x7E.
 			if ((bit_data & 0x7E) == 0x7E)
 				// Received "one" bit.
-				buffer[i] |= bit_mask;
+				*byte |= bit_mask;
 		}
 	}
 	DEBUG_LOW;
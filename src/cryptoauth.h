@@ -1,5 +1,7 @@
 #include "api/CryptoBuffer.h"
 #include "api/AtSha204.h"
+#include "api/Sha204Bus.h"
+#include "api/Sha204RandomPool.h"
 //#include "api/AtEcc108.h"
 #include "softcrypto/sha256.h"
 #include "softcrypto/sha_256.h"